@@ -0,0 +1,166 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <agent-proto/command/command.h>
+
+namespace vxg {
+namespace cloud {
+namespace agent {
+namespace proto {
+
+//! @brief Pending command acknowledgements tracker.
+//!
+//! Acks are kept in a fixed ring indexed by the command msgid, msgids are
+//! sequential so the ring slot is reused only when the command which
+//! occupied it is capacity commands older. Such an ack is evicted and
+//! notified as timed out, the tracker never holds more than capacity acks.
+//!
+//! Tracker doesn't run timers, the owner calls sweep() periodically, a
+//! single sweep expires all acks whose deadline passed. Ack callbacks are
+//! called without the tracker's lock held and may add new acks.
+//!
+//! Thread-safe.
+class ack_tracker {
+public:
+    using clock = std::chrono::steady_clock;
+    using ack_cb =
+        std::function<void(bool timed_out, command::base_command::ptr)>;
+
+    //! @param capacity Max pending acks, rounded up to the power of 2
+    ack_tracker(size_t capacity = 1024) {
+        size_t size = 1;
+
+        while (size < capacity)
+            size <<= 1;
+
+        slots_.resize(size);
+        mask_ = size - 1;
+    }
+
+    //! @brief Track the ack of the command with @p msgid.
+    //!
+    //! @return false if an older pending ack was evicted to free the slot.
+    bool add(int msgid, ack_cb cb, clock::time_point deadline) {
+        ack_cb evicted;
+        bool eviction = false;
+
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            slot& s = slots_[msgid & mask_];
+
+            if (s.used) {
+                evicted = std::move(s.cb);
+                eviction = true;
+                evictions_++;
+                pending_--;
+            }
+
+            s.used = true;
+            s.msgid = msgid;
+            s.cb = std::move(cb);
+            s.deadline = deadline;
+            pending_++;
+        }
+
+        if (evicted)
+            evicted(true, nullptr);
+
+        return !eviction;
+    }
+
+    //! @brief Notify the ack with @p refid.
+    //!
+    //! @return false if there is no pending ack, e.g. it was timed out or
+    //!         evicted before.
+    bool ack(int refid, command::base_command::ptr command) {
+        ack_cb cb;
+
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            slot& s = slots_[refid & mask_];
+
+            if (!s.used || s.msgid != refid)
+                return false;
+
+            cb = std::move(s.cb);
+            __release(s);
+        }
+
+        if (cb)
+            cb(false, command);
+
+        return true;
+    }
+
+    //! @brief Notify all acks with the passed deadline as timed out.
+    //!
+    //! @return Number of the timed out acks.
+    size_t sweep(clock::time_point now) {
+        std::vector<ack_cb> expired;
+
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+
+            for (size_t i = 0; pending_ && i < slots_.size(); i++) {
+                slot& s = slots_[i];
+
+                if (s.used && s.deadline <= now) {
+                    expired.push_back(std::move(s.cb));
+                    __release(s);
+                }
+            }
+        }
+
+        for (auto& cb : expired)
+            if (cb)
+                cb(true, nullptr);
+
+        return expired.size();
+    }
+
+    //! @brief Notify all pending acks as timed out, the connection was lost
+    //! and no acks will be received.
+    size_t flush() { return sweep(clock::time_point::max()); }
+
+    size_t pending() {
+        std::lock_guard<std::mutex> lock(lock_);
+        return pending_;
+    }
+
+    //! Number of the acks evicted by the newer ones since the creation
+    size_t evictions() {
+        std::lock_guard<std::mutex> lock(lock_);
+        return evictions_;
+    }
+
+    size_t capacity() const { return slots_.size(); }
+
+private:
+    struct slot {
+        bool used {false};
+        int msgid {0};
+        ack_cb cb;
+        clock::time_point deadline;
+    };
+
+    std::mutex lock_;
+    std::vector<slot> slots_;
+    size_t mask_ {0};
+    size_t pending_ {0};
+    size_t evictions_ {0};
+
+    void __release(slot& s) {
+        s.used = false;
+        s.cb = nullptr;
+        pending_--;
+    }
+};
+
+}  // namespace proto
+}  // namespace agent
+}  // namespace cloud
+}  // namespace vxg
@@ -21,7 +21,12 @@ namespace agent {
 namespace proto {
 
 command_handler::command_handler(transport::worker::ptr transport)
-    : transport_ {transport} {
+    : acks_ {profile::global::instance().command_acks_max_pending},
+      transport_ {transport} {
+    // Settings written via profile::global::instance() before the creation
+    // are read from the snapshot by the agent manager's members
+    profile::global::publish();
+
     if (transport == nullptr)
         transport_ = std::make_shared<websocket>(
             std::bind(&command_handler::on_receive, this, placeholders::_1),
@@ -29,6 +34,12 @@ command_handler::command_handler(transport::worker::ptr transport)
 }
 
 command_handler::~command_handler() {
+    std::lock_guard<std::mutex> lock(acks_sweep_lock_);
+
+    if (acks_sweep_timer_) {
+        transport_->cancel_timed_cb(acks_sweep_timer_);
+        acks_sweep_timer_ = nullptr;
+    }
 }
 
 void command_handler::on_connected() {
@@ -44,6 +55,8 @@ void command_handler::on_connected() {
 
 void command_handler::on_error(void* unused, std::string msg) {
     _reset_reconnect_timer();
+    _flush_command_acks();
+    _session_lost();
 
     hello_received_ = false;
     registered_ = false;
@@ -53,6 +66,9 @@ void command_handler::on_error(void* unused, std::string msg) {
 
 void command_handler::on_disconnected() {
     _reset_reconnect_timer();
+    // Acks of the commands sent over the lost connection will never arrive
+    _flush_command_acks();
+    _session_lost();
 
     hello_received_ = false;
     registered_ = false;
@@ -70,6 +86,19 @@ void command_handler::_reset_reconnect_timer() {
     }
 }
 
+void command_handler::_session_lost() {
+    session_resumed_ = false;
+
+    // Only operational session lost not by the Cloud's request may be resumed,
+    // failed reconnection attempts don't restart the resume window
+    if (!hello_received_ || bye_reason_ != command::bye_reason::BR_INVALID)
+        return;
+
+    session_.cam_id = cm_config_.cam_id;
+    session_.lost_at = std::chrono::steady_clock::now();
+    session_.lost = true;
+}
+
 // Reconnect to websockets server in case of network error or bye message.
 bool command_handler::try_connect() {
     return transport_->connect(cm_config_.get_address());
@@ -90,9 +119,12 @@ json command_handler::handle_hello(hello* hello) {
     try {
         if (hello->ca != UnsetString)
             cm_config_.ca = hello->ca;
-        if (hello->sid != UnsetString)
-            profile::global::instance().cm_registration_sid = cm_config_.sid =
-                hello->sid;
+        if (hello->sid != UnsetString) {
+            cm_config_.sid = hello->sid;
+            profile::global::update([&](profile::description& settings) {
+                settings.cm_registration_sid = hello->sid;
+            });
+        }
         // For instances with old proto
         if (hello->upload_url != UnsetString)
             cm_config_.upload_url = hello->upload_url;
@@ -183,6 +215,15 @@ json command_handler::handle_cam_hello(cam_hello* camHello) {
 
     cm_config_.activity = camHello->activity;
 
+    session_resumed_ =
+        session_.lost && session_.cam_id == cm_config_.cam_id &&
+        std::chrono::steady_clock::now() - session_.lost_at <=
+            std::chrono::seconds(
+                profile::global::snapshot()->session_resume_window_sec);
+    session_.lost = false;
+    if (session_resumed_)
+        logger->info("Session of camera {} resumed", cm_config_.cam_id);
+
     on_set_activity(camHello->activity);
 
     hello_received_ = true;
@@ -568,7 +609,7 @@ json command_handler::handle_raw_message(raw_message* rawMessage) {
             raw_message reply = json(*factory::create(RAW_MESSAGE));
             reply.client_id = rawMessage->client_id;
             reply.message = message;
-            send_command(json(reply));
+            send_command(reply);
         }
     }
 
@@ -768,10 +809,11 @@ bool command_handler::do_register() {
     if (!cm_config_.pwd.empty())
         command->pwd = cm_config_.pwd;
 
+    auto settings = profile::global::snapshot();
     if (!cm_config_.sid.empty())
         command->prev_sid = cm_config_.sid;
-    else if (!profile::global::instance().cm_registration_sid.empty())
-        command->prev_sid = profile::global::instance().cm_registration_sid;
+    else if (!settings->cm_registration_sid.empty())
+        command->prev_sid = settings->cm_registration_sid;
 
     if (!cm_config_.reg_token.isEmpty())
         command->reg_token = cm_config_.reg_token.getToken();
@@ -797,13 +839,13 @@ bool command_handler::do_cam_register() {
         command->brand = cm_config_.device_brand;
         command->model = cm_config_.device_model;
         command->sn = cm_config_.device_serial;
-        command->raw_messaging = profile::global::instance().raw_messaging;
+        command->raw_messaging = profile::global::snapshot()->raw_messaging;
         command->version = cm_config_.device_fw_version;
         command->type = cm_config_.device_type;
 
         on_registered(cm_config_.sid);
 
-        return (registered_ = send_command(json(*command)));
+        return (registered_ = send_command(*command));
     }
 
     return true;
@@ -816,39 +858,52 @@ bool command_handler::do_bye(std::string reason) {
 }
 
 void command_handler::_flush_command_acks() {
-    for (auto ack = acks_.begin(); ack != acks_.end();) {
-        // Disable timeout callback
-        if (ack->second.timeout_cb_)
-            transport_->cancel_timed_cb(ack->second.timeout_cb_);
-        // Timed out callback, we didn't receive ack from the Cloud
-        if (ack->second.ack_cb_)
-            ack->second.ack_cb_(true, nullptr);
-    }
+    size_t flushed = acks_.flush();
+
+    if (flushed)
+        logger->info("{} pending acks flushed", flushed);
 }
 
 void command_handler::_handle_command_ack(base_command::ptr command) {
     // Check if command refid is in the list of the acknowledge notifications
-    // i.e. command is a reply to command sent with send_command_with_ack()
-    if (acks_.count(command->refid) > 0) {
-        auto ack = acks_[command->refid];
+    // i.e. command is a reply to command sent with send_command_with_ack(),
+    // late acks of the timed out commands are ignored
+    if (!__is_unset(command->refid))
+        acks_.ack(command->refid, command);
+}
+
+void command_handler::_arm_acks_sweep() {
+    std::lock_guard<std::mutex> lock(acks_sweep_lock_);
+
+    if (acks_sweep_timer_ || !acks_.pending())
+        return;
+
+    acks_sweep_timer_ = transport_->schedule_timed_cb(
+        std::bind(&command_handler::_on_acks_sweep, this),
+        ACKS_SWEEP_PERIOD_MS);
+}
 
-        // Disable timeout callback
-        if (ack.timeout_cb_)
-            transport_->cancel_timed_cb(ack.timeout_cb_);
+void command_handler::_on_acks_sweep() {
+    size_t expired = acks_.sweep(ack_tracker::clock::now());
 
-        // Call ack notification with timeout flag set to false
-        if (ack.ack_cb_)
-            ack.ack_cb_(false, command);
+    if (expired)
+        logger->debug("{} acks timed out, {} pending", expired,
+                      acks_.pending());
 
-        acks_.erase(command->refid);
+    {
+        std::lock_guard<std::mutex> lock(acks_sweep_lock_);
+        acks_sweep_timer_ = nullptr;
     }
+
+    // Re-arm if there are acks left or added while sweeping
+    _arm_acks_sweep();
 }
 
 void command_handler::handleMessage(transport::Message& message) {
     base_command::ptr command = factory::parse(message);
     json responseCommand = nullptr;
 
-    logger->info("C <= S: {}", message.dump());
+    VXG_LOG(logger, info, "C <= S: {}", message.dump());
 
     if (command == nullptr)
         return;
@@ -1003,49 +1058,55 @@ void command_handler::handleMessage(transport::Message& message) {
         responseCommand = handle_cam_memorycard_recording(
             static_cast<cam_memorycard_recording*>(command.get()));
 end:
-    if (responseCommand.dump().c_str() != nullptr) {
-        send_command(responseCommand);
-    }
+    send_command(responseCommand);
+}
+
+json_writer& command_handler::_tx_writer() {
+    static thread_local json_writer writer;
+    return writer;
+}
+
+bool command_handler::_send_serialized(const std::string& message) {
+    logger->info("C => S: {}", message);
+    return transport_->send(message);
 }
 
 bool command_handler::send_command(base_command::ptr message) {
-    logger->info("C => S: {}", json(*message).dump());
-    return transport_->send(json(*message.get()).dump());
+    return _send_serialized(_tx_writer().write(*message));
 }
 
 bool command_handler::send_command(const base_command* message) {
-    logger->info("C => S: {}", json(*message).dump());
-
-    return transport_->send(json(*message).dump());
+    return _send_serialized(_tx_writer().write(*message));
 }
 
 bool command_handler::send_command(const json& message) {
-    if (!message.empty()) {
-        logger->info("C => S: {}", message.dump());
-        return transport_->send(message.dump());
-    } else
+    if (!message.empty())
+        return _send_serialized(message.dump());
+    else
         return false;
 }
 
+void command_handler::_track_ack(
+    int msgid,
+    std::function<void(bool timed_out,
+                       proto::command::base_command::ptr ack_cmd)> ack_cb,
+    std::chrono::seconds ack_timeout) {
+    // Acknowledge callback.
+    // Will be called when the command with refid == msgid will be received
+    // from the Cloud or with the timeout flag set to true if there was no
+    // ack during ack_timeout
+    if (!acks_.add(msgid, ack_cb, ack_tracker::clock::now() + ack_timeout))
+        logger->warn("Too many pending acks, the oldest one was dropped");
+
+    _arm_acks_sweep();
+}
+
 bool command_handler::send_command_wait_ack(
     const json& message,
     std::function<void(bool timed_out,
                        proto::command::base_command::ptr ack_cmd)> ack_cb,
     std::chrono::seconds ack_timeout = std::chrono::seconds(10)) {
-    struct command_ack ack;
-
-    // Acknowledge callback.
-    // Will be called when the command with refid == message.msgid will be
-    // received from the Cloud
-    ack.ack_cb_ = ack_cb;
-    // Charge timeout timer cb, timeout cb is ack_cb with timeout flag argument
-    // set to true
-    ack.timeout_cb_ = transport_->schedule_timed_cb(
-        std::bind(ack_cb, true, nullptr),
-        std::chrono::duration_cast<std::chrono::milliseconds>(ack_timeout)
-            .count());
-    // Save ack struct into the acks pool
-    acks_[message["msgid"].get<int>()] = std::move(ack);
+    _track_ack(message["msgid"].get<int>(), ack_cb, ack_timeout);
 
     return send_command(message);
 }
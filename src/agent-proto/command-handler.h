@@ -3,6 +3,7 @@
 
 #include <agent/manager-config.h>
 
+#include <agent-proto/ack-tracker.h>
 #include <agent-proto/proto.h>
 
 #include <net/transport.h>
@@ -25,11 +26,23 @@ protected:
     long long bye_retry_ {0};
     bool hello_received_ {false};
 
-    struct command_ack {
-        std::function<void(bool, command::base_command::ptr)> ack_cb_;
-        transport::timed_cb_ptr timeout_cb_;
-    };
-    std::map<int, command_ack> acks_;
+    //! @brief Cached state of the session lost accidentally, used to resume
+    //! the session without repeating its setup when reconnected in time.
+    struct session_state {
+        int cam_id {0};
+        std::chrono::steady_clock::time_point lost_at;
+        bool lost {false};
+    } session_;
+    //! Last cam_hello resumed the lost session with the same cam_id
+    bool session_resumed_ {false};
+
+    //! Acks timeouts resolution
+    static const size_t ACKS_SWEEP_PERIOD_MS = 1000;
+    //! Pending acks of the commands sent with send_command_wait_ack()
+    ack_tracker acks_;
+    //! Periodic acks timeout sweep, armed while there are pending acks
+    transport::timed_cb_ptr acks_sweep_timer_ {nullptr};
+    std::mutex acks_sweep_lock_;
 
 public:
     command_handler(transport::worker::ptr transport = nullptr);
@@ -112,18 +125,46 @@ protected:
     bool try_connect();
     bool reconnect(int retry_timeout);
     void _reset_reconnect_timer();
+    void _session_lost();
 
     bool send_command(base_command::ptr message);
     bool send_command(const json& message);
     bool send_command(const base_command* message);
+    //! @brief Send the protocol object serialized directly into the
+    //! thread's reusable buffer without building the json tree.
+    template <typename T>
+    typename std::enable_if<has_write_json<T>::value, bool>::type
+    send_command(const T& message) {
+        return _send_serialized(_tx_writer().write(message));
+    }
 
     bool send_command_wait_ack(
         const json& message,
         std::function<void(bool timed_out, proto::command::base_command::ptr)>
             ack_cb,
         std::chrono::seconds ack_timeout);
+    template <typename T>
+    typename std::enable_if<has_write_json<T>::value, bool>::type
+    send_command_wait_ack(
+        const T& message,
+        std::function<void(bool timed_out, proto::command::base_command::ptr)>
+            ack_cb,
+        std::chrono::seconds ack_timeout) {
+        _track_ack(message.msgid, ack_cb, ack_timeout);
+        return send_command(message);
+    }
+    void _track_ack(
+        int msgid,
+        std::function<void(bool timed_out, proto::command::base_command::ptr)>
+            ack_cb,
+        std::chrono::seconds ack_timeout);
+    bool _send_serialized(const std::string& message);
+    //! Per thread outgoing commands serializer
+    static json_writer& _tx_writer();
     void _handle_command_ack(base_command::ptr command);
     void _flush_command_acks();
+    void _arm_acks_sweep();
+    void _on_acks_sweep();
 
     virtual void on_closed(int error, bye_reason reason) = 0;
     virtual void on_prepared() = 0;
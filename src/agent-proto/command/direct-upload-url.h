@@ -31,6 +31,9 @@ struct direct_upload_url_base {
     std::function<void(bool ok)> on_finished {[](bool ok) {}};
     //! Callback returns true if upload canceled.
     std::function<bool(void)> is_canceled {[]() { return false; }};
+    //! Id of the batched get_direct_upload_url item this entry replies to,
+    //! used instead of the command's refid if set.
+    int upload_refid {UnsetInt};
     //! @endinternal
 
     JSON_DEFINE_TYPE_INTRUSIVE(direct_upload_url_base,
@@ -41,15 +41,7 @@ NLOHMANN_JSON_SERIALIZE_ENUM( media_type, {
 })
 // clang-format on
 
-//! 3.22 get_direct_upload_url (CM)
-//! Request for direct upload of a file to Cloud's storage.
-struct get_direct_upload_url : public base_command {
-    typedef std::shared_ptr<get_direct_upload_url> ptr;
-
-    get_direct_upload_url() { cmd = GET_DIRECT_UPLOAD_URL; }
-
-    virtual ~get_direct_upload_url() {}
-
+struct get_direct_upload_url_base {
     //! category: string, must be "record" or “snapshot”
     upload_category category {UC_INVALID};
     //! type: string, media file type; must be "mp4" for "record" or “jpg” for
@@ -71,6 +63,52 @@ struct get_direct_upload_url : public base_command {
     //! height: optional int, only for “snapshot”. Height of image in pixels
     int height {UnsetInt};
 
+    JSON_DEFINE_TYPE_INTRUSIVE(get_direct_upload_url_base,
+                               category,
+                               type,
+                               stream_id,
+                               file_time,
+                               duration,
+                               size,
+                               width,
+                               height);
+};
+using get_direct_upload_url_list = std::vector<get_direct_upload_url_base>;
+}  // namespace command
+}  // namespace proto
+}  // namespace agent
+}  // namespace cloud
+}  // namespace vxg
+
+//! Not batched get_direct_upload_url has no extra field
+template <>
+inline bool
+__is_unset<vxg::cloud::agent::proto::command::get_direct_upload_url_list>(
+    const vxg::cloud::agent::proto::command::get_direct_upload_url_list& t) {
+    return t.empty();
+}
+
+namespace vxg {
+namespace cloud {
+namespace agent {
+namespace proto {
+namespace command {
+
+//! 3.22 get_direct_upload_url (CM)
+//! Request for direct upload of a file to Cloud's storage.
+struct get_direct_upload_url : public base_command,
+                               public get_direct_upload_url_base {
+    typedef std::shared_ptr<get_direct_upload_url> ptr;
+
+    get_direct_upload_url() { cmd = GET_DIRECT_UPLOAD_URL; }
+
+    virtual ~get_direct_upload_url() {}
+
+    //! extra: optional list of additional upload requests batched into this
+    //! command, Cloud replies with single direct_upload_url where the
+    //! direct_upload_url.extra list items are in the same order.
+    get_direct_upload_url_list extra;
+
     //! @internal
     //! Callback which should be called when upload finished.
     std::function<void(bool ok)> on_finished {[](bool ok) {}};
@@ -82,18 +120,16 @@ struct get_direct_upload_url : public base_command {
     //! Duration of fragment in microseconds, used to accurate calculations,
     //! as milliseconds @ref get_direct_upload_url.duration.
     vxg::cloud::duration duration_us {cloud::duration(0)};
+    //! Upload is a part of the periodic timeline upload(continuous direct
+    //! upload recording or memorycard synchronization) and not triggered by
+    //! an event, such uploads have lower priority.
+    bool periodic {false};
     //! @endinternal
 
-    JSON_DEFINE_DERIVED_TYPE_INTRUSIVE(get_direct_upload_url,
-                                       base_command,
-                                       category,
-                                       type,
-                                       stream_id,
-                                       file_time,
-                                       duration,
-                                       size,
-                                       width,
-                                       height);
+    JSON_DEFINE_DERIVED2_TYPE_INTRUSIVE(get_direct_upload_url,
+                                        base_command,
+                                        get_direct_upload_url_base,
+                                        extra);
 };
 }  // namespace command
 }  // namespace proto
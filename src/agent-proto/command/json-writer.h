@@ -0,0 +1,342 @@
+#ifndef __JSON_WRITER_H
+#define __JSON_WRITER_H
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <agent-proto/command/unset-helper.h>
+
+namespace vxg {
+namespace cloud {
+namespace agent {
+namespace proto {
+
+class json_writer;
+
+//! @brief Checks if the type has the write_json() generated by the
+//! JSON_DEFINE_*_INTRUSIVE macros.
+template <typename T, typename = void>
+struct has_write_json : std::false_type {};
+
+template <typename T>
+struct has_write_json<T,
+                      decltype(write_json(std::declval<json_writer&>(),
+                                          std::declval<const T&>()),
+                               void())> : std::true_type {};
+
+//! @brief Streaming JSON serializer of the protocol objects.
+//!
+//! Writes the objects straight into the reusable output buffer without
+//! building the nlohmann::json tree, the buffer keeps its capacity between
+//! the writes so a warmed up writer doesn't allocate for the scalar fields.
+//!
+//! Output is equivalent to the nlohmann::json(obj).dump() one: unset and
+//! null fields are skipped, objects without fields are null. Fields go in
+//! the declaration order instead of the alphabetical one. Types without the
+//! generated write_json(), e.g. enums or the objects with handwritten
+//! to_json(), are serialized via nlohmann::json.
+//!
+//! Not thread-safe, use a writer per thread.
+class json_writer {
+public:
+    json_writer(size_t reserve = 1024) { buf_.reserve(reserve); }
+
+    //! Clear the output keeping the allocated buffer
+    void reset() {
+        buf_.clear();
+        comma_ = false;
+    }
+
+    const std::string& str() const { return buf_; }
+    size_t size() const { return buf_.size(); }
+
+    //! @brief Serialize @p obj as the top-level value.
+    //!
+    //! @return Serialized value, valid until the next writer modification.
+    template <typename T>
+    const std::string& write(const T& obj) {
+        reset();
+        value(obj);
+        return buf_;
+    }
+
+    //! @brief Write object field, skipped if the value is unset or null.
+    template <typename T>
+    void field(const char* name, const T& v) {
+        if (__is_unset(v))
+            return;
+
+        size_t pos = buf_.size();
+        bool comma = comma_;
+
+        key(name);
+        if (!value(v)) {
+            buf_.resize(pos);
+            comma_ = comma;
+        }
+    }
+
+    //! @brief Write object field as is, null value included.
+    template <typename T>
+    void member(const char* name, const T& v) {
+        key(name);
+        value(v);
+    }
+
+    //! @brief Write the fields of @p v into the current object, used for the
+    //! base classes of the derived objects.
+    template <typename T>
+    typename std::enable_if<has_write_json<T>::value>::type fields(
+        const T& v) {
+        write_json(*this, v);
+    }
+
+    template <typename T>
+    typename std::enable_if<!has_write_json<T>::value>::type fields(
+        const T& v) {
+        nlohmann::json j = v;
+
+        for (auto& f : j.items()) {
+            key(f.key().c_str());
+            value(f.value());
+        }
+    }
+
+    //! @brief Write value.
+    //!
+    //! @return false if null was written.
+    bool value(bool v) {
+        __separate();
+        buf_ += v ? "true" : "false";
+        return true;
+    }
+
+    bool value(const std::string& v) {
+        __string(v.data(), v.size());
+        return true;
+    }
+
+    bool value(const char* v) {
+        if (!v)
+            return null();
+
+        __string(v, strlen(v));
+        return true;
+    }
+
+    bool value(std::nullptr_t) { return null(); }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value &&
+                                !std::is_same<T, bool>::value,
+                            bool>::type
+    value(T v) {
+        char digits[24];
+        char* end = digits + sizeof(digits);
+        char* p = end;
+        bool negative = std::is_signed<T>::value && v < 0;
+        // Unsigned magnitude, correct for the min value too
+        unsigned long long u =
+            negative ? 0ULL - static_cast<unsigned long long>(v)
+                     : static_cast<unsigned long long>(v);
+
+        do {
+            *--p = '0' + u % 10;
+            u /= 10;
+        } while (u);
+
+        if (negative)
+            *--p = '-';
+
+        __separate();
+        buf_.append(p, end - p);
+        return true;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+    value(T v) {
+        if (!std::isfinite(v))
+            return null();
+
+        // Shortest of the %.15g and %.17g which reads back the same
+        char digits[32];
+        int len = snprintf(digits, sizeof(digits), "%.15g", (double)v);
+        if (strtod(digits, nullptr) != v)
+            len = snprintf(digits, sizeof(digits), "%.17g", (double)v);
+
+        __separate();
+        buf_.append(digits, len);
+        // Keep it a floating point number as nlohmann::json does
+        if (!strpbrk(digits, ".eE"))
+            buf_ += ".0";
+        return true;
+    }
+
+    template <typename T>
+    bool value(const std::vector<T>& v) {
+        begin_array();
+        for (const auto& e : v)
+            value(e);
+        end_array();
+        return true;
+    }
+
+    template <typename T1, typename T2>
+    bool value(const std::pair<T1, T2>& v) {
+        begin_array();
+        value(v.first);
+        value(v.second);
+        end_array();
+        return true;
+    }
+
+    template <typename T>
+    bool value(const std::map<std::string, T>& v) {
+        begin_object();
+        for (auto& e : v) {
+            key(e.first.c_str());
+            value(e.second);
+        }
+        end_object();
+        return true;
+    }
+
+    bool value(const nlohmann::json& v) {
+        if (v.is_null())
+            return null();
+
+        __separate();
+        buf_ += v.dump();
+        return true;
+    }
+
+    //! Object with the generated write_json()
+    template <typename T>
+    typename std::enable_if<has_write_json<T>::value, bool>::type value(
+        const T& v) {
+        size_t pos = buf_.size();
+        bool comma = comma_;
+
+        begin_object();
+        size_t fields = buf_.size();
+        write_json(*this, v);
+
+        // No fields, nlohmann::json leaves such object null
+        if (buf_.size() == fields) {
+            buf_.resize(pos);
+            comma_ = comma;
+            return null();
+        }
+
+        end_object();
+        return true;
+    }
+
+    //! Everything else goes through nlohmann::json
+    template <typename T>
+    typename std::enable_if<!has_write_json<T>::value &&
+                                !std::is_arithmetic<T>::value,
+                            bool>::type
+    value(const T& v) {
+        return value(nlohmann::json(v));
+    }
+
+    bool null() {
+        __separate();
+        buf_ += "null";
+        return false;
+    }
+
+    void begin_object() {
+        __separate();
+        buf_ += '{';
+        comma_ = false;
+    }
+
+    void end_object() {
+        buf_ += '}';
+        comma_ = true;
+    }
+
+    void begin_array() {
+        __separate();
+        buf_ += '[';
+        comma_ = false;
+    }
+
+    void end_array() {
+        buf_ += ']';
+        comma_ = true;
+    }
+
+    void key(const char* name) {
+        __string(name, strlen(name));
+        buf_ += ':';
+        comma_ = false;
+    }
+
+private:
+    std::string buf_;
+    //! Next value or key should be separated with the comma
+    bool comma_ {false};
+
+    void __separate() {
+        if (comma_)
+            buf_ += ',';
+        comma_ = true;
+    }
+
+    void __string(const char* s, size_t len) {
+        static const char hex[] = "0123456789abcdef";
+        const char* run = s;
+        const char* end = s + len;
+
+        __separate();
+        buf_ += '"';
+        for (const char* p = s; p < end; p++) {
+            unsigned char c = *p;
+            const char* esc = nullptr;
+
+            switch (c) {
+                case '"': esc = "\\\""; break;
+                case '\\': esc = "\\\\"; break;
+                case '\b': esc = "\\b"; break;
+                case '\f': esc = "\\f"; break;
+                case '\n': esc = "\\n"; break;
+                case '\r': esc = "\\r"; break;
+                case '\t': esc = "\\t"; break;
+                default:
+                    if (c >= 0x20)
+                        continue;
+            }
+
+            buf_.append(run, p - run);
+            run = p + 1;
+            if (esc) {
+                buf_ += esc;
+            } else {
+                char u[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+                buf_.append(u, sizeof(u));
+            }
+        }
+        buf_.append(run, end - run);
+        buf_ += '"';
+    }
+};
+
+}  // namespace proto
+}  // namespace agent
+}  // namespace cloud
+}  // namespace vxg
+
+#endif
@@ -101,7 +101,7 @@ T unset_value_for_impl(T*) {
 //!               It's also possible that json has such field but its value is
 //!               set to value treated as unset value. @see __is_unset<>()
 template <typename T>
-inline bool __is_unset(T) {
+inline bool __is_unset(const T&) {
     return false;
 }
 
@@ -113,32 +113,32 @@ inline bool __is_unset(T) {
 //! @return false value is initialized.
 //! @see unset_value_for<int>()
 template <>
-inline bool __is_unset<int>(int t) {
+inline bool __is_unset<int>(const int& t) {
     return t == unset_value_for<int>();
 }
 
 template <>
-inline bool __is_unset<std::string>(std::string t) {
+inline bool __is_unset<std::string>(const std::string& t) {
     return t == unset_value_for<std::string>();
 }
 
 template <>
-inline bool __is_unset<double>(double t) {
+inline bool __is_unset<double>(const double& t) {
     return t == unset_value_for<double>();
 }
 
 template <>
-inline bool __is_unset<vxg::cloud::time>(vxg::cloud::time t) {
+inline bool __is_unset<vxg::cloud::time>(const vxg::cloud::time& t) {
     return t == unset_value_for<vxg::cloud::time>();
 }
 
 template <>
-inline bool __is_unset<vxg::cloud::duration>(vxg::cloud::duration t) {
+inline bool __is_unset<vxg::cloud::duration>(const vxg::cloud::duration& t) {
     return t == unset_value_for<vxg::cloud::duration>();
 }
 
 template <>
-inline bool __is_unset<nlohmann::json>(nlohmann::json t) {
+inline bool __is_unset<nlohmann::json>(const nlohmann::json& t) {
     // unset if null, empty array or array with null element
     bool is_null = (t == nullptr);
     bool is_empty_array = (t.is_array() && t.empty());
@@ -147,7 +147,7 @@ inline bool __is_unset<nlohmann::json>(nlohmann::json t) {
 }
 
 template <>
-inline bool __is_unset<std::nullptr_t>(std::nullptr_t t) {
+inline bool __is_unset<std::nullptr_t>(const std::nullptr_t& t) {
     return true;
 }
 
@@ -216,7 +216,7 @@ struct alter_bool {
     n_alter_bool val {B_INVALID};
 };
 template <>
-inline bool __is_unset<alter_bool>(alter_bool t) {
+inline bool __is_unset<alter_bool>(const alter_bool& t) {
     return t.val == alter_bool::B_INVALID;
 }
 
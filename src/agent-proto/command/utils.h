@@ -3,6 +3,7 @@
 
 #include <nlohmann/json.hpp>
 
+#include <agent-proto/command/json-writer.h>
 #include <agent-proto/command/unset-helper.h>
 
 // namespace CameraManagerProtocol {
@@ -28,47 +29,70 @@
                 nlohmann_json_j.erase(#v1);            \
         }                                              \
     }
+#define MY_JSON_WRITE(v1) nlohmann_json_w.field(#v1, nlohmann_json_t.v1);
 // #undef NLOHMANN_JSON_FROM
 #define MY_JSON_FROM(v1) \
     ignore_exception(nlohmann_json_j.at(#v1).get_to(nlohmann_json_t.v1));
 
-#define JSON_DEFINE_TYPE_INTRUSIVE(Type, ...)                                \
-    friend void to_json(nlohmann::json& nlohmann_json_j,                     \
-                        const Type& nlohmann_json_t) {                       \
-        NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MY_JSON_TO, __VA_ARGS__))   \
-    }                                                                        \
-    friend void from_json(const nlohmann::json& nlohmann_json_j,             \
-                          Type& nlohmann_json_t) {                           \
-        NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MY_JSON_FROM, __VA_ARGS__)) \
+#define JSON_DEFINE_TYPE_INTRUSIVE(Type, ...)                                 \
+    friend void to_json(nlohmann::json& nlohmann_json_j,                      \
+                        const Type& nlohmann_json_t) {                        \
+        NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MY_JSON_TO, __VA_ARGS__))    \
+    }                                                                         \
+    friend void from_json(const nlohmann::json& nlohmann_json_j,              \
+                          Type& nlohmann_json_t) {                            \
+        NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MY_JSON_FROM, __VA_ARGS__))  \
+    }                                                                         \
+    friend void write_json(                                                   \
+        ::vxg::cloud::agent::proto::json_writer& nlohmann_json_w,             \
+        const Type& nlohmann_json_t) {                                        \
+        NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MY_JSON_WRITE, __VA_ARGS__)) \
     }
 
-#define JSON_DEFINE_DERIVED_TYPE_INTRUSIVE(Type, BaseType, ...)              \
-    friend void to_json(nlohmann::json& nlohmann_json_j,                     \
-                        const Type& nlohmann_json_t) {                       \
-        to_json(nlohmann_json_j, static_cast<BaseType>(nlohmann_json_t));    \
-        NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MY_JSON_TO, __VA_ARGS__))   \
-    }                                                                        \
-    friend void from_json(const nlohmann::json& nlohmann_json_j,             \
-                          Type& nlohmann_json_t) {                           \
-        from_json(nlohmann_json_j, static_cast<BaseType&>(nlohmann_json_t)); \
-        NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MY_JSON_FROM, __VA_ARGS__)) \
+#define JSON_DEFINE_DERIVED_TYPE_INTRUSIVE(Type, BaseType, ...)               \
+    friend void to_json(nlohmann::json& nlohmann_json_j,                      \
+                        const Type& nlohmann_json_t) {                        \
+        to_json(nlohmann_json_j,                                              \
+                static_cast<const BaseType&>(nlohmann_json_t));               \
+        NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MY_JSON_TO, __VA_ARGS__))    \
+    }                                                                         \
+    friend void from_json(const nlohmann::json& nlohmann_json_j,              \
+                          Type& nlohmann_json_t) {                            \
+        from_json(nlohmann_json_j, static_cast<BaseType&>(nlohmann_json_t));  \
+        NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MY_JSON_FROM, __VA_ARGS__))  \
+    }                                                                         \
+    friend void write_json(                                                   \
+        ::vxg::cloud::agent::proto::json_writer& nlohmann_json_w,             \
+        const Type& nlohmann_json_t) {                                        \
+        nlohmann_json_w.fields(                                               \
+            static_cast<const BaseType&>(nlohmann_json_t));                   \
+        NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MY_JSON_WRITE, __VA_ARGS__)) \
     }
 
-#define JSON_DEFINE_DERIVED_TYPE_INTRUSIVE_NO_ARGS(Type, BaseType)           \
-    friend void to_json(nlohmann::json& nlohmann_json_j,                     \
-                        const Type& nlohmann_json_t) {                       \
-        to_json(nlohmann_json_j, static_cast<BaseType>(nlohmann_json_t));    \
-    }                                                                        \
-    friend void from_json(const nlohmann::json& nlohmann_json_j,             \
-                          Type& nlohmann_json_t) {                           \
-        from_json(nlohmann_json_j, static_cast<BaseType&>(nlohmann_json_t)); \
+#define JSON_DEFINE_DERIVED_TYPE_INTRUSIVE_NO_ARGS(Type, BaseType)            \
+    friend void to_json(nlohmann::json& nlohmann_json_j,                      \
+                        const Type& nlohmann_json_t) {                        \
+        to_json(nlohmann_json_j,                                              \
+                static_cast<const BaseType&>(nlohmann_json_t));               \
+    }                                                                         \
+    friend void from_json(const nlohmann::json& nlohmann_json_j,              \
+                          Type& nlohmann_json_t) {                            \
+        from_json(nlohmann_json_j, static_cast<BaseType&>(nlohmann_json_t));  \
+    }                                                                         \
+    friend void write_json(                                                   \
+        ::vxg::cloud::agent::proto::json_writer& nlohmann_json_w,             \
+        const Type& nlohmann_json_t) {                                        \
+        nlohmann_json_w.fields(                                               \
+            static_cast<const BaseType&>(nlohmann_json_t));                   \
     }
 
 #define JSON_DEFINE_DERIVED2_TYPE_INTRUSIVE(Type, BaseType1, BaseType2, ...)  \
     friend void to_json(nlohmann::json& nlohmann_json_j,                      \
                         const Type& nlohmann_json_t) {                        \
-        to_json(nlohmann_json_j, static_cast<BaseType1>(nlohmann_json_t));    \
-        to_json(nlohmann_json_j, static_cast<BaseType2>(nlohmann_json_t));    \
+        to_json(nlohmann_json_j,                                              \
+                static_cast<const BaseType1&>(nlohmann_json_t));              \
+        to_json(nlohmann_json_j,                                              \
+                static_cast<const BaseType2&>(nlohmann_json_t));              \
         NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MY_JSON_TO, __VA_ARGS__))    \
     }                                                                         \
     friend void from_json(const nlohmann::json& nlohmann_json_j,              \
@@ -76,19 +100,38 @@
         from_json(nlohmann_json_j, static_cast<BaseType1&>(nlohmann_json_t)); \
         from_json(nlohmann_json_j, static_cast<BaseType2&>(nlohmann_json_t)); \
         NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MY_JSON_FROM, __VA_ARGS__))  \
+    }                                                                         \
+    friend void write_json(                                                   \
+        ::vxg::cloud::agent::proto::json_writer& nlohmann_json_w,             \
+        const Type& nlohmann_json_t) {                                        \
+        nlohmann_json_w.fields(                                               \
+            static_cast<const BaseType1&>(nlohmann_json_t));                  \
+        nlohmann_json_w.fields(                                               \
+            static_cast<const BaseType2&>(nlohmann_json_t));                  \
+        NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(MY_JSON_WRITE, __VA_ARGS__)) \
     }
 
 #define JSON_DEFINE_DERIVED2_TYPE_INTRUSIVE_NO_ARGS(Type, BaseType1,          \
                                                     BaseType2)                \
     friend void to_json(nlohmann::json& nlohmann_json_j,                      \
                         const Type& nlohmann_json_t) {                        \
-        to_json(nlohmann_json_j, static_cast<BaseType1>(nlohmann_json_t));    \
-        to_json(nlohmann_json_j, static_cast<BaseType2>(nlohmann_json_t));    \
+        to_json(nlohmann_json_j,                                              \
+                static_cast<const BaseType1&>(nlohmann_json_t));              \
+        to_json(nlohmann_json_j,                                              \
+                static_cast<const BaseType2&>(nlohmann_json_t));              \
     }                                                                         \
     friend void from_json(const nlohmann::json& nlohmann_json_j,              \
                           Type& nlohmann_json_t) {                            \
         from_json(nlohmann_json_j, static_cast<BaseType1&>(nlohmann_json_t)); \
         from_json(nlohmann_json_j, static_cast<BaseType2&>(nlohmann_json_t)); \
+    }                                                                         \
+    friend void write_json(                                                   \
+        ::vxg::cloud::agent::proto::json_writer& nlohmann_json_w,             \
+        const Type& nlohmann_json_t) {                                        \
+        nlohmann_json_w.fields(                                               \
+            static_cast<const BaseType1&>(nlohmann_json_t));                  \
+        nlohmann_json_w.fields(                                               \
+            static_cast<const BaseType2&>(nlohmann_json_t));                  \
     }
 // }  // namespace utils
 // }  // namespace CameraManagerProtocol
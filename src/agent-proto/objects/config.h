@@ -858,6 +858,44 @@ private:
         }
     }
 
+    //! \internal Direct serializer, same output as to_json()
+    friend void write_json(json_writer& w, const event_object& c) {
+        w.member("time", c.time);
+        if (!__is_unset(c.mediatm))
+            w.member("mediatm", c.mediatm);
+        if (!__is_unset(c.status))
+            w.member("status", c.status);
+        if (!__is_unset(c.meta))
+            w.member("meta", c.meta);
+        if (!__is_unset(c.snapshot_info.image_time))
+            w.member("snapshot_info", c.snapshot_info);
+        if (!__is_unset(c.file_meta_info.size))
+            w.member("file_meta_info", c.file_meta_info);
+
+        if (c.event == ET_CUSTOM)
+            w.member("event", c.custom_event_name);
+        else
+            w.member("event", c.event);
+        switch (c.event) {
+            case ET_MOTION:
+                w.member("motion_info", c.motion_info);
+                break;
+            case ET_MEMORYCARD:
+                if (!__is_unset(c.memorycard_info.status))
+                    w.member("memorycard_info", c.memorycard_info);
+                break;
+            case ET_RECORD:
+                if (!__is_unset(c.record_info.on))
+                    w.member("record_info", c.record_info);
+                break;
+            case ET_WIFI:
+                w.member("wifi_info", c.wifi_info);
+                break;
+            default: {
+            }
+        }
+    }
+
     //! \internal nlohmann::json reflection mapper
     friend void from_json(const json& j, event_object& c) {
         ignore_exception(j.at("event").get_to(c.event));
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <agent-proto/ack-tracker.h>
+
+using namespace vxg::cloud::agent::proto;
+
+namespace {
+struct ack_result {
+    size_t calls {0};
+    bool timed_out {false};
+    command::base_command::ptr command;
+
+    ack_tracker::ack_cb cb() {
+        return [this](bool t, command::base_command::ptr c) {
+            calls++;
+            timed_out = t;
+            command = c;
+        };
+    }
+};
+
+command::base_command::ptr make_ack(int refid) {
+    auto cmd = std::make_shared<command::base_command>("done");
+    cmd->refid = refid;
+    return cmd;
+}
+}  // namespace
+
+TEST(ack_tracker, Ack) {
+    ack_tracker acks(16);
+    auto now = ack_tracker::clock::now();
+    ack_result r;
+
+    EXPECT_TRUE(acks.add(1, r.cb(), now + std::chrono::seconds(10)));
+    EXPECT_EQ(acks.pending(), 1);
+
+    auto cmd = make_ack(1);
+    EXPECT_TRUE(acks.ack(1, cmd));
+    EXPECT_EQ(r.calls, 1);
+    EXPECT_FALSE(r.timed_out);
+    EXPECT_EQ(r.command, cmd);
+    EXPECT_EQ(acks.pending(), 0);
+
+    // Unknown refid
+    EXPECT_FALSE(acks.ack(2, make_ack(2)));
+}
+
+TEST(ack_tracker, Timeout) {
+    ack_tracker acks(16);
+    auto now = ack_tracker::clock::now();
+    ack_result early, late;
+
+    acks.add(1, early.cb(), now + std::chrono::seconds(1));
+    acks.add(2, late.cb(), now + std::chrono::seconds(5));
+
+    EXPECT_EQ(acks.sweep(now), 0);
+    EXPECT_EQ(acks.sweep(now + std::chrono::seconds(2)), 1);
+    EXPECT_EQ(early.calls, 1);
+    EXPECT_TRUE(early.timed_out);
+    EXPECT_EQ(late.calls, 0);
+
+    EXPECT_EQ(acks.sweep(now + std::chrono::seconds(5)), 1);
+    EXPECT_EQ(late.calls, 1);
+    EXPECT_TRUE(late.timed_out);
+    EXPECT_EQ(acks.pending(), 0);
+}
+
+TEST(ack_tracker, LateAck) {
+    ack_tracker acks(16);
+    auto now = ack_tracker::clock::now();
+    ack_result r;
+
+    acks.add(7, r.cb(), now);
+    EXPECT_EQ(acks.sweep(now), 1);
+
+    // Ack after the timeout is ignored, callback isn't called twice
+    EXPECT_FALSE(acks.ack(7, make_ack(7)));
+    EXPECT_EQ(r.calls, 1);
+    EXPECT_TRUE(r.timed_out);
+
+    // Ack with the refid of the evicted command sharing the slot is ignored
+    ack_result newer;
+    acks.add(7 + 16, newer.cb(), now + std::chrono::seconds(1));
+    EXPECT_FALSE(acks.ack(7, make_ack(7)));
+    EXPECT_EQ(newer.calls, 0);
+    EXPECT_TRUE(acks.ack(7 + 16, make_ack(7 + 16)));
+    EXPECT_EQ(newer.calls, 1);
+}
+
+TEST(ack_tracker, Flood) {
+    ack_tracker acks(1000);
+    auto deadline = ack_tracker::clock::now() + std::chrono::seconds(10);
+    std::vector<ack_result> results(5000);
+
+    EXPECT_EQ(acks.capacity(), 1024);
+
+    for (size_t i = 0; i < results.size(); i++)
+        acks.add(i, results[i].cb(), deadline);
+
+    // Memory is bounded, the oldest acks were evicted as timed out
+    EXPECT_EQ(acks.pending(), acks.capacity());
+    EXPECT_EQ(acks.evictions(), results.size() - acks.capacity());
+
+    size_t evicted = results.size() - acks.capacity();
+    for (size_t i = 0; i < results.size(); i++) {
+        if (i < evicted) {
+            EXPECT_EQ(results[i].calls, 1);
+            EXPECT_TRUE(results[i].timed_out);
+        } else {
+            EXPECT_EQ(results[i].calls, 0);
+        }
+    }
+
+    for (size_t i = evicted; i < results.size(); i++)
+        EXPECT_TRUE(acks.ack(i, make_ack(i)));
+    EXPECT_EQ(acks.pending(), 0);
+}
+
+TEST(ack_tracker, FlushOnReconnect) {
+    ack_tracker acks(16);
+    auto deadline = ack_tracker::clock::now() + std::chrono::seconds(10);
+    std::vector<ack_result> results(10);
+    size_t added_from_cb = 0;
+
+    for (size_t i = 0; i < results.size(); i++)
+        acks.add(i, results[i].cb(), deadline);
+
+    // Callback may add new acks, the tracker's lock is not held
+    acks.add(
+        10,
+        [&](bool, command::base_command::ptr) {
+            acks.add(11, nullptr, deadline);
+            added_from_cb++;
+        },
+        deadline);
+
+    EXPECT_EQ(acks.flush(), results.size() + 1);
+    for (auto& r : results) {
+        EXPECT_EQ(r.calls, 1);
+        EXPECT_TRUE(r.timed_out);
+    }
+    EXPECT_EQ(added_from_cb, 1);
+    EXPECT_EQ(acks.pending(), 1);
+}
@@ -219,6 +219,31 @@ TEST(base_command, register) {
                  jj["tz"].get<std::string>().c_str());
 }
 
+TEST(base_command, BatchedGetDirectUploadUrl) {
+    get_direct_upload_url req;
+    get_direct_upload_url req2;
+
+    req.category = req2.category = UC_RECORD;
+    req.type = req2.type = MT_MP4;
+    req.file_time = "20230101T000000.000";
+    req2.file_time = "20230101T000015.000";
+
+    // Not batched request has no extra list
+    EXPECT_EQ(json(req).count("extra"), 0);
+
+    req.extra.push_back(req2);
+    json j = req;
+
+    ASSERT_EQ(j["extra"].size(), 1);
+    EXPECT_EQ(j["extra"][0]["file_time"], req2.file_time);
+    EXPECT_EQ(j["extra"][0].count("cmd"), 0);
+    EXPECT_EQ(j["extra"][0].count("msgid"), 0);
+
+    get_direct_upload_url parsed = j;
+    ASSERT_EQ(parsed.extra.size(), 1);
+    EXPECT_EQ(parsed.extra[0].file_time, req2.file_time);
+}
+
 #include <nlohmann/json.hpp>
 struct ca {
     int a {1};
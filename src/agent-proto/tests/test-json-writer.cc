@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include <agent-proto/proto.h>
+
+using namespace vxg::cloud::agent;
+using namespace vxg::cloud::agent::proto;
+using namespace vxg::cloud::agent::proto::command;
+
+namespace {
+//! Direct serialization must parse into the same document as the json one
+template <typename T>
+void expect_same_json(const T& obj) {
+    json_writer writer;
+    std::string direct = writer.write(obj);
+
+    EXPECT_EQ(json::parse(direct), json(obj)) << direct;
+}
+}  // namespace
+
+TEST(json_writer, Done) {
+    base_command cmd("get_cam_status", 1, UnsetInt);
+    done reply(&cmd, DS_OK);
+
+    expect_same_json(reply);
+    // Unset fields are skipped
+    EXPECT_EQ(json::parse(json_writer().write(reply)).count("orig_cmd"), 1);
+    EXPECT_EQ(json::parse(json_writer().write(base_command())).count("cmd"),
+              0);
+}
+
+TEST(json_writer, CamEvent) {
+    cam_event event;
+
+    event.cam_id = 1;
+    event.event = ET_MOTION;
+    event.time = 1760800000.123456;
+    event.status = ES_OK;
+    event.meta = {{"zone", "entrance"}, {"score", 0.87}};
+    event.snapshot_info.image_time = "20261018T120000.123456";
+    event.snapshot_info.width = 640;
+    event.snapshot_info.height = 480;
+    event.snapshot_info.size = 32768;
+    expect_same_json(event);
+
+    // Custom event name replaces the event type
+    event.event = ET_CUSTOM;
+    event.custom_event_name = "line \"crossing\"\n";
+    expect_same_json(event);
+
+    // Empty nested object is null as in json
+    cam_event empty;
+    empty.event = ET_MOTION;
+    expect_same_json(empty);
+}
+
+TEST(json_writer, NestedObjects) {
+    proto::stream_config config;
+
+    for (auto id : {"Main", "Sub"}) {
+        video_stream_config video;
+
+        video.stream = id;
+        video.format = VF_H264;
+        video.horz = 1920;
+        video.vert = 1080;
+        video.fps = 29.97;
+        config.video.push_back(video);
+    }
+    expect_same_json(config);
+
+    supported_streams_config streams;
+    supported_stream_config stream;
+    stream.id = "Main";
+    stream.video = "MainVideo";
+    streams.streams.push_back(stream);
+    streams.video_es.push_back(stream.video);
+    expect_same_json(streams);
+
+    // Handwritten to_json() of the nested objects
+    events_config events;
+    event_config motion;
+    motion.event = ET_MOTION;
+    motion.active = true;
+    motion.snapshot = true;
+    events.events.push_back(motion);
+    events.enabled = true;
+    expect_same_json(events);
+}
+
+TEST(json_writer, Scalars) {
+    json_writer w;
+
+    w.begin_array();
+    w.value(0);
+    w.value(-2147483647 - 1);
+    w.value(18446744073709551615ULL);
+    w.value(25.0);
+    w.value(0.1);
+    w.value(1e300);
+    w.value(std::numeric_limits<double>::infinity());
+    w.value(std::string("\x01\t\\"));
+    w.end_array();
+
+    EXPECT_EQ(w.str(),
+              "[0,-2147483648,18446744073709551615,25.0,0.1,1e+300,null,"
+              "\"\\u0001\\t\\\\\"]");
+    EXPECT_EQ(json::parse(w.str())[3].get<double>(), 25.0);
+}
+
+TEST(json_writer, BufferReuse) {
+    json_writer w(16);
+    cam_event event;
+
+    event.event = ET_MOTION;
+    event.time = 1760800000.5;
+    event.meta = {{"zone", std::string(100, 'z')}};
+
+    std::string first = w.write(event);
+    const char* data = w.str().data();
+
+    // Same size output doesn't reallocate the buffer
+    EXPECT_EQ(w.write(event), first);
+    EXPECT_EQ(w.str().data(), data);
+}
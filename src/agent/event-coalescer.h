@@ -0,0 +1,312 @@
+#pragma once
+
+#include <agent-proto/objects/config.h>
+#include <utils/logging.h>
+#include <utils/utils.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace vxg {
+namespace cloud {
+namespace agent {
+
+//! @brief Per event type coalescer of the event streams notifications.
+//!
+//! Sits between the event streams and the manager's events handling, bursts
+//! of the same event type are merged and rate limited so a flapping detector
+//! doesn't trigger a snapshot, a cam_event and a records upload per
+//! notification.
+//!
+//! Stateless event is held for the debounce window, events of the same type
+//! notified meanwhile are merged into it extending its time_end, the held
+//! event is released after the debounce window of quiet or the max delay
+//! since its first notification. Stateful event activation is released
+//! immediately, deactivation is held for the debounce window and canceled by
+//! the next activation, so the flapping state is reported as one long event.
+//! Repeated states are dropped.
+//!
+//! Released events are rate limited by the token bucket of their type, while
+//! the bucket is empty the stateless events are kept merging and the stateful
+//! activations wait, deactivations are not limited.
+//!
+//! Upload cancelers, memorycard synchronization and state emulation events
+//! are passed as is.
+//!
+//! The coalescer is not thread-safe, agent::manager serializes the calls.
+class event_coalescer {
+    vxg::logger::logger_ptr logger {vxg::logger::instance("event-coalescer")};
+
+public:
+    struct config {
+        //! Quiet time before releasing the held event, zero disables
+        //! debouncing
+        cloud::duration debounce {cloud::duration(0)};
+        //! Max holding time of the stateless event since its first
+        //! notification, bounds the latency during the continuous burst
+        cloud::duration max_delay {std::chrono::seconds(10)};
+        //! Token bucket refill rate in events per second, zero disables rate
+        //! limiting
+        double rate {0};
+        //! Token bucket size, max number of events released at once
+        size_t burst {1};
+        //! Merge stateless events extending the held event's time span, if
+        //! false the held event is released as is and the others are dropped
+        bool merge {true};
+    };
+
+private:
+    struct state {
+        config conf;
+        bool stateful {false};
+        //! Last released state of the stateful event
+        bool active {false};
+
+        //! Theoretical arrival time of the next event
+        cloud::time tat {utils::time::null()};
+
+        //! Stateless event or stateful activation waiting for release
+        bool held {false};
+        proto::event_object event;
+        cloud::time first {utils::time::null()};
+        cloud::time due {utils::time::null()};
+
+        //! Stateful deactivation waiting for the debounce window end
+        bool held_stop {false};
+        proto::event_object stop;
+        cloud::time stop_due {utils::time::null()};
+    };
+
+    config default_config_;
+    std::map<std::string, config> configs_;
+    std::map<std::string, state> states_;
+    size_t merged_ {0};
+    size_t dropped_ {0};
+
+    static bool __bypass(const proto::event_object& e) {
+        return e.state_dummy || e.upload_canceler || !e.upload_token.empty();
+    }
+
+    static double __end_time(const proto::event_object& e) {
+        return __is_unset(e.time_end) ? e.time : e.time_end;
+    }
+
+    static cloud::duration __seconds(double s) {
+        return std::chrono::duration_cast<cloud::duration>(
+            std::chrono::duration<double>(s));
+    }
+
+    state& __state(const std::string& name) {
+        auto it = states_.find(name);
+
+        if (it == states_.end()) {
+            auto conf = configs_.find(name);
+
+            it = states_.emplace(name, state()).first;
+            it->second.conf =
+                conf != configs_.end() ? conf->second : default_config_;
+        }
+
+        return it->second;
+    }
+
+    //! Token bucket as the virtual scheduling, the token is available if
+    //! the theoretical arrival time minus the burst tolerance has come
+    static cloud::duration __interval(const state& s) {
+        return __seconds(1 / s.conf.rate);
+    }
+
+    static cloud::duration __tolerance(const state& s) {
+        return __interval(s) * (s.conf.burst ? s.conf.burst - 1 : 0);
+    }
+
+    bool __take_token(state& s, cloud::time now) {
+        // Flush of everything at the max time ignores the rate
+        if (s.conf.rate <= 0 || now == utils::time::max())
+            return true;
+
+        if (now < s.tat - __tolerance(s))
+            return false;
+        s.tat = std::max(s.tat, now) + __interval(s);
+
+        return true;
+    }
+
+    //! Time when the token will be available
+    cloud::time __token_time(const state& s) {
+        if (s.conf.rate <= 0)
+            return utils::time::null();
+
+        return s.tat - __tolerance(s);
+    }
+
+    void __push_stateless(state& s,
+                          proto::event_object& event,
+                          const std::string& name,
+                          cloud::time now) {
+        if (!s.held) {
+            s.held = true;
+            s.event = std::move(event);
+            s.first = now;
+            s.due = now + s.conf.debounce;
+            return;
+        }
+
+        if (s.conf.merge) {
+            s.event.time_end =
+                std::max(__end_time(s.event), __end_time(event));
+            merged_++;
+            logger->debug("Event {} merged, time span extended to {}", name,
+                          utils::time::to_iso(utils::time::from_double(
+                              s.event.time_end)));
+        } else {
+            dropped_++;
+            logger->debug("Event {} dropped, previous one is held", name);
+        }
+
+        s.due = std::min(now + s.conf.debounce, s.first + s.conf.max_delay);
+    }
+
+    void __push_stateful(state& s,
+                         proto::event_object& event,
+                         const std::string& name,
+                         cloud::time now) {
+        if (event.active) {
+            if (s.held_stop) {
+                // Flapping, the state is continued
+                s.held_stop = false;
+                merged_++;
+                logger->debug("Event {} deactivation canceled by activation",
+                              name);
+            } else if (s.active || s.held) {
+                dropped_++;
+                logger->debug("Event {} is already active", name);
+            } else {
+                s.held = true;
+                s.event = std::move(event);
+                s.first = s.due = now;
+            }
+        } else {
+            if (s.held_stop || (!s.active && !s.held)) {
+                dropped_++;
+                logger->debug("Event {} is already inactive", name);
+            } else {
+                s.held_stop = true;
+                s.stop = std::move(event);
+                s.stop_due = now + s.conf.debounce;
+            }
+        }
+    }
+
+    void __release(state& s,
+                   cloud::time now,
+                   std::vector<proto::event_object>& out) {
+        if (s.held && now >= s.due && __take_token(s, now)) {
+            out.push_back(std::move(s.event));
+            s.held = false;
+            if (s.stateful)
+                s.active = true;
+        }
+
+        if (s.held_stop && !s.held && now >= s.stop_due) {
+            out.push_back(std::move(s.stop));
+            s.held_stop = false;
+            s.active = false;
+        }
+    }
+
+public:
+    //! @brief Config of the event types without own config.
+    void set_default_config(config conf) { default_config_ = conf; }
+
+    //! @brief Set config of the event type.
+    //!
+    //! @param name Event name as returned by proto::event_object::name().
+    void configure(const std::string& name, config conf) {
+        configs_[name] = conf;
+
+        auto it = states_.find(name);
+        if (it != states_.end())
+            it->second.conf = conf;
+    }
+
+    //! @brief Pass the notified event through the coalescer.
+    //!
+    //! @param event Notified event.
+    //! @param stateful Event type is stateful.
+    //! @param[out] out Events released by this call, the held events are
+    //!                 released by flush().
+    //! @param now Current time.
+    void push(proto::event_object event,
+              bool stateful,
+              std::vector<proto::event_object>& out,
+              cloud::time now = utils::time::now()) {
+        if (__bypass(event)) {
+            out.push_back(std::move(event));
+            return;
+        }
+
+        std::string name = event.name();
+        state& s = __state(name);
+
+        s.stateful = stateful;
+        if (stateful)
+            __push_stateful(s, event, name, now);
+        else
+            __push_stateless(s, event, name, now);
+
+        __release(s, now, out);
+    }
+
+    //! @brief Release the held events which are due.
+    //!
+    //! @param[out] out Released events.
+    //! @param now Current time, utils::time::max() releases all held events.
+    void flush(std::vector<proto::event_object>& out,
+               cloud::time now = utils::time::now()) {
+        for (auto& s : states_)
+            __release(s.second, now, out);
+    }
+
+    //! @brief Time of the next flush() which may release the held events,
+    //! max if nothing is held.
+    cloud::time next_due() {
+        cloud::time due = utils::time::max();
+
+        for (auto& it : states_) {
+            auto& s = it.second;
+
+            if (s.held)
+                due = std::min(due, std::max(s.due, __token_time(s)));
+            else if (s.held_stop)
+                due = std::min(due, s.stop_due);
+        }
+
+        return due;
+    }
+
+    //! @brief Drop the held events and the events states.
+    void clear() { states_.clear(); }
+
+    //! @return Number of the held events.
+    size_t held() const {
+        size_t result = 0;
+
+        for (auto& s : states_)
+            result += s.second.held + s.second.held_stop;
+
+        return result;
+    }
+
+    //! @return Number of the events merged into the held or active ones.
+    size_t merged() const { return merged_; }
+
+    //! @return Number of the dropped repeated events.
+    size_t dropped() const { return dropped_; }
+};
+
+}  // namespace agent
+}  // namespace cloud
+}  // namespace vxg
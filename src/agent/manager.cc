@@ -30,7 +30,7 @@ manager::manager(callback::ptr callback, transport::worker::ptr transport)
       callback_(std::move(callback)),
       started_(false),
       http_ {std::make_shared<transport::libwebsockets::http>(
-          profile::global::instance().allow_invalid_ssl_certs)},
+          profile::global::snapshot()->allow_invalid_ssl_certs)},
       direct_upload_timer_ {
           std::make_shared<transport::libwebsockets::http>()} {
     if (!callback_)
@@ -161,7 +161,7 @@ bool manager::set_token(const proto::access_token access_token) {
 
     if (!host.empty()) {
         // FIXME: remove
-        if (!profile::global::instance().insecure_cloud_channel) {
+        if (!profile::global::snapshot()->insecure_cloud_channel) {
             if (access_token.cam_sp > 0)
                 svcp_port = access_token.cam_sp;
             else
@@ -218,6 +218,10 @@ bool manager::set_token(const proto::access_token access_token) {
 }
 
 bool manager::start() {
+    // Settings written via profile::global::instance() before the start are
+    // read by the agent threads from the published snapshot
+    profile::global::publish();
+
     websocket::ptr ws = dynamic_pointer_cast<websocket>(transport_);
     // Bind callbacks, bind gives no need to pass a userdata
     ws->set_connected_cb(std::bind(&command_handler::on_connected, this));
@@ -230,6 +234,9 @@ bool manager::start() {
         http_->set_proxy(cm_config_.proxy_socks5_uri_);
     }
 
+    ws->set_permessage_deflate(
+        profile::global::snapshot()->websocket_permessage_deflate);
+
     // Start libwebsockets service threads for HTTP and WebSockets
     http_->start();
     transport_->start();
@@ -239,6 +246,7 @@ bool manager::start() {
     // be handled by command_proto::on_error and command_proto::on_disconnect
     try_connect();
 
+    _configure_direct_upload_scheduler();
     timed_cb_direct_uploader_ = direct_upload_timer_->schedule_timed_cb(
         [=] { direct_upload_sync_cb(); }, 10000);
 
@@ -256,6 +264,16 @@ void manager::stop() {
     hello_received_ = false;
     registered_ = false;
 
+    if (resume_expire_timer_) {
+        transport_->cancel_timed_cb(resume_expire_timer_);
+        resume_expire_timer_ = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queued_events_lock_);
+        queued_events_.clear();
+        resume_pending_ = false;
+    }
+
     _stop_all_event_streams();
 
     if (uploader_)
@@ -273,6 +291,9 @@ void manager::stop() {
     if (direct_upload_timer_) {
         direct_upload_timer_->stop();
     }
+    direct_upload_q_.clear();
+    upload_url_batch_timer_ = nullptr;
+    upload_url_batch_.clear();
 
     if (http_) {
         http_->disconnect();
@@ -287,6 +308,11 @@ void manager::stop() {
  *        our own commands(events, status etc.)
  */
 void manager::on_prepared() {
+    reconnect_backoff_.reset();
+
+    if (resume_pending_)
+        _resume_session(session_resumed_);
+
     if (callback_) {
         // Get memory card status from user, cache, send memorycard event
         // _update_storage_status();
@@ -297,7 +323,23 @@ void manager::on_closed(int error, bye_reason reason) {
     logger->debug("on_closed: error {} reason {}", error, json(reason).dump());
 
     _stop_all_streams();
-    _stop_all_event_streams();
+
+    // Session lost accidentally may be resumed by the next connection, event
+    // streams keep running and their events are queued until the cam_hello
+    if (reason == BR_CONN_CLOSE && session_.lost && auto_reconnect_ &&
+        event_streams_running_) {
+        // Failed reconnection attempts don't restart the resume window
+        if (!resume_pending_.exchange(true))
+            resume_expire_timer_ = transport_->schedule_timed_cb(
+                [this]() {
+                    resume_expire_timer_ = nullptr;
+                    logger->info("Session resume window expired");
+                    _expire_session_resume();
+                },
+                profile::global::snapshot()->session_resume_window_sec * 1000);
+    } else {
+        _stop_all_event_streams();
+    }
 
     // Count accident disconnections
     if (reason == proto::BR_CONN_CLOSE)
@@ -306,13 +348,14 @@ void manager::on_closed(int error, bye_reason reason) {
     // Notify userland
     callback_->on_bye(reason);
 
-    // Try to reconnect in 5 or specified in the bye message from server seconds
+    // Try to reconnect after the backoff delay or in specified in the bye
+    // message from server seconds.
     // Doesn't make sense to reconnect in case of auth failure.
     if (reason != BR_AUTH_FAILURE &&
         (reason == BR_RECONNECT || auto_reconnect_)) {
-        int timeout = (reason == BR_RECONNECT) ? bye_retry_ * 1000 : 5000;
+        int timeout = (reason == BR_RECONNECT) ? bye_retry_ * 1000 : 0;
         if (!timeout)
-            timeout = 5000;
+            timeout = reconnect_backoff_.next().count();
 
         if (reason == BR_RECONNECT)
             logger->info("Reconnect scheduled in {} ms", timeout);
@@ -328,6 +371,77 @@ void manager::on_closed(int error, bye_reason reason) {
     }
 }
 
+//! Must be called with the queued_events_lock_ held
+bool manager::_queue_event(const proto::event_object& event) {
+    if (queued_events_.size() >=
+        profile::global::snapshot()->max_queued_events) {
+        logger->warn("Too many queued events, dropping the oldest {}",
+                     queued_events_.front().name());
+        queued_events_.pop_front();
+    }
+
+    queued_events_.push_back(event);
+
+    return true;
+}
+
+void manager::_resume_session(bool resumed) {
+    if (resume_expire_timer_) {
+        transport_->cancel_timed_cb(resume_expire_timer_);
+        resume_expire_timer_ = nullptr;
+    }
+
+    if (!resumed) {
+        _expire_session_resume();
+        return;
+    }
+
+    // Events notified while flushing are queued after the flushed ones to
+    // keep the order, the queue is open until it's empty
+    while (true) {
+        std::deque<proto::event_object> events;
+
+        {
+            std::lock_guard<std::mutex> lock(queued_events_lock_);
+            if (queued_events_.empty()) {
+                resume_pending_ = false;
+                break;
+            }
+            events.swap(queued_events_);
+        }
+
+        logger->info("Sending {} events queued while disconnected",
+                     events.size());
+        for (auto& event : events)
+            _notify_event(event);
+    }
+}
+
+//! Session was not resumed, fall back to the full session setup
+void manager::_expire_session_resume() {
+    size_t dropped;
+
+    if (resume_expire_timer_) {
+        transport_->cancel_timed_cb(resume_expire_timer_);
+        resume_expire_timer_ = nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queued_events_lock_);
+        dropped = queued_events_.size();
+        queued_events_.clear();
+        resume_pending_ = false;
+    }
+
+    if (dropped)
+        logger->warn("Session was not resumed, {} queued events dropped",
+                     dropped);
+
+    session_.lost = false;
+    // Streams are restarted when the Cloud configures events
+    _stop_all_event_streams();
+}
+
 bool manager::on_get_stream_config(proto::stream_config& config) {
     bool result = true;
     for (auto& s : streams_) {
@@ -503,45 +617,7 @@ bool manager::_request_direct_upload_video(
                              json(direct_upload.category).dump(),
                              direct_upload.msgid);
 
-                auto timeout = std::chrono::seconds(20);
-                // Request upload URL, wait for reply for 20 seconds
-                send_command_wait_ack(
-                    json(direct_upload),
-                    [=](bool timedout,
-                        proto::command::base_command::ptr ack_cmd) {
-                        // If no direct_upload_url was received from the Cloud
-                        if (timedout) {
-                            direct_upload.on_finished(false);
-                            // Drop record
-                            records_.erase(direct_upload.msgid);
-                            logger->warn(
-                                "No reply for record direct upload request "
-                                "after "
-                                "{} seconds, dropping record {}.",
-                                timeout.count(), direct_upload.msgid);
-                            profile::global::instance()
-                                .stats.records_upload_failed++;
-                        } else {
-                            if (dynamic_pointer_cast<
-                                    proto::command::direct_upload_url_base>(
-                                    ack_cmd)
-                                    ->status == "OK") {
-                                dynamic_pointer_cast<
-                                    proto::command::direct_upload_url_base>(
-                                    ack_cmd)
-                                    ->on_finished = direct_upload.on_finished;
-                                dynamic_pointer_cast<
-                                    proto::command::direct_upload_url_base>(
-                                    ack_cmd)
-                                    ->is_canceled = direct_upload.is_canceled;
-                            } else {
-                                logger->warn("Direct upload request error!");
-                                direct_upload.on_finished(false);
-                            }
-                        }
-                    },
-                    // Wait for reply with direct upload url for several seconds
-                    timeout);
+                _request_direct_upload_url(direct_upload);
                 return true;
             } else {
                 logger->warn("Unable to export record, skipping");
@@ -556,15 +632,106 @@ bool manager::_request_direct_upload_video(
     return false;
 }
 
-bool manager::_request_direct_upload_snapshot(
+//! @brief Gather record upload url request into the batch, the batch is sent
+//! when it's full or the batch window expired.
+void manager::_request_direct_upload_url(
     proto::get_direct_upload_url direct_upload) {
-    logger->info("Requesting direct upload url for {:.3f}Mb of {}",
-                 direct_upload.size / (double)(1024 * 1024),
-                 json(direct_upload.category).dump());
+    auto settings = profile::global::snapshot();
+
+    upload_url_batch_.push_back(std::move(direct_upload));
+
+    if (upload_url_batch_.size() >= settings->direct_upload_url_batch_size ||
+        settings->direct_upload_url_batch_window ==
+            std::chrono::milliseconds(0)) {
+        _flush_direct_upload_url_batch();
+    } else if (!upload_url_batch_timer_) {
+        upload_url_batch_timer_ = direct_upload_timer_->schedule_timed_cb(
+            [this]() {
+                upload_url_batch_timer_ = nullptr;
+                _flush_direct_upload_url_batch();
+            },
+            settings->direct_upload_url_batch_window.count());
+    }
+}
 
-    // Request upload URL
-    send_command(json(direct_upload));
-    return true;
+//! @brief Send gathered record upload url requests as single
+//! get_direct_upload_url command, first request is the command itself, the
+//! rest are in the extra list.
+void manager::_flush_direct_upload_url_batch() {
+    if (upload_url_batch_timer_) {
+        direct_upload_timer_->cancel_timed_cb(upload_url_batch_timer_);
+        upload_url_batch_timer_ = nullptr;
+    }
+
+    if (upload_url_batch_.empty())
+        return;
+
+    std::vector<proto::get_direct_upload_url> batch;
+    batch.swap(upload_url_batch_);
+
+    proto::get_direct_upload_url request = batch.front();
+    for (size_t i = 1; i < batch.size(); i++)
+        request.extra.push_back(batch[i]);
+
+    logger->info("Sending upload url request for {} records, id {}",
+                 batch.size(), request.msgid);
+
+    auto timeout = std::chrono::seconds(20);
+    // Request upload URLs, wait for reply for timeout
+    send_command_wait_ack(
+        request,
+        [=](bool timedout, proto::command::base_command::ptr ack_cmd) {
+            _on_direct_upload_url_batch_reply(batch, timedout, timeout,
+                                              ack_cmd);
+        },
+        timeout);
+}
+
+//! @brief Correlate direct_upload_url reply entries with the batched
+//! requests, the reply's extra list has the same order as the request's one.
+void manager::_on_direct_upload_url_batch_reply(
+    const std::vector<proto::get_direct_upload_url>& batch,
+    bool timedout,
+    std::chrono::seconds timeout,
+    proto::command::base_command::ptr ack_cmd) {
+    auto reply =
+        dynamic_pointer_cast<proto::command::direct_upload_url>(ack_cmd);
+    // Reply with bad status is dropped by the command handler with all the
+    // extra entries
+    bool reply_ok = !timedout && reply != nullptr && reply->status == "OK";
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        const auto& direct_upload = batch[i];
+        proto::command::direct_upload_url_base* entry = nullptr;
+
+        if (reply_ok) {
+            if (i == 0)
+                entry = reply.get();
+            else if (i - 1 < reply->extra.size())
+                entry = &reply->extra[i - 1];
+        }
+
+        // If no direct_upload_url was received from the Cloud
+        if (timedout) {
+            direct_upload.on_finished(false);
+            // Drop record
+            records_.erase(direct_upload.msgid);
+            logger->warn(
+                "No reply for record direct upload request after {} seconds, "
+                "dropping record {}.",
+                timeout.count(), direct_upload.msgid);
+            profile::global::instance().stats.records_upload_failed++;
+        } else if (entry && entry->status == "OK") {
+            entry->on_finished = direct_upload.on_finished;
+            entry->is_canceled = direct_upload.is_canceled;
+            entry->upload_refid = direct_upload.msgid;
+        } else {
+            logger->warn("Direct upload request {} error!",
+                         direct_upload.msgid);
+            records_.erase(direct_upload.msgid);
+            direct_upload.on_finished(false);
+        }
+    }
 }
 
 bool manager::direct_upload_sync_cb() {
@@ -573,67 +740,80 @@ bool manager::direct_upload_sync_cb() {
         logger->debug(
             "Direct upload scheduler awaken, current uploads {} pre uploads "
             "{} max uploads {} planned uploads {}",
-            profile::global::instance().stats.records_uploading,
+            profile::global::instance().stats.records_uploading.load(),
             records_.size(),
-            profile::global::instance().max_concurent_video_uploads,
-            direct_upload_video_q_.size());
+            profile::global::snapshot()->max_concurent_video_uploads,
+            direct_upload_q_.size());
 
-    // Delete late uploads
-    _update_direct_upload_queue_latency();
-
-    profile::global::instance().stats.records_upload_queued =
-        direct_upload_video_q_.size();
-
-    if (registered_) {
-        while (profile::global::instance().stats.records_uploading <
-                   profile::global::instance().max_concurent_video_uploads &&
-               direct_upload_video_q_.size() > 0 &&
-               records_.size() <
-                   profile::global::instance().max_concurent_video_uploads) {
-            auto direct_upload_obj = direct_upload_video_q_.front();
-            direct_upload_video_q_.pop_front();
-
-            if (direct_upload_obj.is_canceled()) {
-                logger->info("Planned direct upload id {} canceled.",
-                             direct_upload_obj.msgid);
-                continue;
-            }
-
-            if (direct_upload_obj.category == proto::UC_RECORD)
-                if (_request_direct_upload_video(direct_upload_obj))
-                    break;
-        }
-    }
+    _dispatch_direct_uploads();
 
     timed_cb_direct_uploader_ = direct_upload_timer_->schedule_timed_cb(
         [=] { direct_upload_sync_cb(); }, 1000);
     return true;
 }
 
-//! @brief Delete all planned direct upload requests older than allowed
-void manager::_update_direct_upload_queue_latency() {
-    direct_upload_video_q_.erase(
-        std::remove_if(
-            direct_upload_video_q_.begin(), direct_upload_video_q_.end(),
-            [&](const proto::get_direct_upload_url& upload) {
-                bool late = (utils::time::from_iso_packed(upload.file_time) <
-                             (utils::time::now() -
-                              profile::global::instance()
-                                  .max_video_uploads_queue_lateness)) &&
-                            upload.memorycard_sync_ticket.empty();
-                if (late) {
-                    logger->info("Drop too late planned direct upload id {}",
-                                 upload.msgid);
-                    upload.on_finished(false);
-                    profile::global::instance().stats.records_upload_failed++;
-                }
-                return late;
-            }),
-        direct_upload_video_q_.end());
+void manager::_configure_direct_upload_scheduler() {
+    auto settings = profile::global::snapshot();
+    size_t timeline_quota = std::min(settings->max_concurent_timeline_uploads,
+                                     settings->max_concurent_video_uploads);
+
+    direct_upload_q_.set_max_in_flight(settings->max_concurent_uploads);
+    direct_upload_q_.set_aging_step(settings->upload_priority_aging_step);
+    direct_upload_q_.configure(upload_scheduler::UPC_SNAPSHOT,
+                               settings->max_concurent_snapshot_uploads,
+                               settings->max_snapshot_uploads_queue_lateness);
+    direct_upload_q_.configure(upload_scheduler::UPC_FILE_META,
+                               settings->max_concurent_file_meta_uploads,
+                               settings->max_file_meta_uploads_queue_lateness);
+    // Records deadlines are calculated from the record time, see
+    // _schedule_direct_upload()
+    direct_upload_q_.configure(upload_scheduler::UPC_EVENT_RECORD,
+                               settings->max_concurent_video_uploads,
+                               cloud::duration(0));
+    direct_upload_q_.configure(upload_scheduler::UPC_TIMELINE_RECORD,
+                               timeline_quota, cloud::duration(0));
+}
+
+//! @brief Put the upload task into the scheduler and kick it, serialized by
+//! the direct upload timer.
+void manager::_enqueue_direct_upload(upload_scheduler::task task) {
+    direct_upload_timer_->schedule_timed_cb(
+        [=]() {
+            direct_upload_q_.push(task);
+            _dispatch_direct_uploads();
+        },
+        0);
+}
+
+//! @brief Release the upload slot and start the next planned upload,
+//! serialized by the direct upload timer.
+void manager::_release_direct_upload_slot(
+    upload_scheduler::release_cb release) {
+    direct_upload_timer_->schedule_timed_cb(
+        [=]() {
+            release();
+            _dispatch_direct_uploads();
+        },
+        0);
+}
+
+//! @brief Drop all planned uploads older than allowed, start the most urgent
+//! planned uploads if there are free upload slots.
+void manager::_dispatch_direct_uploads() {
+    direct_upload_q_.drop_late();
+
+    profile::global::instance().stats.records_upload_queued =
+        direct_upload_q_.size(upload_scheduler::UPC_EVENT_RECORD) +
+        direct_upload_q_.size(upload_scheduler::UPC_TIMELINE_RECORD);
+
+    if (registered_)
+        direct_upload_q_.dispatch();
 }
 
 bool manager::_schedule_direct_upload(
     proto::get_direct_upload_url get_upload_url) {
+    upload_scheduler::task task;
+
     get_upload_url.cam_id = cm_config_.cam_id;
 
     if (get_upload_url.is_canceled()) {
@@ -642,43 +822,54 @@ bool manager::_schedule_direct_upload(
         return false;
     }
 
-    auto f = std::bind(
-        [=](proto::get_direct_upload_url direct_upload_req) {
-            logger->info("Enqueue {} id {} to direct upload queue",
-                         direct_upload_req.category == proto::UC_RECORD
-                             ? "record"
-                             : "snapshot",
-                         direct_upload_req.msgid);
-
-            if (direct_upload_req.category == proto::UC_RECORD)
-                direct_upload_video_q_.push_back(direct_upload_req);
-            else if (direct_upload_req.category == proto::UC_SNAPSHOT)
-                direct_upload_snapshot_q_.push_back(direct_upload_req);
-            else
-                logger->warn("Can't enqueue {} for direct upload",
-                             json(direct_upload_req.category).dump());
-        },
-        get_upload_url);
+    if (get_upload_url.category != proto::UC_RECORD) {
+        logger->warn("Can't enqueue {} for direct upload",
+                     json(get_upload_url.category).dump());
+        return false;
+    }
 
-    // FIXME:
-    direct_upload_timer_->schedule_timed_cb(f, 1);
+    logger->info("Enqueue {} record id {} to direct upload queue",
+                 get_upload_url.periodic ? "timeline" : "event",
+                 get_upload_url.msgid);
+
+    task.cls = get_upload_url.periodic ? upload_scheduler::UPC_TIMELINE_RECORD
+                                       : upload_scheduler::UPC_EVENT_RECORD;
+    task.ticket = get_upload_url.memorycard_sync_ticket;
+    task.is_canceled = get_upload_url.is_canceled;
+    // Memorycard synchronization uploads are never late
+    if (get_upload_url.memorycard_sync_ticket.empty())
+        task.deadline =
+            utils::time::from_iso_packed(get_upload_url.file_time) +
+            profile::global::snapshot()->max_video_uploads_queue_lateness;
+    task.drop = [=]() {
+        logger->info("Drop planned direct upload id {}",
+                     get_upload_url.msgid);
+        get_upload_url.on_finished(false);
+        profile::global::instance().stats.records_upload_failed++;
+    };
+    task.start = [=](upload_scheduler::release_cb release) {
+        proto::get_direct_upload_url upload = get_upload_url;
+        auto on_finished = get_upload_url.on_finished;
+
+        // Record's upload slot is busy since export until upload finished
+        upload.on_finished = [=](bool ok) {
+            on_finished(ok);
+            _release_direct_upload_slot(release);
+        };
+
+        return _request_direct_upload_video(upload);
+    };
+
+    _enqueue_direct_upload(task);
     return true;
 }
 
 bool manager::_cancel_direct_uploads_by_ticket(std::string ticket) {
     auto f = std::bind(
         [&](std::string ticket) {
-            auto new_end = std::remove_if(
-                direct_upload_video_q_.begin(), direct_upload_video_q_.end(),
-                [&](const proto::get_direct_upload_url& upload) {
-                    bool cancel = (!upload.memorycard_sync_ticket.empty() &&
-                                   (ticket == upload.memorycard_sync_ticket));
-                    if (cancel)
-                        logger->info("Canceling planned record upload id {}",
-                                     upload.msgid);
-                    return cancel;
-                });
-            direct_upload_video_q_.erase(new_end, direct_upload_video_q_.end());
+            size_t canceled = direct_upload_q_.cancel_by_ticket(ticket);
+            if (canceled)
+                logger->info("Canceled {} planned record uploads", canceled);
         },
         ticket);
 
@@ -754,20 +945,21 @@ bool manager::_handle_stream_stateless_event(
 bool manager::handle_event_snapshot(proto::event_object& event) {
     proto::event_config eventConfig;
 
+    auto settings = profile::global::snapshot();
+    auto& stats = profile::global::instance().stats;
+    size_t uploading = stats.snapshots_uploading;
+
     // We do not concurrently upload more snapshots than allowed
     // by the user for preventing OOM
-    if (profile::global::instance().stats.snapshots_uploading >=
-            profile::global::instance().max_concurent_snapshot_uploads ||
-        snapshots_.size() >
-            profile::global::instance().max_concurent_snapshot_uploads) {
-        profile::global::instance().stats.snapshots_upload_failed++;
+    if (uploading >= settings->max_concurent_snapshot_uploads ||
+        snapshots_.size() > settings->max_concurent_snapshot_uploads) {
+        stats.snapshots_upload_failed++;
         logger->warn(
             "No space in snapshot upload queue, currently "
             "uploading {} in pre upload queue {} max allowed {}, "
             "generating event without snapshot!",
-            profile::global::instance().stats.snapshots_uploading,
-            snapshots_.size(),
-            profile::global::instance().max_concurent_snapshot_uploads);
+            uploading, snapshots_.size(),
+            settings->max_concurent_snapshot_uploads);
         return false;
     }
 
@@ -786,17 +978,28 @@ bool manager::handle_event_snapshot(proto::event_object& event) {
 
         event.snapshot_info.width =
             __is_unset(event.snapshot_info.width)
-                ? profile::global::instance().default_snapshot_width
+                ? settings->default_snapshot_width
                 : event.snapshot_info.width;
         event.snapshot_info.height =
             __is_unset(event.snapshot_info.height)
-                ? profile::global::instance().default_snapshot_height
+                ? settings->default_snapshot_height
                 : event.snapshot_info.height;
 
+        auto cache = snapshot_stream_ ? snapshot_stream_->get_snapshot_cache()
+                                      : nullptr;
+        if (cache && cache->get_snapshot(utils::time::from_double(event.time),
+                                         event.snapshot_info)) {
+            // Cached keyframe nearest to the event time, no waiting for the
+            // stream, image time is the event trigger time as below
+            event.snapshot_info.image_time = utils::time::to_iso_packed(
+                utils::time::from_double(event.time));
+            return true;
+        }
+
         if (snapshot_stream_) {
             if (!snapshot_stream_->get_snapshot(event.snapshot_info)) {
                 logger->warn("Unable to get snapshot");
-                profile::global::instance().stats.snapshots_capture_failed++;
+                stats.snapshots_capture_failed++;
             } else {
                 // VXG Cloud doc states we have to use event trigger time as
                 // an image time
@@ -805,7 +1008,7 @@ bool manager::handle_event_snapshot(proto::event_object& event) {
                 return true;
             }
         } else {
-            profile::global::instance().stats.snapshots_capture_failed++;
+            stats.snapshots_capture_failed++;
             logger->warn("No streams to take snapshot");
         }
     }
@@ -832,18 +1035,19 @@ bool manager::handle_event_meta_file(proto::event_object& event) {
         // by the user for preventing OOM and spamming http transport instance,
         // which uploads everything in a round-robin manier, too many meta files
         // may significantly slow down the overall upload speed
-        if (profile::global::instance().stats.file_meta_uploading >=
-                profile::global::instance().max_concurent_file_meta_uploads ||
-            meta_files_.size() >
-                profile::global::instance().max_concurent_file_meta_uploads) {
-            profile::global::instance().stats.file_meta_upload_failed++;
+        auto settings = profile::global::snapshot();
+        auto& stats = profile::global::instance().stats;
+        size_t uploading = stats.file_meta_uploading;
+
+        if (uploading >= settings->max_concurent_file_meta_uploads ||
+            meta_files_.size() > settings->max_concurent_file_meta_uploads) {
+            stats.file_meta_upload_failed++;
             logger->trace(
                 "No space in file meta upload queue, currently "
                 "uploading {} in pre upload queue {} max allowed {}, "
                 "generating event without file meta!",
-                profile::global::instance().stats.file_meta_uploading,
-                meta_files_.size(),
-                profile::global::instance().max_concurent_file_meta_uploads);
+                uploading, meta_files_.size(),
+                settings->max_concurent_file_meta_uploads);
             return false;
         }
 
@@ -875,7 +1079,7 @@ bool manager::__notify_record_event(std::string stream_id, bool on) {
         // Append camera id
         event_command.cam_id = cm_config_.cam_id;
 
-        return send_command(json(event_command));
+        return send_command(event_command);
     }
 
     return false;
@@ -906,6 +1110,17 @@ manager::event_state::stream_delivery_mode manager::_current_delivery_mode() {
  * @return if event notification was successfull
  */
 bool manager::notify_event(proto::event_object event) {
+    if (resume_pending_) {
+        std::lock_guard<std::mutex> lock(queued_events_lock_);
+        // Recheck under the lock, the session may be resumed meanwhile
+        if (resume_pending_)
+            return _queue_event(event);
+    }
+
+    return _notify_event(std::move(event));
+}
+
+bool manager::_notify_event(proto::event_object event) {
     using namespace std::chrono;
     bool need_snapshot = false;
     bool need_meta = false;
@@ -945,7 +1160,7 @@ bool manager::notify_event(proto::event_object event) {
     /* check event info_ struct if presented/required */
     switch (event.event) {
         case proto::ET_MOTION:
-            if (profile::global::instance().attach_qos_report_to_motion) {
+            if (profile::global::snapshot()->attach_qos_report_to_motion) {
                 event.meta = profile::global::instance().stats;
             }
             break;
@@ -1051,8 +1266,8 @@ bool manager::notify_event(proto::event_object event) {
     need_snapshot = event_config.snapshot &&
                     (((event_config.caps.statefull && event.active) ||
                       !event_config.caps.statefull) ||
-                     (profile::global::instance()
-                          .stateful_event_continuation_kick_snapshot &&
+                     (profile::global::snapshot()
+                          ->stateful_event_continuation_kick_snapshot &&
                       event.state_dummy));
 
     if (need_snapshot && (need_snapshot = handle_event_snapshot(event))) {
@@ -1090,7 +1305,7 @@ bool manager::notify_event(proto::event_object event) {
         // upload url, we wait for this reply for several seconds and then
         // drop the snapshot
         return send_command_wait_ack(
-            json(*event_command),
+            *event_command,
             [=](bool timedout, proto::command::base_command::ptr not_used) {
                 if (timedout) {
                     if (need_snapshot)
@@ -1112,7 +1327,7 @@ bool manager::notify_event(proto::event_object event) {
             std::chrono::seconds(20));
     }
 
-    return send_command(json(*event_command));
+    return send_command(*event_command);
 }
 
 bool manager::on_direct_upload_url(const direct_upload_url_base& direct_upload,
@@ -1122,6 +1337,10 @@ bool manager::on_direct_upload_url(const direct_upload_url_base& direct_upload,
     std::string media_type;
     bool has_category = (direct_upload.category != UC_INVALID);
 
+    // Entry of the batched request's reply
+    if (!__is_unset(direct_upload.upload_refid))
+        refid = direct_upload.upload_refid;
+
     if (snapshots_.count(refid) &&
         ((has_category && direct_upload.category == UC_SNAPSHOT) ||
          (!has_category))) {
@@ -1254,8 +1473,65 @@ bool manager::on_direct_upload_url(const direct_upload_url_base& direct_upload,
             }
         });
 
-        req->max_upload_speed = profile::global::instance().max_upload_speed;
-        return http_->make(req);
+        auto settings = profile::global::snapshot();
+        req->max_upload_speed = settings->max_upload_speed;
+
+        // Record's upload slot was acquired by the scheduler before the export
+        if (media_type == "Record") {
+            size_t part_size = settings->direct_upload_part_size;
+
+            if (part_size && req->request_body_.size() > part_size) {
+                auto multipart = multipart_upload::create(
+                    http_, req, part_size, settings->direct_upload_parts_window,
+                    settings->direct_upload_part_retries);
+
+                logger->info("Uploading video chunk id {} in {} parts", refid,
+                             multipart->parts());
+
+                return multipart->start();
+            }
+
+            return http_->make(req);
+        }
+
+        upload_scheduler::task task;
+        task.cls = (media_type == "Snapshot") ? upload_scheduler::UPC_SNAPSHOT
+                                              : upload_scheduler::UPC_FILE_META;
+        task.is_canceled = direct_upload.is_canceled;
+        auto failed = [=]() {
+            direct_upload.on_finished(false);
+
+            if (media_type == "Snapshot") {
+                profile::global::instance().stats.snapshots_uploading--;
+                profile::global::instance().stats.snapshots_upload_failed++;
+            } else {
+                profile::global::instance().stats.file_meta_uploading--;
+                profile::global::instance().stats.file_meta_upload_failed++;
+            }
+        };
+        task.drop = failed;
+        task.start = [=](upload_scheduler::release_cb release) {
+            auto response_cb = req->response_;
+
+            req->set_response_cb([=](transport::Data& resp, int code) {
+                response_cb(resp, code);
+                _release_direct_upload_slot(release);
+            });
+
+            // Response callback is never called if the request was not made,
+            // the slot is released by the scheduler
+            if (!http_->make(req)) {
+                logger->error("Failed to start {} {} upload", media_type,
+                              refid);
+                failed();
+                return false;
+            }
+
+            return true;
+        };
+
+        _enqueue_direct_upload(task);
+        return true;
     } else {
         if (direct_upload.is_canceled())
             logger->info("Direct upload {} has been canceled.", refid);
@@ -1342,7 +1618,9 @@ void manager::_cancel_periodic_events(const proto::events_config& events) {
 }
 
 void manager::_append_internal_custom_events(proto::events_config& config) {
-    if (profile::global::instance().send_qos_report_as_separate_event) {
+    auto settings = profile::global::snapshot();
+
+    if (settings->send_qos_report_as_separate_event) {
         logger->info("Append QOS event to events config");
 
         std::vector<proto::event_config> conf_list;
@@ -1351,8 +1629,7 @@ void manager::_append_internal_custom_events(proto::events_config& config) {
         qos_event_config.event = proto::ET_CUSTOM;
         qos_event_config.custom_event_name = "qos-report";
         qos_event_config.active = true;
-        qos_event_config.period =
-            profile::global::instance().send_qos_report_period_sec;
+        qos_event_config.period = settings->send_qos_report_period_sec;
         qos_event_config.snapshot = false;
         qos_event_config.stream = false;
 
@@ -1557,9 +1834,14 @@ void manager::_load_events_configs(proto::events_config& config) {
 bool manager::on_get_cam_events_config(proto::events_config& config) {
     bool result = true;
 
+    // Resumed session's event streams are running with the actual config
+    bool resumed = session_resumed_ && event_streams_running_;
+
     // Stop all events providers
-    _cancel_periodic_events(events_config_);
-    _stop_all_event_streams();
+    if (!resumed) {
+        _cancel_periodic_events(events_config_);
+        _stop_all_event_streams();
+    }
 
     // Load events configs and caps before applying new settings
     if (events_config_.events.empty())
@@ -1573,6 +1855,11 @@ bool manager::on_get_cam_events_config(proto::events_config& config) {
             [](proto::event_config& ec) { return ec.caps.internal_hidden; }),
         config.events.end());
 
+    if (resumed) {
+        logger->debug("Event streams of the resumed session kept running");
+        return result;
+    }
+
     // Start sending events only after get_events command will be sent to the
     // Cloud. This is ugly since we schedule it to run after one second but
     // there is no other way to postpone it rn.
@@ -1584,14 +1871,8 @@ bool manager::on_get_cam_events_config(proto::events_config& config) {
 
             // Start event streams if required, event providers must immediately
             // notify states of all statefull events
-            if (events_config_.enabled) {
-                for (auto& event_stream : event_streams_) {
-                    logger->info("Start event stream {}", event_stream->name());
-                    event_stream->set_notification_cb(std::bind(
-                        &manager::notify_event, this, placeholders::_1));
-                    event_stream->start();
-                }
-            }
+            if (events_config_.enabled)
+                _start_all_event_streams();
             // TODO: move memorycard event to internal events
             _update_storage_status();
         },
@@ -1601,6 +1882,16 @@ bool manager::on_get_cam_events_config(proto::events_config& config) {
 }
 
 bool manager::on_set_cam_events_config(const proto::events_config& config) {
+    size_t config_hash = std::hash<std::string>()(json(config).dump());
+
+    // Same config is set again for the resumed session, nothing to apply
+    if (session_resumed_ && event_streams_running_ &&
+        config_hash == events_config_hash_) {
+        logger->debug("Events config of the resumed session is not changed");
+        return callback_->on_set_cam_events_config(events_config_);
+    }
+    events_config_hash_ = config_hash;
+
     // Disable all periodic events to apply new settings
     _cancel_periodic_events(events_config_);
     _stop_all_event_streams();
@@ -1627,14 +1918,8 @@ bool manager::on_set_cam_events_config(const proto::events_config& config) {
         _init_events_states(events_config_);
 
     // Start/stop event streams according to global 'enabled' flag
-    if (config.enabled) {
-        for (auto& event_stream : event_streams_) {
-            logger->info("Start event stream {}", event_stream->name());
-            event_stream->set_notification_cb(
-                std::bind(&manager::notify_event, this, placeholders::_1));
-            event_stream->start();
-        }
-    }
+    if (config.enabled)
+        _start_all_event_streams();
 
     // Reschedule periodic events with new settings
     _schedule_periodic_events(events_config_);
@@ -1699,10 +1984,25 @@ void manager::_stop_all_streams(bool sync) {
     }
 }
 
+void manager::_start_all_event_streams() {
+    _configure_event_coalescer();
+
+    for (auto& event_stream : event_streams_) {
+        logger->info("Start event stream {}", event_stream->name());
+        event_stream->set_notification_cb(
+            std::bind(&manager::_coalesce_event, this, placeholders::_1));
+        event_stream->start();
+    }
+
+    event_streams_running_ = true;
+}
+
 void manager::_stop_all_event_streams() {
     for (auto& s : event_streams_) {
         s->stop();
     }
+    event_streams_running_ = false;
+    _clear_coalesced_events();
 
     // Loop over all event states and stop all active statefull events
     auto now = utils::time::now();
@@ -1716,6 +2016,126 @@ void manager::_stop_all_event_streams() {
     }
 }
 
+static event_coalescer::config __coalescer_config(
+    const profile::description::event_coalescing& c) {
+    event_coalescer::config conf;
+
+    conf.debounce = c.debounce;
+    conf.max_delay = c.max_delay;
+    conf.rate = c.max_rate;
+    conf.burst = c.burst;
+    conf.merge = c.merge;
+
+    return conf;
+}
+
+void manager::_configure_event_coalescer() {
+    auto settings = profile::global::snapshot();
+    std::lock_guard<std::mutex> lock(event_coalescer_lock_);
+
+    event_coalescer_.set_default_config(
+        __coalescer_config(settings->default_event_coalescing));
+    for (auto& c : settings->event_coalescing_by_event)
+        event_coalescer_.configure(c.first, __coalescer_config(c.second));
+}
+
+//! Event streams notification callback, events released by the coalescer are
+//! passed to notify_event(), the held ones are released by the timer.
+bool manager::_coalesce_event(proto::event_object event) {
+    std::vector<proto::event_object> released;
+    proto::event_config event_config;
+    bool stateful = events_config_.get_event_config(event, event_config) &&
+                    event_config.caps.statefull;
+    bool result = true;
+
+    {
+        std::lock_guard<std::mutex> lock(event_coalescer_lock_);
+        event_coalescer_.push(std::move(event), stateful, released);
+        _schedule_coalesced_events_flush(released);
+    }
+
+    for (auto& e : released)
+        result &= notify_event(std::move(e));
+
+    return result;
+}
+
+void manager::_flush_coalesced_events() {
+    std::vector<proto::event_object> released;
+
+    {
+        std::lock_guard<std::mutex> lock(event_coalescer_lock_);
+        event_coalescer_timer_ = nullptr;
+        event_coalescer_timer_due_ = utils::time::max();
+        event_coalescer_.flush(released);
+        _schedule_coalesced_events_flush(released);
+
+        if (!released.empty())
+            logger->debug(
+                "Releasing {} coalesced events, {} merged, {} dropped so far",
+                released.size(), event_coalescer_.merged(),
+                event_coalescer_.dropped());
+    }
+
+    for (auto& e : released)
+        notify_event(std::move(e));
+}
+
+//! Must be called with the event_coalescer_lock_ held, if the timer can't be
+//! scheduled the held events are released to @p released immediately
+void manager::_schedule_coalesced_events_flush(
+    std::vector<proto::event_object>& released) {
+    using namespace std::chrono;
+    cloud::time due = event_coalescer_.next_due();
+
+    // Already scheduled timer will flush earlier
+    if (due == utils::time::max() ||
+        (event_coalescer_timer_ && due >= event_coalescer_timer_due_))
+        return;
+
+    if (event_coalescer_timer_)
+        transport_->cancel_timed_cb(event_coalescer_timer_);
+
+    // Round up, the timer fired before the due time would reschedule itself
+    auto delay = duration_cast<milliseconds>(due - utils::time::now() +
+                                             milliseconds(1) - nanoseconds(1));
+    event_coalescer_timer_due_ = due;
+    event_coalescer_timer_ = transport_->schedule_timed_cb(
+        [this]() { _flush_coalesced_events(); },
+        std::max<int64_t>(delay.count(), 0));
+
+    if (!event_coalescer_timer_) {
+        logger->warn("Failed to schedule coalesced events flush, releasing "
+                     "{} held events now",
+                     event_coalescer_.held());
+        event_coalescer_timer_due_ = utils::time::max();
+        event_coalescer_.flush(released, utils::time::max());
+    }
+}
+
+//! Release all held events and reset the coalescer
+void manager::_clear_coalesced_events() {
+    std::vector<proto::event_object> released;
+
+    {
+        std::lock_guard<std::mutex> lock(event_coalescer_lock_);
+
+        if (event_coalescer_timer_) {
+            transport_->cancel_timed_cb(event_coalescer_timer_);
+            event_coalescer_timer_ = nullptr;
+        }
+        event_coalescer_timer_due_ = utils::time::max();
+        event_coalescer_.flush(released, utils::time::max());
+        event_coalescer_.clear();
+    }
+
+    if (!released.empty())
+        logger->debug("Releasing {} held events on stop", released.size());
+
+    for (auto& e : released)
+        notify_event(std::move(e));
+}
+
 void manager::_stop_stream(stream::ptr s, bool sync) {
     if (!sync) {
         // Stream stop should always be serialized with transport rx thread.
@@ -2118,8 +2538,9 @@ bool manager::on_get_supported_streams(
 
 bool manager::on_update_preview(std::string url) {
     proto::event_object::snapshot_info_object info;
-    info.width = profile::global::instance().default_snapshot_width;
-    info.height = profile::global::instance().default_snapshot_height;
+    auto settings = profile::global::snapshot();
+    info.width = settings->default_snapshot_width;
+    info.height = settings->default_snapshot_height;
 
     if (snapshot_stream_ == nullptr) {
         logger->warn("No snapshot stream for preview");
@@ -2131,7 +2552,9 @@ bool manager::on_update_preview(std::string url) {
         return false;
     }
 
-    if (!snapshot_stream_->get_snapshot(info)) {
+    auto cache = snapshot_stream_->get_snapshot_cache();
+    if ((!cache || !cache->get_snapshot(utils::time::now(), info)) &&
+        !snapshot_stream_->get_snapshot(info)) {
         logger->error("Unable to get preview snapshot");
         return false;
     }
@@ -2228,14 +2651,11 @@ bool manager::on_get_stream_by_event(proto::stream_by_event_config& conf) {
     conf.post_event = post_record_time_.count();
 
     using namespace std::chrono;
+    auto settings = profile::global::snapshot();
     conf.caps.post_event_max =
-        duration_cast<milliseconds>(
-            profile::global::instance().default_pre_record_time)
-            .count();
+        duration_cast<milliseconds>(settings->default_pre_record_time).count();
     conf.caps.pre_event_max =
-        duration_cast<milliseconds>(
-            profile::global::instance().default_pre_record_time)
-            .count();
+        duration_cast<milliseconds>(settings->default_pre_record_time).count();
 
     return true;
 }
@@ -2,13 +2,17 @@
 
 #include <agent-proto/command-handler.h>
 #include <agent/callback.h>
+#include <agent/event-coalescer.h>
 #include <agent/event-stream.h>
 #include <agent/manager-config.h>
+#include <agent/multipart-upload.h>
 #include <cloud/CloudShareConnection.h>
 
 #include <agent/stream.h>
+#include <agent/upload-scheduler.h>
 #include <agent/upload.h>
 #include <net/http.h>
+#include <utils/backoff.h>
 #include <utils/logging.h>
 
 namespace vxg {
@@ -47,9 +51,9 @@ private:
     bool stream_by_event_ {false};
     bool continuos_direct_record_ {false};
     std::chrono::milliseconds pre_record_time_ {
-        profile::global::instance().default_pre_record_time};
+        profile::global::snapshot()->default_pre_record_time};
     std::chrono::milliseconds post_record_time_ {
-        profile::global::instance().default_post_record_time};
+        profile::global::snapshot()->default_post_record_time};
     agent::media::stream::ptr record_stream_ {nullptr};
     agent::media::stream::ptr live_stream_ {nullptr};
     agent::media::stream::ptr snapshot_stream_ {nullptr};
@@ -57,10 +61,34 @@ private:
     transport::timed_cb_ptr timed_cb_direct_uploader_;
     proto::event_object::memorycard_info_object memorycard_info_;
     callback::ptr callback_ {nullptr};
-    std::deque<proto::get_direct_upload_url> direct_upload_video_q_;
-    std::deque<proto::get_direct_upload_url> direct_upload_snapshot_q_;
+    upload_scheduler direct_upload_q_;
+    //! Record upload url requests waiting for the batched
+    //! get_direct_upload_url command
+    std::vector<proto::get_direct_upload_url> upload_url_batch_;
+    transport::timed_cb_ptr upload_url_batch_timer_;
     std::map<std::string, transport::timed_cb_ptr> periodic_events_;
     agent::segmented_uploader::ptr uploader_;
+    utils::decorrelated_backoff reconnect_backoff_ {
+        std::chrono::milliseconds(
+            profile::global::snapshot()->reconnect_backoff_base_ms),
+        std::chrono::milliseconds(
+            profile::global::snapshot()->reconnect_backoff_cap_ms)};
+    //! Session is lost but may be resumed, event streams are kept running and
+    //! their events are queued until the cam_hello
+    std::atomic<bool> resume_pending_ {false};
+    transport::timed_cb_ptr resume_expire_timer_;
+    std::deque<proto::event_object> queued_events_;
+    std::mutex queued_events_lock_;
+    std::atomic<bool> event_streams_running_ {false};
+    //! Merges and rate limits the event streams notifications before
+    //! notify_event()
+    event_coalescer event_coalescer_;
+    std::mutex event_coalescer_lock_;
+    transport::timed_cb_ptr event_coalescer_timer_;
+    cloud::time event_coalescer_timer_due_ {utils::time::max()};
+    //! Hash of the last applied events config, same config set again for the
+    //! resumed session doesn't restart event streams
+    size_t events_config_hash_ {0};
 
     struct event_state {
         vxg::logger::logger_ptr logger = vxg::logger::instance("event-state");
@@ -92,8 +120,8 @@ private:
         segmented_uploader::ptr uploader_;
 
         const cloud::duration RECORDS_UPLOAD_START_DELAY =
-            profile::global::instance()
-                .delay_between_event_and_records_upload_start;
+            profile::global::snapshot()
+                ->delay_between_event_and_records_upload_start;
 
     public:
         enum stream_delivery_mode { SDM_NONE, SDM_UPLOAD, SDM_STREAM };
@@ -375,7 +403,7 @@ private:
             segmenter_->end = stop_;
             segmenter_->cur_seg_start = start_ - pre;
             segmenter_->step =
-                profile::global::instance().record_by_event_upload_step;
+                profile::global::snapshot()->record_by_event_upload_step;
             segmenter_->cur_seg_stop =
                 std::min(start_ + segmenter_->step, stop_ != utils::time::null()
                                                         ? stop_ + post
@@ -388,6 +416,9 @@ private:
             segmenter_->realtime = realtime;
             segmenter_->delay = delay;
             segmenter_->last_processed_time = utils::time::now();
+            segmenter_->trigger = event;
+            // Internal events are periodic timeline uploads
+            segmenter_->periodic = caps_.internal_hidden;
 
             logger->debug(
                 "New segmenter {} - {}, cur_seg {} - {}, pre: {}, post: {}, "
@@ -566,6 +597,7 @@ protected:
     void set_event_streams(std::vector<event_stream::ptr> streams);
 
     bool notify_event(proto::event_object event);
+    bool _notify_event(proto::event_object event);
 
     // Storage status event trigger
     bool _update_storage_status();
@@ -574,6 +606,20 @@ protected:
     void _stop_all_streams(bool sync = false);
     void _stop_stream(agent::media::stream::ptr s, bool sync = false);
     void _stop_all_event_streams();
+    void _start_all_event_streams();
+
+    // Event streams notifications coalescing
+    void _configure_event_coalescer();
+    bool _coalesce_event(proto::event_object event);
+    void _flush_coalesced_events();
+    void _schedule_coalesced_events_flush(
+        std::vector<proto::event_object>& released);
+    void _clear_coalesced_events();
+
+    // Session resuming
+    bool _queue_event(const proto::event_object& event);
+    void _resume_session(bool resumed);
+    void _expire_session_resume();
 
     // Periodic events internals
     void _schedule_periodic_events(proto::events_config& events_conf);
@@ -613,9 +659,17 @@ protected:
     bool _cancel_direct_uploads_by_ticket(std::string ticket);
     bool _request_direct_upload_video(
         proto::get_direct_upload_url direct_upload);
-    bool _request_direct_upload_snapshot(
-        proto::get_direct_upload_url direct_upload);
-    void _update_direct_upload_queue_latency();
+    void _request_direct_upload_url(proto::get_direct_upload_url direct_upload);
+    void _flush_direct_upload_url_batch();
+    void _on_direct_upload_url_batch_reply(
+        const std::vector<proto::get_direct_upload_url>& batch,
+        bool timedout,
+        std::chrono::seconds timeout,
+        proto::command::base_command::ptr ack_cmd);
+    void _configure_direct_upload_scheduler();
+    void _enqueue_direct_upload(upload_scheduler::task task);
+    void _release_direct_upload_slot(upload_scheduler::release_cb release);
+    void _dispatch_direct_uploads();
     bool direct_upload_sync_cb();
 
     agent::media::stream::ptr lookup_stream(std::string name);
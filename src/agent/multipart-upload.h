@@ -0,0 +1,258 @@
+#pragma once
+
+#include <net/http.h>
+#include <utils/logging.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vxg {
+namespace cloud {
+namespace agent {
+
+//! @brief Sliding window multi-part upload of the single request body.
+//!
+//! Single PUT upload speed is bound by the connection's bandwidth-delay
+//! product, on high-latency links one clip utilizes only a fraction of the
+//! available bandwidth. The body of the request is split into parts, each
+//! part is uploaded with its own PUT request with the Content-Range header to
+//! the original url, up to window parts are in flight at the same time. Next
+//! part is started as soon as any of the in-flight parts finished. Failed
+//! parts are retried, the upload fails if any part failed after all retries.
+//!
+//! When all parts landed the original request's response callback is called
+//! with code 200 and the upload stats filled as if the body was uploaded with
+//! the single request, on failure it's called with the failed part's code.
+class multipart_upload
+    : public std::enable_shared_from_this<multipart_upload> {
+    vxg::logger::logger_ptr logger {
+        vxg::logger::instance("multipart-upload")};
+
+    using http = transport::libwebsockets::http;
+
+    std::shared_ptr<http> http_;
+    http::request_ptr whole_;
+    size_t part_size_;
+    size_t window_;
+    size_t retries_;
+
+    std::mutex lock_;
+    size_t parts_total_ {0};
+    size_t next_part_ {0};
+    size_t parts_done_ {0};
+    size_t in_flight_ {0};
+    std::vector<size_t> attempts_;
+    bool failed_ {false};
+    int failed_code_ {-1};
+    bool finished_ {false};
+
+    multipart_upload(std::shared_ptr<http> h,
+                     http::request_ptr whole,
+                     size_t part_size,
+                     size_t window,
+                     size_t retries)
+        : http_ {h},
+          whole_ {whole},
+          part_size_ {std::max<size_t>(part_size, 1)},
+          window_ {std::max<size_t>(window, 1)},
+          retries_ {retries} {
+        size_t total = whole_->request_body_.size();
+
+        parts_total_ = (total + part_size_ - 1) / part_size_;
+        attempts_.assign(parts_total_, 0);
+    }
+
+    static bool __is_ok(int code) { return code == 200 || code == 201; }
+
+    http::request_ptr __make_part(size_t part) {
+        size_t total = whole_->request_body_.size();
+        size_t offset = part * part_size_;
+        size_t len = std::min(part_size_, total - offset);
+        auto req = std::make_shared<http::request>(
+            whole_->url_, whole_->method_,
+            whole_->request_body_.substr(offset, len), whole_->timeout_s_);
+
+        req->headers_ = whole_->headers_;
+        req->headers_["Content-Range:"] =
+            "bytes " + std::to_string(offset) + "-" +
+            std::to_string(offset + len - 1) + "/" + std::to_string(total);
+        // Keep the overall upload speed limit
+        req->max_upload_speed = whole_->max_upload_speed / window_;
+
+        auto self = shared_from_this();
+        req->set_response_cb([self, part](transport::Data& resp, int code) {
+            self->__on_part_finished(part, resp, code);
+        });
+
+        return req;
+    }
+
+    //! Reserve the parts to fill the window, must be called with the lock_
+    //! held
+    void __fill_window(std::vector<size_t>& parts) {
+        while (!failed_ && in_flight_ < window_ && next_part_ < parts_total_) {
+            size_t part = next_part_++;
+
+            attempts_[part]++;
+            in_flight_++;
+            parts.push_back(part);
+        }
+    }
+
+    //! Finalize when all parts landed or when the last in-flight part of the
+    //! failed upload finished, must be called with the lock_ held
+    bool __check_finished(int& code) {
+        if (finished_ ||
+            !((parts_done_ == parts_total_) || (failed_ && in_flight_ == 0)))
+            return false;
+
+        finished_ = true;
+        code = failed_ ? failed_code_ : 200;
+
+        return true;
+    }
+
+    //! Fail the upload and release @p n reserved parts which were not started
+    void __release_parts(size_t n) {
+        bool done = false;
+        int code = -1;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+
+            in_flight_ -= n;
+            failed_ = true;
+            done = __check_finished(code);
+        }
+
+        if (done) {
+            transport::Data resp;
+            __finalize(resp, code);
+        }
+    }
+
+    //! Start the reserved parts, must be called without the lock_ held
+    void __start_parts(const std::vector<size_t>& parts) {
+        for (size_t i = 0; i < parts.size(); i++) {
+            if (!http_->make(__make_part(parts[i]))) {
+                logger->error("Failed to start part {}/{} of {}",
+                              parts[i] + 1, parts_total_, whole_->url_);
+                __release_parts(parts.size() - i);
+                return;
+            }
+        }
+    }
+
+    //! HTTP transport calls the response callback with its requests queue
+    //! locked if the connection failed, so the parts are never started from
+    //! the response callback but posted to the transport's timer.
+    void __post_parts(const std::vector<size_t>& parts) {
+        if (parts.empty())
+            return;
+
+        auto self = shared_from_this();
+        auto t = http_->schedule_timed_cb(
+            [self, parts]() { self->__start_parts(parts); }, 0);
+
+        if (!t) {
+            logger->error("Failed to schedule {} parts of {}", parts.size(),
+                          whole_->url_);
+            __release_parts(parts.size());
+        }
+    }
+
+    void __on_part_finished(size_t part, transport::Data& resp, int code) {
+        std::vector<size_t> parts;
+        bool done = false;
+        int result = -1;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+
+            in_flight_--;
+
+            if (__is_ok(code)) {
+                parts_done_++;
+            } else if (!failed_ && attempts_[part] <= retries_) {
+                logger->warn("Part {}/{} of {} failed with code {}, retrying",
+                             part + 1, parts_total_, whole_->url_, code);
+                attempts_[part]++;
+                in_flight_++;
+                failed_code_ = code;
+                parts.push_back(part);
+            } else if (!failed_) {
+                logger->error("Part {}/{} of {} failed with code {}", part + 1,
+                              parts_total_, whole_->url_, code);
+                failed_ = true;
+                failed_code_ = code;
+            }
+
+            __fill_window(parts);
+            done = __check_finished(result);
+        }
+
+        if (done)
+            __finalize(resp, result);
+        else
+            __post_parts(parts);
+    }
+
+    void __finalize(transport::Data& resp, int code) {
+        whole_->status_ = code;
+        whole_->send_pos = whole_->request_body_.size();
+        whole_->stats_finalize();
+
+        logger->debug("Multi-part upload of {} parts finished with code {}",
+                      parts_total_, code);
+
+        if (whole_->response_)
+            whole_->response_(resp, code);
+
+        whole_->response_ = nullptr;
+    }
+
+public:
+    using ptr = std::shared_ptr<multipart_upload>;
+
+    //! @brief Create multi-part upload of the @p whole request's body.
+    //!
+    //! @param h HTTP transport
+    //! @param whole Request with the url, headers, body and response callback
+    //! @param part_size Max part size in bytes
+    //! @param window Max number of the parts uploaded at the same time
+    //! @param retries Number of retries of the failed part
+    static ptr create(std::shared_ptr<http> h,
+                      http::request_ptr whole,
+                      size_t part_size,
+                      size_t window,
+                      size_t retries = 2) {
+        return ptr(new multipart_upload(h, whole, part_size, window, retries));
+    }
+
+    bool start() {
+        std::vector<size_t> parts;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+
+            if (parts_total_ == 0)
+                return false;
+
+            logger->debug("Uploading {} bytes in {} parts with window {}",
+                          whole_->request_body_.size(), parts_total_, window_);
+
+            whole_->stats_start();
+            __fill_window(parts);
+        }
+
+        __start_parts(parts);
+
+        std::lock_guard<std::mutex> lock(lock_);
+        return !failed_;
+    }
+
+    size_t parts() { return parts_total_; }
+};
+
+}  // namespace agent
+}  // namespace cloud
+}  // namespace vxg
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <agent-proto/objects/config.h>
+#include <streamer/base_streamer.h>
+#include <utils/logging.h>
+#include <utils/utils.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vxg {
+namespace cloud {
+namespace agent {
+namespace media {
+
+//! @brief Rolling cache of the stream's recent video keyframes for the
+//! snapshots.
+//!
+//! Linked to the stream source as a sink, keeps the last keyframes as they
+//! are, without decoding, with their realtime timestamps and the in-band
+//! parameter sets. The snapshot is served from the keyframe nearest to the
+//! requested time, the keyframe is encoded to JPEG by the user's encoder
+//! only when requested and once, the next requests of the same keyframe
+//! reuse the image.
+//!
+//! Keyframe's realtime is MediaFrame::time_realtime if the source provides
+//! it, the arrival time otherwise.
+class snapshot_cache : public vxg::media::Streamer::ISink {
+    vxg::logger::logger_ptr logger {vxg::logger::instance("snapshot-cache")};
+
+public:
+    using ptr = std::shared_ptr<snapshot_cache>;
+    using frame_ptr = std::shared_ptr<vxg::media::Streamer::MediaFrame>;
+    using video_info = vxg::media::Streamer::StreamInfo::VideoInfo;
+
+    //! @brief Cached keyframe, everything needed for decoding.
+    struct keyframe {
+        cloud::time time {utils::time::null()};
+        frame_ptr frame;
+        //! Last SPS, PPS and sequence header frames received before the
+        //! keyframe
+        std::vector<frame_ptr> params;
+        //! Negotiated video info, extradata and resolution
+        std::shared_ptr<const video_info> info;
+    };
+
+    //! @brief Keyframe to JPEG encoder.
+    //!
+    //! @param kf Keyframe to encode.
+    //! @param[in,out] width Requested image width, may be unset, the encoded
+    //!                      image width on return.
+    //! @param[in,out] height Requested image height, see @p width.
+    //! @param[out] jpeg Encoded image.
+    //! @return false if failed.
+    using encoder = std::function<bool(const keyframe& kf,
+                                       int& width,
+                                       int& height,
+                                       std::vector<uint8_t>& jpeg)>;
+
+    //! @param enc Keyframe to JPEG encoder.
+    //! @param capacity Number of the keyframes to keep.
+    //! @param max_distance Max distance between the requested time and the
+    //!                     keyframe time.
+    snapshot_cache(encoder enc,
+                   size_t capacity = 4,
+                   cloud::duration max_distance = std::chrono::seconds(2))
+        : encoder_ {enc},
+          capacity_ {std::max<size_t>(capacity, 1)},
+          max_distance_ {max_distance} {}
+
+    virtual ~snapshot_cache() {}
+
+    virtual bool init(std::string) override { return true; }
+
+    virtual bool finit() override { return true; }
+
+    //! Keyframes are lost anyway if the queue is full
+    virtual bool droppable() override { return true; }
+
+    virtual std::string name() override { return "snapshot-cache"; }
+
+    virtual void error(vxg::media::Streamer::StreamError error) override {
+        logger->warn("Source error {}, dropping cached keyframes", error);
+        clear();
+    }
+
+    virtual bool negotiate(
+        std::vector<vxg::media::Streamer::StreamInfo> streams) override {
+        std::lock_guard<std::mutex> lock(lock_);
+
+        info_ = nullptr;
+        for (auto& s : streams) {
+            if (s.type == vxg::media::Streamer::StreamInfo::ST_VIDEO) {
+                info_ = std::make_shared<const video_info>(s.video);
+                break;
+            }
+        }
+
+        return true;
+    }
+
+    //! @brief Called on the sink thread with every frame of the source.
+    virtual bool process(frame_ptr frame) override {
+        using vxg::media::Streamer::MediaType;
+
+        if (!frame)
+            return true;
+
+        switch (frame->type) {
+            case MediaType::VIDEO_AVC_SPS:
+            case MediaType::VIDEO_AVC_PPS:
+            case MediaType::VIDEO_SEQ_HDR: {
+                std::lock_guard<std::mutex> lock(lock_);
+                _set_param(frame);
+            } break;
+            case MediaType::VIDEO:
+                if (frame->is_key)
+                    _push(frame);
+                break;
+            default:
+                break;
+        }
+
+        return true;
+    }
+
+    //! @brief Find the keyframe nearest to @p t.
+    //!
+    //! @return false if there is no keyframe within the max distance.
+    bool find(cloud::time t, keyframe& kf) {
+        std::lock_guard<std::mutex> lock(lock_);
+        auto it = _nearest(t);
+
+        if (it == ring_.end())
+            return false;
+
+        kf = it->kf;
+        return true;
+    }
+
+    //! @brief Get the snapshot of the keyframe nearest to @p t.
+    //!
+    //! @param t Requested time, the event time for example.
+    //! @param[in,out] snapshot Width and height are the requested size, the
+    //!                         image, its size and the keyframe time are set
+    //!                         on success.
+    //! @return false if there is no keyframe within the max distance or the
+    //!         encoding failed.
+    bool get_snapshot(cloud::time t,
+                      proto::event_object::snapshot_info_object& snapshot) {
+        keyframe kf;
+        std::shared_ptr<image> img;
+
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            auto it = _nearest(t);
+
+            if (it == ring_.end()) {
+                misses_++;
+                logger->debug("No keyframe near {}, {} cached",
+                              utils::time::to_iso(t), ring_.size());
+                return false;
+            }
+
+            kf = it->kf;
+            img = it->jpeg;
+        }
+
+        // Encoding is serialized per keyframe, concurrent requests of the
+        // same keyframe wait for the first one and reuse its image
+        std::lock_guard<std::mutex> lock(img->lock);
+        if (!img->done || img->requested_width != snapshot.width ||
+            img->requested_height != snapshot.height) {
+            img->requested_width = img->width = snapshot.width;
+            img->requested_height = img->height = snapshot.height;
+            img->data.clear();
+            img->ok = encoder_ &&
+                      encoder_(kf, img->width, img->height, img->data) &&
+                      !img->data.empty();
+            img->done = true;
+            encoded_++;
+
+            if (!img->ok)
+                logger->warn("Failed to encode keyframe {}",
+                             utils::time::to_iso(kf.time));
+        } else {
+            hits_++;
+        }
+
+        if (!img->ok)
+            return false;
+
+        snapshot.image_data = img->data;
+        snapshot.size = img->data.size();
+        snapshot.width = img->width;
+        snapshot.height = img->height;
+        snapshot.image_time = utils::time::to_iso_packed(kf.time);
+
+        return true;
+    }
+
+    //! @brief Drop the cached keyframes.
+    void clear() {
+        std::lock_guard<std::mutex> lock(lock_);
+
+        ring_.clear();
+        params_.clear();
+    }
+
+    //! @return Number of the cached keyframes.
+    size_t size() {
+        std::lock_guard<std::mutex> lock(lock_);
+        return ring_.size();
+    }
+
+    //! @return Number of the snapshots served without encoding.
+    size_t hits() const { return hits_; }
+
+    //! @return Number of the snapshot requests without the keyframe nearby.
+    size_t misses() const { return misses_; }
+
+    //! @return Number of the encoder calls.
+    size_t encoded() const { return encoded_; }
+
+private:
+    //! Keyframe's JPEG, encoded on the first request
+    struct image {
+        std::mutex lock;
+        bool done {false};
+        bool ok {false};
+        int requested_width {0};
+        int requested_height {0};
+        int width {0};
+        int height {0};
+        std::vector<uint8_t> data;
+    };
+
+    struct entry {
+        keyframe kf;
+        std::shared_ptr<image> jpeg;
+    };
+
+    encoder encoder_;
+    size_t capacity_;
+    cloud::duration max_distance_;
+
+    //! Protects everything below
+    std::mutex lock_;
+    std::deque<entry> ring_;
+    std::vector<frame_ptr> params_;
+    std::shared_ptr<const video_info> info_;
+
+    std::atomic<size_t> hits_ {0};
+    std::atomic<size_t> misses_ {0};
+    std::atomic<size_t> encoded_ {0};
+
+    //! Keep the last parameter set of each type
+    void _set_param(const frame_ptr& frame) {
+        for (auto& p : params_) {
+            if (p->type == frame->type) {
+                p = frame;
+                return;
+            }
+        }
+
+        params_.push_back(frame);
+    }
+
+    void _push(const frame_ptr& frame) {
+        entry e;
+
+        if (frame->time_realtime)
+            e.kf.time = cloud::time(std::chrono::duration_cast<cloud::duration>(
+                std::chrono::microseconds(frame->time_realtime)));
+        else
+            e.kf.time = utils::time::now();
+        e.kf.frame = frame;
+        e.jpeg = std::make_shared<image>();
+
+        std::lock_guard<std::mutex> lock(lock_);
+        e.kf.params = params_;
+        e.kf.info = info_;
+
+        ring_.push_back(std::move(e));
+        while (ring_.size() > capacity_)
+            ring_.pop_front();
+    }
+
+    //! Ring is small, realtime may jump back on the clock sync so it's not
+    //! sorted
+    std::deque<entry>::iterator _nearest(cloud::time t) {
+        auto result = ring_.end();
+        cloud::duration best = max_distance_;
+
+        for (auto it = ring_.begin(); it != ring_.end(); ++it) {
+            auto d = it->kf.time > t ? it->kf.time - t : t - it->kf.time;
+
+            // The later keyframe wins on equal distance
+            if (d <= best) {
+                best = d;
+                result = it;
+            }
+        }
+
+        return result;
+    }
+};
+
+}  // namespace media
+}  // namespace agent
+}  // namespace cloud
+}  // namespace vxg
@@ -6,6 +6,7 @@
 #include <regex>
 
 #include <agent-proto/objects/config.h>
+#include <agent/snapshot-cache.h>
 #include <streamer/rtmp_sink.h>
 #include <streamer/stream.h>
 #include <utils/utils.h>
@@ -23,6 +24,33 @@ class stream : public vxg::media::stream {
     //! @brief Indicates if stream should start source before calling
     //! start_record() virtual method.
     bool record_needs_source_ {false};
+    //! @private
+    snapshot_cache::ptr snapshot_cache_ {nullptr};
+    //! @private
+    bool snapshot_cache_linked_ {false};
+
+    //! @private
+    void _link_snapshot_cache() {
+        if (!snapshot_cache_ || snapshot_cache_linked_ || !source_)
+            return;
+
+        if (source_->linkSink(snapshot_cache_)) {
+            snapshot_cache_linked_ = snapshot_cache_->start();
+            if (!snapshot_cache_linked_)
+                source_->unlinkSink(snapshot_cache_);
+        }
+    }
+
+    //! @private
+    void _unlink_snapshot_cache() {
+        if (!snapshot_cache_linked_)
+            return;
+
+        snapshot_cache_->stop();
+        source_->unlinkSink(snapshot_cache_);
+        snapshot_cache_->clear();
+        snapshot_cache_linked_ = false;
+    }
 
 public:
     //! @brief std::shared_ptr to the base_stream
@@ -45,7 +73,40 @@ public:
               source,
               std::make_shared<vxg::media::rtmp_sink>(sink_error_cb)),
           record_needs_source_ {recorder_needs_source} {}
-    virtual ~stream() {}
+    virtual ~stream() { _unlink_snapshot_cache(); }
+
+    //! @private
+    virtual bool start(std::string uri = "") override {
+        if (!vxg::media::stream::start(uri))
+            return false;
+
+        _link_snapshot_cache();
+        return true;
+    }
+
+    //! @private
+    virtual void stop() override {
+        _unlink_snapshot_cache();
+        vxg::media::stream::stop();
+    }
+
+    //! @brief Set the cache of the recent keyframes for the events snapshots.
+    //!
+    //! The cache is fed while the stream's source is running, the manager
+    //! serves events snapshots from it and calls get_snapshot() only if
+    //! there is no keyframe near the event time. Should be set before the
+    //! stream start.
+    //!
+    //! @param cache Snapshot cache with the platform's JPEG encoder.
+    void set_snapshot_cache(snapshot_cache::ptr cache) {
+        _unlink_snapshot_cache();
+        snapshot_cache_ = cache;
+        if (source_started_)
+            _link_snapshot_cache();
+    }
+
+    //! @return Snapshot cache or nullptr if not set.
+    snapshot_cache::ptr get_snapshot_cache() { return snapshot_cache_; }
 
     //! @brief Get the media stream caps
     //! @details video/audio elementary streams caps request
@@ -0,0 +1,247 @@
+#include <gtest/gtest.h>
+
+#include <agent/event-coalescer.h>
+
+using namespace ::testing;
+using namespace std;
+using namespace vxg::cloud;
+using namespace vxg::cloud::agent;
+
+namespace {
+const vxg::cloud::time T0 = utils::time::from_double(1600000000);
+
+vxg::cloud::time at_ms(int ms) {
+    return T0 + std::chrono::milliseconds(ms);
+}
+
+proto::event_object make_event(int ms,
+                               bool active = false,
+                               proto::event_type type = proto::ET_MOTION) {
+    proto::event_object e;
+    e.event = type;
+    e.time = utils::time::to_double(at_ms(ms));
+    e.active = active;
+    return e;
+}
+
+event_coalescer::config make_config(int debounce_ms,
+                                    double rate = 0,
+                                    size_t burst = 1) {
+    event_coalescer::config c;
+    c.debounce = std::chrono::milliseconds(debounce_ms);
+    c.rate = rate;
+    c.burst = burst;
+    return c;
+}
+}  // namespace
+
+TEST(event_coalescer, PassThroughByDefault) {
+    event_coalescer coalescer;
+    std::vector<proto::event_object> out;
+
+    for (int i = 0; i < 5; i++)
+        coalescer.push(make_event(i), false, out, at_ms(i));
+
+    EXPECT_EQ(out.size(), 5);
+    EXPECT_EQ(coalescer.held(), 0);
+    EXPECT_EQ(coalescer.next_due(), utils::time::max());
+}
+
+TEST(event_coalescer, StatelessMerge) {
+    event_coalescer coalescer;
+    std::vector<proto::event_object> out;
+
+    coalescer.set_default_config(make_config(500));
+
+    // Burst of motion every 100ms
+    for (int i = 0; i <= 1000; i += 100)
+        coalescer.push(make_event(i), false, out, at_ms(i));
+    EXPECT_TRUE(out.empty());
+    EXPECT_EQ(coalescer.held(), 1);
+    EXPECT_EQ(coalescer.merged(), 10);
+    EXPECT_EQ(coalescer.next_due(), at_ms(1500));
+
+    coalescer.flush(out, at_ms(1499));
+    EXPECT_TRUE(out.empty());
+    coalescer.flush(out, at_ms(1500));
+    ASSERT_EQ(out.size(), 1);
+    EXPECT_EQ(utils::time::from_double(out[0].time), at_ms(0));
+    EXPECT_EQ(utils::time::from_double(out[0].time_end), at_ms(1000));
+    EXPECT_EQ(coalescer.held(), 0);
+
+    // Other event types are not merged
+    out.clear();
+    coalescer.push(make_event(2000), false, out, at_ms(2000));
+    coalescer.push(make_event(2000, false, proto::ET_SOUND), false, out,
+                   at_ms(2000));
+    coalescer.flush(out, at_ms(2500));
+    ASSERT_EQ(out.size(), 2);
+    EXPECT_TRUE(__is_unset(out[0].time_end));
+}
+
+TEST(event_coalescer, StatelessMaxDelay) {
+    event_coalescer coalescer;
+    std::vector<proto::event_object> out;
+    auto conf = make_config(500);
+
+    conf.max_delay = std::chrono::seconds(2);
+    coalescer.configure("motion", conf);
+
+    // Continuous burst is released every max delay
+    for (int i = 0; i <= 5000; i += 100) {
+        coalescer.push(make_event(i), false, out, at_ms(i));
+        coalescer.flush(out, at_ms(i));
+    }
+    ASSERT_EQ(out.size(), 2);
+    EXPECT_EQ(utils::time::from_double(out[0].time), at_ms(0));
+    EXPECT_EQ(utils::time::from_double(out[0].time_end), at_ms(2000));
+    EXPECT_EQ(utils::time::from_double(out[1].time), at_ms(2100));
+    EXPECT_EQ(utils::time::from_double(out[1].time_end), at_ms(4100));
+
+    // No merging, the first event is kept
+    conf.merge = false;
+    coalescer.configure("motion", conf);
+    coalescer.flush(out, at_ms(10000));
+    out.clear();
+    coalescer.push(make_event(20000), false, out, at_ms(20000));
+    coalescer.push(make_event(20100), false, out, at_ms(20100));
+    coalescer.flush(out, at_ms(21000));
+    ASSERT_EQ(out.size(), 1);
+    EXPECT_EQ(utils::time::from_double(out[0].time), at_ms(20000));
+    EXPECT_TRUE(__is_unset(out[0].time_end));
+    EXPECT_EQ(coalescer.dropped(), 1);
+}
+
+TEST(event_coalescer, StatefulFlapping) {
+    event_coalescer coalescer;
+    std::vector<proto::event_object> out;
+
+    coalescer.set_default_config(make_config(1000));
+
+    // Activation is released immediately
+    coalescer.push(make_event(0, true), true, out, at_ms(0));
+    ASSERT_EQ(out.size(), 1);
+    EXPECT_TRUE(out[0].active);
+
+    // Flapping within the debounce window keeps the event active
+    for (int i = 100; i < 2000; i += 200) {
+        coalescer.push(make_event(i, false), true, out, at_ms(i));
+        coalescer.push(make_event(i + 100, true), true, out, at_ms(i + 100));
+        coalescer.flush(out, at_ms(i + 100));
+    }
+    EXPECT_EQ(out.size(), 1);
+
+    // Repeated states are dropped
+    coalescer.push(make_event(2000, true), true, out, at_ms(2000));
+    coalescer.push(make_event(2100, false), true, out, at_ms(2100));
+    coalescer.push(make_event(2200, false), true, out, at_ms(2200));
+    EXPECT_EQ(coalescer.dropped(), 2);
+    EXPECT_EQ(coalescer.next_due(), at_ms(3100));
+
+    coalescer.flush(out, at_ms(3100));
+    ASSERT_EQ(out.size(), 2);
+    EXPECT_FALSE(out[1].active);
+    EXPECT_EQ(utils::time::from_double(out[1].time), at_ms(2100));
+    EXPECT_EQ(coalescer.held(), 0);
+
+    // Deactivation of not active event is dropped
+    coalescer.push(make_event(4000, false), true, out, at_ms(4000));
+    EXPECT_EQ(out.size(), 2);
+    EXPECT_EQ(coalescer.held(), 0);
+}
+
+TEST(event_coalescer, RateLimit) {
+    event_coalescer coalescer;
+    std::vector<proto::event_object> out;
+
+    // 2 events per second, burst of 3
+    coalescer.set_default_config(make_config(0, 2, 3));
+
+    for (int i = 0; i < 10; i++)
+        coalescer.push(make_event(i * 10), false, out, at_ms(i * 10));
+    // Burst passed, the rest is merged into the held event
+    ASSERT_EQ(out.size(), 3);
+    EXPECT_EQ(coalescer.held(), 1);
+    EXPECT_EQ(coalescer.merged(), 6);
+    EXPECT_EQ(coalescer.next_due(), at_ms(500));
+
+    coalescer.flush(out, at_ms(499));
+    EXPECT_EQ(out.size(), 3);
+    coalescer.flush(out, at_ms(500));
+    ASSERT_EQ(out.size(), 4);
+    EXPECT_EQ(utils::time::from_double(out[3].time), at_ms(30));
+    EXPECT_EQ(utils::time::from_double(out[3].time_end), at_ms(90));
+
+    // Stateful activation waits for the token, deactivation is not limited
+    out.clear();
+    coalescer.configure("sound", make_config(0, 1, 1));
+    coalescer.push(make_event(1000, true, proto::ET_SOUND), true, out,
+                   at_ms(1000));
+    coalescer.push(make_event(1100, false, proto::ET_SOUND), true, out,
+                   at_ms(1100));
+    coalescer.push(make_event(1200, true, proto::ET_SOUND), true, out,
+                   at_ms(1200));
+    ASSERT_EQ(out.size(), 2);
+    EXPECT_FALSE(out[1].active);
+    EXPECT_EQ(coalescer.held(), 1);
+    EXPECT_EQ(coalescer.next_due(), at_ms(2000));
+    coalescer.flush(out, at_ms(1999));
+    EXPECT_EQ(out.size(), 2);
+    coalescer.flush(out, at_ms(2000));
+    ASSERT_EQ(out.size(), 3);
+    EXPECT_TRUE(out[2].active);
+    EXPECT_EQ(utils::time::from_double(out[2].time), at_ms(1200));
+}
+
+TEST(event_coalescer, FlushAll) {
+    event_coalescer coalescer;
+    std::vector<proto::event_object> out;
+
+    // 1 event per second, debounce of 1 second
+    coalescer.set_default_config(make_config(1000, 1, 1));
+
+    coalescer.push(make_event(0), false, out, at_ms(0));
+    coalescer.flush(out, at_ms(1000));
+    ASSERT_EQ(out.size(), 1);
+    coalescer.push(make_event(1100), false, out, at_ms(1100));
+    coalescer.push(make_event(1200, true, proto::ET_SOUND), true, out,
+                   at_ms(1200));
+    coalescer.push(make_event(1300, false, proto::ET_SOUND), true, out,
+                   at_ms(1300));
+    ASSERT_EQ(out.size(), 2);
+    EXPECT_TRUE(out[1].active);
+    EXPECT_EQ(coalescer.held(), 2);
+
+    // Everything held is released regardless of the debounce and the rate
+    out.clear();
+    coalescer.flush(out, utils::time::max());
+    ASSERT_EQ(out.size(), 2);
+    EXPECT_EQ(utils::time::from_double(out[0].time), at_ms(1100));
+    EXPECT_FALSE(out[1].active);
+    EXPECT_EQ(coalescer.held(), 0);
+    EXPECT_EQ(coalescer.next_due(), utils::time::max());
+}
+
+TEST(event_coalescer, Bypass) {
+    event_coalescer coalescer;
+    std::vector<proto::event_object> out;
+
+    coalescer.set_default_config(make_config(1000, 1, 1));
+
+    auto canceler = make_event(0);
+    canceler.upload_canceler = true;
+    canceler.upload_token = "ticket";
+    auto dummy = make_event(0, true);
+    dummy.state_dummy = true;
+
+    coalescer.push(make_event(0), false, out, at_ms(0));
+    coalescer.push(canceler, false, out, at_ms(0));
+    coalescer.push(dummy, true, out, at_ms(0));
+    coalescer.push(dummy, true, out, at_ms(0));
+    EXPECT_EQ(out.size(), 3);
+    EXPECT_EQ(coalescer.held(), 1);
+
+    coalescer.clear();
+    EXPECT_EQ(coalescer.held(), 0);
+    EXPECT_EQ(coalescer.next_due(), utils::time::max());
+}
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+
+#include <agent/multipart-upload.h>
+
+using namespace ::testing;
+using namespace std;
+using namespace vxg::cloud;
+using namespace vxg::cloud::agent;
+using namespace vxg::cloud::transport::libwebsockets;
+
+namespace {
+//! HTTP transport which only collects the requests, the test replies them.
+//! Timed callbacks are run right after the reply as the transport's loop
+//! does.
+class fake_http : public http {
+public:
+    std::vector<http::request_ptr> requests;
+    std::vector<std::function<void()>> posted;
+    bool in_response {false};
+    //! Requests made from the response callback
+    size_t reentered {0};
+    bool fail_schedule {false};
+
+    virtual bool make(request_ptr req) override {
+        if (in_response)
+            reentered++;
+        requests.push_back(req);
+        return true;
+    }
+
+    virtual transport::timed_cb_ptr schedule_timed_cb(
+        std::function<void()> cb,
+        size_t ms) override {
+        if (fail_schedule)
+            return nullptr;
+
+        posted.push_back(cb);
+        return std::make_shared<transport::timed_cb>();
+    }
+
+    void reply(size_t idx, int code) {
+        transport::Data resp;
+
+        in_response = true;
+        requests[idx]->response_(resp, code);
+        in_response = false;
+
+        while (!posted.empty()) {
+            auto cb = posted.front();
+            posted.erase(posted.begin());
+            cb();
+        }
+    }
+};
+
+http::request_ptr make_whole(size_t size, int& code, size_t& calls) {
+    std::string body;
+    for (size_t i = 0; i < size; i++)
+        body.push_back('a' + i % 26);
+
+    auto req = std::make_shared<http::request>("http://127.0.0.1/upload/1",
+                                               "PUT", body);
+    req->set_header("Content-Type", "video/mp4");
+    req->set_response_cb([&code, &calls](transport::Data&, int c) {
+        code = c;
+        calls++;
+    });
+
+    return req;
+}
+}  // namespace
+
+TEST(multipart_upload, SlidingWindow) {
+    auto h = std::make_shared<fake_http>();
+    int code = 0;
+    size_t calls = 0;
+    auto whole = make_whole(1000, code, calls);
+    auto upload = multipart_upload::create(h, whole, 300, 2);
+
+    EXPECT_EQ(upload->parts(), 4);
+    EXPECT_TRUE(upload->start());
+
+    // Window is full
+    ASSERT_EQ(h->requests.size(), 2);
+    EXPECT_EQ(h->requests[0]->headers_["Content-Range:"], "bytes 0-299/1000");
+    EXPECT_EQ(h->requests[1]->headers_["Content-Range:"],
+              "bytes 300-599/1000");
+    EXPECT_EQ(h->requests[0]->headers_["Content-Type:"], "video/mp4");
+    EXPECT_EQ(h->requests[0]->request_body_,
+              whole->request_body_.substr(0, 300));
+
+    // Second part finished first, next part is started immediately
+    h->reply(1, 200);
+    ASSERT_EQ(h->requests.size(), 3);
+    EXPECT_EQ(h->requests[2]->headers_["Content-Range:"],
+              "bytes 600-899/1000");
+
+    h->reply(0, 200);
+    ASSERT_EQ(h->requests.size(), 4);
+    EXPECT_EQ(h->requests[3]->headers_["Content-Range:"],
+              "bytes 900-999/1000");
+    EXPECT_EQ(h->requests[3]->request_body_.size(), 100);
+
+    h->reply(2, 200);
+    EXPECT_EQ(calls, 0);
+    h->reply(3, 200);
+
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(code, 200);
+    EXPECT_EQ(h->requests.size(), 4);
+    EXPECT_EQ(h->reentered, 0);
+}
+
+TEST(multipart_upload, RetryFailedPart) {
+    auto h = std::make_shared<fake_http>();
+    int code = 0;
+    size_t calls = 0;
+    auto upload =
+        multipart_upload::create(h, make_whole(200, code, calls), 100, 2, 1);
+
+    EXPECT_TRUE(upload->start());
+    ASSERT_EQ(h->requests.size(), 2);
+
+    h->reply(0, 503);
+    // Failed part was restarted
+    ASSERT_EQ(h->requests.size(), 3);
+    EXPECT_EQ(h->requests[2]->headers_["Content-Range:"], "bytes 0-99/200");
+
+    h->reply(1, 200);
+    h->reply(2, 200);
+
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(code, 200);
+}
+
+TEST(multipart_upload, FailAfterRetries) {
+    auto h = std::make_shared<fake_http>();
+    int code = 0;
+    size_t calls = 0;
+    auto upload =
+        multipart_upload::create(h, make_whole(300, code, calls), 100, 2, 1);
+
+    EXPECT_TRUE(upload->start());
+    ASSERT_EQ(h->requests.size(), 2);
+
+    h->reply(0, 503);
+    ASSERT_EQ(h->requests.size(), 3);
+    h->reply(2, 503);
+
+    // No more parts started after the failure, the result is reported when
+    // the last in-flight part finished
+    EXPECT_EQ(h->requests.size(), 3);
+    EXPECT_EQ(calls, 0);
+    h->reply(1, 200);
+
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(code, 503);
+}
+
+TEST(multipart_upload, ScheduleFailed) {
+    auto h = std::make_shared<fake_http>();
+    int code = 0;
+    size_t calls = 0;
+    auto upload =
+        multipart_upload::create(h, make_whole(300, code, calls), 100, 2, 1);
+
+    EXPECT_TRUE(upload->start());
+    ASSERT_EQ(h->requests.size(), 2);
+
+    // Next part can't be posted, the upload fails when the last in-flight
+    // part finished
+    h->fail_schedule = true;
+    h->reply(0, 200);
+    EXPECT_EQ(h->requests.size(), 2);
+    EXPECT_EQ(calls, 0);
+    h->reply(1, 200);
+
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(code, -1);
+    EXPECT_EQ(h->reentered, 0);
+}
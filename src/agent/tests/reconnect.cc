@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+
+#include <agent/event-stream.h>
+#include <agent/manager.h>
+#include <tests/mock-cloud.h>
+#include <utils/profile.h>
+
+using namespace vxg::cloud;
+using namespace vxg::cloud::agent;
+
+namespace {
+//! Event stream notifying events on the test's request
+class manual_event_stream : public event_stream {
+public:
+    std::atomic<size_t> starts {0};
+
+    manual_event_stream() : event_stream("manual") {}
+
+    bool emit() {
+        proto::event_object event;
+
+        event.event = proto::ET_MOTION;
+        event.time = utils::time::to_double(utils::time::now());
+
+        return notify(event);
+    }
+
+    virtual bool start() override {
+        starts++;
+        return true;
+    }
+    virtual void stop() override {}
+
+    virtual bool get_events(
+        std::vector<proto::event_config>& configs) override {
+        proto::event_config motion;
+
+        motion.event = proto::ET_MOTION;
+        motion.active = true;
+        configs.push_back(motion);
+
+        return true;
+    }
+
+    virtual bool set_events(
+        const std::vector<proto::event_config>& config) override {
+        return true;
+    }
+
+    virtual bool set_trigger_recording(bool enabled,
+                                       int pre,
+                                       int post) override {
+        return false;
+    }
+
+    virtual bool init() override { return true; }
+    virtual void finit() override {}
+};
+
+class reconnect_callback : public callback {
+public:
+    virtual void on_bye(proto::command::bye_reason reason) override {}
+};
+
+template <class F>
+bool wait_for(F condition, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    return true;
+}
+}  // namespace
+
+TEST(reconnect, ResumeAfterDrop) {
+    mock_cloud::config config;
+
+    config.port = 8990;
+    config.on_register.push_back(
+        {{"cmd", "set_cam_events"},
+         {"enabled", true},
+         {"events", {{{"event", "motion"}, {"active", true}}}}});
+
+    auto cloud = std::make_shared<mock_cloud>(config);
+    ASSERT_TRUE(cloud->start());
+
+    profile::global::instance().insecure_cloud_channel = true;
+    profile::global::instance().reconnect_backoff_base_ms = 200;
+
+    auto events = std::make_shared<manual_event_stream>();
+    auto token = std::make_shared<proto::access_token>(cloud->access_token());
+    std::vector<media::stream::ptr> streams;
+    std::vector<event_stream::ptr> event_streams {events};
+    auto manager = manager::create(callback::ptr(new reconnect_callback()),
+                                   token, streams, event_streams);
+    ASSERT_NE(manager, nullptr);
+    ASSERT_TRUE(manager->start());
+
+    ASSERT_TRUE(wait_for([&]() { return events->starts > 0; },
+                         std::chrono::seconds(5)));
+    EXPECT_TRUE(events->emit());
+    ASSERT_TRUE(
+        wait_for([&]() { return cloud->commands_received("cam_event") == 1; },
+                 std::chrono::seconds(2)));
+
+    auto dropped_at = std::chrono::steady_clock::now();
+    cloud->drop_connection();
+    // Reconnection is delayed by the backoff which is at least 200ms, events
+    // notified during the gap are queued, not lost
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    for (int i = 0; i < 3; i++)
+        EXPECT_TRUE(events->emit());
+
+    ASSERT_TRUE(wait_for(
+        [&]() { return cloud->commands_received("cam_event") == 4; },
+        std::chrono::seconds(5)));
+    auto operational_in = std::chrono::steady_clock::now() - dropped_at;
+
+    EXPECT_EQ(cloud->commands_received("cam_register"), 2);
+    // Event streams of the resumed session were not restarted
+    EXPECT_EQ(events->starts, 1);
+    EXPECT_LT(operational_in, std::chrono::seconds(1));
+
+    manager->stop();
+    cloud->stop();
+}
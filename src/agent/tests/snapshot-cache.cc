@@ -0,0 +1,221 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <deque>
+#include <thread>
+
+#include <agent/snapshot-cache.h>
+
+using namespace ::testing;
+using namespace vxg::cloud;
+using namespace vxg::cloud::agent;
+using namespace vxg::media;
+
+namespace {
+const vxg::cloud::time T0 = utils::time::from_double(1600000000);
+
+vxg::cloud::time at_ms(int ms) {
+    return T0 + std::chrono::milliseconds(ms);
+}
+
+std::shared_ptr<Streamer::MediaFrame> make_frame(
+    int ms,
+    bool key,
+    Streamer::MediaType type = Streamer::VIDEO) {
+    auto f = std::make_shared<Streamer::MediaFrame>();
+
+    f->type = type;
+    f->is_key = key;
+    f->time_realtime = std::chrono::duration_cast<std::chrono::microseconds>(
+                           at_ms(ms).time_since_epoch())
+                           .count();
+    f->data.assign(key ? 1000 : 100, static_cast<uint8_t>(ms / 40));
+    f->len = f->data.size();
+    return f;
+}
+
+//! Synthetic 25fps H.264 stream with the keyframe every second and the in-band
+//! SPS/PPS before each keyframe.
+class synthetic_source : public Streamer::ISource {
+    std::deque<std::shared_ptr<Streamer::MediaFrame>> frames_;
+
+public:
+    synthetic_source(int frames) {
+        for (int n = 0; n < frames; n++) {
+            if (n % 25 == 0) {
+                frames_.push_back(
+                    make_frame(n * 40, false, Streamer::VIDEO_AVC_SPS));
+                frames_.push_back(
+                    make_frame(n * 40, false, Streamer::VIDEO_AVC_PPS));
+            }
+            frames_.push_back(make_frame(n * 40, n % 25 == 0));
+        }
+    }
+    ~synthetic_source() { stop(); }
+
+    std::atomic<bool> done {false};
+
+    bool init(std::string) override { return true; }
+    void finit() override {}
+    std::string name() override { return "synthetic-source"; }
+
+    std::vector<Streamer::StreamInfo> negotiate() override {
+        Streamer::StreamInfo info;
+
+        info.type = Streamer::StreamInfo::ST_VIDEO;
+        info.video.codec = Streamer::StreamInfo::VC_H264;
+        info.video.width = 1920;
+        info.video.height = 1080;
+        return {info};
+    }
+
+    std::shared_ptr<Streamer::MediaFrame> pullFrame() override {
+        if (frames_.empty()) {
+            done = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            return nullptr;
+        }
+
+        // Faster than realtime but not flooding the droppable sink queue
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        auto f = frames_.front();
+        frames_.pop_front();
+        return f;
+    }
+};
+
+//! Fake JPEG, the keyframe's first byte and the requested size
+bool fake_encoder(const agent::media::snapshot_cache::keyframe& kf,
+                  int& width,
+                  int& height,
+                  std::vector<uint8_t>& jpeg) {
+    if (__is_unset(width))
+        width = kf.info ? kf.info->width : 0;
+    if (__is_unset(height))
+        height = kf.info ? kf.info->height : 0;
+    jpeg = {0xff, 0xd8, kf.frame->data[0], 0xff, 0xd9};
+    return true;
+}
+}  // namespace
+
+TEST(snapshot_cache, Ring) {
+    agent::media::snapshot_cache cache(fake_encoder, 3,
+                                       std::chrono::milliseconds(500));
+    agent::media::snapshot_cache::keyframe kf;
+
+    EXPECT_FALSE(cache.find(at_ms(0), kf));
+
+    // Keyframe every second, only keyframes are kept
+    for (int ms = 0; ms < 5000; ms += 40) {
+        if (ms % 1000 == 0)
+            cache.process(make_frame(ms, false, Streamer::VIDEO_AVC_SPS));
+        cache.process(make_frame(ms, ms % 1000 == 0));
+        cache.process(make_frame(ms, false, Streamer::AUDIO));
+    }
+    EXPECT_EQ(cache.size(), 3);
+
+    // Nearest keyframe within the max distance
+    ASSERT_TRUE(cache.find(at_ms(3100), kf));
+    EXPECT_EQ(kf.time, at_ms(3000));
+    EXPECT_TRUE(kf.frame->is_key);
+    ASSERT_EQ(kf.params.size(), 1);
+    EXPECT_EQ(kf.params[0]->type, Streamer::VIDEO_AVC_SPS);
+    ASSERT_TRUE(cache.find(at_ms(3600), kf));
+    EXPECT_EQ(kf.time, at_ms(4000));
+    ASSERT_TRUE(cache.find(at_ms(4400), kf));
+    EXPECT_EQ(kf.time, at_ms(4000));
+    EXPECT_FALSE(cache.find(at_ms(4600), kf));
+
+    // Rotated out
+    EXPECT_FALSE(cache.find(at_ms(1000), kf));
+
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(snapshot_cache, EncodeOnDemand) {
+    std::atomic<int> calls {0};
+    agent::media::snapshot_cache cache(
+        [&](const agent::media::snapshot_cache::keyframe& kf, int& w, int& h,
+            std::vector<uint8_t>& jpeg) {
+            calls++;
+            return fake_encoder(kf, w, h, jpeg);
+        });
+    proto::event_object::snapshot_info_object snapshot;
+
+    for (int ms = 0; ms < 3000; ms += 1000)
+        cache.process(make_frame(ms, true));
+    // Caching doesn't encode
+    EXPECT_EQ(calls, 0);
+
+    snapshot.width = 800;
+    snapshot.height = 600;
+    ASSERT_TRUE(cache.get_snapshot(at_ms(1200), snapshot));
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(snapshot.image_data,
+              std::vector<uint8_t>({0xff, 0xd8, 25, 0xff, 0xd9}));
+    EXPECT_EQ(snapshot.size, 5);
+    EXPECT_EQ(snapshot.width, 800);
+    EXPECT_EQ(utils::time::from_iso_packed(snapshot.image_time), at_ms(1000));
+
+    // The same keyframe is encoded once
+    proto::event_object::snapshot_info_object again;
+    again.width = 800;
+    again.height = 600;
+    ASSERT_TRUE(cache.get_snapshot(at_ms(900), again));
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(cache.hits(), 1);
+    EXPECT_EQ(again.image_data, snapshot.image_data);
+
+    // Other size is encoded again
+    proto::event_object::snapshot_info_object full;
+    ASSERT_TRUE(cache.get_snapshot(at_ms(1000), full));
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(cache.encoded(), 2);
+
+    // No keyframe near
+    EXPECT_FALSE(cache.get_snapshot(at_ms(10000), full));
+    EXPECT_EQ(cache.misses(), 1);
+
+    // Encoder failure
+    agent::media::snapshot_cache failing(
+        [](const agent::media::snapshot_cache::keyframe&, int&, int&,
+           std::vector<uint8_t>&) { return false; });
+    failing.process(make_frame(0, true));
+    EXPECT_FALSE(failing.get_snapshot(at_ms(0), full));
+}
+
+TEST(snapshot_cache, SyntheticSource) {
+    auto source = std::make_shared<synthetic_source>(25 * 5);
+    auto cache =
+        std::make_shared<agent::media::snapshot_cache>(fake_encoder, 4);
+    proto::event_object::snapshot_info_object snapshot;
+
+    ASSERT_TRUE(source->linkSink(cache));
+    ASSERT_TRUE(cache->start());
+    ASSERT_TRUE(source->start());
+
+    for (int i = 0; i < 500 && !source->done; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_TRUE(source->done);
+    for (int i = 0; i < 500 && cache->size() < 4; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    source->stop();
+    cache->stop();
+    source->unlinkSink(cache);
+
+    // 5 keyframes, the last 4 are kept with the negotiated info
+    EXPECT_EQ(cache->size(), 4);
+    ASSERT_TRUE(cache->get_snapshot(at_ms(2100), snapshot));
+    EXPECT_EQ(utils::time::from_iso_packed(snapshot.image_time), at_ms(2000));
+    EXPECT_EQ(snapshot.width, 1920);
+    EXPECT_EQ(snapshot.height, 1080);
+
+    agent::media::snapshot_cache::keyframe kf;
+    ASSERT_TRUE(cache->find(at_ms(4000), kf));
+    EXPECT_EQ(kf.params.size(), 2);
+    // The first keyframe is rotated out
+    ASSERT_TRUE(cache->find(at_ms(0), kf));
+    EXPECT_EQ(kf.time, at_ms(1000));
+}
@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+#include <thread>
+
+#include <agent/upload-scheduler.h>
+
+using namespace ::testing;
+using namespace std;
+using namespace vxg::cloud;
+using namespace vxg::cloud::agent;
+
+namespace {
+upload_scheduler::task make_task(upload_scheduler::upload_class cls,
+                                 std::vector<int>& started,
+                                 int id,
+                                 std::vector<upload_scheduler::release_cb>* rel =
+                                     nullptr) {
+    upload_scheduler::task t;
+    t.cls = cls;
+    t.start = [&started, id, rel](upload_scheduler::release_cb release) {
+        started.push_back(id);
+        if (rel)
+            rel->push_back(release);
+        else
+            release();
+        return true;
+    };
+    return t;
+}
+}  // namespace
+
+TEST(upload_scheduler, PriorityOrder) {
+    upload_scheduler sched;
+    std::vector<int> started;
+
+    sched.configure(upload_scheduler::UPC_SNAPSHOT, 4, duration(0));
+    sched.configure(upload_scheduler::UPC_EVENT_RECORD, 4, duration(0));
+    sched.configure(upload_scheduler::UPC_FILE_META, 4, duration(0));
+    sched.configure(upload_scheduler::UPC_TIMELINE_RECORD, 4, duration(0));
+
+    sched.push(make_task(upload_scheduler::UPC_TIMELINE_RECORD, started, 3));
+    sched.push(make_task(upload_scheduler::UPC_FILE_META, started, 2));
+    sched.push(make_task(upload_scheduler::UPC_EVENT_RECORD, started, 1));
+    sched.push(make_task(upload_scheduler::UPC_SNAPSHOT, started, 0));
+
+    EXPECT_EQ(sched.dispatch(), 4);
+    EXPECT_EQ(started, std::vector<int>({0, 1, 2, 3}));
+    EXPECT_EQ(sched.size(), 0);
+    EXPECT_EQ(sched.in_flight(), 0);
+}
+
+TEST(upload_scheduler, ClassQuota) {
+    upload_scheduler sched;
+    std::vector<int> started;
+    std::vector<upload_scheduler::release_cb> releases;
+
+    sched.configure(upload_scheduler::UPC_EVENT_RECORD, 2, duration(0));
+    sched.configure(upload_scheduler::UPC_TIMELINE_RECORD, 1, duration(0));
+
+    for (int i = 0; i < 4; i++)
+        sched.push(make_task(upload_scheduler::UPC_EVENT_RECORD, started, i,
+                             &releases));
+    sched.push(make_task(upload_scheduler::UPC_TIMELINE_RECORD, started, 10,
+                         &releases));
+
+    // Event quota is 2, timeline class runs in its own slot
+    EXPECT_EQ(sched.dispatch(), 3);
+    EXPECT_EQ(started, std::vector<int>({0, 1, 10}));
+    EXPECT_EQ(sched.in_flight(upload_scheduler::UPC_EVENT_RECORD), 2);
+
+    // Release is idempotent
+    releases[0]();
+    releases[0]();
+    EXPECT_EQ(sched.in_flight(upload_scheduler::UPC_EVENT_RECORD), 1);
+
+    EXPECT_EQ(sched.dispatch(), 1);
+    EXPECT_EQ(started.back(), 2);
+    EXPECT_EQ(sched.size(), 1);
+}
+
+TEST(upload_scheduler, GlobalLimit) {
+    upload_scheduler sched;
+    std::vector<int> started;
+    std::vector<upload_scheduler::release_cb> releases;
+
+    sched.set_max_in_flight(2);
+    sched.configure(upload_scheduler::UPC_SNAPSHOT, 4, duration(0));
+    sched.configure(upload_scheduler::UPC_EVENT_RECORD, 4, duration(0));
+
+    for (int i = 0; i < 3; i++) {
+        sched.push(
+            make_task(upload_scheduler::UPC_SNAPSHOT, started, i, &releases));
+        sched.push(make_task(upload_scheduler::UPC_EVENT_RECORD, started,
+                             10 + i, &releases));
+    }
+
+    EXPECT_EQ(sched.dispatch(), 2);
+    EXPECT_EQ(sched.in_flight(), 2);
+    EXPECT_EQ(started, std::vector<int>({0, 1}));
+}
+
+TEST(upload_scheduler, Aging) {
+    upload_scheduler sched;
+    std::vector<int> started;
+
+    sched.set_max_in_flight(1);
+    sched.set_aging_step(std::chrono::milliseconds(10));
+    sched.configure(upload_scheduler::UPC_TIMELINE_RECORD, 1, duration(0));
+    sched.configure(upload_scheduler::UPC_SNAPSHOT, 1, duration(0));
+
+    sched.push(make_task(upload_scheduler::UPC_TIMELINE_RECORD, started, 3));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    sched.push(make_task(upload_scheduler::UPC_SNAPSHOT, started, 0));
+
+    // Timeline task waited long enough to reach the top priority and it's
+    // older than the snapshot task
+    EXPECT_EQ(sched.dispatch(), 2);
+    EXPECT_EQ(started, std::vector<int>({3, 0}));
+}
+
+TEST(upload_scheduler, DropLate) {
+    upload_scheduler sched;
+    std::vector<int> started;
+    int dropped = 0;
+
+    sched.configure(upload_scheduler::UPC_SNAPSHOT, 1,
+                    std::chrono::milliseconds(10));
+
+    auto t = make_task(upload_scheduler::UPC_SNAPSHOT, started, 0);
+    t.drop = [&dropped]() { dropped++; };
+    sched.push(t);
+
+    auto t2 = make_task(upload_scheduler::UPC_EVENT_RECORD, started, 1);
+    t2.deadline = utils::time::now() + std::chrono::hours(1);
+    sched.push(t2);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    EXPECT_EQ(sched.drop_late(), 1);
+    EXPECT_EQ(dropped, 1);
+    EXPECT_EQ(sched.dispatch(), 1);
+    EXPECT_EQ(started, std::vector<int>({1}));
+}
+
+TEST(upload_scheduler, CancelAndFailedStart) {
+    upload_scheduler sched;
+    std::vector<int> started;
+    bool canceled = false;
+
+    int dropped = 0;
+
+    auto t1 = make_task(upload_scheduler::UPC_EVENT_RECORD, started, 0);
+    t1.ticket = "ticket";
+    t1.drop = [&dropped]() { dropped++; };
+    sched.push(t1);
+
+    auto t2 = make_task(upload_scheduler::UPC_EVENT_RECORD, started, 1);
+    t2.is_canceled = [&canceled]() { return canceled; };
+    t2.drop = [&dropped]() { dropped++; };
+    sched.push(t2);
+
+    auto t3 = make_task(upload_scheduler::UPC_EVENT_RECORD, started, 2);
+    t3.start = [](upload_scheduler::release_cb) { return false; };
+    sched.push(t3);
+
+    EXPECT_EQ(sched.cancel_by_ticket("ticket"), 1);
+    EXPECT_EQ(dropped, 1);
+    canceled = true;
+
+    // Canceled task skipped and dropped, failed start releases the slot
+    EXPECT_EQ(sched.dispatch(), 0);
+    EXPECT_EQ(dropped, 2);
+    EXPECT_EQ(sched.size(), 0);
+    EXPECT_EQ(sched.in_flight(), 0);
+    EXPECT_TRUE(started.empty());
+}
+
+TEST(upload_scheduler, ClearDrops) {
+    upload_scheduler sched;
+    std::vector<int> started;
+    int dropped = 0;
+
+    for (int i = 0; i < 3; i++) {
+        auto t = make_task(upload_scheduler::upload_class(i), started, i);
+        t.drop = [&dropped]() { dropped++; };
+        sched.push(t);
+    }
+
+    sched.clear();
+    EXPECT_EQ(dropped, 3);
+    EXPECT_EQ(sched.size(), 0);
+    EXPECT_EQ(sched.dispatch(), 0);
+    EXPECT_TRUE(started.empty());
+}
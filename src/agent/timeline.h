@@ -9,6 +9,8 @@
 #include <cloud/CloudAPIEndPoints.h>
 #include <cloud/cloud_api_v4.h>
 
+#include <algorithm>
+#include <deque>
 #include <fstream>
 #include <memory>
 #include <vector>
@@ -264,7 +266,7 @@ public:
 
         secure_transport_ =
             http_->is_secure() &&
-            !agent::profile::global::instance().insecure_cloud_channel;
+            !agent::profile::global::snapshot()->insecure_cloud_channel;
 
         http_->start();
     }
@@ -417,15 +419,148 @@ public:
     virtual void erase(item_ptr) {}
 };
 
+//! @brief Sorted set of non-intersecting periods, intersecting and adjacent
+//! periods are merged on insertion.
+class period_set {
+    std::vector<period> periods_;
+
+    // First period which ends at or after the time
+    std::vector<period>::iterator __lower(cloud::time t) {
+        return std::lower_bound(
+            periods_.begin(), periods_.end(), t,
+            [](const period& p, const cloud::time& t) { return p.end < t; });
+    }
+
+public:
+    void add(period p) {
+        if (!(p.begin < p.end))
+            return;
+
+        auto first = __lower(p.begin);
+        auto last = first;
+
+        while (last != periods_.end() && last->begin <= p.end) {
+            p.begin = std::min(p.begin, last->begin);
+            p.end = std::max(p.end, last->end);
+            last++;
+        }
+
+        first = periods_.erase(first, last);
+        periods_.insert(first, p);
+    }
+
+    void remove(period p) {
+        std::vector<period> result;
+
+        if (!(p.begin < p.end))
+            return;
+
+        for (auto& cur : periods_) {
+            if (!cur.intersects(p)) {
+                result.push_back(cur);
+                continue;
+            }
+
+            if (cur.begin < p.begin)
+                result.push_back({cur.begin, p.begin});
+            if (cur.end > p.end)
+                result.push_back({p.end, cur.end});
+        }
+
+        periods_.swap(result);
+    }
+
+    //! @brief Check if the period is fully included in the set
+    bool covers(period p) {
+        auto it = __lower(p.begin);
+
+        return it != periods_.end() && it->begin <= p.begin &&
+               it->end >= p.end;
+    }
+
+    //! @brief Periods intersecting the @p p, not clipped by @p p borders
+    std::vector<period> intersecting(period p) {
+        std::vector<period> result;
+
+        for (auto it = __lower(p.begin);
+             it != periods_.end() && it->begin < p.end; it++) {
+            if (it->intersects(p))
+                result.push_back(*it);
+        }
+
+        return result;
+    }
+
+    const std::vector<period>& periods() const { return periods_; }
+    size_t size() const { return periods_.size(); }
+    bool empty() const { return periods_.empty(); }
+    void clear() { periods_.clear(); }
+};
+
+//! @brief Timeline of the timed storage.
+//!
+//! Slices listed from the storage are cached, the storage is requested only
+//! if the requested period is not fully covered by the known periods. Every
+//! known period expires after the cache TTL, the storage is requested again
+//! for the expired periods. Successful uploads should be reported with
+//! add() so the following requests don't need the storage listing.
+//!
+//! The timeline is not thread-safe, segmented_uploader calls it only from the
+//! serialized timed callbacks.
 template <class T>
 class timeline {
     std::shared_ptr<T> storage_;
 
+    //! Known slices of the data in the storage
+    period_set slices_;
+    //! Periods we know everything about, union of the non-expired fetches
+    period_set known_;
+    //! Fetched or added periods with the time they were learned
+    std::deque<std::pair<period, cloud::time>> fetches_;
+    cloud::duration ttl_ {agent::profile::global::snapshot()
+                              ->cloud_timeline_cache_ttl};
+    size_t hits_ {0};
+    size_t misses_ {0};
+
+    void __learn(period p, cloud::time now) {
+        known_.add(p);
+        fetches_.push_back({p, now});
+    }
+
+    // Forget the expired periods and the slices we don't know anything about
+    // anymore
+    void __expire(cloud::time now) {
+        bool expired = false;
+
+        while (!fetches_.empty() && fetches_.front().second + ttl_ <= now) {
+            fetches_.pop_front();
+            expired = true;
+        }
+
+        if (!expired)
+            return;
+
+        period_set slices;
+
+        known_.clear();
+        for (auto& f : fetches_)
+            known_.add(f.first);
+
+        for (auto& k : known_.periods()) {
+            for (auto& s : slices_.intersecting(k))
+                slices.add({std::max(s.begin, k.begin),
+                            std::min(s.end, k.end)});
+        }
+
+        slices_ = std::move(slices);
+    }
+
 public:
     timeline(vxg::cloud::agent::proto::access_token::ptr access_token,
              transport::libwebsockets::http::ptr http = nullptr)
         : storage_ {std::make_shared<T>(access_token, http)} {}
     timeline(std::string path) : storage_ {std::make_shared<T>(path)} {}
+    timeline(std::shared_ptr<T> storage) : storage_ {storage} {}
 
     std::vector<period> _squash_periods(
         std::vector<timed_storage::item_ptr> periods) {
@@ -459,8 +594,65 @@ public:
 
 public:
     std::vector<period> slices(cloud::time start, cloud::time stop) {
-        return _squash_periods(storage_->list(start, stop));
+        auto now = utils::time::now();
+        period p {start, stop};
+
+        if (ttl_ == cloud::duration(0))
+            return _squash_periods(storage_->list(start, stop));
+
+        __expire(now);
+
+        if (known_.covers(p)) {
+            hits_++;
+            return slices_.intersecting(p);
+        }
+
+        misses_++;
+
+        auto fetched = _squash_periods(storage_->list(start, stop));
+
+        // Storage data is authoritative for the requested period
+        slices_.remove(p);
+        __learn(p, now);
+        for (auto& s : fetched) {
+            slices_.add(s);
+            // Listed slices are not clipped by the requested period, we know
+            // the data is present along the whole slice
+            __learn(s, now);
+        }
+
+        return slices_.intersecting(p);
     }
+
+    //! @brief Add the period of the data stored without the timeline.
+    //!
+    //! Optimistic update of the cache after the successful upload.
+    void add(period p) {
+        if (ttl_ == cloud::duration(0) || !p.is_valid())
+            return;
+
+        auto now = utils::time::now();
+
+        __expire(now);
+        slices_.add(p);
+        __learn(p, now);
+    }
+
+    //! @brief Drop all cached slices.
+    void invalidate() {
+        slices_.clear();
+        known_.clear();
+        fetches_.clear();
+    }
+
+    //! @brief Set the cached slices lifetime, zero disables caching.
+    void set_cache_ttl(cloud::duration ttl) {
+        ttl_ = ttl;
+        invalidate();
+    }
+
+    size_t cache_hits() { return hits_; }
+    size_t cache_misses() { return misses_; }
 };
 
 }  // namespace cloud
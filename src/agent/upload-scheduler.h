@@ -0,0 +1,299 @@
+#pragma once
+
+#include <utils/logging.h>
+#include <utils/utils.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+
+namespace vxg {
+namespace cloud {
+namespace agent {
+
+//! @brief Priority-aware direct upload scheduler.
+//!
+//! Pending uploads are queued per upload class. Every class has its own base
+//! priority, concurrency quota and max queueing time. The next upload to start
+//! is the head of the class with the best effective priority, a head's
+//! effective priority is raised by one level for each aging step it waited in
+//! the queue, so the low priority uploads are not starving during bursts of
+//! the urgent ones. Uploads which were not started before their deadline are
+//! dropped.
+//!
+//! The scheduler is not thread-safe, agent::manager calls it only from the
+//! direct upload timer callbacks which are serialized.
+class upload_scheduler {
+    vxg::logger::logger_ptr logger {vxg::logger::instance("upload-scheduler")};
+
+public:
+    //! Upload classes ordered by the base priority, the first is most urgent.
+    enum upload_class {
+        UPC_SNAPSHOT,
+        UPC_EVENT_RECORD,
+        UPC_FILE_META,
+        UPC_TIMELINE_RECORD,
+
+        UPC_MAX
+    };
+
+    //! Releases the upload slot, must be called when the upload finished.
+    using release_cb = std::function<void()>;
+
+    struct task {
+        upload_class cls {UPC_EVENT_RECORD};
+        //! Enqueue time, filled by push()
+        cloud::time enqueued {utils::time::null()};
+        //! Task is dropped if it was not started until this time, if max
+        //! the class's max_wait is used
+        cloud::time deadline {utils::time::max()};
+        //! Memorycard synchronization ticket, empty for other uploads
+        std::string ticket;
+        //! Starts the upload, returns false if upload was not started, the
+        //! slot is released by the scheduler in this case.
+        std::function<bool(release_cb)> start {nullptr};
+        //! Called when the task is removed without being started: dropped
+        //! because of the deadline, canceled or cleared
+        std::function<void()> drop {nullptr};
+        //! Canceled tasks are removed from the queue and dropped
+        std::function<bool()> is_canceled {[]() { return false; }};
+    };
+
+    struct class_config {
+        //! Max number of the concurrent uploads of the class
+        size_t quota {1};
+        //! Max queueing time, zero means no limit
+        cloud::duration max_wait {cloud::duration(0)};
+    };
+
+private:
+    std::array<std::deque<task>, UPC_MAX> queues_;
+    std::array<class_config, UPC_MAX> configs_;
+    std::array<size_t, UPC_MAX> in_flight_;
+    size_t max_in_flight_ {8};
+    cloud::duration aging_step_ {std::chrono::seconds(30)};
+
+    static const char* __class_name(upload_class cls) {
+        switch (cls) {
+            case UPC_SNAPSHOT:
+                return "snapshot";
+            case UPC_EVENT_RECORD:
+                return "event record";
+            case UPC_FILE_META:
+                return "file meta";
+            case UPC_TIMELINE_RECORD:
+                return "timeline record";
+            default:
+                return "unknown";
+        }
+    }
+
+    int __effective_priority(const task& t, cloud::time now) {
+        int prio = static_cast<int>(t.cls);
+
+        if (aging_step_ > cloud::duration(0) && now > t.enqueued)
+            prio -= static_cast<int>((now - t.enqueued) / aging_step_);
+
+        return std::max(prio, 0);
+    }
+
+    bool __class_has_slot(size_t cls) {
+        return in_flight() < max_in_flight_ &&
+               in_flight_[cls] < configs_[cls].quota;
+    }
+
+    //! Pick the head task with the best effective priority among classes
+    //! with free upload slots, older task wins if priorities are equal.
+    bool __pop(task& result, cloud::time now) {
+        int best_cls = -1;
+        int best_prio = 0;
+
+        for (size_t cls = 0; cls < UPC_MAX; cls++) {
+            auto& q = queues_[cls];
+
+            // Canceled tasks are not the candidates
+            while (!q.empty() && q.front().is_canceled()) {
+                task canceled = std::move(q.front());
+
+                q.pop_front();
+                logger->info("Planned {} upload canceled",
+                             __class_name(canceled.cls));
+                if (canceled.drop)
+                    canceled.drop();
+            }
+
+            if (q.empty() || !__class_has_slot(cls))
+                continue;
+
+            int prio = __effective_priority(q.front(), now);
+            if (best_cls < 0 || prio < best_prio ||
+                (prio == best_prio &&
+                 q.front().enqueued < queues_[best_cls].front().enqueued)) {
+                best_cls = cls;
+                best_prio = prio;
+            }
+        }
+
+        if (best_cls < 0)
+            return false;
+
+        result = std::move(queues_[best_cls].front());
+        queues_[best_cls].pop_front();
+
+        return true;
+    }
+
+    release_cb __make_release_cb(upload_class cls) {
+        auto released = std::make_shared<std::atomic<bool>>(false);
+
+        return [this, cls, released]() {
+            // Release only once, upload finalization may be reported twice
+            // on error paths
+            if (!released->exchange(true) && in_flight_[cls] > 0)
+                in_flight_[cls]--;
+        };
+    }
+
+public:
+    upload_scheduler() {
+        in_flight_.fill(0);
+        configs_.fill(class_config());
+    }
+
+    //! @brief Set concurrency quota and max queueing time of the class.
+    void configure(upload_class cls, size_t quota, cloud::duration max_wait) {
+        configs_[cls].quota = quota;
+        configs_[cls].max_wait = max_wait;
+    }
+
+    //! @brief Max number of concurrent uploads of all classes.
+    void set_max_in_flight(size_t max) { max_in_flight_ = max; }
+
+    //! @brief Time of waiting in the queue which raises task's priority by
+    //! one level, zero disables aging.
+    void set_aging_step(cloud::duration step) { aging_step_ = step; }
+
+    void push(task t) {
+        t.enqueued = utils::time::now();
+
+        if (t.deadline == utils::time::max() &&
+            configs_[t.cls].max_wait > cloud::duration(0))
+            t.deadline = t.enqueued + configs_[t.cls].max_wait;
+
+        logger->debug("Enqueue {} upload, queued {}, in flight {}",
+                      __class_name(t.cls), queues_[t.cls].size() + 1,
+                      in_flight_[t.cls]);
+
+        queues_[t.cls].push_back(std::move(t));
+    }
+
+    //! @brief Drop all tasks with the deadline in the past.
+    //!
+    //! @return Number of dropped tasks.
+    size_t drop_late() {
+        auto now = utils::time::now();
+        size_t dropped = 0;
+
+        for (auto& q : queues_) {
+            q.erase(std::remove_if(q.begin(), q.end(),
+                                   [&](const task& t) {
+                                       bool late = t.deadline < now;
+                                       if (late) {
+                                           logger->info(
+                                               "Drop too late planned {} "
+                                               "upload",
+                                               __class_name(t.cls));
+                                           if (t.drop)
+                                               t.drop();
+                                           dropped++;
+                                       }
+                                       return late;
+                                   }),
+                    q.end());
+        }
+
+        return dropped;
+    }
+
+    //! @brief Start queued tasks while there are free upload slots.
+    //!
+    //! @return Number of started tasks.
+    size_t dispatch() {
+        auto now = utils::time::now();
+        size_t started = 0;
+        task t;
+
+        while (__pop(t, now)) {
+            auto release = __make_release_cb(t.cls);
+
+            in_flight_[t.cls]++;
+            if (t.start && t.start(release))
+                started++;
+            else
+                release();
+        }
+
+        return started;
+    }
+
+    //! @brief Remove all tasks with specified memorycard sync ticket.
+    //!
+    //! @return Number of removed tasks.
+    size_t cancel_by_ticket(const std::string& ticket) {
+        size_t canceled = 0;
+
+        if (ticket.empty())
+            return 0;
+
+        for (auto& q : queues_) {
+            q.erase(std::remove_if(q.begin(), q.end(),
+                                   [&](const task& t) {
+                                       bool cancel = (t.ticket == ticket);
+                                       if (cancel && t.drop)
+                                           t.drop();
+                                       canceled += cancel;
+                                       return cancel;
+                                   }),
+                    q.end());
+        }
+
+        return canceled;
+    }
+
+    //! @brief Remove and drop all tasks.
+    void clear() {
+        for (auto& q : queues_) {
+            std::deque<task> removed;
+
+            removed.swap(q);
+            for (auto& t : removed)
+                if (t.drop)
+                    t.drop();
+        }
+    }
+
+    size_t size(upload_class cls) { return queues_[cls].size(); }
+
+    size_t size() {
+        size_t result = 0;
+        for (auto& q : queues_)
+            result += q.size();
+        return result;
+    }
+
+    size_t in_flight(upload_class cls) { return in_flight_[cls]; }
+
+    size_t in_flight() {
+        size_t result = 0;
+        for (auto n : in_flight_)
+            result += n;
+        return result;
+    }
+};
+
+}  // namespace agent
+}  // namespace cloud
+}  // namespace vxg
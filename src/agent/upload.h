@@ -33,6 +33,8 @@ public:
         atomic_bool finished {false};
         //! Realtime delay between chunks processing
         atomic_bool realtime {true};
+        //! Periodic timeline upload, not triggered by an event
+        atomic_bool periodic {false};
         agent::media::stream::ptr seg_provider {nullptr};
         proto::event_object trigger;
         std::string ticket;
@@ -166,7 +168,13 @@ protected:
 
         getUploadUrl.is_canceled = [segment]() { return !!segment->canceled; };
 
-        getUploadUrl.on_finished = [this, segment, latest_time](bool ok) {
+        cloud::period uploaded(getUploadUrl);
+        getUploadUrl.on_finished = [this, segment, latest_time,
+                                    uploaded](bool ok) {
+            // Cloud has this chunk now, no need to request it from the Cloud
+            if (ok)
+                __timeline_add_uploaded(uploaded);
+
             segment->uploads_done += ok;
             segment->uploads_failed += !ok;
             segment->finished =
@@ -190,6 +198,11 @@ protected:
         };
     }
 
+    // Timeline is accessed only from the serialized timed callbacks
+    void __timeline_add_uploaded(cloud::period p) {
+        http_->schedule_timed_cb([this, p]() { cloud_timeline_.add(p); }, 0);
+    }
+
     bool __segment_step(segmenter_ptr segment) {
         using namespace std::chrono;
 
@@ -343,6 +356,7 @@ protected:
                         clip.tp_stop - clip.tp_start);
                 getUploadUrl.size = clip.data.size();
                 getUploadUrl.stream_id = segment->seg_provider->cloud_name();
+                getUploadUrl.periodic = segment->periodic;
 
                 segment->uploads_planned++;
 
@@ -0,0 +1,394 @@
+#include "event-loop.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <future>
+
+namespace vxg {
+namespace cloud {
+namespace transport {
+
+constexpr int event_loop::MAX_EVENTS;
+constexpr uint64_t event_loop::WAKEUP_ID;
+
+event_loop::~event_loop() {
+    if (in_loop_thread()) {
+        bool unused = false;
+
+        // Destroyed by its own callback, the loop thread leaves as soon as the
+        // callback returns
+        if (destroyed_)
+            *destroyed_ = true;
+        __shutdown(unused);
+        thread_.detach();
+        return;
+    }
+
+    stop();
+}
+
+event_loop::ptr event_loop::shared() {
+    static std::mutex lock;
+    static ptr loop;
+    std::lock_guard<std::mutex> _lock(lock);
+
+    if (!loop) {
+        loop = std::make_shared<event_loop>();
+        loop->start("shared-loop");
+    }
+
+    return loop;
+}
+
+bool event_loop::start(const std::string& name) {
+    struct epoll_event ev;
+
+    if (running_)
+        return true;
+
+    // Stopped from the loop thread which is not joined yet
+    if (thread_.joinable()) {
+        if (in_loop_thread())
+            return false;
+        thread_.join();
+    }
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wakeup_fd_ < 0) {
+        logger->error("Failed to create epoll: {}", strerror(errno));
+        goto fail;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = WAKEUP_ID;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &ev) < 0) {
+        logger->error("Failed to watch wakeup fd: {}", strerror(errno));
+        goto fail;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        accepting_ = true;
+    }
+    running_ = true;
+    thread_ = std::thread(&event_loop::__run, this, name);
+
+    return true;
+fail:
+    if (epoll_fd_ >= 0)
+        close(epoll_fd_);
+    if (wakeup_fd_ >= 0)
+        close(wakeup_fd_);
+    epoll_fd_ = wakeup_fd_ = -1;
+
+    return false;
+}
+
+void event_loop::stop() {
+    running_ = false;
+
+    // The loop exits and tears down when the current iteration is finished
+    if (in_loop_thread())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (wakeup_fd_ >= 0)
+            __wakeup();
+    }
+
+    if (thread_.joinable())
+        thread_.join();
+
+    __teardown();
+}
+
+bool event_loop::__shutdown(const bool& destroyed) {
+    // Tasks posted from now on are run in place
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        accepting_ = false;
+    }
+    if (!__run_tasks(destroyed))
+        return false;
+    running_ = false;
+    __teardown();
+
+    return true;
+}
+
+void event_loop::__teardown() {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    timers_.clear([](timer_wheel::node* n) {
+        auto t = std::move(static_cast<timed_cb_priv*>(n)->self);
+
+        if (t)
+            t->state = timed_cb::CANCELED;
+    });
+    sources_.clear();
+    fds_.clear();
+
+    if (epoll_fd_ >= 0)
+        close(epoll_fd_);
+    if (wakeup_fd_ >= 0)
+        close(wakeup_fd_);
+    epoll_fd_ = wakeup_fd_ = -1;
+}
+
+bool event_loop::add(int fd, uint32_t events, event_cb cb) {
+    std::lock_guard<std::mutex> lock(lock_);
+    struct epoll_event ev;
+
+    if (epoll_fd_ < 0 || fds_.count(fd))
+        return false;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.u64 = next_id_;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        logger->error("Failed to watch fd {}: {}", fd, strerror(errno));
+        return false;
+    }
+
+    auto s = std::make_shared<source>();
+    s->fd = fd;
+    s->cb = std::move(cb);
+    sources_[next_id_] = s;
+    fds_[fd] = next_id_++;
+
+    return true;
+}
+
+bool event_loop::modify(int fd, uint32_t events) {
+    std::lock_guard<std::mutex> lock(lock_);
+    struct epoll_event ev;
+    auto it = fds_.find(fd);
+
+    if (it == fds_.end())
+        return false;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.u64 = it->second;
+
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void event_loop::remove(int fd) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = fds_.find(fd);
+
+    if (it == fds_.end())
+        return;
+
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    sources_.erase(it->second);
+    fds_.erase(it);
+}
+
+void event_loop::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+
+        if (accepting_) {
+            tasks_.push_back(std::move(task));
+            if (!in_loop_thread())
+                __wakeup();
+            return;
+        }
+    }
+
+    task();
+}
+
+void event_loop::invoke(std::function<void()> task) {
+    if (in_loop_thread() || !running_) {
+        task();
+        return;
+    }
+
+    std::promise<void> done;
+    post([&]() {
+        task();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+timed_cb_ptr event_loop::schedule_timed_cb(std::function<void()> cb,
+                                           size_t ms) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    if (!accepting_)
+        return nullptr;
+
+    auto t = std::make_shared<timed_cb>();
+    auto priv = std::make_shared<timed_cb_priv>();
+    uint64_t now = __now_ms();
+
+    t->priv = priv;
+    t->state = timed_cb::PENDING;
+    t->cb = std::move(cb);
+    // The wheel's time is advanced only by the loop, sync it with the
+    // current time if there are no timers to keep the placement cheap
+    if (timers_.empty())
+        timers_.advance(now, [](timer_wheel::node*) {});
+
+    // This refs t until it's triggered or canceled
+    priv->self = t;
+    timers_.add(priv.get(), now + ms);
+
+    // The loop recalculates its sleep time after the callbacks
+    if (!in_loop_thread())
+        __wakeup();
+
+    return t;
+}
+
+void event_loop::cancel_timed_cb(timed_cb_ptr t) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    if (t && t->priv && t->state == timed_cb::PENDING) {
+        auto priv = std::static_pointer_cast<timed_cb_priv>(t->priv);
+
+        if (priv->linked())
+            timers_.remove(priv.get());
+        priv->self.reset();
+        t->state = timed_cb::CANCELED;
+    }
+}
+
+void event_loop::__wakeup() {
+    eventfd_write(wakeup_fd_, 1);
+}
+
+int event_loop::__timeout() {
+    std::lock_guard<std::mutex> lock(lock_);
+    uint64_t tick;
+    uint64_t now = __now_ms();
+
+    // Posted from the loop thread, which doesn't wake up the loop
+    if (!tasks_.empty())
+        return 0;
+
+    if (!timers_.next_tick(tick))
+        return -1;
+
+    return tick > now ? static_cast<int>(std::min<uint64_t>(tick - now,
+                                                            INT32_MAX))
+                      : 0;
+}
+
+bool event_loop::__run_timers(const bool& destroyed) {
+    std::vector<timed_cb_ptr> expired;
+
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+
+        timers_.advance(__now_ms(), [&expired](timer_wheel::node* n) {
+            expired.push_back(std::move(static_cast<timed_cb_priv*>(n)->self));
+        });
+    }
+
+    // Callbacks are called without the lock held so they can schedule and
+    // cancel timers
+    for (auto& t : expired) {
+        if (!t || t->state != timed_cb::PENDING)
+            continue;
+
+        // The rest of the expired timers are canceled by the destroyed loop
+        if (destroyed) {
+            t->state = timed_cb::CANCELED;
+            continue;
+        }
+
+        if (t->cb)
+            t->cb();
+        // t->state may be changed in cb()
+        if (t->state == timed_cb::PENDING)
+            t->state = timed_cb::TRIGGERED;
+    }
+
+    return !destroyed;
+}
+
+bool event_loop::__run_tasks(const bool& destroyed) {
+    std::vector<std::function<void()>> tasks;
+
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        tasks.swap(tasks_);
+    }
+
+    // The rest of the tasks are run even if the loop is destroyed by one of
+    // them, as the posted tasks are run on stop
+    for (auto& task : tasks)
+        task();
+
+    return !destroyed;
+}
+
+void event_loop::__run(std::string name) {
+    struct epoll_event events[MAX_EVENTS];
+    bool destroyed = false;
+
+    destroyed_ = &destroyed;
+    utils::set_thread_name(name);
+    logger->info("{} started", name);
+
+    while (running_) {
+        int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, __timeout());
+
+        if (n < 0 && errno != EINTR) {
+            logger->error("epoll_wait failed: {}", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            std::shared_ptr<source> s;
+
+            if (events[i].data.u64 == WAKEUP_ID) {
+                eventfd_t value;
+                eventfd_read(wakeup_fd_, &value);
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(lock_);
+                auto it = sources_.find(events[i].data.u64);
+
+                // Removed by the callback of the previous event
+                if (it == sources_.end())
+                    continue;
+                s = it->second;
+            }
+
+            s->cb(events[i].events);
+            // The loop is freed, nothing of it can be touched
+            if (destroyed)
+                return;
+        }
+
+        if (!__run_timers(destroyed) || !__run_tasks(destroyed))
+            return;
+    }
+
+    if (!__shutdown(destroyed))
+        return;
+    destroyed_ = nullptr;
+
+    logger->info("{} stopped", name);
+}
+
+}  // namespace transport
+}  // namespace cloud
+}  // namespace vxg
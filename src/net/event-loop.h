@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "timer-wheel.h"
+#include "transport.h"
+
+namespace vxg {
+namespace cloud {
+namespace transport {
+
+//! @brief Single thread epoll event loop.
+//!
+//! Watches file descriptors, runs the timed callbacks and the tasks posted
+//! from other threads, all the callbacks are called on the loop thread. The
+//! thread sleeps in epoll_wait() until an fd event, the nearest timer or a
+//! posted task, an idle loop doesn't consume CPU.
+//!
+//! Lets many sources share one thread instead of a thread per source, the
+//! callbacks must not block.
+class event_loop : public timed_callback {
+    vxg::logger::logger_ptr logger {vxg::logger::instance("event-loop")};
+
+public:
+    using ptr = std::shared_ptr<event_loop>;
+    //! Called on the loop thread with the epoll events of the fd
+    using event_cb = std::function<void(uint32_t events)>;
+
+    event_loop() {}
+    virtual ~event_loop();
+
+    //! @brief Start the loop thread.
+    //!
+    //! The loop may be destroyed by its own callback, the loop thread tears
+    //! it down in place and leaves without touching the destroyed loop.
+    bool start(const std::string& name = "event-loop");
+
+    //! @brief Stop the loop thread.
+    //!
+    //! Pending timers are canceled, the fds are unwatched and the posted tasks
+    //! are run before the return. If called from the loop thread the loop is
+    //! stopped and torn down by the loop thread itself when the current
+    //! iteration is finished, the thread is joined by the next start() or
+    //! stop() from another thread.
+    void stop();
+
+    bool running() const { return running_; }
+
+    //! Loop shared by the library's subsystems, started on the first call
+    static ptr shared();
+
+    //! @brief Watch @p fd.
+    //!
+    //! @param events Epoll events, EPOLLET may be used.
+    //! @param cb Events callback.
+    //! @return false if the loop is not running or epoll_ctl() failed.
+    bool add(int fd, uint32_t events, event_cb cb);
+
+    bool modify(int fd, uint32_t events);
+
+    //! @brief Stop watching @p fd, must be called before the fd is closed.
+    //!
+    //! Events fetched by the loop but not yet delivered are dropped, if called
+    //! from another thread the callback may be running during the call.
+    void remove(int fd);
+
+    //! @brief Run @p task on the loop thread.
+    //!
+    //! The task is run in place if the loop is not running.
+    void post(std::function<void()> task);
+
+    //! @brief Run @p task on the loop thread and wait for it.
+    //!
+    //! The task is run in place if called from the loop thread or the loop is
+    //! not running.
+    void invoke(std::function<void()> task);
+
+    bool in_loop_thread() const {
+        return std::this_thread::get_id() == thread_.get_id();
+    }
+
+    //! @return nullptr if the loop is not running.
+    timed_cb_ptr schedule_timed_cb(std::function<void()> cb,
+                                   size_t ms = 0) override;
+    void cancel_timed_cb(timed_cb_ptr t) override;
+
+private:
+    //! Timed callback's private data, the node of the timers wheel
+    struct timed_cb_priv : public timer_wheel::node {
+        //! Keeps the timer alive while it's pending in the wheel
+        timed_cb_ptr self;
+    };
+
+    struct source {
+        int fd;
+        event_cb cb;
+    };
+
+    static constexpr int MAX_EVENTS = 64;
+    //! Epoll data of the wakeup eventfd, sources ids start from 1
+    static constexpr uint64_t WAKEUP_ID = 0;
+
+    int epoll_fd_ {-1};
+    int wakeup_fd_ {-1};
+    std::thread thread_;
+    std::atomic<bool> running_ {false};
+
+    //! Protects everything below
+    std::mutex lock_;
+    //! Posted tasks are accepted only while the loop thread runs
+    bool accepting_ {false};
+    std::vector<std::function<void()>> tasks_;
+    //! Sources by id, ids are never reused so the stale events of the
+    //! removed fd can't be delivered to the new source with the same fd
+    std::unordered_map<uint64_t, std::shared_ptr<source>> sources_;
+    std::unordered_map<int, uint64_t> fds_;
+    uint64_t next_id_ {WAKEUP_ID + 1};
+    timer_wheel timers_ {__now_ms()};
+    //! Loop thread's flag set by the destructor called from a callback, used
+    //! only on the loop thread
+    bool* destroyed_ {nullptr};
+
+    static uint64_t __now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    void __wakeup();
+    //! Cancel the timers, unwatch the fds and close the epoll
+    void __teardown();
+    //! @brief Stop accepting the tasks, run the posted ones and tear down.
+    //! @return false if the loop was destroyed by a task.
+    bool __shutdown(const bool& destroyed);
+    //! epoll_wait() timeout until the nearest timer
+    int __timeout();
+    //! @return false if the loop was destroyed by a callback.
+    bool __run_timers(const bool& destroyed);
+    //! @return false if the loop was destroyed by a task.
+    bool __run_tasks(const bool& destroyed);
+    void __run(std::string name);
+};
+
+}  // namespace transport
+}  // namespace cloud
+}  // namespace vxg
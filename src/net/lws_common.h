@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstring>
 #include <functional>
 #include <future>
 #include <iomanip>
@@ -8,6 +9,7 @@
 
 #include <libwebsockets.h>
 
+#include "timer-wheel.h"
 #include "transport.h"
 
 namespace vxg {
@@ -16,13 +18,38 @@ namespace transport {
 namespace libwebsockets {
 
 class lws_common : public worker {
+public:
+    //! Timed callback's private data, the node of the timers wheel
+    struct timed_cb_priv : public timer_wheel::node {
+        //! Keeps the timer alive while it's pending in the wheel
+        timed_cb_ptr self;
+    };
+
 protected:
     struct lws_context* lws_context_ {nullptr};
     struct lws* client_wsi_ {nullptr};
     lws_retry_bo_t lws_retry_;
     std::mutex lws_timers_queue_lock_;
-    std::vector<timed_cb_ptr> scheduled_callbacks_;
 
+private:
+    //! Single lws timer which drives the timers wheel
+    struct timers_tick {
+        lws_sorted_usec_list_t sul;
+        lws_common* owner {nullptr};
+        bool armed {false};
+        uint64_t tick {0};
+    };
+
+    timer_wheel timers_ {__now_ms()};
+    timers_tick timers_tick_;
+
+    static uint64_t __now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+protected:
     static std::string __get_this_tid() {
         std::stringstream ss;
         ss << std::hex << std::showbase << std::setw(8) << std::setfill('0')
@@ -32,74 +59,95 @@ protected:
 
 public:
     lws_common(std::function<void(transport::Data&)> handler = nullptr)
-        : worker(handler) {}
+        : worker(handler) {
+        memset(&timers_tick_.sul, 0, sizeof(timers_tick_.sul));
+        timers_tick_.owner = this;
+    }
 
     virtual ~lws_common() { stop(); }
 
     virtual bool stop() override {
         std::lock_guard<std::mutex> _lock(lws_timers_queue_lock_);
-        for (auto& cb : scheduled_callbacks_)
-            _cancel_timed_cb(cb);
-        _cleanup();
+
+        timers_.clear([](timer_wheel::node* n) {
+            auto priv = static_cast<timed_cb_priv*>(n);
+            auto t = std::move(priv->self);
+
+            if (t)
+                t->state = timed_cb::CANCELED;
+        });
+        _disarm_tick();
+
         return true;
     }
 
-    struct timed_cb_priv {
-        struct lws_sorted_usec_list sul;
-        timed_cb_weak_ptr owner;
-    };
-
 private:
-    void _cleanup() {
-        if (!scheduled_callbacks_.empty())
-            scheduled_callbacks_.erase(
-                std::remove_if(
-                    scheduled_callbacks_.begin(), scheduled_callbacks_.end(),
-                    [](timed_cb_ptr t) {
-                        if (t->state != timed_cb::PENDING) {
-                            vxg::logger::instance("lws-common")
-                                ->trace("Cleanup timer {} state {}",
-                                        (void*)(t.get()),
-                                        (t->state == timed_cb::TRIGGERED
-                                             ? "TRIGGERED"
-                                             : "CANCELED"));
-                            vxg::logger::instance("lws-common")->flush();
-                        }
-                        return (t->state != timed_cb::PENDING);
-                    }),
-                scheduled_callbacks_.end());
+    //! Must be called with the lws_timers_queue_lock_ held
+    void _disarm_tick() {
+        if (timers_tick_.armed && lws_context_)
+            lws_sul_schedule(lws_context_, 0, &timers_tick_.sul,
+                             (sul_cb_t)0xffffffff, LWS_SET_TIMER_USEC_CANCEL);
+        timers_tick_.armed = false;
+    }
+
+    //! Schedule the lws timer to the next wheel's tick if it's earlier than
+    //! already scheduled one. Must be called with the lws_timers_queue_lock_
+    //! held.
+    void _arm_tick(uint64_t now) {
+        uint64_t tick;
+
+        if (!lws_context_)
+            return;
+
+        if (!timers_.next_tick(tick)) {
+            _disarm_tick();
+            return;
+        }
+
+        if (timers_tick_.armed && timers_tick_.tick <= tick)
+            return;
+
+        timers_tick_.armed = true;
+        timers_tick_.tick = tick;
+        lws_sul_schedule(lws_context_, 0, &timers_tick_.sul, _tick_cb,
+                         (tick > now ? tick - now : 0) * LWS_US_PER_MS);
     }
 
     void _cancel_timed_cb(timed_cb_ptr cb_id) {
-        if (cb_id && cb_id->priv && cb_id->state == timed_cb::PENDING &&
-            lws_context_) {
+        if (cb_id && cb_id->priv && cb_id->state == timed_cb::PENDING) {
             auto priv = std::static_pointer_cast<timed_cb_priv>(cb_id->priv);
 
             vxg::logger::instance("lws-common")
                 ->trace("Canceling timer {} on TID:{}", (void*)cb_id.get(),
                         __get_this_tid());
-            vxg::logger::instance("lws-common")->flush();
 
-            lws_sul_schedule(lws_context_, 0,
-                             static_cast<lws_sorted_usec_list_t*>(&priv->sul),
-                             (sul_cb_t)0xffffffff, LWS_SET_TIMER_USEC_CANCEL);
+            timers_.remove(priv.get());
+            priv->self.reset();
 
             cb_id->state = timed_cb::CANCELED;
         }
     }
 
-// Explicitly disable offsetof warning as usage is valid here
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Winvalid-offsetof"
-    static void _sul_cb(struct lws_sorted_usec_list* sul) {
-        struct timed_cb_priv* t =
-            lws_container_of(sul, struct timed_cb_priv, sul);
-        if (auto w = t->owner.lock()) {
+    //! Expire all due timers of the wheel in a batch, callbacks are called
+    //! without the lock held so they can schedule and cancel timers.
+    void _on_tick() {
+        std::vector<timed_cb_ptr> expired;
+
+        {
+            std::lock_guard<std::mutex> _lock(lws_timers_queue_lock_);
+
+            timers_tick_.armed = false;
+            timers_.advance(__now_ms(), [&expired](timer_wheel::node* n) {
+                expired.push_back(
+                    std::move(static_cast<timed_cb_priv*>(n)->self));
+            });
+        }
+
+        for (auto& w : expired) {
             if (w && w->state == timed_cb::PENDING) {
                 vxg::logger::instance("lws-common")
                     ->trace("Calling timed callback {} on TID:{}",
                             (void*)w.get(), __get_this_tid());
-                vxg::logger::instance("lws-common")->flush();
                 if (w->cb)
                     w->cb();
                 // w->state may be changed in cb()
@@ -107,42 +155,46 @@ private:
                     w->state = timed_cb::TRIGGERED;
             }
         }
+
+        std::lock_guard<std::mutex> _lock(lws_timers_queue_lock_);
+        _arm_tick(__now_ms());
+    }
+
+    static void _tick_cb(struct lws_sorted_usec_list* sul) {
+        struct timers_tick* t = lws_container_of(sul, struct timers_tick, sul);
+
+        t->owner->_on_tick();
     }
-#pragma GCC diagnostic pop
+
 public:
     virtual std::shared_ptr<timed_cb> schedule_timed_cb(
         std::function<void()> cb,
         size_t ms) {
         std::lock_guard<std::mutex> _lock(lws_timers_queue_lock_);
+
+        if (!lws_context_)
+            return nullptr;
+
         auto t = std::make_shared<timed_cb>();
         auto priv = std::make_shared<timed_cb_priv>();
+        uint64_t now = __now_ms();
 
-        // Cleanup all canceled or triggered timers
-        _cleanup();
-
-        // This also refs t
-        priv->owner = t;
         t->priv = priv;
         t->state = timed_cb::PENDING;
-        scheduled_callbacks_.push_back(t);
-
-        // Handle callback in 2 stages, we pass sul_cb_t as callback to lws and
-        // call real callback inside this wrapper callback
         t->cb = cb;
+        // The wheel's time is advanced only by the tick, sync it with the
+        // current time if there are no timers to keep the placement cheap
+        if (timers_.empty())
+            timers_.advance(now, [](timer_wheel::node*) {});
 
-        // LWSSULLI_WAKE_IF_SUSPENDED flag used to wakeup device if it went to
-        // powersafe mode
-        if (lws_context_) {
-            vxg::logger::instance("lws-common")
-                ->trace("Scheduling timer {} on TID:{}", (void*)t.get(),
-                        __get_this_tid());
-            vxg::logger::instance("lws-common")->flush();
+        // This refs t until it's triggered or canceled
+        priv->self = t;
+        timers_.add(priv.get(), now + ms);
+        _arm_tick(now);
 
-            lws_sul_schedule(lws_context_, 0,
-                             static_cast<lws_sorted_usec_list_t*>(&priv->sul),
-                             _sul_cb, ms * LWS_US_PER_MS);
-        } else
-            t = nullptr;
+        vxg::logger::instance("lws-common")
+            ->trace("Scheduling timer {} on TID:{}", (void*)t.get(),
+                    __get_this_tid());
 
         return t;
     }
@@ -152,16 +204,16 @@ public:
     //! @param cb_id Timed callback
     virtual void cancel_timed_cb(timed_cb_ptr cb_id) {
         if (cb_id && running_) {
-            // If we are canceling from the timed callback itself we don't need
-            // to serialize anything, just call cancellation code directly
-            if (std::this_thread::get_id() == this->thr_.get_id()) {
-                _cancel_timed_cb(cb_id);
-            } else {
-                std::lock_guard<std::mutex> _lock(lws_timers_queue_lock_);
-                _cancel_timed_cb(cb_id);
-            }
+            std::lock_guard<std::mutex> _lock(lws_timers_queue_lock_);
+            _cancel_timed_cb(cb_id);
         }
     }
+
+    //! @brief Number of pending timed callbacks.
+    size_t timed_cb_count() {
+        std::lock_guard<std::mutex> _lock(lws_timers_queue_lock_);
+        return timers_.size();
+    }
 };
 }  // namespace libwebsockets
 }  // namespace transport
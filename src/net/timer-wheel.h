@@ -0,0 +1,241 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vxg {
+namespace cloud {
+namespace transport {
+
+//! @brief Hierarchical timing wheel.
+//!
+//! Timers are kept in the intrusive lists of 4 levels with 64 slots each, the
+//! slot of the level N covers 64^N ticks. Timer is placed to the lowest level
+//! which covers its expiry time, timers of the upper levels are cascaded down
+//! when the wheel's time crosses the slot boundary. Adding and removing of the
+//! timer are O(1), expiry is processed in batches of the slot.
+//!
+//! Timers which don't fit the wheel's span (64^4 ticks) are parked in the
+//! farthest slot of the top level and re-placed during the cascading.
+//!
+//! The wheel doesn't own the nodes and is not thread-safe.
+class timer_wheel {
+public:
+    static const size_t BITS = 6;
+    static const size_t SLOTS = 1 << BITS;
+    static const size_t MASK = SLOTS - 1;
+    static const size_t LEVELS = 4;
+
+    //! Intrusive timer node, must stay valid while linked to the wheel
+    struct node {
+        uint64_t expires {0};
+        node* prev {nullptr};
+        node* next {nullptr};
+        int level {-1};
+        size_t slot {0};
+
+        bool linked() const { return level >= 0; }
+    };
+
+private:
+    node* slots_[LEVELS][SLOTS];
+    uint64_t occupancy_[LEVELS];
+    uint64_t current_;
+    size_t size_ {0};
+
+    static uint64_t __span(size_t level) { return 1ull << (BITS * level); }
+
+    //! Link node to the slot according to its expiry, nodes expiring earlier
+    //! than @p min_tick are placed to the @p min_tick slot
+    void __link(node* n, uint64_t min_tick) {
+        uint64_t expires = n->expires < min_tick ? min_tick : n->expires;
+        uint64_t delta = expires - current_;
+        size_t level = 0;
+
+        while (level < LEVELS - 1 && delta >= __span(level + 1))
+            level++;
+
+        // Park too far timers in the farthest top level slot
+        if (delta >= __span(LEVELS))
+            expires = current_ + __span(LEVELS) - 1;
+
+        size_t slot = (expires >> (BITS * level)) & MASK;
+
+        n->level = level;
+        n->slot = slot;
+        n->prev = nullptr;
+        n->next = slots_[level][slot];
+        if (n->next)
+            n->next->prev = n;
+        slots_[level][slot] = n;
+        occupancy_[level] |= (1ull << slot);
+    }
+
+    //! @brief Start tick of the nearest occupied slot of the @p level after
+    //! the current one, the slot is expired or cascaded at this tick.
+    //!
+    //! The level must be occupied. The current slot index is the farthest
+    //! one, its nodes are the next round's.
+    uint64_t __next_slot_tick(size_t level) const {
+        uint64_t base = current_ >> (BITS * level);
+        size_t start = (base + 1) & MASK;
+        uint64_t rotated =
+            (occupancy_[level] >> start) |
+            (start ? occupancy_[level] << (SLOTS - start) : 0);
+
+        return (base + 1 + __builtin_ctzll(rotated)) << (BITS * level);
+    }
+
+    void __unlink(node* n) {
+        if (n->prev)
+            n->prev->next = n->next;
+        else
+            slots_[n->level][n->slot] = n->next;
+
+        if (n->next)
+            n->next->prev = n->prev;
+
+        if (!slots_[n->level][n->slot])
+            occupancy_[n->level] &= ~(1ull << n->slot);
+
+        n->prev = n->next = nullptr;
+        n->level = -1;
+    }
+
+    //! Move all nodes of the current slot of the @p level to the lower levels
+    void __cascade(size_t level) {
+        size_t slot = (current_ >> (BITS * level)) & MASK;
+        node* n = slots_[level][slot];
+
+        slots_[level][slot] = nullptr;
+        occupancy_[level] &= ~(1ull << slot);
+
+        while (n) {
+            node* next = n->next;
+            // Nodes expiring at the current tick are expired right after the
+            // cascading
+            __link(n, current_);
+            n = next;
+        }
+    }
+
+public:
+    timer_wheel(uint64_t now = 0) : current_ {now} {
+        for (size_t l = 0; l < LEVELS; l++) {
+            occupancy_[l] = 0;
+            for (size_t s = 0; s < SLOTS; s++)
+                slots_[l][s] = nullptr;
+        }
+    }
+
+    //! @brief Add the timer expiring at the @p expires tick, timers expiring
+    //! in the past expire at the next tick.
+    void add(node* n, uint64_t expires) {
+        if (n->linked())
+            remove(n);
+
+        n->expires = expires;
+        __link(n, current_ + 1);
+        size_++;
+    }
+
+    void remove(node* n) {
+        if (!n->linked())
+            return;
+
+        __unlink(n);
+        size_--;
+    }
+
+    //! @brief Advance the wheel's time up to the @p now tick.
+    //!
+    //! @param now Current tick
+    //! @param on_expired Called for every expired node, node is unlinked
+    //!                   before the call and may be reused or freed.
+    template <class F>
+    void advance(uint64_t now, F on_expired) {
+        while (current_ < now) {
+            size_t level = 0;
+
+            // Nothing happens until the next slot boundary of the lowest
+            // non-empty level, skip idle ticks
+            while (level < LEVELS && !occupancy_[level])
+                level++;
+
+            if (level == LEVELS) {
+                current_ = now;
+                break;
+            }
+
+            uint64_t next = (current_ | (__span(level) - 1)) + 1;
+            if (next > now) {
+                current_ = now;
+                break;
+            }
+
+            current_ = next;
+
+            for (size_t l = 1; l < LEVELS; l++) {
+                if (current_ & (__span(l) - 1))
+                    break;
+                __cascade(l);
+            }
+
+            size_t slot = current_ & MASK;
+            while (node* n = slots_[0][slot]) {
+                __unlink(n);
+                size_--;
+                on_expired(n);
+            }
+        }
+    }
+
+    //! @brief Tick when the wheel needs to be advanced next time.
+    //!
+    //! @return false if the wheel is empty.
+    bool next_tick(uint64_t& tick) const {
+        bool found = false;
+        uint64_t nearest = 0;
+
+        // Upper levels nodes are cascaded at their slots' start, the owner
+        // is woken up only when there is something to do
+        for (size_t level = 0; level < LEVELS; level++) {
+            if (!occupancy_[level])
+                continue;
+
+            uint64_t next = __next_slot_tick(level);
+            if (!found || next < nearest)
+                nearest = next;
+            found = true;
+        }
+
+        if (found)
+            tick = nearest;
+
+        return found;
+    }
+
+    //! @brief Remove all nodes.
+    //!
+    //! @param on_removed Called for every removed node after unlinking.
+    template <class F>
+    void clear(F on_removed) {
+        for (size_t l = 0; l < LEVELS; l++) {
+            for (size_t s = 0; s < SLOTS; s++) {
+                while (node* n = slots_[l][s]) {
+                    __unlink(n);
+                    size_--;
+                    on_removed(n);
+                }
+            }
+        }
+    }
+
+    uint64_t now() const { return current_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+};
+
+}  // namespace transport
+}  // namespace cloud
+}  // namespace vxg
@@ -30,9 +30,40 @@ struct timed_cb {
 typedef std::shared_ptr<timed_cb> timed_cb_ptr;
 typedef std::weak_ptr<timed_cb> timed_cb_weak_ptr;
 
+//! @brief Auto-reset wakeup event, may be shared by several queues.
+//!
+//! The notification is latched until the waiter consumes it so no wakeup is
+//! lost if notify() happens before wait().
+class wakeup {
+public:
+    void notify() {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            signaled_ = true;
+        }
+
+        cond_.notify_one();
+    }
+
+    //! Wait for the notification and reset it
+    void wait() {
+        std::unique_lock<std::mutex> lock(lock_);
+
+        cond_.wait(lock, [this] { return signaled_; });
+        signaled_ = false;
+    }
+
+private:
+    bool signaled_ {false};
+    std::mutex lock_;
+    std::condition_variable cond_;
+};
+
 template <class T>
 class Queue {
 public:
+    Queue(wakeup* w = nullptr) : wakeup_ {w} {}
+
     void push(T&& t) {
         {
             // scoped lock guard, unlocked after this scope ends
@@ -41,6 +72,20 @@ public:
         }
 
         cond_.notify_one();
+        if (wakeup_)
+            wakeup_->notify();
+    }
+
+    bool try_pop(T& t) {
+        std::lock_guard<std::mutex> lock(lock_);
+
+        if (q_.empty())
+            return false;
+
+        t = std::move(q_.front());
+        q_.pop_front();
+
+        return true;
     }
 
     bool pop(T& t, std::chrono::milliseconds timeout) {
@@ -80,6 +125,7 @@ private:
     std::deque<T> q_;
     mutable std::mutex lock_;
     std::condition_variable cond_;
+    wakeup* wakeup_;
 };
 
 struct Data : public std::string {
@@ -147,6 +193,7 @@ public:
         running_ = false;
 
         rx_q_.flush();
+        rx_wakeup_.notify();
         // tx_q_.clear();
 
         if (thr_.get_id() != std::this_thread::get_id() && thr_.joinable())
@@ -182,17 +229,30 @@ public:
         logger->info("Started");
 
         while (running_) {
-            Data data;
-            if (rx_q_.pop(data, std::chrono::milliseconds(500)) && handle_) {
-                logger->debug("RX handling data, queue size {}", rx_q_.size());
-                handle_(data);
-                logger->debug("RX data handled");
-            }
+            // Both queues signal the same wakeup, sleep until any of them
+            // has something or the worker is terminated
+            rx_wakeup_.wait();
 
-            if (rx_task_q_.size()) {
+            bool pending = true;
+            while (running_ && pending) {
+                Data data;
                 Task t;
-                rx_task_q_.pop(t, std::chrono::milliseconds(0));
-                std::forward<Task>(t)();
+
+                pending = false;
+                if (rx_q_.try_pop(data)) {
+                    if (handle_) {
+                        logger->debug("RX handling data, queue size {}",
+                                      rx_q_.size());
+                        handle_(data);
+                        logger->debug("RX data handled");
+                    }
+                    pending = true;
+                }
+
+                if (rx_task_q_.try_pop(t)) {
+                    std::forward<Task>(t)();
+                    pending = true;
+                }
             }
         }
 
@@ -217,8 +277,9 @@ protected:
     std::thread thr_;
     std::thread rx_thr_;
     std::atomic_bool running_;
-    Queue<Data> rx_q_;
-    Queue<Task> rx_task_q_;
+    wakeup rx_wakeup_;
+    Queue<Data> rx_q_ {&rx_wakeup_};
+    Queue<Task> rx_task_q_ {&rx_wakeup_};
     std::queue<Data> tx_q_;
     std::mutex rx_lock_;
     std::mutex tx_lock_;
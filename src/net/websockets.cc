@@ -16,6 +16,18 @@ static const struct lws_protocols _lws_protocols[] = {
     },
     {NULL, NULL, 0, 0}
 };
+
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+static const struct lws_extension _lws_extensions[] = {
+    {
+        "permessage-deflate",
+        lws_extension_callback_pm_deflate,
+        "permessage-deflate; client_no_context_takeover; "
+        "client_max_window_bits"
+    },
+    {NULL, NULL, NULL}
+};
+#endif
 /* clang-format on */
 
 int websocket::lws_callback_(struct lws* wsi,
@@ -57,6 +69,17 @@ int websocket::lws_callback_(struct lws* wsi,
 
             ws->client_wsi_ = wsi;
 
+            /* Messages queued while disconnected belong to the previous
+             * session, the new one must start from the registration
+             */
+            {
+                std::lock_guard<std::mutex> lock(ws->tx_lock_);
+                if (!ws->tx_ring_.empty())
+                    logger->info("Dropping {} stale messages",
+                                 ws->tx_ring_.size());
+                ws->tx_ring_.clear();
+            }
+
             if (ws->connected_)
                 ws->connected_();
         } break;
@@ -79,38 +102,9 @@ int websocket::lws_callback_(struct lws* wsi,
                 ws->message_(msg);
         } break;
 
-        case LWS_CALLBACK_CLIENT_WRITEABLE: {
-            transport::Message msg;
-            std::vector<uint8_t> data;
-            std::string msg_str;
-
-            ws->tx_lock_.lock();
-            if (!ws->tx_q_.empty()) {
-                // get message from TX queue
-                msg = ws->tx_q_.front();
-                ws->tx_q_.pop();
-                msg_str = msg.dump();
-
-                logger->trace("TX: {} queue len {}", msg_str.c_str(),
-                              ws->tx_q_.size());
-
-                /* libwebsockets lws_write description says:
-                 * For data being sent on a websocket
-                 * connection (ie, not default http), this buffer MUST have
-                 * LWS_PRE bytes valid BEFORE the pointer.
-                 */
-                data.resize(LWS_PRE + msg_str.size() +
-                            LWS_SEND_BUFFER_POST_PADDING);
-                memset(&data[0], 0, msg_str.size());
-                memcpy(&data[LWS_PRE], msg_str.c_str(), msg_str.size());
-
-                lws_write(wsi, &data[LWS_PRE], data.size() - LWS_PRE,
-                          LWS_WRITE_TEXT);
-
-                lws_callback_on_writable(wsi);
-            }
-            ws->tx_lock_.unlock();
-        } break;
+        case LWS_CALLBACK_CLIENT_WRITEABLE:
+            ret = ws->__write_pending(wsi);
+            break;
 
         case LWS_CALLBACK_CLIENT_CLOSED:
         case LWS_CALLBACK_CLOSED_CLIENT_HTTP:
@@ -244,6 +238,15 @@ bool websocket::start() {
     info.timeout_secs = 20;
     info.connect_timeout_secs = 20;
 
+    if (permessage_deflate_) {
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+        info.extensions = _lws_extensions;
+#else
+        logger->warn("permessage-deflate requested but libwebsockets was "
+                     "built without extensions");
+#endif
+    }
+
     // ws ping/pong interval
     memset(&lws_retry_, 0, sizeof(lws_retry_));
     // how long to wait since last time we were told the connection is valid
@@ -412,32 +415,66 @@ void* websocket::poll_() {
     return nullptr;
 }
 
-bool websocket::send(const transport::Data& message) {
-    bool ret = true;
+int websocket::__write_pending(struct lws* wsi) {
+    std::lock_guard<std::mutex> lock(tx_lock_);
+    size_t written = 0;
 
-    /* put message to the tx queue */
-    transport::worker::send(message);
+    /* Write queued messages until the socket would block, libwebsockets
+     * buffers a partially sent message itself and reports the pipe choked
+     * until it's flushed.
+     */
+    while (!tx_ring_.empty() && written < TX_BATCH_MAX &&
+           (!written || !lws_send_pipe_choked(wsi))) {
+        size_t len = tx_ring_.front_size();
+
+        logger->trace("TX: {} queue len {}",
+                      fmt::string_view((char*)tx_ring_.front_data(), len),
+                      tx_ring_.size());
+
+        /* libwebsockets lws_write description says:
+         * For data being sent on a websocket
+         * connection (ie, not default http), this buffer MUST have
+         * LWS_PRE bytes valid BEFORE the pointer.
+         */
+        if (lws_write(wsi, tx_ring_.front_data(), len, LWS_WRITE_TEXT) <
+            (int)len) {
+            logger->error("Failed to write message of {} bytes", len);
+            return -1;
+        }
 
-    /* request write */
-    if (lws_context_ && client_wsi_)
-        lws_callback_on_writable(client_wsi_);
-    else
-        ret = false;
+        tx_ring_.pop();
+        written++;
+    }
 
-    return ret;
-}
+    if (written > 1)
+        logger->debug("TX: {} messages written, {} left", written,
+                      tx_ring_.size());
 
-bool websocket::send(const transport::Message& message) {
-    bool ret = true;
+    if (!tx_ring_.empty())
+        lws_callback_on_writable(wsi);
 
-    /* put message to the tx queue */
-    transport::worker::send(message);
+    return 0;
+}
+
+bool websocket::__queue_tx(const std::string& message) {
+    {
+        std::lock_guard<std::mutex> lock(tx_lock_);
+        tx_ring_.push(message.data(), message.size());
+    }
 
     /* request write */
     if (lws_context_ && client_wsi_)
         lws_callback_on_writable(client_wsi_);
     else
-        ret = false;
+        return false;
 
-    return ret;
+    return true;
+}
+
+bool websocket::send(const transport::Data& message) {
+    return __queue_tx(message);
+}
+
+bool websocket::send(const transport::Message& message) {
+    return __queue_tx(message.dump());
 }
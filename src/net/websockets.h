@@ -11,6 +11,62 @@ namespace cloud {
 namespace transport {
 
 namespace libwebsockets {
+//! @brief Ring of the outgoing WebSocket messages.
+//!
+//! Every message is stored with the LWS_PRE headroom required by lws_write()
+//! so it can be written without copying. Slots keep their buffers after the
+//! message was sent and are reused, the ring grows when it's full.
+class tx_ring {
+public:
+    tx_ring(size_t capacity = 16) : slots_(capacity) {}
+
+    void push(const char* data, size_t len) {
+        if (count_ == slots_.size())
+            __grow();
+
+        std::string& slot = slots_[(head_ + count_) % slots_.size()];
+        slot.assign(LWS_PRE, '\0');
+        slot.append(data, len);
+        count_++;
+    }
+
+    //! Payload of the oldest message, LWS_PRE bytes before it are writable
+    unsigned char* front_data() {
+        return reinterpret_cast<unsigned char*>(&slots_[head_][LWS_PRE]);
+    }
+
+    size_t front_size() const { return slots_[head_].size() - LWS_PRE; }
+
+    void pop() {
+        slots_[head_].clear();
+        head_ = (head_ + 1) % slots_.size();
+        count_--;
+    }
+
+    void clear() {
+        while (count_)
+            pop();
+    }
+
+    bool empty() const { return count_ == 0; }
+    size_t size() const { return count_; }
+
+private:
+    std::vector<std::string> slots_;
+    size_t head_ {0};
+    size_t count_ {0};
+
+    void __grow() {
+        std::vector<std::string> slots(slots_.size() * 2);
+
+        for (size_t i = 0; i < count_; i++)
+            slots[i] = std::move(slots_[(head_ + i) % slots_.size()]);
+
+        slots_ = std::move(slots);
+        head_ = 0;
+    }
+};
+
 class websocket : public lws_common {
     logger::logger_ptr logger = vxg::logger::instance("websockets-transport");
 
@@ -57,6 +113,14 @@ public:
     }
 
     void set_proxy(std::string proxy) { proxy_ = proxy; }
+
+    //! @brief Offer the permessage-deflate extension, the compression is used
+    //! if the server accepts it. Should be set before the start().
+    void set_permessage_deflate(bool enabled) { permessage_deflate_ = enabled; }
+
+    //! Max messages written per one writeable callback
+    static const size_t TX_BATCH_MAX = 64;
+
 private:
     std::string url_;
     std::string host_;
@@ -68,6 +132,8 @@ private:
     std::queue<std::string> requests_q_;
     std::mutex requests_q_lock_;
     std::string proxy_;
+    bool permessage_deflate_ {false};
+    tx_ring tx_ring_;
 
     std::function<void()> connected_;
     std::function<void()> disconnected_;
@@ -75,6 +141,8 @@ private:
     std::function<void(transport::Message&)> message_;
 
     struct lws* __connect(std::string uri);
+    int __write_pending(struct lws* wsi);
+    bool __queue_tx(const std::string& message);
 
 };  // class websocket
 }  // namespace libwebsockets
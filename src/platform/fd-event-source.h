@@ -0,0 +1,304 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <net/event-loop.h>
+
+namespace vxg {
+namespace cloud {
+
+//! @brief Input of the file descriptor delivered by the event loop.
+//!
+//! The fd is watched by the transport::event_loop, the data is read in bulk
+//! until the fd is drained and passed to the data callback on the loop
+//! thread, no thread and no polling per input. Many sources may share the
+//! same loop.
+//!
+//! Supported fds are the ones epoll accepts: ttys, pipes, named pipes,
+//! sockets, character devices and sysfs attributes. Sysfs attributes (GPIO
+//! value file with the edge configured) notify the change with EPOLLPRI and
+//! are reread from the beginning, the whole value is passed to the callback.
+//! Regular files and /dev/null are not supported by epoll.
+//!
+//! All the callbacks are called on the loop thread and must not block, a
+//! source which notifies the agent from the callback (notification may wait
+//! for a snapshot or a command send) should use its own loop instead of the
+//! shared one.
+class fd_event_source {
+    vxg::logger::logger_ptr logger {vxg::logger::instance("fd-event-source")};
+
+public:
+    enum type {
+        //! Stream of data, tty, pipe, socket
+        FD_STREAM,
+        //! Sysfs attribute, the value is reread on change
+        FD_SYSFS,
+    };
+
+    //! Data read from the fd, valid only during the call
+    using data_cb = std::function<void(const char* data, size_t size)>;
+    //! End of the stream or read error, the fd is not watched anymore
+    using close_cb = std::function<void()>;
+
+    //! @param loop Loop to watch the fd on, the shared loop if nullptr.
+    fd_event_source(transport::event_loop::ptr loop = nullptr)
+        : loop_ {loop ? loop : transport::event_loop::shared()} {}
+
+    virtual ~fd_event_source() { stop(); }
+
+    //! @brief Watch the fd, the fd is not owned by the source.
+    //!
+    //! The fd is switched to non-blocking mode, the original flags are
+    //! restored by the stop().
+    //!
+    //! @param fd File descriptor to read.
+    //! @param cb Data callback.
+    //! @param t Type of the fd.
+    //! @param on_close End of the stream callback.
+    //! @return false if already started or the fd can't be watched.
+    bool start(int fd,
+               data_cb cb,
+               type t = FD_STREAM,
+               close_cb on_close = nullptr) {
+        return _start(fd, false, cb, t, on_close);
+    }
+
+    //! @brief Open the file and watch it, the fd is closed by the stop().
+    //!
+    //! Named pipe is opened for reading and writing so the source doesn't
+    //! see the end of the stream when the writers come and go.
+    bool open(const std::string& path,
+              data_cb cb,
+              type t = FD_STREAM,
+              close_cb on_close = nullptr) {
+        struct stat st;
+        int flags = O_RDONLY | O_NONBLOCK | O_CLOEXEC;
+
+        if (!stat(path.c_str(), &st) && S_ISFIFO(st.st_mode))
+            flags = O_RDWR | O_NONBLOCK | O_CLOEXEC;
+
+        int fd = ::open(path.c_str(), flags);
+        if (fd < 0) {
+            logger->error("Failed to open {}: {}", path, strerror(errno));
+            return false;
+        }
+
+        if (!_start(fd, true, cb, t, on_close)) {
+            ::close(fd);
+            return false;
+        }
+
+        return true;
+    }
+
+    //! @brief Stop watching the fd.
+    //!
+    //! No callbacks are running after the return unless called from the
+    //! callback itself.
+    void stop() { loop_->invoke([this]() { _detach(); }); }
+
+    bool running() const { return fd_ >= 0; }
+
+    int fd() const { return fd_; }
+
+    //! @return Total number of bytes read.
+    size_t bytes() const { return bytes_; }
+
+private:
+    static constexpr size_t READ_BUFFER_SIZE = 16 * 1024;
+
+    transport::event_loop::ptr loop_;
+    int fd_ {-1};
+    bool own_fd_ {false};
+    int orig_flags_ {-1};
+    type type_ {FD_STREAM};
+    data_cb data_cb_;
+    close_cb close_cb_;
+    std::vector<char> buffer_;
+    size_t bytes_ {0};
+
+    bool _start(int fd, bool own, data_cb cb, type t, close_cb on_close) {
+        if (fd_ >= 0 || fd < 0 || !cb)
+            return false;
+
+        int flags = fcntl(fd, F_GETFL);
+        if (flags < 0) {
+            logger->error("Bad fd {}: {}", fd, strerror(errno));
+            return false;
+        }
+        if (!(flags & O_NONBLOCK))
+            fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+        fd_ = fd;
+        own_fd_ = own;
+        orig_flags_ = flags;
+        type_ = t;
+        data_cb_ = cb;
+        close_cb_ = on_close;
+        buffer_.resize(READ_BUFFER_SIZE);
+
+        bool added = false;
+        loop_->invoke([this, &added]() {
+            // Sysfs attribute should be read before the poll to arm the
+            // change notification
+            if (type_ == FD_SYSFS && !_read_sysfs())
+                return;
+
+            uint32_t events = type_ == FD_SYSFS
+                                  ? EPOLLPRI | EPOLLERR
+                                  : EPOLLIN | EPOLLRDHUP | EPOLLET;
+            added = loop_->add(fd_, events, [this](uint32_t events) {
+                _on_events(events);
+            });
+        });
+
+        if (!added) {
+            logger->error("Failed to watch fd {}", fd);
+            if (fd_ >= 0)
+                fcntl(fd_, F_SETFL, orig_flags_);
+            fd_ = -1;
+            own_fd_ = false;
+            return false;
+        }
+
+        logger->debug("Watching fd {}", fd_);
+
+        return true;
+    }
+
+    //! Called on the loop thread
+    void _detach() {
+        if (fd_ < 0)
+            return;
+
+        loop_->remove(fd_);
+        if (!(orig_flags_ & O_NONBLOCK))
+            fcntl(fd_, F_SETFL, orig_flags_);
+        if (own_fd_)
+            ::close(fd_);
+
+        logger->debug("Stopped watching fd {}", fd_);
+        fd_ = -1;
+        own_fd_ = false;
+    }
+
+    void _closed() {
+        auto cb = close_cb_;
+
+        _detach();
+        if (cb)
+            cb();
+    }
+
+    void _on_events(uint32_t events) {
+        if (type_ == FD_SYSFS) {
+            if (!_read_sysfs())
+                _closed();
+        } else {
+            _read_stream();
+        }
+    }
+
+    //! Edge triggered, read until EAGAIN. Short read doesn't mean the fd is
+    //! drained, canonical tty returns one line per read.
+    void _read_stream() {
+        int fd = fd_;
+
+        while (fd_ == fd) {
+            ssize_t n = ::read(fd_, buffer_.data(), buffer_.size());
+
+            if (n > 0) {
+                bytes_ += n;
+                data_cb_(buffer_.data(), n);
+            } else if (n == 0) {
+                logger->debug("End of fd {} stream", fd_);
+                _closed();
+                return;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            } else {
+                logger->error("Failed to read fd {}: {}", fd_,
+                              strerror(errno));
+                _closed();
+                return;
+            }
+        }
+    }
+
+    bool _read_sysfs() {
+        ssize_t n;
+
+        if (lseek(fd_, 0, SEEK_SET) < 0 ||
+            (n = ::read(fd_, buffer_.data(), buffer_.size())) < 0) {
+            logger->error("Failed to read fd {}: {}", fd_, strerror(errno));
+            return false;
+        }
+
+        bytes_ += n;
+        data_cb_(buffer_.data(), n);
+
+        return true;
+    }
+};
+
+//! @brief Splits the fd_event_source data into lines.
+class line_splitter {
+    std::string partial_;
+    char delim_;
+    size_t max_line_;
+
+public:
+    //! @param delim Line delimiter, not included into the line.
+    //! @param max_line Max line length, longer line is split.
+    line_splitter(char delim = '\n', size_t max_line = 4096)
+        : delim_ {delim}, max_line_ {std::max<size_t>(max_line, 1)} {}
+
+    //! @brief Feed the data, @p cb is called for every completed line.
+    void feed(const char* data,
+              size_t size,
+              const std::function<void(const std::string& line)>& cb) {
+        const char* end = data + size;
+
+        while (data < end) {
+            const char* eol =
+                static_cast<const char*>(memchr(data, delim_, end - data));
+            const char* stop = eol ? eol : end;
+            size_t room = max_line_ - partial_.size();
+
+            if (static_cast<size_t>(stop - data) > room) {
+                partial_.append(data, room);
+                data += room;
+                cb(partial_);
+                partial_.clear();
+                continue;
+            }
+
+            partial_.append(data, stop - data);
+            data = eol ? eol + 1 : end;
+
+            if (eol || partial_.size() >= max_line_) {
+                cb(partial_);
+                partial_.clear();
+            }
+        }
+    }
+
+    //! @brief Drop the incomplete line.
+    void reset() { partial_.clear(); }
+};
+
+}  // namespace cloud
+}  // namespace vxg
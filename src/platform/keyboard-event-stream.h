@@ -1,6 +1,7 @@
 #pragma once
 
 #include <agent/event-stream.h>
+#include <platform/fd-event-source.h>
 
 namespace vxg {
 namespace cloud {
@@ -8,13 +9,15 @@ class keyboard_event_stream : public vxg::cloud::agent::event_stream {
     static constexpr char* TAG = "kbd-event-stream";
     static constexpr char* KEYBOARD_COMMAND_M = "m";
     static constexpr char* KEYBOARD_COMMAND_M_VXG_EVENT = "keyboard-cmd-m";
-    static constexpr int SLEEP_TIMEOUT_US = 100000;
     vxg::logger::logger_ptr logger {vxg::logger::instance(TAG)};
 
-    // Thread
-    std::thread kb_thread_;
-    std::atomic<bool> running_ {false};
-    std::mutex lock_;
+    // Own loop for the stdin reader, the notifications block until the agent
+    // handles the event and must not stall the shared loop's subsystems
+    transport::event_loop::ptr loop_ {
+        std::make_shared<transport::event_loop>()};
+    // Stdin reader on the own event loop
+    fd_event_source stdin_source_ {loop_};
+    line_splitter lines_;
 
     // Mapping
     struct kb_to_vxg_event_mapping {
@@ -25,33 +28,6 @@ class keyboard_event_stream : public vxg::cloud::agent::event_stream {
     // VXG event name -> mapping
     std::map<std::string, kb_to_vxg_event_mapping> mappings_;
 
-    // Nonblocking keyboard reader
-    static bool __getline_async(std::istream& is,
-                                std::string& str,
-                                char delim = '\n') {
-        static std::string line_so_far;
-        char in_ch;
-        int chars_read = 0;
-        bool line_read = false;
-        str = "";
-
-        do {
-            chars_read = is.readsome(&in_ch, 1);
-            if (chars_read == 1) {
-                // if the delimiter is read then return the string so far
-                if (in_ch == delim) {
-                    str = line_so_far;
-                    line_so_far = "";
-                    line_read = true;
-                } else {  // otherwise add it to the string so far
-                    line_so_far.append(1, in_ch);
-                }
-            }
-        } while (chars_read != 0 && !line_read);
-
-        return line_read;
-    }
-
     bool _get_mapping_by_cmd(const std::string& cmd,
                              kb_to_vxg_event_mapping& mapping) {
         // Search for mapping by the keyboard cmd
@@ -96,83 +72,36 @@ class keyboard_event_stream : public vxg::cloud::agent::event_stream {
         return result;
     }
 
-    static bool input_avail() {
-        struct timeval tv;
-        fd_set fds;
-        tv.tv_sec = 0;
-        tv.tv_usec = 100000;
-        FD_ZERO(&fds);
-        FD_SET(STDIN_FILENO, &fds);
-
-        // Check if select() has failed, it may happen if the process was
-        // daemonized and stdin was closed, we sleep in that case, otherwise we
-        // will fall into the busy loop consuming whole CPU time.
-        if (select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) < 0)
-            usleep(SLEEP_TIMEOUT_US);
-        return (FD_ISSET(0, &fds));
-    }
-
-    static int interrupt_;
-    static std::string _get_cmd() {
-        std::string cmd;
-
-        fcntl(STDIN_FILENO, F_SETFL, fcntl(0, F_GETFL) | O_NONBLOCK);
-
-        while (!interrupt_) {
-            if (input_avail()) {
-                char ch, ret;
-                if (1 == (ret = read(STDIN_FILENO, &ch, 1))) {
-                    if (ch == '\n')
-                        break;
-                    cmd += ch;
-                } else {
-                    usleep(SLEEP_TIMEOUT_US);
-                }
-            }
-        }
-
-        fcntl(0, F_SETFL, fcntl(0, F_GETFL) & ~O_NONBLOCK);
-        if (interrupt_)
-            return "";
-        return cmd;
-    }
+    //! Called on the own event loop thread
+    void _on_cmd(const std::string& cmd) {
+        kb_to_vxg_event_mapping m;
 
-    static void __keyboard_routine(keyboard_event_stream* _this) {
-        vxg::cloud::utils::set_thread_name("kbd");
+        if (cmd.empty())
+            return;
 
-        while (_this->running_) {
-            std::string cmd = _get_cmd();
+        _toggle_mapping_state_by_cmd(cmd);
 
-            if (!cmd.empty()) {
-                kb_to_vxg_event_mapping m;
-
-                _this->_toggle_mapping_state_by_cmd(cmd);
-
-                if (_this->_get_mapping_by_cmd(cmd, m)) {
-                    // Construct event with the mapping and notify
-                    _this->notify(_event_from_mapping(m));
-                }
-            } else
-                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        if (_get_mapping_by_cmd(cmd, m)) {
+            // Construct event with the mapping and notify
+            notify(_event_from_mapping(m));
         }
     }
 
-    void _start_kb_thread() {
-        std::lock_guard<std::mutex> lock(lock_);
-
-        running_ = true;
-        interrupt_ = 0;
-        kb_thread_ = std::thread(__keyboard_routine, this);
-    }
-
-    void _stop_kb_thread() {
-        std::lock_guard<std::mutex> lock(lock_);
+    bool _start_stdin_reader() {
+        lines_.reset();
 
-        running_ = false;
-        interrupt_ = 1;
+        if (!loop_->start(TAG))
+            return false;
 
-        if (kb_thread_.joinable())
-            kb_thread_.join();
+        return stdin_source_.start(
+            STDIN_FILENO,
+            [this](const char* data, size_t size) {
+                lines_.feed(data, size, [this](const std::string& line) {
+                    _on_cmd(line);
+                });
+            },
+            fd_event_source::FD_STREAM,
+            [this]() { logger->warn("Stdin closed, no keyboard commands"); });
     }
 
 public:
@@ -218,8 +147,10 @@ public:
             notify(_event_from_mapping(m.second));
         }
 
-        // Start keyboard commands reader thread
-        _start_kb_thread();
+        // Start keyboard commands reader, stdin may be closed if the process
+        // was daemonized, the mapped events are reported anyway
+        if (!_start_stdin_reader())
+            logger->warn("Unable to read stdin, no keyboard commands");
 
         logger->info("Keyboard event stream started");
 
@@ -227,8 +158,9 @@ public:
     }
 
     virtual void stop() override {
-        // Start keyboard commands reader thread
-        _stop_kb_thread();
+        // Stop keyboard commands reader
+        stdin_source_.stop();
+        loop_->stop();
 
         logger->info("Keyboard event stream stopped");
     }
@@ -246,6 +178,5 @@ public:
 
     virtual void finit() {}
 };
-int keyboard_event_stream::interrupt_ = 0;
 }  // namespace cloud
 }  // namespace vxg
\ No newline at end of file
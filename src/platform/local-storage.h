@@ -0,0 +1,743 @@
+#pragma once
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <platform/storage.h>
+#include <utils/logging.h>
+#include <utils/utils.h>
+
+namespace vxg {
+namespace cloud {
+
+//! @brief Local directory object storage with the time index.
+//!
+//! Objects are files in the storage directory named after their time span,
+//! trigger and media type. Every trigger and media type pair has its own
+//! index file, the index is a memory mapped array of the fixed size entries
+//! sorted by the object start time, so a time range search is a binary search
+//! plus the scan of the found objects and the directory is walked only if the
+//! index is missing or broken.
+//!
+//! Objects are mostly written in the time order and removed starting from the
+//! oldest ones, appending is O(1) and removal marks the entry removed, the
+//! removed entries are compacted once they are the half of the index.
+//!
+//! Used space is the sum of the indexed objects sizes kept in the index, free
+//! space is taken from the file system at most every FS_STAT_PERIOD_SEC and
+//! corrected by the objects written and removed since then.
+//!
+//! All methods are thread-safe.
+class local_storage : public object_storage {
+    vxg::logger::logger_ptr logger {vxg::logger::instance("local-storage")};
+
+public:
+    //! Max age of the cached file system stats in seconds
+    static constexpr int FS_STAT_PERIOD_SEC {30};
+    //! Index entries allocated for the new index, the index grows twice
+    static constexpr size_t INITIAL_CAPACITY {1024};
+    //! Removed entries are compacted if there are more of them and they are
+    //! the half of the index
+    static constexpr size_t COMPACT_THRESHOLD {256};
+
+    //! Stored object description
+    struct object {
+        trigger_type trigger {TT_ANY};
+        media_type type {OT_MP4};
+        cloud::time start {utils::time::null()};
+        cloud::time stop {utils::time::null()};
+        //! Object size in bytes
+        size_t size {0};
+        int width {UnsetInt};
+        int height {UnsetInt};
+    };
+
+private:
+    static constexpr uint32_t MAGIC {0x58494756};  // "VGIX"
+    static constexpr uint32_t VERSION {1};
+    static constexpr size_t MEDIA_TYPES {2};
+    static constexpr size_t TRIGGER_TYPES {2};
+
+    struct header {
+        uint32_t magic;
+        uint32_t version;
+        //! Entries including removed ones
+        uint64_t count;
+        uint64_t removed;
+        //! Size of the not removed objects
+        uint64_t used;
+        //! Longest object duration in ms, bounds the range search
+        int64_t max_duration;
+    };
+
+    struct entry {
+        //! Milliseconds since epoch
+        int64_t start;
+        int64_t stop;
+        uint64_t size;
+        int32_t width;
+        int32_t height;
+        uint32_t flags;
+        uint32_t reserved;
+    };
+    static constexpr uint32_t EF_REMOVED {1};
+
+    struct bucket {
+        int fd {-1};
+        void* map {nullptr};
+        size_t map_size {0};
+        header* hdr {nullptr};
+        entry* entries {nullptr};
+        size_t capacity {0};
+    };
+
+    std::string path_;
+    size_t capacity_ {0};
+    std::mutex lock_;
+    std::array<bucket, MEDIA_TYPES * TRIGGER_TYPES> buckets_;
+    bool opened_ {false};
+
+    // Cached file system stats
+    std::chrono::steady_clock::time_point fs_stat_time_;
+    size_t fs_size_ {0};
+    size_t fs_free_ {0};
+    size_t fs_stat_used_ {0};
+
+    static int64_t __ms(cloud::time t) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   t.time_since_epoch())
+            .count();
+    }
+
+    static cloud::time __time(int64_t ms) {
+        return cloud::time(std::chrono::milliseconds(ms));
+    }
+
+    static bool __start_less(const entry& a, const entry& b) {
+        return a.start < b.start;
+    }
+
+    static bool __valid(trigger_type trigger, media_type type) {
+        return trigger >= 0 && static_cast<size_t>(trigger) < TRIGGER_TYPES &&
+               type >= 0 && static_cast<size_t>(type) < MEDIA_TYPES;
+    }
+
+    static const char* __extension(media_type type) {
+        return type == OT_JPEG ? "jpg" : "mp4";
+    }
+
+    bucket& __bucket(trigger_type trigger, media_type type) {
+        return buckets_[type * TRIGGER_TYPES + trigger];
+    }
+
+    std::string __index_path(size_t i) {
+        return path_ + "/.index-" + std::to_string(i / TRIGGER_TYPES) + "-" +
+               std::to_string(i % TRIGGER_TYPES);
+    }
+
+    //! @brief Map the index of @p capacity entries, the file is extended if
+    //! needed.
+    //!
+    //! The file blocks are reserved, writing to a sparse region of the shared
+    //! mapping raises SIGBUS when the file system is full. The previous
+    //! mapping is kept if the new one failed.
+    bool __map(bucket& b, size_t capacity) {
+        size_t size = sizeof(header) + capacity * sizeof(entry);
+        void* map = MAP_FAILED;
+        int err = posix_fallocate(b.fd, 0, size);
+
+        if (!err) {
+            map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, b.fd,
+                       0);
+            if (map == MAP_FAILED)
+                err = errno;
+        }
+
+        if (err) {
+            logger->error("Unable to map index of {} entries: {}", capacity,
+                          strerror(err));
+            return false;
+        }
+
+        if (b.map)
+            munmap(b.map, b.map_size);
+
+        b.map = map;
+        b.map_size = size;
+        b.hdr = static_cast<header*>(map);
+        b.entries = reinterpret_cast<entry*>(b.hdr + 1);
+        b.capacity = capacity;
+
+        return true;
+    }
+
+    //! Unmap the index, the file stays opened
+    void __drop_map(bucket& b) {
+        if (b.map)
+            munmap(b.map, b.map_size);
+        b.map = nullptr;
+        b.map_size = 0;
+        b.hdr = nullptr;
+        b.entries = nullptr;
+        b.capacity = 0;
+    }
+
+    void __unmap(bucket& b) {
+        __drop_map(b);
+        if (b.fd >= 0)
+            ::close(b.fd);
+        b = bucket();
+    }
+
+    //! Index is empty
+    bool __reset(bucket& b) {
+        // The mapping of the truncated file must not be left behind
+        __drop_map(b);
+        if (ftruncate(b.fd, 0) || !__map(b, INITIAL_CAPACITY))
+            return false;
+
+        memset(b.hdr, 0, sizeof(header));
+        b.hdr->magic = MAGIC;
+        b.hdr->version = VERSION;
+
+        return true;
+    }
+
+    //! Index was written by the same version and is consistent, the used size
+    //! and the max duration are recalculated
+    bool __check(bucket& b) {
+        header& h = *b.hdr;
+        uint64_t used = 0;
+        uint64_t removed = 0;
+        int64_t max_duration = 0;
+
+        if (h.magic != MAGIC || h.version != VERSION || h.count > b.capacity)
+            return false;
+
+        for (size_t i = 0; i < h.count; i++) {
+            const entry& e = b.entries[i];
+
+            if ((i && e.start < b.entries[i - 1].start) || e.stop < e.start)
+                return false;
+            if (e.flags & EF_REMOVED) {
+                removed++;
+                continue;
+            }
+            used += e.size;
+            max_duration = std::max(max_duration, e.stop - e.start);
+        }
+
+        h.used = used;
+        h.removed = removed;
+        h.max_duration = max_duration;
+
+        return true;
+    }
+
+    //! @return false if the index is not usable, true if it's opened,
+    //!         @p valid is false if it was recreated
+    bool __open(size_t i, bool& valid) {
+        bucket& b = buckets_[i];
+        std::string file = __index_path(i);
+        struct stat st;
+
+        valid = false;
+        b.fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (b.fd < 0 || fstat(b.fd, &st)) {
+            logger->error("Unable to open index {}: {}", file,
+                          strerror(errno));
+            return false;
+        }
+
+        if (static_cast<size_t>(st.st_size) >= sizeof(header) &&
+            !((st.st_size - sizeof(header)) % sizeof(entry)) &&
+            __map(b, (st.st_size - sizeof(header)) / sizeof(entry)) &&
+            __check(b)) {
+            valid = true;
+            return true;
+        }
+
+        logger->warn("Index {} is broken or missing, recreating", file);
+        return __reset(b);
+    }
+
+    bool __grow(bucket& b) {
+        size_t capacity = b.capacity ? b.capacity * 2 : INITIAL_CAPACITY;
+
+        logger->debug("Grow index to {} entries", capacity);
+        return __map(b, capacity);
+    }
+
+    bool __insert(bucket& b, const entry& e) {
+        header* h = b.hdr;
+        size_t pos = std::upper_bound(b.entries, b.entries + h->count, e,
+                                      __start_less) -
+                     b.entries;
+
+        // Same object written again is replaced
+        for (size_t i = pos; i > 0 && b.entries[i - 1].start == e.start; i--) {
+            entry& old = b.entries[i - 1];
+
+            if (old.stop != e.stop)
+                continue;
+            if (old.flags & EF_REMOVED)
+                h->removed--;
+            else
+                h->used -= old.size;
+            old = e;
+            h->used += e.size;
+
+            return true;
+        }
+
+        if (h->count == b.capacity) {
+            if (!__grow(b))
+                return false;
+            h = b.hdr;
+        }
+
+        memmove(b.entries + pos + 1, b.entries + pos,
+                (h->count - pos) * sizeof(entry));
+        b.entries[pos] = e;
+        h->count++;
+        h->used += e.size;
+        h->max_duration = std::max(h->max_duration, e.stop - e.start);
+
+        return true;
+    }
+
+    void __compact(bucket& b) {
+        header* h = b.hdr;
+        entry* end = std::remove_if(
+            b.entries, b.entries + h->count,
+            [](const entry& e) { return e.flags & EF_REMOVED; });
+        int64_t max_duration = 0;
+
+        h->count = end - b.entries;
+        h->removed = 0;
+        for (entry* e = b.entries; e != end; e++)
+            max_duration = std::max(max_duration, e->stop - e->start);
+        h->max_duration = max_duration;
+    }
+
+    entry* __find(bucket& b, int64_t start, int64_t stop) {
+        entry key {};
+        key.start = start;
+        auto range = std::equal_range(b.entries, b.entries + b.hdr->count,
+                                      key, __start_less);
+
+        for (entry* e = range.first; e != range.second; e++)
+            if (e->stop == stop && !(e->flags & EF_REMOVED))
+                return e;
+
+        return nullptr;
+    }
+
+    //! Objects of the bucket overlapping [start, stop]
+    void __search(size_t i,
+                  int64_t start,
+                  int64_t stop,
+                  std::vector<object>& result) {
+        bucket& b = buckets_[i];
+        entry key {};
+        entry* end = b.entries + b.hdr->count;
+
+        // Objects starting before the range may overlap it if they are long
+        // enough
+        key.start = start - b.hdr->max_duration;
+        entry* first = std::lower_bound(b.entries, end, key, __start_less);
+        key.start = stop;
+        entry* last = std::upper_bound(first, end, key, __start_less);
+
+        for (entry* e = first; e != last; e++) {
+            if ((e->flags & EF_REMOVED) || e->stop < start)
+                continue;
+
+            object o;
+            o.trigger = static_cast<trigger_type>(i % TRIGGER_TYPES);
+            o.type = static_cast<media_type>(i / TRIGGER_TYPES);
+            o.start = __time(e->start);
+            o.stop = __time(e->stop);
+            o.size = e->size;
+            o.width = e->width;
+            o.height = e->height;
+            result.push_back(o);
+        }
+    }
+
+    //! Index the objects files found in the storage directory
+    bool __rebuild() {
+        DIR* dir = opendir(path_.c_str());
+        struct dirent* de;
+        size_t found = 0;
+
+        if (!dir) {
+            logger->error("Unable to open storage {}: {}", path_,
+                          strerror(errno));
+            return false;
+        }
+
+        for (auto& b : buckets_)
+            if (!__reset(b)) {
+                closedir(dir);
+                return false;
+            }
+
+        while ((de = readdir(dir))) {
+            long long start, stop;
+            int trigger, consumed = 0;
+            char ext[4];
+            struct stat st;
+            entry e {};
+
+            if (de->d_name[0] == '.' ||
+                sscanf(de->d_name, "%lld_%lld_%d.%3s%n", &start, &stop,
+                       &trigger, ext, &consumed) != 4 ||
+                de->d_name[consumed] || stop < start)
+                continue;
+
+            media_type type = !strcmp(ext, __extension(OT_JPEG)) ? OT_JPEG
+                              : !strcmp(ext, __extension(OT_MP4)) ? OT_MP4
+                                                                  : OT_INVALID;
+            std::string file = path_ + "/" + de->d_name;
+            if (!__valid(static_cast<trigger_type>(trigger), type) ||
+                stat(file.c_str(), &st) || !S_ISREG(st.st_mode))
+                continue;
+
+            e.start = start;
+            e.stop = stop;
+            e.size = st.st_size;
+            e.width = e.height = UnsetInt;
+            if (__insert(__bucket(static_cast<trigger_type>(trigger), type),
+                         e))
+                found++;
+        }
+        closedir(dir);
+
+        logger->info("Index of {} rebuilt, {} objects found", path_, found);
+
+        return true;
+    }
+
+    size_t __used() {
+        size_t used = 0;
+
+        for (auto& b : buckets_)
+            if (b.hdr)
+                used += b.hdr->used;
+
+        return used;
+    }
+
+    //! Refresh the file system stats if they are too old
+    void __stat_fs() {
+        auto now = std::chrono::steady_clock::now();
+        struct statvfs st;
+
+        if (fs_stat_time_ != std::chrono::steady_clock::time_point() &&
+            std::chrono::duration_cast<std::chrono::seconds>(now -
+                                                             fs_stat_time_)
+                    .count() < FS_STAT_PERIOD_SEC)
+            return;
+
+        if (statvfs(path_.c_str(), &st)) {
+            logger->warn("Unable to stat storage {}: {}", path_,
+                         strerror(errno));
+            return;
+        }
+
+        fs_stat_time_ = now;
+        fs_size_ = static_cast<size_t>(st.f_blocks) * st.f_frsize;
+        fs_free_ = static_cast<size_t>(st.f_bavail) * st.f_frsize;
+        fs_stat_used_ = __used();
+    }
+
+    //! Free space of the file system corrected by the objects written and
+    //! removed since the last stat
+    size_t __fs_free() {
+        __stat_fs();
+
+        size_t used = __used();
+        if (used >= fs_stat_used_)
+            return fs_free_ - std::min(fs_free_, used - fs_stat_used_);
+        return fs_free_ + (fs_stat_used_ - used);
+    }
+
+public:
+    //! @param path Storage directory, must exist.
+    //! @param capacity Max size of the stored objects in bytes, 0 if the
+    //!                 storage may take the whole file system.
+    local_storage(const std::string& path, size_t capacity = 0)
+        : path_ {path}, capacity_ {capacity} {}
+
+    virtual ~local_storage() { close(); }
+
+    //! @brief Open the storage index, the index is rebuilt from the storage
+    //! directory content if it's missing or broken.
+    bool open() {
+        std::lock_guard<std::mutex> lock(lock_);
+        bool all_valid = true;
+
+        if (opened_)
+            return true;
+
+        for (size_t i = 0; i < buckets_.size(); i++) {
+            bool valid;
+
+            if (!__open(i, valid)) {
+                for (auto& b : buckets_)
+                    __unmap(b);
+                return false;
+            }
+            all_valid &= valid;
+        }
+
+        if (!all_valid && !__rebuild()) {
+            for (auto& b : buckets_)
+                __unmap(b);
+            return false;
+        }
+
+        opened_ = true;
+        fs_stat_time_ = std::chrono::steady_clock::time_point();
+        __stat_fs();
+
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(lock_);
+
+        for (auto& b : buckets_)
+            __unmap(b);
+        opened_ = false;
+    }
+
+    //! @brief Path of the object's file.
+    std::string file_path(const object& o) {
+        return path_ + "/" + std::to_string(__ms(o.start)) + "_" +
+               std::to_string(__ms(o.stop)) + "_" + std::to_string(o.trigger) +
+               "." + __extension(o.type);
+    }
+
+    //! @brief Index the object, its file must be already written to the
+    //! file_path(). Object with the same time span, trigger and type is
+    //! replaced.
+    bool add(const object& o) {
+        std::lock_guard<std::mutex> lock(lock_);
+        entry e {};
+
+        if (!opened_ || !__valid(o.trigger, o.type) || o.stop < o.start) {
+            logger->error("Unable to add object to {}", path_);
+            return false;
+        }
+
+        e.start = __ms(o.start);
+        e.stop = __ms(o.stop);
+        e.size = o.size;
+        e.width = o.width;
+        e.height = o.height;
+
+        return __insert(__bucket(o.trigger, o.type), e);
+    }
+
+    //! @brief Write the clip data to the storage and index it.
+    bool write(trigger_type trigger,
+               media_type type,
+               const agent::proto::video_clip_info& clip) {
+        object o;
+        FILE* f;
+
+        o.trigger = trigger;
+        o.type = type;
+        o.start = clip.tp_start;
+        o.stop = clip.tp_stop;
+        o.size = clip.data.size();
+        o.width = clip.video_width;
+        o.height = clip.video_height;
+
+        if (!__valid(trigger, type))
+            return false;
+
+        // Written to the temporary file and renamed so the rebuild never
+        // finds a partial object
+        std::string file = file_path(o);
+        std::string tmp = path_ + "/.tmp-" + file.substr(path_.size() + 1);
+        if (!(f = fopen(tmp.c_str(), "wb"))) {
+            logger->error("Unable to create {}: {}", tmp, strerror(errno));
+            return false;
+        }
+        bool written = fwrite(clip.data.data(), 1, clip.data.size(), f) ==
+                       clip.data.size();
+        written &= !fclose(f);
+
+        if (!written || rename(tmp.c_str(), file.c_str())) {
+            logger->error("Unable to write {}: {}", file, strerror(errno));
+            unlink(tmp.c_str());
+            return false;
+        }
+
+        return add(o);
+    }
+
+    //! @brief Read the object's data.
+    bool read(const object& o, std::vector<uint8_t>& data) {
+        std::string file = file_path(o);
+        FILE* f = fopen(file.c_str(), "rb");
+
+        if (!f) {
+            logger->error("Unable to open {}: {}", file, strerror(errno));
+            return false;
+        }
+
+        data.resize(o.size);
+        bool result = fread(data.data(), 1, o.size, f) == o.size;
+        fclose(f);
+
+        return result;
+    }
+
+    //! @brief Remove the object from the index and delete its file.
+    bool remove(const object& o) {
+        std::lock_guard<std::mutex> lock(lock_);
+
+        if (!opened_ || !__valid(o.trigger, o.type))
+            return false;
+
+        bucket& b = __bucket(o.trigger, o.type);
+        entry* e = __find(b, __ms(o.start), __ms(o.stop));
+        if (!e)
+            return false;
+
+        e->flags |= EF_REMOVED;
+        b.hdr->removed++;
+        b.hdr->used -= e->size;
+        if (b.hdr->removed > COMPACT_THRESHOLD &&
+            b.hdr->removed * 2 > b.hdr->count)
+            __compact(b);
+
+        std::string file = file_path(o);
+        if (unlink(file.c_str()) && errno != ENOENT)
+            logger->warn("Unable to delete {}: {}", file, strerror(errno));
+
+        return true;
+    }
+
+    //! @brief Find objects overlapping the time range.
+    //!
+    //! @param trigger Objects trigger, TT_ANY for all triggers.
+    //! @param type Objects media type, OT_INVALID for all types.
+    //! @return Objects ordered by the start time.
+    std::vector<object> find(trigger_type trigger,
+                             media_type type,
+                             cloud::time start,
+                             cloud::time stop) {
+        std::lock_guard<std::mutex> lock(lock_);
+        std::vector<object> result;
+        size_t buckets = 0;
+
+        if (!opened_)
+            return result;
+
+        for (size_t i = 0; i < buckets_.size(); i++) {
+            if ((trigger != TT_ANY && i % TRIGGER_TYPES != (size_t)trigger) ||
+                (type != OT_INVALID && i / TRIGGER_TYPES != (size_t)type))
+                continue;
+
+            __search(i, __ms(start), __ms(stop), result);
+            buckets++;
+        }
+
+        if (buckets > 1)
+            std::stable_sort(result.begin(), result.end(),
+                             [](const object& a, const object& b) {
+                                 return a.start < b.start;
+                             });
+
+        return result;
+    }
+
+    //! @brief Number of the stored objects.
+    size_t count() {
+        std::lock_guard<std::mutex> lock(lock_);
+        size_t result = 0;
+
+        for (auto& b : buckets_)
+            if (b.hdr)
+                result += b.hdr->count - b.hdr->removed;
+
+        return result;
+    }
+
+    virtual size_t free() override {
+        std::lock_guard<std::mutex> lock(lock_);
+        size_t fs_free = __fs_free();
+
+        if (capacity_)
+            return std::min(fs_free, capacity_ - std::min(capacity_, __used()));
+        return fs_free;
+    }
+
+    virtual size_t used() override {
+        std::lock_guard<std::mutex> lock(lock_);
+        return __used();
+    }
+
+    virtual size_t size() override {
+        std::lock_guard<std::mutex> lock(lock_);
+
+        if (capacity_)
+            return capacity_;
+        __stat_fs();
+        return fs_size_;
+    }
+
+    virtual std::string path() override { return path_; }
+
+    //! Data of the found clips is not loaded, use find() and read().
+    virtual std::vector<agent::proto::video_clip_info> search(
+        trigger_type ttype,
+        media_type otype,
+        std::time_t time_start,
+        std::time_t time_stop) override {
+        std::vector<agent::proto::video_clip_info> result;
+        auto objects = find(ttype, otype,
+                            cloud::time(std::chrono::seconds(time_start)),
+                            cloud::time(std::chrono::seconds(time_stop)));
+
+        result.reserve(objects.size());
+        for (auto& o : objects) {
+            agent::proto::video_clip_info clip;
+
+            clip.tp_start = o.start;
+            clip.tp_stop = o.stop;
+            clip.time_begin = std::chrono::duration_cast<std::chrono::seconds>(
+                                  o.start.time_since_epoch())
+                                  .count();
+            clip.time_end = std::chrono::duration_cast<std::chrono::seconds>(
+                                o.stop.time_since_epoch())
+                                .count();
+            clip.video_width = o.width;
+            clip.video_height = o.height;
+            result.push_back(std::move(clip));
+        }
+
+        return result;
+    }
+};
+
+}  // namespace cloud
+}  // namespace vxg
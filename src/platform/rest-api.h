@@ -1,8 +1,14 @@
 #ifndef __REST_API_H
 #define __REST_API_H
 
+#include <string.h>
+
 #include <algorithm>
+#include <chrono>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include <net/http.h>
 #include <utils/base64.h>
@@ -24,6 +30,12 @@ public:
     virtual ~parser() {}
 
     virtual kv_list process(std::string raw_data) = 0;
+    //! @brief Parse raw data without copying it, kv pairs are added to the
+    //! result, default implementation calls process(std::string).
+    virtual void process(const char* data, size_t size, kv_list& result) {
+        for (auto& kv : process(std::string(data, size)))
+            result[kv.first] = std::move(kv.second);
+    }
     virtual std::string reverse_process(kv_list kv) {
         vxg::logger::warn(
             "Parser's reverse_process() not implemented but used!");
@@ -31,40 +43,107 @@ public:
     }
 };  // class parser
 
-//! Basic kv parser, parses k='v'\r\n... lines into std::map
-const std::string __trim_chars = "\n\r\'";
-class kv_parser : public parser {
-    std::string& trim(std::string& str,
-                      const std::string& chars = __trim_chars) {
-        for (auto& c : __trim_chars)
-            str.erase(std::remove(str.begin(), str.end(), c), str.end());
+//! @brief k='v' pair found by the kv_tokenizer, points to the tokenized data.
+struct kv_token {
+    const char* key {nullptr};
+    size_t key_len {0};
+    //! Value with the trailing \r and the surrounding quotes stripped, may
+    //! still contain the inner quotes
+    const char* value {nullptr};
+    size_t value_len {0};
+};
+
+//! @brief Zero-copy tokenizer of the k='v'\r\n... lines.
+//!
+//! Line without '=' is skipped, the key is everything before the first '=',
+//! the value is the rest of the line. Tokens point to the tokenized data,
+//! it should outlive them.
+class kv_tokenizer {
+    const char* pos_;
+    const char* end_;
+
+public:
+    kv_tokenizer(const char* data, size_t size)
+        : pos_ {data}, end_ {data + size} {}
+
+    //! @brief Find the next kv pair.
+    //! @param[out] token Found pair.
+    //! @return false if no more pairs.
+    bool next(kv_token& token) {
+        while (pos_ < end_) {
+            const char* line = pos_;
+            const char* eol = static_cast<const char*>(
+                memchr(line, '\n', end_ - line));
+
+            if (!eol)
+                eol = end_;
+            pos_ = eol < end_ ? eol + 1 : end_;
+
+            const char* eq =
+                static_cast<const char*>(memchr(line, '=', eol - line));
+            if (!eq)
+                continue;
+
+            const char* v = eq + 1;
+            const char* v_end = eol;
+            while (v_end > v && v_end[-1] == '\r')
+                v_end--;
+            if (v_end - v >= 2 && *v == '\'' && v_end[-1] == '\'') {
+                v++;
+                v_end--;
+            }
+
+            token.key = line;
+            token.key_len = eq - line;
+            token.value = v;
+            token.value_len = v_end - v;
+            return true;
+        }
+
+        return false;
+    }
 
-        return str;
+    //! @brief Copy the token's value to the string removing the inner quotes
+    //! and carriage returns.
+    static void value(const kv_token& token, std::string& result) {
+        const char* v = token.value;
+        const char* end = v + token.value_len;
+
+        result.clear();
+        while (v < end) {
+            const char* stop = v;
+            while (stop < end && *stop != '\'' && *stop != '\r')
+                stop++;
+            result.append(v, stop - v);
+            v = stop + 1;
+        }
     }
+};  // class kv_tokenizer
 
+//! Basic kv parser, parses k='v'\r\n... lines into std::map
+class kv_parser : public parser {
 public:
     kv_parser() {}
 
     virtual ~kv_parser() {}
 
     virtual kv_list process(std::string raw_data) {
-        std::istringstream props(raw_data);
-        std::string line, k, v;
         kv_list results;
 
-        while (std::getline(props, line)) {
-            std::istringstream sline(line);
-            std::getline(sline, k, '=');
-            if (line == k)
-                continue;
-            std::getline(sline, v);
-
-            results[k] = trim(v);
-        }
+        process(raw_data.data(), raw_data.size(), results);
 
         return results;
     }
 
+    virtual void process(const char* data, size_t size, kv_list& result) {
+        kv_tokenizer tokenizer(data, size);
+        kv_token token;
+
+        while (tokenizer.next(token))
+            kv_tokenizer::value(
+                token, result[std::string(token.key, token.key_len)]);
+    }
+
     virtual std::string reverse_process(kv_list kvmap) {
         std::string result;
 
@@ -81,14 +160,33 @@ public:
 };  // class kv_parser
 
 //! HTTP settings setter/getter class dervied from the kv_parser
+//!
+//! Multi keys get and set are split into the requests of up to
+//! set_max_keys_per_request() keys performed concurrently by up to
+//! set_max_concurrent_requests() requests at once. Values got by the get()
+//! may be cached for set_cache_ttl(), the set() of the key invalidates it.
 class http {
     vxg::logger::logger_ptr logger {vxg::logger::instance("http-rest-api")};
+    using request_ptr = transport::libwebsockets::http::request_ptr;
     transport::libwebsockets::http http_transport_;
     std::string base_uri_ = "";
     transport::libwebsockets::http::request::auth_context auth_context_;
     kv_list common_headers_;
     parser* parser_ {nullptr};
 
+    size_t max_keys_per_request_ {0};
+    size_t max_concurrent_requests_ {4};
+
+    struct cache_entry {
+        std::string value;
+        std::chrono::steady_clock::time_point stored;
+    };
+    std::chrono::milliseconds cache_ttl_ {0};
+    //! Cached values by key by the request path, set of the key on any path
+    //! invalidates it on all paths
+    std::map<std::string, std::map<std::string, cache_entry>> cache_;
+    std::mutex cache_lock_;
+
 public:
     http(std::string base_uri = "http://localhost",
          transport::libwebsockets::http::request::auth_context auth_context =
@@ -113,6 +211,7 @@ public:
         base_uri_ = base_uri;
         auth_context_ = auth_context;
         common_headers_.clear();
+        invalidate_cache();
     }
 
     void reset(std::string base_uri,
@@ -123,6 +222,35 @@ public:
                             username, password));
     }
 
+    //! @brief Max number of keys per multi keys get/set request, 0 means all
+    //! keys in one request.
+    void set_max_keys_per_request(size_t n) { max_keys_per_request_ = n; }
+
+    //! @brief Max number of requests of the multi keys get/set performed at
+    //! once, 0 or 1 means sequential requests.
+    void set_max_concurrent_requests(size_t n) {
+        max_concurrent_requests_ = n;
+    }
+
+    //! @brief TTL of the get() values cache, 0 disables caching.
+    void set_cache_ttl(std::chrono::milliseconds ttl) {
+        cache_ttl_ = ttl;
+        if (!ttl.count())
+            invalidate_cache();
+    }
+
+    //! @brief Drop all cached values.
+    void invalidate_cache() {
+        std::lock_guard<std::mutex> lock(cache_lock_);
+        cache_.clear();
+    }
+
+    //! @brief Drop cached values of the key.
+    void invalidate_cache(const std::string& k) {
+        std::lock_guard<std::mutex> lock(cache_lock_);
+        cache_.erase(k);
+    }
+
     std::string _dump_req_error(transport::libwebsockets::http::request* req) {
         std::string dump = utils::string_format(
             "HTTP '%s' request to '%s' failed, status %d", req->method_.c_str(),
@@ -139,10 +267,11 @@ public:
         return dump;
     }
 
-    kv_list request(const std::string& path, const std::string& method) {
-        kv_list result;
+    request_ptr _prepare(const std::string& path,
+                         const std::string& method,
+                         const std::string& body = "") {
         auto req = std::make_shared<transport::libwebsockets::http::request>(
-            base_uri_ + path, method);
+            base_uri_ + path, method, body);
 
         // Add common headers to http requests
         for (auto& kv : common_headers_)
@@ -151,35 +280,106 @@ public:
         // Authorization context for request
         req->set_auth_context(auth_context_);
 
-        // Perform sync request
-        if (http_transport_.make_blocked(req)) {
-            if (req->status_ == 200) {
-                logger->trace("http status {}", req->status_);
-
-                logger->trace("http response\n{}", req->response_body_);
-
-                // Don't parse binary data
-                if (req->response_headers_.count("content-type")) {
-                    if (req->response_headers_["content-type"] ==
-                            "application/octet-stream" ||
-                        req->response_headers_["content-type"] ==
-                            "application/http" ||
-                        utils::string_startswith(
-                            req->response_headers_["content-type"], "image") ||
-                        utils::string_startswith(
-                            req->response_headers_["content-type"], "video"))
-                        return {};
-                }
-
-                if (parser_)
-                    result = parser_->process(req->response_body_);
-            } else {
-                logger->error(_dump_req_error(req.get()));
-            }
-        } else {
+        return req;
+    }
+
+    //! Wait for the request scheduled by the make(), same as make_blocked()
+    bool _wait(request_ptr& req) {
+        std::unique_lock<std::mutex> lock(req->lock_);
+
+        if (!req->cond_.wait_for(lock, req->timeout_s_, [&req] {
+                return req->close_connection_;
+            })) {
+            logger->info(
+                "HTTP request didn't finish in {} seconds, closing "
+                "connection.",
+                (int)req->timeout_s_.count());
+            req->close_connection_ = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    //! @brief Perform requests keeping up to max concurrent requests in
+    //! flight.
+    //! @return Per request results of the make_blocked() semantics.
+    std::vector<bool> _perform(std::vector<request_ptr>& reqs) {
+        std::vector<bool> result(reqs.size(), false);
+        size_t window = std::max<size_t>(max_concurrent_requests_, 1);
+
+        if (reqs.size() == 1 || window == 1) {
+            for (size_t i = 0; i < reqs.size(); i++)
+                result[i] = http_transport_.make_blocked(reqs[i]);
+            return result;
+        }
+
+        size_t sent = 0;
+        for (size_t done = 0; done < reqs.size(); done++) {
+            while (sent < reqs.size() && sent < done + window)
+                http_transport_.make(reqs[sent++]);
+            result[done] = _wait(reqs[done]);
+        }
+
+        return result;
+    }
+
+    kv_list _process(request_ptr& req, bool made) {
+        kv_list result;
+
+        if (!made) {
             logger->error("HTTP request connection failed");
+            return result;
+        }
+
+        if (req->status_ != 200) {
+            logger->error(_dump_req_error(req.get()));
+            return result;
         }
 
+        logger->trace("http status {}", req->status_);
+        logger->trace("http response\n{}", req->response_body_);
+
+        // Don't parse binary data
+        auto content_type = req->response_headers_.find("content-type");
+        if (content_type != req->response_headers_.end()) {
+            auto& type = content_type->second;
+
+            if (type == "application/octet-stream" ||
+                type == "application/http" ||
+                utils::string_startswith(type, "image") ||
+                utils::string_startswith(type, "video"))
+                return {};
+        }
+
+        if (parser_)
+            parser_->process(req->response_body_.data(),
+                             req->response_body_.size(), result);
+
+        return result;
+    }
+
+    kv_list request(const std::string& path, const std::string& method) {
+        auto req = _prepare(path, method);
+
+        // Perform sync request
+        return _process(req, http_transport_.make_blocked(req));
+    }
+
+    //! @brief Perform requests concurrently.
+    //! @return Parsed responses in order of the paths.
+    std::vector<kv_list> request_many(const std::vector<std::string>& paths,
+                                      const std::string& method) {
+        std::vector<request_ptr> reqs;
+        std::vector<kv_list> result;
+
+        for (auto& path : paths)
+            reqs.push_back(_prepare(path, method));
+
+        auto made = _perform(reqs);
+        for (size_t i = 0; i < reqs.size(); i++)
+            result.push_back(_process(reqs[i], made[i]));
+
         return result;
     }
 
@@ -203,12 +403,7 @@ public:
         int ok_code = 200,
         kv_list headers = {}) {
         std::string url = base_uri_ + path;
-        auto req = std::make_shared<transport::libwebsockets::http::request>(
-            url, method, body);
-
-        // Add common headers to http requests
-        for (auto& kv : common_headers_)
-            req->set_header(kv.first, kv.second);
+        auto req = _prepare(path, method, body);
 
         for (auto& kv : headers)
             req->set_header(kv.first, kv.second);
@@ -220,9 +415,6 @@ public:
                 req->multipart_content_type_ = mime;
         }
 
-        // Authorization context for request
-        req->set_auth_context(auth_context_);
-
         if (mp_context.multipart) {
             req->multipart_ = true;
             req->multipart_form_field_ = mp_context.multipart_form_field_name;
@@ -254,6 +446,64 @@ public:
         return req;
     }
 
+    bool _cache_lookup(const std::string& path,
+                       const std::string& k,
+                       std::string& v) {
+        if (!cache_ttl_.count())
+            return false;
+
+        std::lock_guard<std::mutex> lock(cache_lock_);
+        auto key = cache_.find(k);
+        if (key == cache_.end())
+            return false;
+
+        auto entry = key->second.find(path);
+        if (entry == key->second.end())
+            return false;
+
+        if (entry->second.stored + cache_ttl_ <=
+            std::chrono::steady_clock::now()) {
+            key->second.erase(entry);
+            if (key->second.empty())
+                cache_.erase(key);
+            return false;
+        }
+
+        v = entry->second.value;
+        return true;
+    }
+
+    void _cache_store(const std::string& path,
+                      const std::string& k,
+                      const std::string& v) {
+        if (!cache_ttl_.count())
+            return;
+
+        std::lock_guard<std::mutex> lock(cache_lock_);
+        cache_entry& entry = cache_[k][path];
+        entry.value = v;
+        entry.stored = std::chrono::steady_clock::now();
+    }
+
+    //! Split keys into chunks of up to max keys per request
+    template <class T, class F>
+    std::vector<std::string> _chunks(const T& keys, F append) {
+        std::vector<std::string> result;
+        size_t n = 0;
+
+        for (auto& k : keys) {
+            if (result.empty() ||
+                (max_keys_per_request_ && n == max_keys_per_request_)) {
+                result.emplace_back();
+                n = 0;
+            }
+            append(result.back(), k);
+            n++;
+        }
+
+        return result;
+    }
+
     //! Get keys values HTTP request
     /*!
         \param path HTTP url path
@@ -264,15 +514,51 @@ public:
     virtual kv_list get(const std::string& path,
                         const std::string& method,
                         k_list klist) {
-        std::string kparams;
+        kv_list result;
+        k_list missing;
+
+        // Whole response of the request without keys is not cached
+        if (klist.empty())
+            return request(path, method);
+
         for (auto& k : klist) {
-            kparams.append(k);
-            kparams.append("&");
+            std::string v;
+
+            if (_cache_lookup(path, k, v))
+                result[k] = std::move(v);
+            else
+                missing.push_back(k);
         }
 
-        logger->trace("HTTP GET query string: {}", kparams);
+        if (missing.empty()) {
+            logger->trace("HTTP GET {} keys from cache", klist.size());
+            return result;
+        }
+
+        auto queries =
+            _chunks(missing, [](std::string& q, const std::string& k) {
+                q.append(k);
+                q.append("&");
+            });
+        std::vector<std::string> paths;
+        for (auto& q : queries) {
+            logger->trace("HTTP GET query string: {}", q);
+            paths.push_back(path + q);
+        }
+
+        for (auto& kv : request_many(paths, method)) {
+            for (auto& pair : kv)
+                result[pair.first] = std::move(pair.second);
+        }
+
+        for (auto& k : missing) {
+            auto it = result.find(k);
+
+            if (it != result.end())
+                _cache_store(path, k, it->second);
+        }
 
-        return request(path + kparams, method);
+        return result;
     }
 
     //! Get key value HTTP request.
@@ -285,7 +571,18 @@ public:
     virtual std::string get(const std::string& path,
                             const std::string& method,
                             const std::string& k) {
-        return request(path + k, method)[k];
+        std::string v;
+
+        if (_cache_lookup(path, k, v))
+            return v;
+
+        auto result = request(path + k, method);
+        auto it = result.find(k);
+        if (it == result.end())
+            return "";
+
+        _cache_store(path, k, it->second);
+        return it->second;
     }
 
     //! Set key value HTTP request.
@@ -303,6 +600,12 @@ public:
             request_raw(path, method, k + "=" + v);
         else
             request(path + k + "=" + v, method);
+
+        // Unknown key may be set by the path itself
+        if (k.empty())
+            invalidate_cache();
+        else
+            invalidate_cache(k);
     }
 
     //! Set mapped keys values HTTP request
@@ -314,21 +617,41 @@ public:
     virtual void set(const std::string& path,
                      const std::string& method,
                      kv_list& kvmap) {
-        std::string kparams;
-        for (auto& kv : kvmap) {
-            kparams.append(kv.first);
-            kparams.append("=");
-            kparams.append(kv.second);
-            kparams.append("&");
-        }
+        auto queries = _chunks(kvmap, [](std::string& q,
+                                         const kv_list::value_type& kv) {
+            q.append(kv.first);
+            q.append("=");
+            q.append(kv.second);
+            q.append("&");
+        });
         nlohmann::json j = kvmap;
 
         logger->trace("HTTP SET query string:\n{}", j.dump(2));
 
-        if ((method == "POST" || method == "PUT") && !kparams.empty())
-            request_raw(path, method, kparams);
-        else
-            request(path + kparams, method);
+        if (queries.empty()) {
+            request(path, method);
+            invalidate_cache();
+            return;
+        }
+
+        std::vector<request_ptr> reqs;
+        for (auto& q : queries) {
+            if (method == "POST" || method == "PUT")
+                reqs.push_back(_prepare(path, method, q));
+            else
+                reqs.push_back(_prepare(path + q, method));
+        }
+
+        auto made = _perform(reqs);
+        for (size_t i = 0; i < reqs.size(); i++) {
+            if (!made[i])
+                logger->error("HTTP request connection failed");
+            else if (reqs[i]->status_ != 200)
+                logger->error(_dump_req_error(reqs[i].get()));
+        }
+
+        for (auto& kv : kvmap)
+            invalidate_cache(kv.first);
     }
 };  // class http
 
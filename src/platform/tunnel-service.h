@@ -10,6 +10,7 @@
 #else
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #endif
@@ -17,6 +18,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
@@ -30,15 +32,18 @@
 
 #include <atomic>
 #include <cstdio>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <thread>
 
 #include <agent-proto/proto.h>
+#include <net/event-loop.h>
 #include <net/http.h>
 #include <net/websockets.h>
 #include <utils/base64.h>
 #include <utils/logging.h>
+#include <utils/ring-buffer.h>
 #include <utils/utils.h>
 
 #ifndef INADDR_NONE
@@ -260,20 +265,44 @@ public:
 
 private:
     static constexpr const char* TAG = "libssh2-tunnel";
+    //! Buffer size of every channel direction
+    static constexpr size_t CHANNEL_BUFFER_SIZE = 128 * 1024;
     static std::once_flag libssh_init_flag_;
     params params_;
     std::atomic_bool running_ {false};
-    std::thread thread_acceptor_;
     int ssh_session_sock_ {-1};
     LIBSSH2_SESSION* ssh_session_ {nullptr};
     LIBSSH2_LISTENER* ssh_listener_ {nullptr};
+    //! Loop which drives the session and the channels, may be shared by
+    //! many tunnels
+    transport::event_loop::ptr loop_;
+    //! The loop was created by the tunnel and is stopped with it
+    bool own_loop_ {false};
+    std::weak_ptr<reverse_tunnel> self_;
+    //! Pump is posted to the loop, events of the same epoll batch are
+    //! coalesced into one pump. Accessed on the loop thread only.
+    bool pump_pending_ {false};
 
     struct ssh_channel {
         typedef std::shared_ptr<ssh_channel> ptr;
 
         LIBSSH2_CHANNEL* ssh_channel;
-        std::vector<uint8_t> rx;
-        std::vector<uint8_t> tx;
+        int fd {-1};
+        //! Local connection to ssh channel data
+        utils::ring_buffer rx {CHANNEL_BUFFER_SIZE};
+        //! Ssh channel to local connection data
+        utils::ring_buffer tx {CHANNEL_BUFFER_SIZE};
+        //! Edge triggered local connection readiness, set by epoll and
+        //! cleared when recv()/send() would block
+        bool readable {true};
+        bool writable {true};
+        bool local_eof {false};
+        bool ssh_eof {false};
+        //! Non-blocking connect to the local server is in progress, the
+        //! channel is not pumped until it's finished
+        bool connecting {false};
+        //! Connect to the local server failed, the channel is closed
+        bool connect_failed {false};
     };
 
     std::map<int, ssh_channel::ptr> ssh_channels_;
@@ -343,6 +372,7 @@ private:
     end:
         if (ssh_session_sock_ != -1)
             close(ssh_session_sock_);
+        ssh_session_sock_ = -1;
 
         if (ssh_session_) {
             libssh2_session_disconnect(ssh_session_,
@@ -378,12 +408,21 @@ private:
         return true;
     }
 
-    static int _connect(std::string addr, const uint16_t port) {
+    //! @brief Connect to @p addr:@p port.
+    //!
+    //! @param in_progress If not nullptr the socket is non-blocking and the
+    //!                    connect may be still in progress on return, the
+    //!                    socket becomes writable when it's finished.
+    static int _connect(std::string addr,
+                        const uint16_t port,
+                        bool* in_progress = nullptr) {
         int forwardsock = -1;
         struct sockaddr_in sin;
         socklen_t sinlen = sizeof(sin);
 
-        forwardsock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+        forwardsock = socket(PF_INET,
+                             SOCK_STREAM | (in_progress ? SOCK_NONBLOCK : 0),
+                             IPPROTO_TCP);
 
         if (forwardsock == -1) {
             vxg::logger::instance(TAG)->error("Failed to create socket");
@@ -399,7 +438,14 @@ private:
             goto end;
         }
 
+        if (in_progress)
+            *in_progress = false;
+
         if (0 != connect(forwardsock, (struct sockaddr*)&sin, sinlen)) {
+            if (in_progress && errno == EINPROGRESS) {
+                *in_progress = true;
+                return forwardsock;
+            }
             vxg::logger::instance(TAG)->error("connect");
             goto end;
         }
@@ -411,39 +457,6 @@ private:
         return -1;
     }
 
-    static int _wait_socket(int socket_fd, LIBSSH2_SESSION* session) {
-        struct timeval timeout;
-        int rc;
-        fd_set fd;
-        fd_set* writefd = NULL;
-        fd_set* readfd = NULL;
-        int dir;
-
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 1000;
-
-        FD_ZERO(&fd);
-
-        FD_SET(socket_fd, &fd);
-
-        /* now make sure we wait in the correct direction */
-        if (session) {
-            dir = libssh2_session_block_directions(session);
-            if (dir & LIBSSH2_SESSION_BLOCK_INBOUND)
-                readfd = &fd;
-
-            if (dir & LIBSSH2_SESSION_BLOCK_OUTBOUND)
-                writefd = &fd;
-        } else {
-            readfd = &fd;
-            writefd = &fd;
-        }
-
-        rc = select(socket_fd + 1, readfd, writefd, NULL, &timeout);
-
-        return rc;
-    }
-
     static bool _set_nonblocking(int fd, bool blocking) {
         int flags = fcntl(fd, F_GETFL, 0);
         if (flags == -1)
@@ -452,41 +465,105 @@ private:
         return (fcntl(fd, F_SETFL, flags) == 0) ? true : false;
     }
 
-    static void _open_channel(reverse_tunnel::ptr tunnel) {
+    //! Finish the non-blocking connect of the channel's local connection
+    static void _on_connected(ssh_channel* c) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+
+        c->connecting = false;
+        if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
+            error = errno;
+
+        if (error) {
+            vxg::logger::instance(TAG)->error(
+                "Local connection {} NOT established: {}", c->fd,
+                strerror(error));
+            c->connect_failed = true;
+        } else {
+            vxg::logger::instance(TAG)->info("Local connection {} established.",
+                                             c->fd);
+        }
+    }
+
+    //! @brief Accept the remote connection and start connecting to the
+    //! local server.
+    //!
+    //! The connect is non-blocking, the loop may be shared by many tunnels
+    //! and an unreachable local server must not stall them.
+    //!
+    //! @return false if there is no remote connection to accept
+    static bool _open_channel(reverse_tunnel* tunnel) {
         auto channel = libssh2_channel_forward_accept(tunnel->ssh_listener_);
 
         if (channel) {
             int local_sock = -1;
+            bool in_progress = false;
             vxg::logger::instance(TAG)->info(
                 "Accepted remote connection. Connecting to local server "
                 "{}:{}",
                 tunnel->params_.local_dest_ip, tunnel->params_.local_dest_port);
 
             local_sock = _connect(tunnel->params_.local_dest_ip.c_str(),
-                                  tunnel->params_.local_dest_port);
+                                  tunnel->params_.local_dest_port,
+                                  &in_progress);
 
             if (local_sock > 0) {
                 ssh_channel::ptr _channel = std::make_shared<ssh_channel>();
+                ssh_channel* c = _channel.get();
+
                 _channel->ssh_channel = channel;
+                _channel->fd = local_sock;
+                _channel->connecting = in_progress;
+
+                // The channel is removed from the loop on the loop thread
+                // before it's freed, the raw pointers can't dangle
+                if (!tunnel->loop_->add(
+                        local_sock, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                        [tunnel, c](uint32_t ev) {
+                            // Connect finished, successfully or not
+                            if (c->connecting &&
+                                (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR)))
+                                _on_connected(c);
+                            // Errors and hangups are reported by
+                            // recv()/send()
+                            if (ev &
+                                (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                                c->readable = true;
+                            if (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                                c->writable = true;
+                            tunnel->_schedule_pump();
+                        })) {
+                    vxg::logger::instance(TAG)->error(
+                        "Failed to watch local connection {}", local_sock);
+                    close(local_sock);
+                    libssh2_channel_free(channel);
+                    return true;
+                }
 
                 tunnel->ssh_channels_[local_sock] = _channel;
 
-                _set_nonblocking(local_sock, true);
-
-                vxg::logger::instance(TAG)->info(
-                    "Local connection {} established.", local_sock);
+                if (in_progress)
+                    vxg::logger::instance(TAG)->info(
+                        "Local connection {} in progress.", local_sock);
+                else
+                    vxg::logger::instance(TAG)->info(
+                        "Local connection {} established.", local_sock);
             } else {
                 vxg::logger::instance(TAG)->error(
                     "Local connection NOT established.");
                 libssh2_channel_free(channel);
             }
+            return true;
         }
+
+        return false;
     }
 
     static void _close_channel(reverse_tunnel* tunnel, int fd) {
         vxg::logger::instance(TAG)->info(
             "Closing local connection {} and ssh channel {}", fd,
             (void*)tunnel->ssh_channels_[fd]->ssh_channel);
+        tunnel->loop_->remove(fd);
         close(fd);
         libssh2_channel_free(tunnel->ssh_channels_[fd]->ssh_channel);
     }
@@ -510,7 +587,13 @@ private:
 public:
     ~reverse_tunnel() { stop(); }
 
-    static reverse_tunnel::ptr create(params tun_params) {
+    //! @brief Create the tunnel.
+    //!
+    //! @param loop Loop to run the tunnel on, many tunnels may share the same
+    //!             loop. The tunnel starts its own loop if nullptr.
+    static reverse_tunnel::ptr create(
+        params tun_params,
+        transport::event_loop::ptr loop = nullptr) {
         try {
             std::call_once(reverse_tunnel::libssh_init_flag_, []() {
                 if (libssh2_init(0))
@@ -524,150 +607,193 @@ public:
         struct make_shared_enabler : public reverse_tunnel {
             make_shared_enabler(params p) : reverse_tunnel(p) {}
         };
-        return std::make_shared<make_shared_enabler>(tun_params);
+        auto tunnel = std::make_shared<make_shared_enabler>(tun_params);
+        tunnel->self_ = tunnel;
+        tunnel->own_loop_ = (loop == nullptr);
+        tunnel->loop_ =
+            loop ? loop : std::make_shared<transport::event_loop>();
+        return tunnel;
     }
 
-    static void channels_loop(reverse_tunnel::ptr tunnel) {
-        int ssh_rc, rc;
-        fd_set rd_fds, wr_fds;
-        char buf[1024 * 64];
-        struct timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 1000;
-        int max_fd = -1;
-
-        /* Fill fdsets with local connections descriptors */
-        FD_ZERO(&rd_fds);
-        FD_ZERO(&wr_fds);
-        for (auto& kv : tunnel->ssh_channels_) {
-            FD_SET(kv.first, &rd_fds);
-            FD_SET(kv.first, &wr_fds);
-            max_fd = std::max(max_fd, kv.first);
-        }
-
-        /* Wait for activity on local connections */
-        rc = select(max_fd + 1, &rd_fds, &wr_fds, nullptr, &tv);
-        if (rc > 0) {
-            /* Loop over local connections and read/write where it's possible */
-            for (auto kv = tunnel->ssh_channels_.cbegin();
-                 kv != tunnel->ssh_channels_.cend();) {
-                int i = 0;
-                bool can_read = FD_ISSET(kv->first, &rd_fds);
-                bool can_write = FD_ISSET(kv->first, &wr_fds);
-
-                /* Read from the local connection and put to the local rx buf */
-                if (can_read && kv->second->rx.size() < (1024 * 1024)) {
-                    i = recv(kv->first, buf, sizeof(buf), 0);
-                    // vxg::logger::instance(TAG)->info("Read {} bytes from
-                    // local conn {}", i,
-                    //              kv->first);
-                    if (i > 0)
-                        kv->second->rx.insert(kv->second->rx.end(), buf,
-                                              buf + i);
-                    else if (i <= 0) {
-                        /* recv() returns 0 if peer closed connection */
-                        _close_channel(tunnel.get(), kv->first);
-                        tunnel->ssh_channels_.erase(kv++);
-                        continue;
-                    }
-                }
+    //! @brief Move the channel data as far as the sockets and buffers allow.
+    //!
+    //! @return -1 if the channel should be closed, 1 if any data was moved,
+    //!         0 otherwise.
+    static int _pump_channel(ssh_channel& c) {
+        bool progress = false;
+        size_t len;
+        ssize_t n;
+
+        // Remote data waits in the libssh2 channel until the local connection
+        // is established
+        if (c.connect_failed)
+            return -1;
+        if (c.connecting)
+            return 0;
+
+        // Local connection to rx
+        while (c.readable && !c.rx.full()) {
+            uint8_t* p = c.rx.write_ptr(len);
+
+            n = recv(c.fd, p, len, 0);
+            if (n > 0) {
+                c.rx.commit(n);
+                progress = true;
+            } else if (n == 0) {
+                c.readable = false;
+                c.local_eof = true;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                c.readable = false;
+            } else if (errno != EINTR) {
+                return -1;
+            }
+        }
 
-                /* Write to the local connection */
-                if (can_write && !kv->second->tx.empty()) {
-                    i = send(kv->first, kv->second->tx.data(),
-                             kv->second->tx.size(), 0);
-                    // vxg::logger::instance(TAG)->info("Wrote {} bytes to local
-                    // conn {}", i,
-                    //              kv->first);
-                    if (i > 0)
-                        kv->second->tx.erase(kv->second->tx.begin(),
-                                             kv->second->tx.begin() + i);
-                    else if (i < 0) {
-                        _close_channel(tunnel.get(), kv->first);
-                        tunnel->ssh_channels_.erase(kv++);
-                        continue;
-                    }
-                }
+        // rx to ssh channel, libssh2 returns EAGAIN if the session socket or
+        // the remote window is full
+        while (!c.rx.empty()) {
+            const uint8_t* p = c.rx.read_ptr(len);
 
-                /* Wait for possible activity on ssh connection */
-                ssh_rc = _wait_socket(tunnel->ssh_session_sock_,
-                                      tunnel->ssh_session_);
-                if (ssh_rc != LIBSSH2_ERROR_EAGAIN) {
-                    /* Write data received from the local connection to the ssh
-                     * tunnel's connection corresponding to the ssh channel.
-                     */
-                    while (!kv->second->rx.empty()) {
-                        i = libssh2_channel_write(
-                            kv->second->ssh_channel,
-                            (const char*)kv->second->rx.data(),
-                            kv->second->rx.size());
-
-                        if (i == LIBSSH2_ERROR_EAGAIN) {
-                            _wait_socket(tunnel->ssh_session_sock_,
-                                         tunnel->ssh_session_);
-                            continue;
-                        } else if (i > 0) {
-                            kv->second->rx.erase(kv->second->rx.begin(),
-                                                 kv->second->rx.begin() + i);
-                            break;
-                        }
-                    }
-                    if (i < 0 && i != LIBSSH2_ERROR_EAGAIN) {
-                        _close_channel(tunnel.get(), kv->first);
-                        tunnel->ssh_channels_.erase(kv++);
-                        continue;
-                    }
+            n = libssh2_channel_write(c.ssh_channel, (const char*)p, len);
+            if (n > 0) {
+                c.rx.consume(n);
+                progress = true;
+            } else if (n == LIBSSH2_ERROR_EAGAIN || n == 0) {
+                break;
+            } else {
+                return -1;
+            }
+        }
 
-                    /* Read from ssh channel and put data to the local buffer */
-                    i = libssh2_channel_read(kv->second->ssh_channel, buf,
-                                             sizeof(buf));
-                    if (i < 0 && LIBSSH2_ERROR_EAGAIN != i) {
-                        _close_channel(tunnel.get(), kv->first);
-                        tunnel->ssh_channels_.erase(kv++);
-                        continue;
-                    } else if (i > 0) {
-                        kv->second->tx.insert(kv->second->tx.end(), buf,
-                                              buf + i);
-                    }
+        // Ssh channel to tx
+        while (!c.ssh_eof && !c.tx.full()) {
+            uint8_t* p = c.tx.write_ptr(len);
 
-                    /* Close channel if tunnel's client closed connection */
-                    if (libssh2_channel_eof(kv->second->ssh_channel)) {
-                        _close_channel(tunnel.get(), kv->first);
-                        tunnel->ssh_channels_.erase(kv++);
-                        continue;
-                    }
-                }
+            n = libssh2_channel_read(c.ssh_channel, (char*)p, len);
+            if (n > 0) {
+                c.tx.commit(n);
+                progress = true;
+            } else if (n == LIBSSH2_ERROR_EAGAIN || n == 0) {
+                c.ssh_eof = libssh2_channel_eof(c.ssh_channel);
+                break;
+            } else {
+                return -1;
+            }
+        }
 
-                kv++;
+        // tx to local connection
+        while (c.writable && !c.tx.empty()) {
+            const uint8_t* p = c.tx.read_ptr(len);
+
+            n = send(c.fd, p, len, MSG_NOSIGNAL);
+            if (n > 0) {
+                c.tx.consume(n);
+                progress = true;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                c.writable = false;
+            } else if (n < 0 && errno != EINTR) {
+                return -1;
             }
         }
+
+        // Close when either side closed and its data is delivered
+        if ((c.local_eof && c.rx.empty()) || (c.ssh_eof && c.tx.empty()))
+            return -1;
+
+        return progress;
     }
 
-    static void acceptor_routine(reverse_tunnel::ptr tunnel) {
-        vxg::logger::instance(TAG)->info("Waiting for remote connections");
+    //! @brief Accept the remote connections and pump all the channels once.
+    //!
+    //! libssh2 reads the session socket until EAGAIN and keeps the packets of
+    //! all the channels in the session, so every wake up pumps all of them,
+    //! the edge triggered session socket can't miss the data.
+    //!
+    //! A pass moves at most the channel buffers of data, if anything was
+    //! moved the pump is posted again so the other tunnels and the timers of
+    //! the shared loop are not starved by a busy tunnel.
+    static void _pump(reverse_tunnel* tunnel) {
+        bool progress = false;
+
+        while (_open_channel(tunnel))
+            progress = true;
+
+        for (auto kv = tunnel->ssh_channels_.cbegin();
+             kv != tunnel->ssh_channels_.cend();) {
+            int rc = _pump_channel(*kv->second);
+
+            if (rc < 0) {
+                _close_channel(tunnel, kv->first);
+                tunnel->ssh_channels_.erase(kv++);
+                continue;
+            }
+            progress |= rc > 0;
+            kv++;
+        }
 
-        while (tunnel->running_) {
-            int rc;
+        if (progress)
+            tunnel->_schedule_pump();
+    }
 
-            // Wait for the activity on the main ssh socket.
-            if ((rc = _wait_socket(tunnel->ssh_session_sock_,
-                                   tunnel->ssh_session_)) < 0) {
-                vxg::logger::instance(TAG)->error("wait socket");
-                tunnel->status_ = TS_CLOSED;
-                break;
+    //! Post the pump to the loop if it's not posted yet
+    void _schedule_pump() {
+        std::weak_ptr<reverse_tunnel> self = self_;
+
+        if (pump_pending_)
+            return;
+
+        pump_pending_ = true;
+        loop_->post([self]() {
+            auto tunnel = self.lock();
+
+            if (tunnel) {
+                tunnel->pump_pending_ = false;
+                if (tunnel->running_)
+                    _pump(tunnel.get());
             }
+        });
+    }
 
-            // Try to accept new tunnel's client, nothing bad if there is none
-            if (rc != LIBSSH2_ERROR_EAGAIN)
-                _open_channel(tunnel);
+    //! Watch the session socket, called on the loop thread
+    bool _attach() {
+        // libssh2 switched the session socket to the non-blocking mode in
+        // the handshake
+        if (!loop_->add(ssh_session_sock_,
+                        EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                        [this](uint32_t ev) {
+                            if (ev & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                                vxg::logger::instance(TAG)->error(
+                                    "Ssh session socket closed");
+                                status_ = TS_CLOSED;
+                                running_ = false;
+                                _detach();
+                                return;
+                            }
+                            _schedule_pump();
+                        })) {
+            vxg::logger::instance(TAG)->error(
+                "Failed to watch ssh session socket");
+            return false;
+        }
+
+        vxg::logger::instance(TAG)->info("Waiting for remote connections");
+        running_ = true;
+        // Connections may be pending since the port was bound
+        _pump(this);
 
-            // Loop over all channels
-            channels_loop(tunnel);
+        return true;
+    }
+
+    //! Close the channels and unwatch the session socket, called on the loop
+    //! thread
+    void _detach() {
+        for (auto c = ssh_channels_.cbegin(); c != ssh_channels_.cend();) {
+            _close_channel(this, c->first);
+            ssh_channels_.erase(c++);
         }
 
-        vxg::logger::instance(TAG)->info("{}:{} forwarding thread stopped",
-                                         tunnel->params_.local_dest_ip,
-                                         tunnel->params_.local_dest_port);
+        if (ssh_session_sock_ >= 0)
+            loop_->remove(ssh_session_sock_);
     }
 
     bool init_forward_session() { return _create_ssh_session(); }
@@ -683,8 +809,13 @@ public:
         return false;
     }
 
+    //! @brief Create the ssh session and start the forwarding.
+    //!
+    //! The session is created on the caller thread, the forwarding is run on
+    //! the loop.
     bool start() {
         int dyn_port = -1;
+        bool attached = false;
 
         if (!init_forward_session()) {
             status_ = TS_SSH_CONN_FAILED;
@@ -698,10 +829,18 @@ public:
 
         vxg::logger::instance(TAG)->info("Bound port {}", dyn_port);
 
+        if (own_loop_ && !loop_->start("ssh-tunnel")) {
+            status_ = TS_SSH_TUNN_FAILED;
+            goto end;
+        }
+
         status_ = TS_OK;
-        running_ = true;
-        thread_acceptor_ =
-            std::thread(reverse_tunnel::acceptor_routine, shared_from_this());
+        loop_->invoke([this, &attached]() { attached = _attach(); });
+        if (!attached) {
+            status_ = TS_SSH_TUNN_FAILED;
+            goto end;
+        }
+
         return true;
     end:
         return false;
@@ -709,18 +848,13 @@ public:
 
     bool running() { return running_; }
 
+    //! @brief Stop the forwarding and close the session.
+    //!
+    //! May be called on the loop thread.
     void stop() {
         running_ = false;
-        if (thread_acceptor_.joinable() &&
-            thread_acceptor_.get_id() != std::this_thread::get_id()) {
-            vxg::logger::instance(TAG)->info(
-                "Waiting for forwarding thread stop");
-            thread_acceptor_.join();
-            vxg::logger::instance(TAG)->info("Forwarding thread stopped");
-        } else if (thread_acceptor_.get_id() != std::thread::id()) {
-            thread_acceptor_.detach();
-            vxg::logger::instance(TAG)->info("Forwarding thread detached");
-        }
+        if (loop_)
+            loop_->invoke([this]() { _detach(); });
 
         if (ssh_session_)
             libssh2_session_set_blocking(ssh_session_, 1);
@@ -730,11 +864,6 @@ public:
             ssh_listener_ = nullptr;
         }
 
-        for (auto c = ssh_channels_.cbegin(); c != ssh_channels_.cend();) {
-            _close_channel(this, c->first);
-            ssh_channels_.erase(c++);
-        }
-
         if (ssh_session_) {
             libssh2_session_disconnect(ssh_session_,
                                        "Client disconnecting normally");
@@ -744,6 +873,10 @@ public:
 
         if (ssh_session_sock_ > 0)
             close(ssh_session_sock_);
+        ssh_session_sock_ = -1;
+
+        if (own_loop_ && loop_)
+            loop_->stop();
     }
 
     void set_params(params p) { params_ = p; }
@@ -842,44 +975,74 @@ class reverse_tunneling {
         libssh2::reverse_tunnel::ptr ssh;
         std::chrono::time_point<std::chrono::system_clock> creation_time_;
         std::chrono::seconds timeout;
+        //! Stops the tunnel when its timeout expires
+        transport::timed_cb_ptr expiry;
     };
 
     std::map<std::string, std::pair<std::string, std::string>> keypairs_;
     std::map<std::string, tunnel::ptr> tunnels_;
-    std::thread thread_gc_;
     std::mutex lock_;
-    std::atomic<bool> running_ {true};
+    //! All the tunnels and their channels are multiplexed on this loop, the
+    //! expiration timers are run on it too
+    transport::event_loop::ptr loop_ {
+        std::make_shared<transport::event_loop>()};
+    //! Expired tunnels are stopped on this loop, the SSH disconnect blocks and
+    //! must not stall the tunnels loop
+    transport::event_loop::ptr reaper_ {
+        std::make_shared<transport::event_loop>()};
+
+    reverse_tunneling() {
+        loop_->start("reverse-tunnels");
+        reaper_->start("tunnels-reaper");
+    }
 
-    reverse_tunneling() { thread_gc_ = std::thread(_gc, this); }
+    //! @brief Remove @p key tunnel from the tunnels map.
+    //!
+    //! @param victim Remove only if it's this tunnel, any tunnel if nullptr.
+    //! @return Removed tunnel, the caller should stop it without the lock
+    //!         held since the stop waits for the loop.
+    tunnel::ptr _take(const std::string& key, tunnel::ptr victim = nullptr) {
+        std::lock_guard<std::mutex> lock(lock_);
+        auto it = tunnels_.find(key);
+        tunnel::ptr t;
+
+        if (it != tunnels_.end() && (!victim || it->second == victim)) {
+            t = it->second;
+            tunnels_.erase(it);
+        }
 
-    static bool _expired(tunnel::ptr tunnel) {
-        return (std::chrono::system_clock::now() - tunnel->creation_time_ >
-                tunnel->timeout);
+        return t;
     }
 
-    static void _gc(reverse_tunneling* rt) {
-        while (rt->running_) {
-            {
-                std::lock_guard<std::mutex> lock(rt->lock_);
-
-                for (auto t = rt->tunnels_.cbegin();
-                     t != rt->tunnels_.cend();) {
-                    if (_expired(t->second)) {
-                        t->second->ssh->stop();
-                        rt->tunnels_.erase(t++);
-                    } else
-                        t++;
-                }
-            }
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+    void _stop(tunnel::ptr t) {
+        loop_->cancel_timed_cb(t->expiry);
+        t->ssh->stop();
+    }
+
+    void _expire(const std::string& key, std::weak_ptr<tunnel> weak_victim) {
+        auto victim = weak_victim.lock();
+        tunnel::ptr t;
+
+        if (victim && (t = _take(key, victim))) {
+            logger->info("Tunnel {} expired", key);
+            reaper_->post([t]() { t->ssh->stop(); });
         }
     }
 
 public:
     ~reverse_tunneling() {
-        running_ = false;
-        if (thread_gc_.joinable())
-            thread_gc_.join();
+        std::map<std::string, tunnel::ptr> tunnels;
+
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            tunnels.swap(tunnels_);
+        }
+
+        // Expired tunnels are stopped before the loop
+        reaper_->stop();
+        for (auto& t : tunnels)
+            _stop(t.second);
+        loop_->stop();
     }
 
     static reverse_tunneling& instance() {
@@ -924,7 +1087,7 @@ public:
                 tunnel::ptr complete_tunnel = std::make_shared<tunnel>();
                 std::string tunnel_key =
                     params.cam_ip + ":" + std::to_string(params.cam_port);
-                std::lock_guard<std::mutex> lock(lock_);
+                std::unique_lock<std::mutex> lock(lock_);
 
                 if (tunnels_.count(tunnel_key)) {
                     logger->error("Tunnel {} already exists", tunnel_key);
@@ -945,9 +1108,12 @@ public:
                     tunnel_params.ssh_public_key = keypairs_[client_id].second;
                     // No longer need keypair here
                     keypairs_.erase(client_id);
+                    // The session setup blocks, other tunnels are not
+                    // blocked meanwhile
+                    lock.unlock();
 
                     auto ssh_tunnel =
-                        libssh2::reverse_tunnel::create(tunnel_params);
+                        libssh2::reverse_tunnel::create(tunnel_params, loop_);
 
                     complete_tunnel->creation_time_ =
                         std::chrono::system_clock::now();
@@ -957,27 +1123,46 @@ public:
                     complete_tunnel->client_id = client_id;
 
                     if (ssh_tunnel->start()) {
-                        pf_reply.status = PFS_OK;
-                        tunnels_[tunnel_key] = complete_tunnel;
+                        std::weak_ptr<tunnel> weak_tunnel = complete_tunnel;
+
+                        pf_reply.text = json(ssh_tunnel->get_status()).dump();
+
+                        lock.lock();
+                        if (!tunnels_.count(tunnel_key)) {
+                            complete_tunnel->expiry = loop_->schedule_timed_cb(
+                                [this, tunnel_key, weak_tunnel]() {
+                                    _expire(tunnel_key, weak_tunnel);
+                                },
+                                std::max(params.timeout, 0) * 1000);
+                            tunnels_[tunnel_key] = complete_tunnel;
+                            pf_reply.status = PFS_OK;
+                        } else {
+                            // Created by a concurrent request meanwhile
+                            pf_reply.status = PFS_ERROR;
+                            pf_reply.text =
+                                "Tunnel " + tunnel_key + " already exists.";
+                        }
+                        lock.unlock();
+
+                        if (pf_reply.status != PFS_OK)
+                            ssh_tunnel->stop();
                     } else {
                         pf_reply.status = PFS_ERROR;
+                        pf_reply.text = json(ssh_tunnel->get_status()).dump();
                     }
-
-                    pf_reply.text = json(ssh_tunnel->get_status()).dump();
                 }
             } break;
             case PF_DELETE_TUNNEL: {
-                std::lock_guard<std::mutex> lock(lock_);
                 if (pf_message.data != nullptr) {
                     port_forward_params params = pf_message.data;
                     std::string victim =
                         params.cam_ip + ":" + std::to_string(params.cam_port);
+                    tunnel::ptr t = _take(victim);
 
-                    if (tunnels_.count(victim)) {
+                    if (t) {
                         logger->info("Stopping tunnel {}", victim);
 
-                        tunnels_[victim]->ssh->stop();
-                        tunnels_.erase(victim);
+                        _stop(t);
 
                         pf_reply.status = PFS_OK;
                         pf_reply.text = "Tunnel closed";
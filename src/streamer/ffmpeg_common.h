@@ -10,6 +10,7 @@ extern "C" {
 #include <libavutil/timestamp.h>
 }
 
+#include <algorithm>
 #include <mutex>
 
 #include <streamer/base_streamer.h>
@@ -24,7 +25,6 @@ namespace vxg {
 namespace media {
 namespace ffmpeg {
 
-#define LOG_BUF_PREFIX_SIZE 512
 #define LOG_BUF_SIZE 1024
 
 //! @brief common ffmpeg class
@@ -37,9 +37,17 @@ protected:
                                 int level,
                                 const char* fmt,
                                 va_list vargs) {
-        char ffmpeg_log_buf_prefix[LOG_BUF_PREFIX_SIZE];
+        static vxg::logger::logger_ptr ffmpeg_logger =
+            vxg::logger::instance("ffmpeg");
+        // libav repeats the same warnings for every broken packet
+        static vxg::log_rate_limiter limiter(50, std::chrono::seconds(1));
         char ffmpeg_log_buf_[LOG_BUF_SIZE];
         AVClass* avc = ptr ? *(AVClass**)ptr : NULL;
+        spdlog::level::level_enum lvl;
+        size_t suppressed;
+
+        if (level > AV_LOG_INFO)
+            return;
 
         // Drop all noisy dhav demuxer's messages.
         // !Yes it uses wrong AV_CLASS_CATEGORY_MUXER category!
@@ -49,26 +57,33 @@ protected:
             !std::strcmp(((AVFormatContext*)ptr)->iformat->name, "dhav"))
             return;
 
-        if (level > AV_LOG_INFO)
-            return;
-
-        std::memset(ffmpeg_log_buf_prefix, 0, LOG_BUF_PREFIX_SIZE);
-        std::memset(ffmpeg_log_buf_, 0, LOG_BUF_SIZE);
-
-        std::snprintf(ffmpeg_log_buf_prefix, LOG_BUF_PREFIX_SIZE, "%s", fmt);
-        std::vsnprintf(ffmpeg_log_buf_, LOG_BUF_SIZE, ffmpeg_log_buf_prefix,
-                       vargs);
-
         if (level <= AV_LOG_ERROR)
-            vxg::logger::instance("ffmpeg")->error(ffmpeg_log_buf_);
+            lvl = spdlog::level::err;
         else if (level <= AV_LOG_WARNING)
-            vxg::logger::instance("ffmpeg")->warn(ffmpeg_log_buf_);
+            lvl = spdlog::level::warn;
         else if (level <= AV_LOG_INFO)
-            vxg::logger::instance("ffmpeg")->info(ffmpeg_log_buf_);
+            lvl = spdlog::level::info;
         else if (level <= AV_LOG_DEBUG)
-            vxg::logger::instance("ffmpeg")->debug(ffmpeg_log_buf_);
-        else if (level <= AV_LOG_TRACE)
-            vxg::logger::instance("ffmpeg")->trace(ffmpeg_log_buf_);
+            lvl = spdlog::level::debug;
+        else
+            lvl = spdlog::level::trace;
+
+        // Format only what is going to be logged
+        if (!ffmpeg_logger->should_log(lvl) || !limiter.allow(suppressed))
+            return;
+
+        int len = std::vsnprintf(ffmpeg_log_buf_, LOG_BUF_SIZE, fmt, vargs);
+        if (len < 0)
+            return;
+        len = std::min(len, LOG_BUF_SIZE - 1);
+        // spdlog adds its own line ending
+        if (len > 0 && ffmpeg_log_buf_[len - 1] == '\n')
+            len--;
+
+        if (suppressed)
+            ffmpeg_logger->log(lvl, "{} similar messages suppressed",
+                               suppressed);
+        ffmpeg_logger->log(lvl, spdlog::string_view_t(ffmpeg_log_buf_, len));
     }
 
     static void init() {
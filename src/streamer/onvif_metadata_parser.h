@@ -0,0 +1,521 @@
+#ifndef __ONVIF_METADATA_PARSER_H
+#define __ONVIF_METADATA_PARSER_H
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <utils/logging.h>
+#include <utils/utils.h>
+
+namespace vxg {
+namespace media {
+namespace onvif {
+
+struct simple_item {
+    std::string name;
+    std::string value;
+};
+
+struct event {
+    std::string raw_body;
+
+    std::string topic;
+    cloud::time time;
+    std::string prop_op;
+
+    std::vector<simple_item> source_items;
+    std::vector<simple_item> data_items;
+};
+
+//! @brief Incremental ONVIF metadata stream parser.
+//!
+//! According to ONVIF there are no guarantees that a packet carries the
+//! complete XML document, the sender may split it at any byte. The parser is
+//! fed with the packets as they arrive and resumes the tokenizing where the
+//! previous packet ended, every byte is scanned once. Only the current markup
+//! token, the open elements and the body of the current notification are
+//! kept.
+//!
+//! An event is emitted as soon as its NotificationMessage element is closed:
+//! @code
+//! MetadataStream
+//!     Event
+//!         NotificationMessage
+//!             Topic
+//!             Message
+//!                 Message[UtcTime,PropertyOperation]
+//!                     Source
+//!                         SimpleItem[Name,Value]
+//!                     Data
+//!                         SimpleItem[Name,Value]
+//! @endcode
+//! The event's raw_body is the notification wrapped into its ancestors, so it
+//! keeps their namespace declarations and stays a well-formed document.
+//!
+//! Malformed input resets the parser, it resynchronizes on the next
+//! document.
+class metadata_parser {
+    vxg::logger::logger_ptr logger {
+        vxg::logger::instance("onvif-metadata-parser")};
+
+public:
+    //! Markup longer than this is treated as a corrupted stream
+    static constexpr size_t MAX_TOKEN_SIZE = 64 * 1024;
+    //! Notification body longer than this is treated as a corrupted stream
+    static constexpr size_t MAX_BODY_SIZE = 1024 * 1024;
+
+    explicit metadata_parser(std::function<void(event)> cb = nullptr)
+        : cb_ {cb} {}
+
+    void set_callback(std::function<void(event)> cb) { cb_ = cb; }
+
+    //! Parse the next chunk of the stream, events are emitted from the call
+    void feed(const char* data, size_t len) {
+        // Span of the chunk not yet copied to text_
+        size_t text_from = 0;
+
+        body_from_ = 0;
+
+        for (size_t i = 0; i < len; i++) {
+            char c = data[i];
+
+            if (state_ == TEXT) {
+                if (c != '<')
+                    continue;
+
+                if (collect_text_)
+                    text_.append(data + text_from, i - text_from);
+                state_ = MARKUP;
+                token_from_ = i;
+                markup_len_ = 1;
+                special_ = false;
+                quote_ = 0;
+                continue;
+            }
+
+            // Comments, CDATA and DOCTYPE have no quoted values
+            if (markup_len_++ == 1)
+                special_ = (c == '!');
+            if (markup_len_ > MAX_TOKEN_SIZE) {
+                _fail("Markup is too long");
+                continue;
+            }
+            // '<' is not allowed in a tag even quoted, the tag was truncated
+            // by the lost packet, the new markup starts here
+            if (c == '<' && !special_) {
+                _fail("Truncated markup");
+                i--;
+                continue;
+            }
+
+            if (quote_) {
+                if (c == quote_)
+                    quote_ = 0;
+                continue;
+            }
+            if (!special_ && (c == '"' || c == '\'')) {
+                quote_ = c;
+                continue;
+            }
+            if (c != '>')
+                continue;
+
+            token_.append(data + token_from_, i + 1 - token_from_);
+            token_from_ = i + 1;
+            if (!_token_complete())
+                continue;
+
+            _handle_token(data, i + 1);
+            token_.clear();
+            state_ = TEXT;
+            text_from = i + 1;
+        }
+
+        if (state_ == MARKUP) {
+            token_.append(data + token_from_, len - token_from_);
+            token_from_ = 0;
+        } else if (collect_text_) {
+            text_.append(data + text_from, len - text_from);
+        }
+
+        if (notification_ >= 0) {
+            body_.append(data + body_from_, len - body_from_);
+            if (body_.size() > MAX_BODY_SIZE)
+                _fail("Notification is too long");
+        }
+    }
+
+    void feed(const std::vector<uint8_t>& data) {
+        feed(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+
+    //! Drop the partially parsed document
+    void reset() {
+        state_ = TEXT;
+        token_.clear();
+        token_from_ = 0;
+        markup_len_ = 0;
+        special_ = false;
+        quote_ = 0;
+        stack_.clear();
+        notification_ = -1;
+        collect_text_ = false;
+        text_.clear();
+        body_.clear();
+        event_ = event();
+    }
+
+    //! Number of the resets caused by the malformed input
+    size_t errors() const { return errors_; }
+
+private:
+    enum state { TEXT, MARKUP };
+
+    struct element {
+        std::string qname;
+        std::string local;
+        //! Raw start tag, kept for the ancestors of the notification only
+        std::string start_tag;
+    };
+
+    std::function<void(event)> cb_;
+    state state_ {TEXT};
+    //! Markup token from '<' to '>', may span chunks
+    std::string token_;
+    size_t token_from_ {0};
+    size_t markup_len_ {0};
+    bool special_ {false};
+    char quote_ {0};
+    std::vector<element> stack_;
+    //! Index of the NotificationMessage element in the stack_, -1 if none
+    int notification_ {-1};
+    //! Topic element text is collected
+    bool collect_text_ {false};
+    std::string text_;
+    std::string body_;
+    //! Start of the chunk's span not yet copied to body_
+    size_t body_from_ {0};
+    event event_;
+    size_t errors_ {0};
+
+    void _fail(const char* reason) {
+        logger->debug("Malformed metadata: {}, resetting", reason);
+        errors_++;
+        reset();
+    }
+
+    bool _token_complete() const {
+        if (!special_)
+            return true;
+        if (!token_.compare(0, 4, "<!--"))
+            return token_.size() >= 7 &&
+                   !token_.compare(token_.size() - 3, 3, "-->");
+        if (!token_.compare(0, 9, "<![CDATA["))
+            return token_.size() >= 12 &&
+                   !token_.compare(token_.size() - 3, 3, "]]>");
+        return true;
+    }
+
+    static bool _is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    static bool _is_name_end(char c) {
+        return _is_space(c) || c == '/' || c == '>' || c == '=';
+    }
+
+    static void _append_utf8(std::string& s, uint32_t cp) {
+        if (cp < 0x80) {
+            s += (char)cp;
+        } else if (cp < 0x800) {
+            s += (char)(0xC0 | (cp >> 6));
+            s += (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            s += (char)(0xE0 | (cp >> 12));
+            s += (char)(0x80 | ((cp >> 6) & 0x3F));
+            s += (char)(0x80 | (cp & 0x3F));
+        } else {
+            s += (char)(0xF0 | (cp >> 18));
+            s += (char)(0x80 | ((cp >> 12) & 0x3F));
+            s += (char)(0x80 | ((cp >> 6) & 0x3F));
+            s += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    //! Replace the predefined and the character entities
+    static std::string _decode(const char* p, size_t len) {
+        static const struct {
+            const char* name;
+            size_t len;
+            char c;
+        } entities[] = {{"lt;", 3, '<'},
+                        {"gt;", 3, '>'},
+                        {"amp;", 4, '&'},
+                        {"quot;", 5, '"'},
+                        {"apos;", 5, '\''}};
+        const char* end = p + len;
+        std::string out;
+
+        if (!memchr(p, '&', len))
+            return std::string(p, len);
+
+        out.reserve(len);
+        while (p < end) {
+            const char* amp = static_cast<const char*>(memchr(p, '&', end - p));
+            const char* semi;
+            bool decoded = false;
+
+            if (!amp) {
+                out.append(p, end - p);
+                break;
+            }
+            out.append(p, amp - p);
+            p = amp + 1;
+
+            if (p < end && *p == '#' &&
+                (semi = static_cast<const char*>(memchr(p, ';', end - p)))) {
+                bool hex = p + 1 < semi && (p[1] == 'x' || p[1] == 'X');
+                char* num_end;
+                unsigned long cp = strtoul(p + (hex ? 2 : 1), &num_end,
+                                           hex ? 16 : 10);
+
+                if (num_end == semi && cp > 0 && cp <= 0x10FFFF) {
+                    _append_utf8(out, cp);
+                    p = semi + 1;
+                    decoded = true;
+                }
+            } else {
+                for (auto& e : entities) {
+                    if ((size_t)(end - p) >= e.len &&
+                        !memcmp(p, e.name, e.len)) {
+                        out += e.c;
+                        p += e.len;
+                        decoded = true;
+                        break;
+                    }
+                }
+            }
+
+            if (!decoded)
+                out += '&';
+        }
+
+        return out;
+    }
+
+    static std::string _trim(const std::string& s) {
+        size_t b = 0, e = s.size();
+
+        while (b < e && _is_space(s[b]))
+            b++;
+        while (e > b && _is_space(s[e - 1]))
+            e--;
+
+        return s.substr(b, e - b);
+    }
+
+    //! @brief Find the start tag's attribute value.
+    //!
+    //! @param name Attribute local name.
+    //! @return false if there is no such attribute.
+    bool _attribute(const char* name, std::string& value) const {
+        const char* p = token_.data() + 1;
+        const char* end = token_.data() + token_.size();
+        size_t name_len = strlen(name);
+
+        // Skip the element name
+        while (p < end && !_is_name_end(*p))
+            p++;
+
+        while (p < end) {
+            const char *attr, *attr_end, *colon;
+            char quote;
+
+            while (p < end && _is_space(*p))
+                p++;
+            attr = p;
+            while (p < end && !_is_name_end(*p))
+                p++;
+            attr_end = p;
+            while (p < end && _is_space(*p))
+                p++;
+            if (p == end || *p != '=')
+                return false;
+            p++;
+            while (p < end && _is_space(*p))
+                p++;
+            if (p == end || (*p != '"' && *p != '\''))
+                return false;
+            quote = *p++;
+
+            const char* v = p;
+            while (p < end && *p != quote)
+                p++;
+            if (p == end)
+                return false;
+
+            colon = static_cast<const char*>(
+                memchr(attr, ':', attr_end - attr));
+            if (colon)
+                attr = colon + 1;
+            if ((size_t)(attr_end - attr) == name_len &&
+                !memcmp(attr, name, name_len)) {
+                value = _decode(v, p - v);
+                return true;
+            }
+            p++;
+        }
+
+        return false;
+    }
+
+    //! Local name of the element at @p level below the notification
+    const std::string& _level(size_t level) const {
+        return stack_[notification_ + level].local;
+    }
+
+    //! @param end End of the start tag in the chunk.
+    void _open(element e, size_t end) {
+        size_t level = stack_.size() - notification_;
+
+        if (notification_ < 0) {
+            if (e.local == "NotificationMessage") {
+                notification_ = stack_.size();
+                event_ = event();
+                body_.clear();
+                for (auto& ancestor : stack_)
+                    body_ += ancestor.start_tag;
+                // The start tag may span chunks, the body continues after it
+                body_ += token_;
+                body_from_ = end;
+            } else {
+                e.start_tag = token_;
+            }
+        } else if (level == 1 && e.local == "Topic") {
+            collect_text_ = true;
+            text_.clear();
+        } else if (level == 2 && e.local == "Message" &&
+                   _level(1) == "Message") {
+            std::string value;
+
+            if (_attribute("UtcTime", value))
+                event_.time = cloud::utils::time::from_iso(value);
+            if (_attribute("PropertyOperation", value))
+                event_.prop_op = value;
+        } else if (level == 4 && e.local == "SimpleItem" &&
+                   _level(1) == "Message" && _level(2) == "Message" &&
+                   (_level(3) == "Source" || _level(3) == "Data")) {
+            simple_item item;
+
+            _attribute("Name", item.name);
+            _attribute("Value", item.value);
+            if (_level(3) == "Source")
+                event_.source_items.push_back(item);
+            else
+                event_.data_items.push_back(item);
+        }
+
+        stack_.push_back(std::move(e));
+    }
+
+    //! @param end End of the end tag in the chunk.
+    void _close(const std::string& qname, const char* data, size_t end) {
+        // Closing tags before the first document start are skipped to
+        // resynchronize after reset()
+        if (stack_.empty())
+            return;
+
+        if (stack_.back().qname != qname) {
+            _fail("Mismatched end tag");
+            return;
+        }
+
+        if (collect_text_ && stack_.back().local == "Topic") {
+            event_.topic = _trim(_decode(text_.data(), text_.size()));
+            collect_text_ = false;
+            text_.clear();
+        }
+
+        if ((int)stack_.size() - 1 == notification_) {
+            body_.append(data + body_from_, end - body_from_);
+            for (int i = notification_ - 1; i >= 0; i--)
+                body_ += "</" + stack_[i].qname + ">";
+
+            event_.raw_body.swap(body_);
+            body_.clear();
+            notification_ = -1;
+            stack_.pop_back();
+
+            if (cb_)
+                cb_(std::move(event_));
+            event_ = event();
+            return;
+        }
+
+        stack_.pop_back();
+    }
+
+    //! @param end End of the token in the chunk.
+    void _handle_token(const char* data, size_t end) {
+        const std::string& t = token_;
+        element e;
+        size_t name_end = 1;
+
+        if (t.size() < 3)
+            return;
+
+        // Processing instruction, a new document starts with the XML
+        // declaration, drop the truncated one
+        if (t[1] == '?') {
+            if (!t.compare(0, 5, "<?xml") && _is_name_end(t[5]) &&
+                !stack_.empty())
+                _fail("Truncated document");
+            return;
+        }
+
+        if (t[1] == '!') {
+            if (collect_text_ && !t.compare(0, 9, "<![CDATA["))
+                text_.append(t, 9, t.size() - 12);
+            return;
+        }
+
+        if (t[1] == '/') {
+            size_t b = 2;
+
+            while (b < t.size() && _is_space(t[b]))
+                b++;
+            name_end = b;
+            while (name_end < t.size() && !_is_name_end(t[name_end]))
+                name_end++;
+            _close(t.substr(b, name_end - b), data, end);
+            return;
+        }
+
+        while (name_end < t.size() && !_is_name_end(t[name_end]))
+            name_end++;
+        e.qname = t.substr(1, name_end - 1);
+        if (e.qname.empty()) {
+            _fail("Empty element name");
+            return;
+        }
+
+        size_t colon = e.qname.find(':');
+        e.local =
+            colon == std::string::npos ? e.qname : e.qname.substr(colon + 1);
+
+        bool empty_element = t[t.size() - 2] == '/';
+        std::string qname = e.qname;
+
+        _open(std::move(e), end);
+        if (empty_element)
+            _close(qname, data, end);
+    }
+};
+
+}  // namespace onvif
+}  // namespace media
+}  // namespace vxg
+#endif
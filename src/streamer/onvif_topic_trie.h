@@ -0,0 +1,182 @@
+#ifndef __ONVIF_TOPIC_TRIE_H
+#define __ONVIF_TOPIC_TRIE_H
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vxg {
+namespace media {
+namespace onvif {
+
+//! @brief ONVIF topic patterns to values map, built once and matched per
+//! event.
+//!
+//! A topic is the '/' separated segments path, e.g.
+//! tns1:RuleEngine/CellMotionDetector/Motion. The patterns are:
+//! - exact topic;
+//! - '*' segment which matches any single segment;
+//! - topic ending with "//." (ONVIF ConcreteSet dialect), matches the topic
+//!   and all its descendants;
+//! - "*" which matches all the topics.
+//!
+//! An exact segment is preferred over '*', a full match over the descendants
+//! match, the deepest descendants match over the others. "*" is the last
+//! resort. Matching doesn't allocate, the children are sorted vectors.
+template <typename T>
+class topic_trie {
+public:
+    //! @return false if the pattern is already inserted, the first value is
+    //!         kept
+    bool insert(const std::string& pattern, T value) {
+        static const std::string DESCENDANTS = "//.";
+        std::unique_ptr<T>* slot;
+        node* n = &root_;
+        size_t len = pattern.size();
+        bool descendants = false;
+
+        if (pattern == "*") {
+            slot = &all_;
+        } else {
+            if (len >= DESCENDANTS.size() &&
+                !pattern.compare(len - DESCENDANTS.size(), DESCENDANTS.size(),
+                                 DESCENDANTS)) {
+                len -= DESCENDANTS.size();
+                descendants = true;
+            }
+
+            size_t pos = 0;
+            while (true) {
+                size_t sep = pattern.find('/', pos);
+
+                if (sep == std::string::npos || sep > len)
+                    sep = len;
+                n = _child(n, pattern.substr(pos, sep - pos));
+                if (sep == len)
+                    break;
+                pos = sep + 1;
+            }
+
+            slot = descendants ? &n->descendants : &n->value;
+        }
+
+        if (*slot)
+            return false;
+        slot->reset(new T(std::move(value)));
+
+        return true;
+    }
+
+    //! @return nullptr if no pattern matches @p topic
+    const T* match(const std::string& topic) const {
+        match_state m;
+        const char* end = topic.data() + topic.size();
+        const T* v = _match(root_, topic.data(), end, 0, m);
+
+        if (v)
+            return v;
+        if (m.descendants)
+            return m.descendants;
+        return all_.get();
+    }
+
+    void clear() {
+        root_.children.clear();
+        root_.any.reset();
+        all_.reset();
+    }
+
+    bool empty() const { return root_.children.empty() && !root_.any && !all_; }
+
+private:
+    struct node {
+        //! Sorted by the segment
+        std::vector<std::pair<std::string, std::unique_ptr<node>>> children;
+        //! '*' segment
+        std::unique_ptr<node> any;
+        std::unique_ptr<T> value;
+        std::unique_ptr<T> descendants;
+    };
+
+    struct match_state {
+        const T* descendants {nullptr};
+        size_t depth {0};
+    };
+
+    node root_;
+    std::unique_ptr<T> all_;
+
+    static bool _less(
+        const std::pair<std::string, std::unique_ptr<node>>& child,
+        const std::pair<const char*, size_t>& segment) {
+        return child.first.compare(0, std::string::npos, segment.first,
+                                   segment.second) < 0;
+    }
+
+    static node* _child(node* n, const std::string& segment) {
+        if (segment == "*") {
+            if (!n->any)
+                n->any.reset(new node());
+            return n->any.get();
+        }
+
+        auto key = std::make_pair(segment.data(), segment.size());
+        auto it = std::lower_bound(n->children.begin(), n->children.end(), key,
+                                   _less);
+        if (it == n->children.end() || it->first != segment)
+            it = n->children.emplace(
+                it, std::make_pair(segment, std::unique_ptr<node>(new node())));
+
+        return it->second.get();
+    }
+
+    static const node* _find(const node& n, const char* s, size_t len) {
+        auto key = std::make_pair(s, len);
+        auto it = std::lower_bound(n.children.begin(), n.children.end(), key,
+                                   _less);
+
+        if (it != n.children.end() && !it->first.compare(0, std::string::npos,
+                                                         s, len))
+            return it->second.get();
+
+        return nullptr;
+    }
+
+    //! @param s Rest of the topic, past the end if all segments are matched.
+    const T* _match(const node& n,
+                    const char* s,
+                    const char* end,
+                    size_t depth,
+                    match_state& m) const {
+        if (n.descendants && (!m.descendants || depth > m.depth)) {
+            m.descendants = n.descendants.get();
+            m.depth = depth;
+        }
+
+        if (s > end)
+            return n.value.get();
+
+        auto sep = static_cast<const char*>(memchr(s, '/', end - s));
+        const node* child;
+        const T* v;
+
+        if (!sep)
+            sep = end;
+
+        if ((child = _find(n, s, sep - s)) &&
+            (v = _match(*child, sep + 1, end, depth + 1, m)))
+            return v;
+        if (n.any && (v = _match(*n.any, sep + 1, end, depth + 1, m)))
+            return v;
+
+        return nullptr;
+    }
+};
+
+}  // namespace onvif
+}  // namespace media
+}  // namespace vxg
+#endif
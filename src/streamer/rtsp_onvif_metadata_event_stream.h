@@ -6,6 +6,7 @@
 #include <streamer/stream.h>
 
 #include "onvif_metadata_sink.h"
+#include "onvif_topic_trie.h"
 
 namespace vxg {
 namespace media {
@@ -48,6 +49,7 @@ using proto_event_parse_cb =
     std::function<bool(vxg::cloud::agent::proto::event_object& event,
                        const onvif::event& onvif_event)>;
 struct onvif_topic_to_vxg_event_map {
+    //! Exact topic or the onvif::topic_trie pattern
     std::string onvif_topic;
     std::chrono::seconds min_interval {std::chrono::seconds(0)};
     std::string onvif_state_data_item;
@@ -66,6 +68,8 @@ class event_stream : public vxg::cloud::agent::event_stream {
     bool trigger_ {false};
     bool motion_active_ {false};
     std::map<std::string, onvif_topic_to_vxg_event_map> events_map_;
+    //! Topic patterns to the events_map_ keys
+    topic_trie<std::string> topics_;
     std::map<std::string, vxg::cloud::time> last_onvif_event_time_;
 
 public:
@@ -73,7 +77,13 @@ public:
                  std::map<std::string, onvif_topic_to_vxg_event_map> events_map)
         : vxg::cloud::agent::event_stream("onvif-event-stream"),
           onvif_rtsp_url_ {onvif_rtsp_url},
-          events_map_ {events_map} {}
+          events_map_ {events_map} {
+        for (auto& e : events_map_) {
+            if (!topics_.insert(e.second.onvif_topic, e.first))
+                logger->warn("Duplicate mapping of topic {}, {} ignored",
+                             e.second.onvif_topic, e.first);
+        }
+    }
 
     virtual bool start() override {
         init();
@@ -128,35 +138,12 @@ public:
         return true;
     }
 
-    bool _find_mapping_by_topic(const std::string& topic,
-                                onvif_topic_to_vxg_event_map& mapping) {
-        // First try to find mapping with exact topic name
-        auto it = std::find_if(
-            events_map_.begin(), events_map_.end(),
-            [topic](
-                const std::pair<std::string, onvif_topic_to_vxg_event_map>& m) {
-                return (topic == m.second.onvif_topic);
-            });
+    //! @return nullptr if no mapping matches @p topic
+    const onvif_topic_to_vxg_event_map* _find_mapping_by_topic(
+        const std::string& topic) const {
+        const std::string* key = topics_.match(topic);
 
-        if (it != events_map_.end()) {
-            mapping = it->second;
-            return true;
-        }
-
-        // Last resort is '*' which covers all topics
-        it = std::find_if(
-            events_map_.begin(), events_map_.end(),
-            [topic](
-                const std::pair<std::string, onvif_topic_to_vxg_event_map>& m) {
-                return (m.second.onvif_topic == "*");
-            });
-
-        if (it != events_map_.end()) {
-            mapping = it->second;
-            return true;
-        }
-
-        return false;
+        return key ? &events_map_.at(*key) : nullptr;
     }
 
     void on_onvif_event(const onvif::event& onvif_event) {
@@ -170,10 +157,11 @@ public:
         if (!onvif_event.topic.empty() &&
             onvif_event.time != utils::time::null()) {
             proto::event_object event;
-            std::string topic;
-            onvif_topic_to_vxg_event_map mapping;
+            auto found = _find_mapping_by_topic(onvif_event.topic);
+
+            if (found) {
+                const onvif_topic_to_vxg_event_map& mapping = *found;
 
-            if (_find_mapping_by_topic(onvif_event.topic, mapping)) {
                 event.time = utils::time::to_double(onvif_event.time);
                 event.event = mapping.vxg_event_config.event;
                 event.custom_event_name =
@@ -0,0 +1,107 @@
+//! @file bench_base64.cc
+//! @brief Base64 and motion map codecs benchmark.
+//!
+//! Measures every base64 implementation supported by the CPU on the
+//! credentials, motion map and snapshot sized inputs, and the fused motion
+//! map packing against the packbits() + base64_encode() chain.
+//!
+//! Usage: bench-base64 [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <utils/base64-simd.h>
+#include <utils/base64.h>
+#include <utils/packbits.h>
+#include <utils/utils.h>
+
+using namespace vxg::cloud::utils;
+
+namespace {
+//! Runs @p f @p iterations times, prints ns per call and MB/s of @p bytes
+void measure(const std::string& name,
+             size_t iterations,
+             size_t bytes,
+             std::function<size_t()> f) {
+    size_t sum = f();
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        sum += f();
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count() /
+                static_cast<double>(iterations);
+
+    // Keep the results alive
+    static volatile size_t result;
+    result = sum;
+
+    printf("%-36s %12.1f ns %10.1f MB/s\n", name.c_str(), ns,
+           bytes * 1e3 / ns);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    std::mt19937 rng(1);
+
+    for (size_t size : {48, 1024, 32768}) {
+        std::vector<uint8_t> data(size);
+        for (auto& b : data)
+            b = rng();
+        std::string str(data.begin(), data.end());
+        std::string encoded(base64::encoded_size(size), 0);
+        std::vector<uint8_t> decoded(size);
+        size_t n = std::max<size_t>(1, iterations * 48 / size);
+
+        base64::encode(data.data(), size, &encoded[0]);
+
+        // Url alphabet takes the original char by char code path
+        measure("legacy encode " + std::to_string(size), n, size,
+                [&]() { return base64_encode(str, true).size(); });
+        for (auto impl : {base64::impl::scalar, base64::impl::ssse3,
+                          base64::impl::neon}) {
+            if (!base64::select(impl))
+                continue;
+
+            std::string name = base64::name(impl);
+            measure(name + " encode " + std::to_string(size), n, size, [&]() {
+                return base64::encode(data.data(), size, &encoded[0]);
+            });
+            measure(name + " decode " + std::to_string(size), n, size, [&]() {
+                size_t len;
+                base64::decode(encoded.data(), encoded.size(), decoded.data(),
+                               len);
+                return len;
+            });
+        }
+    }
+
+    // Typical 44x36 cells motion map, motion in a few areas
+    std::string grid;
+    while (grid.size() < 44 * 36)
+        grid.append(1 + rng() % 40, '0' + rng() % 2);
+    grid.resize(44 * 36);
+    std::string packed(grid.size() * 2 + 2, 0);
+    std::string out(motion::map::packed_size(grid.size()), 0);
+
+    measure("motion map packbits + base64", iterations, grid.size(), [&]() {
+        int len = packbits((int8_t*)grid.data(), (int8_t*)&packed[0],
+                           grid.size());
+        return base64_encode(reinterpret_cast<uint8_t*>(&packed[0]), len,
+                             true)
+            .size();
+    });
+    measure("motion map fused", iterations, grid.size(), [&]() {
+        return motion::map::pack(grid.data(), grid.size(), &out[0],
+                                 out.size());
+    });
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,528 @@
+//! @file bench_command_handler.cc
+//! @brief Control plane throughput benchmark.
+//!
+//! Feeds proto::command_handler a recorded mix of the Cloud commands through
+//! the in-process transport, no network and no lws involved. The time and
+//! the heap allocations of every command handling are measured on the
+//! transport rx thread, they include the JSON parsing, the command factory,
+//! the dispatching, the callback and the reply building.
+//!
+//! Reports commands/s, per-command latency percentiles with log2 histogram
+//! and allocations per command.
+//!
+//! Usage: bench-command-handler [commands count] [rate, commands/s, 0 - max]
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <random>
+#include <thread>
+
+#include <agent-proto/command-handler.h>
+#include <net/transport.h>
+#include <utils/logging.h>
+
+using namespace vxg::cloud;
+using namespace vxg::cloud::agent;
+using namespace vxg::cloud::agent::proto;
+
+//! Heap allocations made by the current thread
+static thread_local size_t thread_allocs = 0;
+
+void* operator new(size_t size) {
+    thread_allocs++;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+// Not inlined into the delete-expressions, the compiler would warn about
+// the new-expressions memory passed to free()
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+namespace {
+//! Transport which loops the injected messages to the rx thread and drops
+//! everything sent.
+class loopback_transport : public transport::worker {
+    std::mutex lock_;
+    std::condition_variable cond_;
+
+public:
+    std::atomic<size_t> sent {0};
+    std::atomic<size_t> sent_bytes {0};
+
+    loopback_transport(std::function<void(transport::Data&)> handler)
+        : transport::worker(handler) {}
+
+    virtual ~loopback_transport() { stop(); }
+
+    virtual bool start() override { return run(); }
+
+    virtual bool stop() override {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            running_ = false;
+        }
+        cond_.notify_all();
+        term();
+        return true;
+    }
+
+    virtual bool send(const transport::Data& message) override {
+        sent++;
+        sent_bytes += message.size();
+        return true;
+    }
+
+    virtual transport::timed_cb_ptr schedule_timed_cb(std::function<void()> cb,
+                                                      size_t ms) override {
+        return nullptr;
+    }
+
+    virtual void cancel_timed_cb(transport::timed_cb_ptr t) override {}
+
+    void inject(const std::string& message) { rx_q_.push(message); }
+
+protected:
+    virtual void* poll_() override {
+        std::unique_lock<std::mutex> lock(lock_);
+        cond_.wait(lock, [this]() { return !running_; });
+        return nullptr;
+    }
+};
+
+//! Command handler with the callbacks reporting a typical camera
+class bench_handler : public command_handler {
+public:
+    //! Called on the rx thread with the raw message
+    std::function<void(transport::Data&)> on_message;
+
+    bench_handler()
+        : command_handler(std::make_shared<loopback_transport>(
+              [this](transport::Data& data) { on_message(data); })) {}
+
+    loopback_transport* transport() {
+        return static_cast<loopback_transport*>(transport_.get());
+    }
+
+protected:
+    virtual void on_closed(int error, bye_reason reason) override {}
+    virtual void on_prepared() override {}
+
+    virtual bool on_get_stream_config(proto::stream_config& config) override {
+        for (auto id : {"Main", "Sub"}) {
+            proto::video_stream_config video;
+
+            video.stream = id;
+            video.format = proto::VF_H264;
+            video.horz = 1920;
+            video.vert = 1080;
+            video.fps = 25;
+            video.gop = 50;
+            video.brt = 2048;
+            config.video.push_back(video);
+        }
+        return true;
+    }
+    virtual bool on_set_stream_config(
+        const proto::stream_config& config) override {
+        return true;
+    }
+
+    virtual bool on_get_motion_detection_config(
+        proto::motion_detection_config& config) override {
+        config.columns = 16;
+        config.rows = 16;
+        return true;
+    }
+    virtual bool on_set_motion_detection_config(
+        const proto::motion_detection_config& config) override {
+        return true;
+    }
+
+    virtual bool on_get_cam_video_config(
+        proto::video_config& config) override {
+        config.brightness = 50;
+        config.contrast = 50;
+        config.saturation = 50;
+        return true;
+    }
+    virtual bool on_set_cam_video_config(
+        const proto::video_config& config) override {
+        return true;
+    }
+
+    virtual bool on_get_cam_events_config(
+        proto::events_config& config) override {
+        for (auto type : {proto::ET_MOTION, proto::ET_SOUND}) {
+            proto::event_config event;
+
+            event.event = type;
+            event.active = true;
+            event.snapshot = true;
+            event.caps.snapshot = true;
+            config.events.push_back(event);
+        }
+        config.enabled = true;
+        return true;
+    }
+    virtual bool on_set_cam_events_config(
+        const proto::events_config& config) override {
+        return true;
+    }
+
+    virtual bool on_get_cam_audio_config(
+        proto::audio_config& config) override {
+        return false;
+    }
+    virtual bool on_set_cam_audio_config(
+        const proto::audio_config& config) override {
+        return false;
+    }
+
+    virtual bool on_get_ptz_config(proto::ptz_config& config) override {
+        return false;
+    }
+    virtual bool on_cam_ptz(proto::ptz_command command) override {
+        return false;
+    }
+    virtual bool on_cam_ptz_preset(proto::ptz_preset& preset) override {
+        return false;
+    }
+
+    virtual bool on_get_osd_config(proto::osd_config& config) override {
+        return false;
+    }
+    virtual bool on_set_osd_config(const proto::osd_config& config) override {
+        return false;
+    }
+
+    virtual bool on_get_wifi_config(proto::wifi_config& config) override {
+        return false;
+    }
+    virtual bool on_set_wifi_config(
+        const proto::wifi_network& config) override {
+        return false;
+    }
+
+    virtual bool on_stream_start(const std::string& streamId,
+                                 int publishSessionID,
+                                 proto::stream_reason reason) override {
+        return true;
+    }
+    virtual bool on_stream_stop(const std::string& streamId,
+                                proto::stream_reason reason) override {
+        return true;
+    }
+
+    virtual bool on_get_stream_caps(proto::stream_caps& caps) override {
+        return false;
+    }
+
+    virtual bool on_get_supported_streams(
+        proto::supported_streams_config& config) override {
+        for (auto id : {"Main", "Sub"}) {
+            proto::supported_stream_config stream;
+
+            stream.id = id;
+            stream.video = std::string(id) + "Video";
+            config.streams.push_back(stream);
+            config.video_es.push_back(stream.video);
+        }
+        return true;
+    }
+
+    virtual bool on_direct_upload_url(
+        const proto::command::direct_upload_url_base& direct_upload,
+        int event_id,
+        int ref_id) override {
+        return true;
+    }
+    virtual bool on_get_timezone(std::string& timezone) override {
+        timezone = "UTC";
+        return true;
+    }
+    virtual bool on_set_timezone(std::string timezone) override {
+        return true;
+    }
+
+    virtual bool on_get_cam_memorycard_timeline(
+        proto::command::cam_memorycard_timeline& timeline) override {
+        return false;
+    }
+    virtual bool on_cam_memorycard_synchronize(
+        proto::command::cam_memorycard_synchronize_status& status,
+        vxg::cloud::time start,
+        vxg::cloud::time end) override {
+        return false;
+    }
+    virtual bool on_cam_memorycard_synchronize_cancel(
+        const std::string& request_id) override {
+        return false;
+    }
+    virtual bool on_cam_memorycard_recording(const std::string& stream_id,
+                                             bool enabled) override {
+        return false;
+    }
+
+    virtual bool on_trigger_event(std::string event,
+                                  json meta,
+                                  vxg::cloud::time time) override {
+        return true;
+    }
+
+    virtual bool on_audio_file_play(std::string url) override {
+        return false;
+    }
+    virtual bool on_start_backward(std::string& url) override {
+        return false;
+    }
+    virtual bool on_stop_backward(std::string& url) override {
+        return false;
+    }
+
+    virtual bool on_raw_message(std::string client_id,
+                                std::string& data) override {
+        return false;
+    }
+
+    virtual bool on_set_stream_by_event(
+        proto::stream_by_event_config conf) override {
+        return true;
+    }
+    virtual bool on_get_stream_by_event(
+        proto::stream_by_event_config& conf) override {
+        return true;
+    }
+
+    virtual bool on_update_preview(std::string url) override { return true; }
+
+    virtual bool on_cam_upgrade_firmware(std::string url) override {
+        return false;
+    }
+
+    virtual bool on_set_audio_detection(
+        const proto::audio_detection_config& conf) override {
+        return false;
+    }
+    virtual bool on_get_audio_detection(
+        proto::audio_detection_config& conf) override {
+        return false;
+    }
+
+    virtual bool on_get_log() override { return false; }
+
+    virtual bool on_set_log_enable(bool bEnable) override { return true; }
+    virtual bool on_set_activity(bool bEnable) override { return true; }
+
+    virtual void on_registered(const std::string& sid) override {}
+};
+
+//! Recorded steady state session, the Cloud replies to the camera's upload
+//! requests and polls its state, the UI opens the live view from time to
+//! time.
+struct recorded_command {
+    const char* json;
+    size_t weight;
+};
+
+const recorded_command RECORDED_MIX[] = {
+    {R"({"cmd":"direct_upload_url","msgid":0,"cam_id":1,"refid":1,)"
+     R"("status":"OK","url":"http://127.0.0.1/upload/1","expire":)"
+     R"("20261018T120000.000000","headers":{"Content-Type":"image/jpeg"},)"
+     R"("event_id":1})",
+     30},
+    {R"({"cmd":"get_cam_status","msgid":0,"cam_id":1})", 20},
+    {R"({"cmd":"get_cam_events","msgid":0,"cam_id":1})", 5},
+    {R"({"cmd":"set_cam_events","msgid":0,"cam_id":1,"enabled":true,)"
+     R"("events":[{"event":"motion","active":true,"snapshot":true,)"
+     R"("stream":false},{"event":"sound","active":true,"snapshot":false,)"
+     R"("stream":false}]})",
+     5},
+    {R"({"cmd":"get_supported_streams","msgid":0,"cam_id":1})", 5},
+    {R"({"cmd":"get_stream_config","msgid":0,"cam_id":1})", 5},
+    {R"({"cmd":"get_cam_video_conf","msgid":0,"cam_id":1})", 5},
+    {R"({"cmd":"get_motion_detection","msgid":0,"cam_id":1})", 5},
+    {R"({"cmd":"stream_start","msgid":0,"cam_id":1,"stream_id":"Main",)"
+     R"("reason":"live"})",
+     10},
+    {R"({"cmd":"stream_stop","msgid":0,"cam_id":1,"stream_id":"Main",)"
+     R"("reason":"live"})",
+     10},
+};
+
+struct command_stats {
+    std::vector<uint32_t> latency_ns;
+    size_t allocs {0};
+};
+
+uint32_t percentile(std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    return sorted[std::min(sorted.size() - 1,
+                           static_cast<size_t>(sorted.size() * p))];
+}
+
+//! Latency histogram with the power of 2 microseconds buckets, the last
+//! bucket is open
+std::string log2_histogram(const std::vector<uint32_t>& latency_ns) {
+    static const size_t BUCKETS = 12;
+    size_t buckets[BUCKETS] = {0};
+    std::string result;
+
+    for (auto ns : latency_ns) {
+        size_t us = ns / 1000, b = 0;
+
+        while (us && b < BUCKETS - 1) {
+            us >>= 1;
+            b++;
+        }
+        buckets[b]++;
+    }
+
+    for (size_t b = 0; b < BUCKETS; b++) {
+        if (!buckets[b])
+            continue;
+        result += (b == BUCKETS - 1 ? ">=" : "<") +
+                  std::to_string(1 << (b == BUCKETS - 1 ? b - 1 : b)) +
+                  "us:" + std::to_string(buckets[b]) + " ";
+    }
+
+    return result;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    double rate = argc > 2 ? atof(argv[2]) : 0;
+
+    // C <= S logging of every command at info level would measure the
+    // console, use SPDLOG_LEVEL to benchmark with the logs
+    vxg::logger::reset(argc, argv, vxg::logger::lvl_warn);
+
+    // Deterministic commands sequence according to the mix weights, both
+    // the feeder and the handler walk it, the rx queue keeps the order
+    std::vector<std::string> messages;
+    std::vector<std::string> names;
+    std::vector<size_t> sequence;
+    for (auto& c : RECORDED_MIX) {
+        for (size_t i = 0; i < c.weight; i++)
+            sequence.push_back(messages.size());
+        messages.push_back(c.json);
+        names.push_back(json::parse(c.json)["cmd"]);
+    }
+    std::shuffle(sequence.begin(), sequence.end(), std::mt19937(1));
+
+    std::vector<command_stats> stats(messages.size());
+    std::mutex lock;
+    std::condition_variable cond;
+    size_t handled = 0;
+    size_t handshake = 2;
+
+    auto handler = std::make_shared<bench_handler>();
+    handler->on_message = [&](transport::Data& data) {
+        if (handshake) {
+            handler->on_receive(data);
+            handshake--;
+            return;
+        }
+
+        command_stats& s = stats[sequence[handled % sequence.size()]];
+        size_t allocs = thread_allocs;
+        auto start = std::chrono::steady_clock::now();
+
+        handler->on_receive(data);
+
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        s.allocs += thread_allocs - allocs;
+        s.latency_ns.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                .count());
+
+        std::lock_guard<std::mutex> l(lock);
+        if (++handled == count)
+            cond.notify_one();
+    };
+
+    auto transport = handler->transport();
+    if (!transport->start())
+        return EXIT_FAILURE;
+
+    // Handshake isn't measured, cam_hello sets the cam_id the commands of the
+    // mix are checked against
+    transport->inject(
+        R"({"cmd":"hello","msgid":1,"status":"OK","sid":"bench","upload_uri":)"
+        R"("http://127.0.0.1/","media_server":"127.0.0.1"})");
+    transport->inject(
+        R"({"cmd":"cam_hello","msgid":2,"cam_id":1,"media_uri":"127.0.0.1",)"
+        R"("path":"bench","mode":"cloud","activity":true})");
+
+    for (auto& s : stats)
+        s.latency_ns.reserve(count / sequence.size() * 2 + 1);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        if (rate > 0)
+            std::this_thread::sleep_until(
+                start + std::chrono::nanoseconds(
+                            static_cast<int64_t>(i * 1000000000 / rate)));
+        transport->inject(messages[sequence[i % sequence.size()]]);
+    }
+
+    {
+        std::unique_lock<std::mutex> l(lock);
+        cond.wait_for(l, std::chrono::seconds(60),
+                      [&]() { return handled == count; });
+    }
+    auto finish = std::chrono::steady_clock::now();
+
+    transport->stop();
+
+    double elapsed =
+        std::chrono::duration_cast<std::chrono::microseconds>(finish - start)
+            .count() /
+        1000000.0;
+    size_t total_allocs = 0;
+
+    printf("commands: %zu of %zu, rate: %s\n", handled, count,
+           rate > 0 ? std::to_string(static_cast<size_t>(rate)).c_str()
+                    : "max");
+    printf("commands/s: %.0f\n", handled / elapsed);
+    printf("replies: %zu, reply bytes: %zu\n", transport->sent.load(),
+           transport->sent_bytes.load());
+    printf("%-24s %8s %8s %8s %8s %8s %8s\n", "command", "count", "p50 us",
+           "p90 us", "p99 us", "max us", "allocs");
+
+    for (size_t i = 0; i < stats.size(); i++) {
+        auto& s = stats[i];
+        auto& lat = s.latency_ns;
+
+        if (lat.empty())
+            continue;
+
+        std::sort(lat.begin(), lat.end());
+        total_allocs += s.allocs;
+
+        printf("%-24s %8zu %8.1f %8.1f %8.1f %8.1f %8.1f\n", names[i].c_str(),
+               lat.size(), percentile(lat, 0.5) / 1000.0,
+               percentile(lat, 0.9) / 1000.0, percentile(lat, 0.99) / 1000.0,
+               lat.back() / 1000.0, static_cast<double>(s.allocs) / lat.size());
+        printf("    %s\n", log2_histogram(lat).c_str());
+    }
+
+    printf("allocations/command: %.1f\n",
+           handled ? static_cast<double>(total_allocs) / handled : 0);
+
+    return handled == count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
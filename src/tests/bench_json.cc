@@ -0,0 +1,127 @@
+//! @file bench_json.cc
+//! @brief Outbound commands serialization benchmark.
+//!
+//! Compares the nlohmann::json tree building with dump() against the direct
+//! proto::json_writer serialization into the reusable buffer for the most
+//! frequent outgoing commands. Reports ns and heap allocations per command.
+//!
+//! Usage: bench-json [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+
+#include <agent-proto/proto.h>
+
+using namespace vxg::cloud::agent;
+using namespace vxg::cloud::agent::proto;
+using namespace vxg::cloud::agent::proto::command;
+
+//! Heap allocations since the start
+static size_t allocs = 0;
+
+void* operator new(size_t size) {
+    allocs++;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+// Not inlined into the delete-expressions, the compiler would warn about
+// the new-expressions memory passed to free()
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+namespace {
+//! Runs @p f @p iterations times, prints ns and allocations per call.
+//! @p f returns the serialized size so the work can't be optimized out.
+void measure(const char* name,
+             size_t iterations,
+             std::function<size_t()> f) {
+    size_t bytes = 0;
+
+    // Warm up, the writer grows its buffer once
+    bytes += f();
+
+    size_t start_allocs = allocs;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        bytes += f();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("%-28s %10.1f %10.1f %8zu\n", name,
+           std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                   .count() /
+               static_cast<double>(iterations),
+           static_cast<double>(allocs - start_allocs) / iterations,
+           bytes / (iterations + 1));
+}
+
+template <typename T>
+void compare(const char* name, size_t iterations, const T& command) {
+    json_writer writer;
+    std::string json_name = std::string(name) + " json";
+    std::string writer_name = std::string(name) + " writer";
+
+    measure(json_name.c_str(), iterations,
+            [&]() { return json(command).dump().size(); });
+    measure(writer_name.c_str(), iterations,
+            [&]() { return writer.write(command).size(); });
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+
+    printf("%-28s %10s %10s %8s\n", "command", "ns", "allocs", "bytes");
+
+    base_command request("get_cam_status", 1, UnsetInt);
+    compare("done", iterations, done(&request, DS_OK));
+
+    cam_event event;
+    event.cam_id = 1;
+    event.event = ET_MOTION;
+    event.time = 1760800000.123456;
+    event.status = ES_OK;
+    event.meta = {{"source", "synthetic"}, {"zone", "entrance"}};
+    event.snapshot_info.image_time = "20261018T120000.123456";
+    event.snapshot_info.width = 640;
+    event.snapshot_info.height = 480;
+    event.snapshot_info.size = 32768;
+    compare("cam_event", iterations, event);
+
+    cam_register reg;
+    reg.ip = "192.168.1.10";
+    reg.uuid = "b9d2a7e4-5f0c-4d3e-9a1b-2c3d4e5f6a7b";
+    reg.brand = "VXG";
+    reg.model = "Embedded";
+    reg.sn = "0123456789";
+    reg.version = "2.0.0";
+    reg.type = "camera";
+    compare("cam_register", iterations, reg);
+
+    proto::stream_config config;
+    for (auto id : {"Main", "Sub"}) {
+        video_stream_config video;
+
+        video.stream = id;
+        video.format = VF_H264;
+        video.horz = 1920;
+        video.vert = 1080;
+        video.fps = 25;
+        video.gop = 50;
+        video.brt = 2048;
+        config.video.push_back(video);
+    }
+    compare("stream_config", iterations, config);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,60 @@
+//! @file bench_properties.cc
+//! @brief Properties store get/set benchmark.
+//!
+//! Fills the props file with a typical amount of keys and measures the cost
+//! of the properties::get() and properties::set() calls.
+//!
+//! Usage: bench-properties [iterations] [keys]
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+
+#include <utils/properties.h>
+
+using namespace vxg;
+
+namespace {
+void measure(const char* name,
+             size_t iterations,
+             std::function<void(size_t)> f) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        f(i);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("%-8s %12.1f ns\n", name,
+           std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                   .count() /
+               static_cast<double>(iterations));
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000;
+    size_t keys = argc > 2 ? strtoul(argv[2], nullptr, 10) : 32;
+    std::string file = "/tmp/bench-props-" + std::to_string(getpid());
+    size_t found = 0;
+
+    vxg::logger::reset(argc, argv, vxg::logger::lvl_warn);
+    properties::reset(file);
+    for (size_t i = 0; i < keys; i++)
+        properties::set("key" + std::to_string(i),
+                        "value" + std::to_string(i));
+
+    measure("get", iterations, [&](size_t i) {
+        found += !properties::get("key" + std::to_string(i % keys)).empty();
+    });
+    measure("set", iterations, [&](size_t i) {
+        properties::set("key" + std::to_string(i % keys), std::to_string(i));
+    });
+
+    unlink(file.c_str());
+    unlink((file + ".default").c_str());
+
+    return found == iterations ? EXIT_SUCCESS : EXIT_FAILURE;
+}
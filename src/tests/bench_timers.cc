@@ -0,0 +1,88 @@
+//! @file bench_timers.cc
+//! @brief Timed callbacks scheduling benchmark.
+//!
+//! Schedules timers with random timeouts on the libwebsockets transport,
+//! cancels every second one and waits for the rest. Reports schedule and
+//! cancel cost per timer and the expiry lateness.
+//!
+//! Usage: bench-timers [timers count] [max timeout ms]
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+#include <net/http.h>
+
+using namespace vxg::cloud::transport;
+using namespace vxg::cloud::transport::libwebsockets;
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    size_t max_timeout = argc > 2 ? strtoul(argv[2], nullptr, 10) : 2000;
+    std::mt19937 rng(1);
+    std::vector<timed_cb_ptr> timers(count);
+    std::vector<std::chrono::steady_clock::time_point> deadlines(count);
+    std::vector<double> lateness(count, -1);
+    std::atomic<size_t> fired {0};
+
+    auto transport = std::make_shared<http>();
+    if (!transport->start())
+        return EXIT_FAILURE;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        size_t timeout = rng() % max_timeout;
+
+        deadlines[i] = std::chrono::steady_clock::now() +
+                       std::chrono::milliseconds(timeout);
+        timers[i] = transport->schedule_timed_cb(
+            [i, &deadlines, &lateness, &fired]() {
+                lateness[i] =
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - deadlines[i])
+                        .count() /
+                    1000.0;
+                fired++;
+            },
+            timeout);
+    }
+    auto scheduled = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < count; i += 2)
+        transport->cancel_timed_cb(timers[i]);
+    auto canceled = std::chrono::steady_clock::now();
+
+    // Wait for the not canceled timers, some of the canceled ones may have
+    // fired before the cancellation
+    auto wait_until =
+        canceled + std::chrono::milliseconds(max_timeout + 1000);
+    while (transport->timed_cb_count() &&
+           std::chrono::steady_clock::now() < wait_until)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    transport->stop();
+
+    auto ns_per_op = [](std::chrono::steady_clock::duration d, size_t ops) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() /
+               (double)ops;
+    };
+
+    std::vector<double> late;
+    for (auto l : lateness)
+        if (l >= 0)
+            late.push_back(l);
+    std::sort(late.begin(), late.end());
+
+    printf("timers: %zu, fired: %zu\n", count, fired.load());
+    printf("schedule: %.0f ns/timer\n", ns_per_op(scheduled - start, count));
+    printf("cancel: %.0f ns/timer\n",
+           ns_per_op(canceled - scheduled, (count + 1) / 2));
+    if (!late.empty())
+        printf("lateness p50: %.2f ms, p99: %.2f ms\n",
+               late[late.size() / 2], late[late.size() * 99 / 100]);
+
+    return fired >= count / 2 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,237 @@
+//! @file bench_tunnel.cc
+//! @brief Reverse ssh tunnel throughput and connection setup benchmark.
+//!
+//! Opens reverse tunnels to the local ssh server sharing one event loop, the
+//! tunnels forward the remote ports to the local echo server. Clients connect
+//! to the remote ports on the loopback and echo the data through the ssh
+//! server and the tunnels. Reports the tunnel start latency, the channel
+//! setup latency from connect() to the first echoed byte and MB/s echoed.
+//!
+//! Usage: bench-tunnel [ssh host] [ssh port] [user] [private key file]
+//!                     [tunnels] [channels per tunnel] [MB per channel]
+//!                     [first remote port]
+//!
+//! The user defaults to $USER and the key to ~/.ssh/id_rsa, the ssh server
+//! should allow the key and the tcp forwarding. Exits with 77 (skipped) if
+//! the tunnel can't be started.
+
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <poll.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <platform/tunnel-service.h>
+
+using namespace vxg::cloud;
+
+static const int EXIT_SKIP = 77;
+static const uint16_t ECHO_PORT = 17780;
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start)
+               .count() /
+           1000.0;
+}
+
+static int listen_loopback(uint16_t port) {
+    struct sockaddr_in addr;
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(fd, 128)) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void echo_server(int listen_fd) {
+    int fd;
+
+    while ((fd = accept(listen_fd, nullptr, nullptr)) >= 0) {
+        std::thread([fd]() {
+            std::vector<char> buf(64 * 1024);
+            ssize_t n;
+
+            while ((n = recv(fd, buf.data(), buf.size(), 0)) > 0) {
+                for (ssize_t off = 0, w; off < n; off += w)
+                    if ((w = send(fd, buf.data() + off, n - off,
+                                  MSG_NOSIGNAL)) <= 0)
+                        break;
+            }
+            close(fd);
+        }).detach();
+    }
+}
+
+//! Echo @p bytes through the tunnel's remote @p port
+//! @return true if the echoed data matches
+static bool run_channel(uint16_t port,
+                        size_t bytes,
+                        int seed,
+                        double& setup_ms) {
+    struct sockaddr_in addr;
+    std::vector<char> out(64 * 1024), in(64 * 1024);
+    size_t sent = 0, received = 0;
+    bool good = true;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    auto start = std::chrono::steady_clock::now();
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    setup_ms = -1;
+    while (received < bytes) {
+        struct pollfd pfd {fd, POLLIN, 0};
+
+        if (sent < bytes)
+            pfd.events |= POLLOUT;
+        if (poll(&pfd, 1, 10000) <= 0)
+            break;
+
+        if (sent < bytes) {
+            size_t n = std::min(out.size(), bytes - sent);
+            ssize_t w;
+
+            for (size_t i = 0; i < n; i++)
+                out[i] = (char)((sent + i) * 31 + seed);
+            if ((w = send(fd, out.data(), n, MSG_NOSIGNAL)) > 0)
+                sent += w;
+        }
+
+        ssize_t r = recv(fd, in.data(), in.size(), 0);
+        if (r > 0) {
+            if (setup_ms < 0)
+                setup_ms = ms_since(start);
+            for (ssize_t i = 0; i < r; i++)
+                good &= in[i] == (char)((received + i) * 31 + seed);
+            received += r;
+        } else if (r == 0) {
+            break;
+        }
+    }
+    close(fd);
+
+    return good && received == bytes;
+}
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty())
+        return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+int main(int argc, char** argv) {
+    std::string host = argc > 1 ? argv[1] : "127.0.0.1";
+    uint16_t ssh_port = argc > 2 ? atoi(argv[2]) : 22;
+    std::string user =
+        argc > 3 ? argv[3] : (getenv("USER") ? getenv("USER") : "root");
+    std::string key_file =
+        argc > 4 ? argv[4]
+                 : std::string(getenv("HOME") ? getenv("HOME") : "") +
+                       "/.ssh/id_rsa";
+    int tunnels = argc > 5 ? atoi(argv[5]) : 2;
+    int channels = argc > 6 ? atoi(argv[6]) : 4;
+    size_t bytes = (argc > 7 ? strtoul(argv[7], nullptr, 10) : 16) << 20;
+    uint16_t remote_port = argc > 8 ? atoi(argv[8]) : 17800;
+    std::vector<libssh2::reverse_tunnel::ptr> ssh_tunnels;
+    std::vector<double> start_ms, setup_ms(tunnels * channels, -1);
+    std::vector<std::thread> clients;
+    std::atomic<int> succeeded {0};
+    std::stringstream key;
+
+    std::ifstream key_stream(key_file);
+    if (!key_stream) {
+        printf("No private key %s, skipped\n", key_file.c_str());
+        return EXIT_SKIP;
+    }
+    key << key_stream.rdbuf();
+
+    int echo_fd = listen_loopback(ECHO_PORT);
+    if (echo_fd < 0)
+        return EXIT_FAILURE;
+    std::thread(echo_server, echo_fd).detach();
+
+    auto loop = std::make_shared<transport::event_loop>();
+    loop->start("bench-tunnel");
+
+    for (int t = 0; t < tunnels; t++) {
+        libssh2::reverse_tunnel::params p;
+
+        p.ssh_server = host;
+        p.ssh_server_port = ssh_port;
+        p.ssh_server_username = user;
+        p.ssh_private_key = key.str();
+        p.local_dest_port = ECHO_PORT;
+        p.remote_listen_host = "127.0.0.1";
+        p.remote_listen_port = remote_port + t;
+        p.timeout = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        auto tunnel = libssh2::reverse_tunnel::create(p, loop);
+        if (!tunnel || !tunnel->start()) {
+            printf("Failed to start tunnel to %s@%s:%u, skipped\n",
+                   user.c_str(), host.c_str(), ssh_port);
+            return EXIT_SKIP;
+        }
+        start_ms.push_back(ms_since(start));
+        ssh_tunnels.push_back(tunnel);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < tunnels; t++) {
+        for (int c = 0; c < channels; c++) {
+            int i = t * channels + c;
+
+            clients.emplace_back([&, t, i]() {
+                if (run_channel(remote_port + t, bytes, i, setup_ms[i]))
+                    succeeded++;
+            });
+        }
+    }
+    for (auto& c : clients)
+        c.join();
+    double elapsed = ms_since(start) / 1000.0;
+
+    for (auto& t : ssh_tunnels)
+        t->stop();
+    loop->stop();
+
+    setup_ms.erase(std::remove(setup_ms.begin(), setup_ms.end(), -1),
+                   setup_ms.end());
+    printf("tunnels: %d, channels: %d ok of %d, %zu MB per channel\n",
+           tunnels, succeeded.load(), tunnels * channels, bytes >> 20);
+    printf("tunnel start ms: p50 %.2f, max %.2f\n", percentile(start_ms, 0.5),
+           percentile(start_ms, 1));
+    printf("channel setup ms: p50 %.2f, p99 %.2f, max %.2f\n",
+           percentile(setup_ms, 0.5), percentile(setup_ms, 0.99),
+           percentile(setup_ms, 1));
+    printf("echo MB/s: %.1f\n",
+           2.0 * bytes * succeeded / elapsed / (1024 * 1024));
+
+    return succeeded == tunnels * channels ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,229 @@
+//! @file bench_upload.cc
+//! @brief End-to-end upload throughput benchmark.
+//!
+//! Runs agent::manager against the local mock cloud, the synthetic event
+//! stream notifies motion events with attached snapshots and the mock requests
+//! memorycard synchronization of the synthetic stream's clips. Reports
+//! uploads/s, bytes/s and event-to-uploaded latency percentiles.
+//!
+//! Usage: bench-upload [seconds] [events per second] [upload bandwidth B/s]
+//!                     [upload latency ms] [part size] [parts window]
+//!
+//! Run with the upload latency and bandwidth set and increasing parts window
+//! to check the multi-part upload throughput scaling.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include <agent/event-stream.h>
+#include <agent/manager.h>
+#include <agent/rtsp-stream.h>
+#include <tests/mock-cloud.h>
+#include <utils/profile.h>
+
+using namespace vxg::cloud;
+using namespace vxg::cloud::agent;
+
+static const size_t SNAPSHOT_SIZE = 64 * 1024;
+static const size_t CLIP_SIZE = 1024 * 1024;
+static const std::chrono::seconds CLIP_DURATION {10};
+static const std::chrono::minutes SYNC_PERIOD {10};
+
+//! Synthetic clips of the CLIP_DURATION, every requested period is covered.
+class synthetic_stream : public media::rtsp_stream {
+public:
+    synthetic_stream() : media::rtsp_stream("", "synthetic") {}
+
+    virtual std::vector<proto::video_clip_info> record_get_list(
+        vxg::cloud::time begin,
+        vxg::cloud::time end,
+        bool align) override {
+        std::vector<proto::video_clip_info> result;
+
+        for (auto t = begin; t < end; t += CLIP_DURATION) {
+            proto::video_clip_info clip;
+            clip.tp_start = t;
+            clip.tp_stop = std::min(t + CLIP_DURATION, end);
+            result.push_back(clip);
+        }
+
+        return result;
+    }
+
+    virtual proto::video_clip_info record_export(
+        vxg::cloud::time begin,
+        vxg::cloud::time end) override {
+        proto::video_clip_info clip;
+
+        clip.tp_start = begin;
+        clip.tp_stop = end;
+        clip.data.assign(CLIP_SIZE, 0x5a);
+
+        return clip;
+    }
+};
+
+//! Motion events with the attached snapshot at the constant rate.
+class synthetic_event_stream : public event_stream {
+    std::atomic<bool> running_ {false};
+    std::thread thread_;
+    double rate_;
+
+public:
+    synthetic_event_stream(double rate)
+        : event_stream("synthetic"), rate_ {rate} {}
+
+    virtual ~synthetic_event_stream() { stop(); }
+
+    virtual bool start() override {
+        if (running_.exchange(true))
+            return true;
+
+        thread_ = std::thread([this]() {
+            auto period = std::chrono::microseconds(
+                static_cast<int64_t>(1000000 / rate_));
+
+            while (running_) {
+                proto::event_object event;
+
+                event.event = proto::ET_MOTION;
+                event.time = utils::time::to_double(utils::time::now());
+                event.snapshot_info.image_time =
+                    utils::time::to_iso_packed(utils::time::now());
+                event.snapshot_info.width = 640;
+                event.snapshot_info.height = 480;
+                event.snapshot_info.size = SNAPSHOT_SIZE;
+                event.snapshot_info.image_data.assign(SNAPSHOT_SIZE, 0xa5);
+
+                notify(event);
+                std::this_thread::sleep_for(period);
+            }
+        });
+
+        return true;
+    }
+
+    virtual void stop() override {
+        running_ = false;
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+    virtual bool get_events(
+        std::vector<proto::event_config>& configs) override {
+        proto::event_config motion;
+
+        motion.event = proto::ET_MOTION;
+        motion.active = true;
+        motion.snapshot = true;
+        motion.caps.snapshot = true;
+        configs.push_back(motion);
+
+        return true;
+    }
+
+    virtual bool set_events(
+        const std::vector<proto::event_config>& config) override {
+        return true;
+    }
+
+    virtual bool set_trigger_recording(bool enabled,
+                                       int pre,
+                                       int post) override {
+        return false;
+    }
+
+    virtual bool init() override { return true; }
+    virtual void finit() override {}
+};
+
+class bench_callback : public callback {
+public:
+    virtual void on_bye(proto::command::bye_reason reason) override {}
+
+    virtual bool on_get_memorycard_info(
+        proto::event_object::memorycard_info_object& info) override {
+        info.status = proto::MCS_NORMAL;
+        info.size = 32 * 1024;
+        info.free = 16 * 1024;
+        return true;
+    }
+};
+
+int main(int argc, char** argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 30;
+    double events_rate = argc > 2 ? atof(argv[2]) : 5;
+    mock_cloud::config config;
+
+    if (argc > 3)
+        config.upload_bandwidth = strtoul(argv[3], nullptr, 10);
+    if (argc > 4)
+        config.upload_latency = std::chrono::milliseconds(atoi(argv[4]));
+    if (argc > 5)
+        profile::global::instance().direct_upload_part_size =
+            strtoul(argv[5], nullptr, 10);
+    if (argc > 6)
+        profile::global::instance().direct_upload_parts_window =
+            strtoul(argv[6], nullptr, 10);
+
+    config.on_register.push_back(
+        {{"cmd", "set_cam_events"},
+         {"enabled", true},
+         {"events", {{{"event", "motion"}, {"active", true},
+                      {"snapshot", true}, {"stream", false}}}}});
+
+    auto cloud = std::make_shared<mock_cloud>(config);
+    if (!cloud->start())
+        return EXIT_FAILURE;
+
+    profile::global::instance().insecure_cloud_channel = true;
+
+    auto token = std::make_shared<proto::access_token>(cloud->access_token());
+    std::vector<media::stream::ptr> streams {
+        std::make_shared<synthetic_stream>()};
+    std::vector<event_stream::ptr> event_streams {
+        std::make_shared<synthetic_event_stream>(events_rate)};
+
+    auto manager = manager::create(callback::ptr(new bench_callback()), token,
+                                   streams, event_streams);
+    if (!manager || !manager->start())
+        return EXIT_FAILURE;
+
+    for (int i = 0; i < 100 && !cloud->commands_received("cam_register"); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // Synchronize clips recorded before the benchmark start
+    auto now = utils::time::now();
+    cloud->send_command({{"cmd", "cam_memorycard_synchronize"},
+                         {"msgid", 1000000},
+                         {"cam_id", config.cam_id},
+                         {"request_id", "bench"},
+                         {"start", utils::time::to_iso_packed(
+                                       now - SYNC_PERIOD)},
+                         {"end", utils::time::to_iso_packed(now)}});
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+
+    manager->stop();
+    cloud->stop();
+
+    auto stats = cloud->get_stats();
+    double elapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            stats.last_upload - stats.first_upload)
+            .count() /
+        1000.0;
+    if (elapsed <= 0)
+        elapsed = seconds;
+
+    printf("uploads: %zu ok, %zu failed\n", stats.uploads_ok,
+           stats.uploads_failed);
+    printf("uploads/s: %.2f\n", stats.uploads_ok / elapsed);
+    printf("bytes/s: %.0f\n", stats.bytes / elapsed);
+    printf("latency p50: %.1f ms, p99: %.1f ms\n", stats.percentile(50),
+           stats.percentile(99));
+
+    return stats.uploads_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+//! @file bench_websocket.cc
+//! @brief WebSocket transport TX throughput benchmark.
+//!
+//! Connects the websocket transport to the local mock cloud and sends event
+//! messages as fast as possible. Reports messages/s, payload bytes and bytes
+//! on the wire received by the mock.
+//!
+//! Usage: bench-websocket [messages count] [permessage-deflate 0|1]
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+#include <net/websockets.h>
+#include <tests/mock-cloud.h>
+
+using namespace vxg::cloud;
+using namespace vxg::cloud::transport::libwebsockets;
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    bool deflate = argc > 2 ? !!atoi(argv[2]) : false;
+    mock_cloud::config config;
+    std::mutex lock;
+    std::condition_variable cond;
+    bool connected = false;
+
+    config.permessage_deflate = deflate;
+    auto cloud = std::make_shared<mock_cloud>(config);
+    if (!cloud->start())
+        return EXIT_FAILURE;
+
+    std::function<void(transport::Data&)> on_message =
+        [](transport::Data&) {};
+    auto ws = std::make_shared<websocket>(on_message);
+    ws->set_permessage_deflate(deflate);
+    ws->set_connected_cb([&]() {
+        std::lock_guard<std::mutex> l(lock);
+        connected = true;
+        cond.notify_one();
+    });
+
+    if (!ws->start() ||
+        !ws->connect("ws://127.0.0.1:" + std::to_string(config.port) + "/"))
+        return EXIT_FAILURE;
+
+    {
+        std::unique_lock<std::mutex> l(lock);
+        if (!cond.wait_for(l, std::chrono::seconds(5),
+                           [&]() { return connected; }))
+            return EXIT_FAILURE;
+    }
+
+    // Typical event without attachments, repetitive as the real traffic is
+    transport::Message event;
+    event["cmd"] = "cam_event";
+    event["cam_id"] = config.cam_id;
+    event["event"] = "motion";
+    event["status"] = "OK";
+    event["meta"] = {{"source", "synthetic"}, {"zone", "entrance"}};
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        event["msgid"] = i + 1;
+        event["time"] = utils::time::to_double(utils::time::now());
+        ws->send(event);
+    }
+
+    auto deadline = start + std::chrono::seconds(60);
+    while (cloud->get_stats().ws_messages < count &&
+           std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    auto finish = std::chrono::steady_clock::now();
+
+    auto stats = cloud->get_stats();
+    size_t wire_bytes = cloud->ws_wire_bytes();
+
+    ws->stop();
+    cloud->stop();
+
+    double elapsed =
+        std::chrono::duration_cast<std::chrono::microseconds>(finish - start)
+            .count() /
+        1000000.0;
+
+    printf("messages: %zu of %zu, permessage-deflate: %s\n",
+           stats.ws_messages, count, deflate ? "on" : "off");
+    printf("messages/s: %.0f\n", stats.ws_messages / elapsed);
+    printf("payload bytes: %zu, wire bytes: %zu\n", stats.ws_bytes,
+           wire_bytes);
+
+    return stats.ws_messages == count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,99 @@
+//! @file bench_worker.cc
+//! @brief Transport rx thread dispatch latency benchmark.
+//!
+//! Enqueues messages and tasks alternately to the idle transport worker, one
+//! at a time, and measures the time until the rx thread handles each one.
+//! Reports the p50 and p99 dispatch latency.
+//!
+//! Usage: bench-worker [messages count]
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#include <net/transport.h>
+
+using namespace vxg::cloud;
+using namespace vxg::cloud::transport;
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+//! Worker without the service loop, only the rx thread is measured
+class bench_worker : public worker {
+public:
+    bench_worker(std::function<void(Data&)> handler) : worker(handler) {}
+    virtual ~bench_worker() { term(); }
+
+    virtual bool start() override { return run(); }
+    virtual bool stop() override {
+        term();
+        return true;
+    }
+
+    virtual timed_cb_ptr schedule_timed_cb(std::function<void()> cb,
+                                           size_t ms) override {
+        return nullptr;
+    }
+    virtual void cancel_timed_cb(timed_cb_ptr t) override {}
+
+    void inject(Data d) { rx_q_.push(std::move(d)); }
+
+protected:
+    virtual void* poll_() override { return nullptr; }
+};
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000;
+    std::mutex lock;
+    std::condition_variable cond;
+    clock_type::time_point enqueued;
+    std::vector<double> latencies;
+
+    auto record = [&]() {
+        std::lock_guard<std::mutex> l(lock);
+        latencies.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock_type::now() - enqueued)
+                .count() /
+            1000000.0);
+        cond.notify_one();
+    };
+
+    bench_worker w([&](Data&) { record(); });
+    if (!w.start())
+        return EXIT_FAILURE;
+
+    for (size_t i = 0; i < count; i++) {
+        std::unique_lock<std::mutex> l(lock);
+        size_t handled = latencies.size();
+
+        enqueued = clock_type::now();
+        if (i % 2)
+            w.inject(Data(std::string("{}")));
+        else
+            w.run_on_rx_thread(record);
+
+        if (!cond.wait_for(l, std::chrono::seconds(5), [&]() {
+                return latencies.size() > handled;
+            })) {
+            printf("message %zu was not handled\n", i);
+            break;
+        }
+    }
+
+    w.stop();
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("messages: %zu, handled: %zu\n", count, latencies.size());
+    if (!latencies.empty())
+        printf("dispatch latency p50: %.3f ms, p99: %.3f ms\n",
+               latencies[latencies.size() / 2],
+               latencies[latencies.size() * 99 / 100]);
+
+    return latencies.size() == count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
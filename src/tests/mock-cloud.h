@@ -0,0 +1,652 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <agent-proto/objects/config.h>
+#include <net/lws_common.h>
+#include <utils/logging.h>
+#include <utils/utils.h>
+
+//! @brief Local VXG Cloud emulation for the tests and benchmarks.
+//!
+//! Serves the camera WebSocket command channel and the direct upload HTTP
+//! endpoint on the same port. The camera is registered with the hello and
+//! cam_hello commands, cam_event and get_direct_upload_url requests are
+//! replied with direct_upload_url pointing to the mock itself. Uploads are
+//! accepted with configurable reply latency, emulated bandwidth and failure
+//! rate, every finished upload is accounted in the stats.
+//!
+//! Bandwidth is emulated per request by delaying the upload reply until the
+//! time the body would take to pass the link, the socket itself is not
+//! throttled. Parts of the multi-part upload are accepted with the
+//! Content-Range header, the upload is accounted when all parts landed.
+//!
+//! The camera connection may be dropped to test the reconnection.
+class mock_cloud : public vxg::cloud::transport::libwebsockets::lws_common {
+    vxg::logger::logger_ptr logger {vxg::logger::instance("mock-cloud")};
+
+public:
+    using json = nlohmann::json;
+
+    struct config {
+        //! Listening port, WebSocket and HTTP
+        int port {8988};
+        //! Camera id reported in cam_hello
+        int cam_id {1};
+        //! Delay of the command replies
+        std::chrono::milliseconds command_latency {0};
+        //! Delay of the upload replies
+        std::chrono::milliseconds upload_latency {0};
+        //! Emulated upload bandwidth in bytes per second, 0 - unlimited
+        size_t upload_bandwidth {0};
+        //! Probability of the upload failure reply, 0.0 - 1.0
+        double upload_failure_rate {0};
+        //! Commands sent to the camera right after the cam_hello, e.g.
+        //! set_cam_events to enable the events with snapshots
+        std::vector<json> on_register;
+        //! Accept the permessage-deflate extension offered by the camera
+        bool permessage_deflate {false};
+    };
+
+    struct stats {
+        //! Received commands counters by the command name
+        std::map<std::string, size_t> commands;
+        //! WebSocket messages received and their payload bytes
+        size_t ws_messages {0};
+        size_t ws_bytes {0};
+        size_t uploads_ok {0};
+        //! Failed upload replies, including failed parts of the multi-part
+        //! uploads
+        size_t uploads_failed {0};
+        size_t bytes {0};
+        //! Time since the upload's origin until the upload finish,
+        //! milliseconds. Origin is the event time for snapshots and meta
+        //! files and the get_direct_upload_url receiving time for records.
+        std::vector<double> latencies;
+        vxg::cloud::time first_upload {vxg::cloud::utils::time::null()};
+        vxg::cloud::time last_upload {vxg::cloud::utils::time::null()};
+
+        //! @brief Latency percentile, milliseconds.
+        double percentile(double p) const {
+            if (latencies.empty())
+                return 0;
+
+            std::vector<double> sorted(latencies);
+            std::sort(sorted.begin(), sorted.end());
+
+            size_t idx = static_cast<size_t>(p / 100.0 * (sorted.size() - 1));
+            return sorted[std::min(idx, sorted.size() - 1)];
+        }
+    };
+
+private:
+    //! Per HTTP connection data, allocated and zeroed by libwebsockets
+    struct http_session {
+        uint64_t serial;
+        size_t received;
+        //! Total size from the Content-Range header of the multi-part upload,
+        //! 0 for the single request uploads
+        size_t range_total;
+        int status;
+        bool is_list;
+        bool ready;
+        bool headers_sent;
+        char path[128];
+    };
+
+    struct pending_upload {
+        std::string category;
+        vxg::cloud::time origin;
+        //! Bytes of the multi-part upload landed so far
+        size_t received;
+    };
+
+    config config_;
+    struct lws_protocols protocols_[3];
+    struct lws* ws_wsi_ {nullptr};
+    std::atomic<int> ws_fd_ {-1};
+    std::atomic<bool> drop_ws_ {false};
+    std::string ws_rx_;
+    std::deque<std::string> ws_tx_;
+    std::mutex ws_tx_lock_;
+    int msgid_ {0};
+    size_t upload_id_ {0};
+    uint64_t http_serial_ {0};
+    std::map<struct lws*, uint64_t> http_live_;
+    std::map<std::string, pending_upload> pending_uploads_;
+    std::mt19937 rng_ {std::random_device {}()};
+    std::mutex stats_lock_;
+    stats stats_;
+
+    static constexpr const char* STORAGE_LIST_PATH = "/api/v2/storage/data/";
+    static constexpr const char* EMPTY_STORAGE_LIST =
+        "{\"meta\":{\"next\":null},\"objects\":[]}";
+
+    std::string __base_url() {
+        return "http://127.0.0.1:" + std::to_string(config_.port);
+    }
+
+    json __reply(const json& msg, const std::string& cmd) {
+        json reply;
+
+        reply["cmd"] = cmd;
+        reply["msgid"] = ++msgid_;
+        if (msg.count("msgid"))
+            reply["refid"] = msg["msgid"];
+        if (msg.count("cmd"))
+            reply["orig_cmd"] = msg["cmd"];
+        reply["cam_id"] = config_.cam_id;
+
+        return reply;
+    }
+
+    //! Must be called on the lws thread only
+    void __send_ws(const std::string& msg, size_t delay_ms) {
+        schedule_timed_cb(
+            [this, msg]() {
+                {
+                    std::lock_guard<std::mutex> lock(ws_tx_lock_);
+                    ws_tx_.push_back(msg);
+                }
+                if (ws_wsi_)
+                    lws_callback_on_writable(ws_wsi_);
+            },
+            delay_ms);
+    }
+
+    void __reply_ws(const json& reply) {
+        __send_ws(reply.dump(), config_.command_latency.count());
+    }
+
+    json __upload_entry(const std::string& category,
+                        vxg::cloud::time origin) {
+        json entry;
+        std::string path = "/upload/" + std::to_string(++upload_id_);
+
+        pending_uploads_[path] = {category, origin, 0};
+
+        entry["category"] = category;
+        entry["status"] = "OK";
+        entry["url"] = __base_url() + path;
+        entry["expire"] = vxg::cloud::utils::time::to_iso(
+            vxg::cloud::utils::time::now() + std::chrono::minutes(5));
+        entry["headers"] = {{"Content-Type", "application/octet-stream"}};
+
+        return entry;
+    }
+
+    void __handle_cam_event(const json& msg) {
+        std::vector<json> entries;
+        auto origin = vxg::cloud::utils::time::now();
+
+        if (msg.count("time") && msg["time"].is_number())
+            origin = vxg::cloud::utils::time::from_double(
+                msg["time"].get<double>());
+
+        if (msg.count("snapshot_info") && msg["snapshot_info"].count("size"))
+            entries.push_back(__upload_entry("snapshot", origin));
+        if (msg.count("file_meta_info") && msg["file_meta_info"].count("size"))
+            entries.push_back(__upload_entry("file_meta", origin));
+
+        if (entries.empty())
+            return;
+
+        json reply = __reply(msg, "direct_upload_url");
+        reply.update(entries[0]);
+        reply["event_id"] = msg["msgid"];
+        if (entries.size() > 1)
+            reply["extra"] =
+                std::vector<json>(entries.begin() + 1, entries.end());
+
+        __reply_ws(reply);
+    }
+
+    void __handle_get_direct_upload_url(const json& msg) {
+        auto origin = vxg::cloud::utils::time::now();
+        json reply = __reply(msg, "direct_upload_url");
+
+        reply.update(__upload_entry("record", origin));
+
+        if (msg.count("extra")) {
+            json extra = json::array();
+            for (size_t i = 0; i < msg["extra"].size(); i++)
+                extra.push_back(__upload_entry("record", origin));
+            reply["extra"] = extra;
+        }
+
+        __reply_ws(reply);
+    }
+
+    void __handle_command(const json& msg) {
+        std::string cmd = msg.value("cmd", "");
+
+        {
+            std::lock_guard<std::mutex> lock(stats_lock_);
+            stats_.commands[cmd]++;
+        }
+
+        if (cmd == "register") {
+            json reply = __reply(msg, "hello");
+            reply.erase("cam_id");
+            reply["sid"] = "mock-sid";
+            reply["upload_uri"] = __base_url();
+            reply["media_server"] = "127.0.0.1";
+            reply["connid"] = "mock-connid";
+            __reply_ws(reply);
+        } else if (cmd == "cam_register") {
+            json reply = __reply(msg, "cam_hello");
+            reply["media_uri"] = "127.0.0.1";
+            reply["path"] = "mock";
+            reply["mode"] = "cloud";
+            reply["activity"] = true;
+            __reply_ws(reply);
+
+            for (auto c : config_.on_register) {
+                c["msgid"] = ++msgid_;
+                c["cam_id"] = config_.cam_id;
+                __reply_ws(c);
+            }
+        } else if (cmd == "cam_event") {
+            __handle_cam_event(msg);
+        } else if (cmd == "get_direct_upload_url") {
+            __handle_get_direct_upload_url(msg);
+        } else if (cmd != "done" && msg.count("msgid")) {
+            // Every other command is acked as the Cloud does
+            json reply = __reply(msg, "done");
+            reply["status"] = "OK";
+            __reply_ws(reply);
+        }
+    }
+
+    //! Upload body received, plan the reply according to the emulated
+    //! latency, bandwidth and failure rate.
+    void __finish_upload(struct lws* wsi, http_session* session) {
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        size_t delay_ms = config_.upload_latency.count();
+
+        if (config_.upload_bandwidth)
+            delay_ms += session->received * 1000 / config_.upload_bandwidth;
+
+        bool failed = dist(rng_) < config_.upload_failure_rate;
+        session->status = failed ? 503 : 200;
+
+        auto it = pending_uploads_.find(session->path);
+        if (it == pending_uploads_.end()) {
+            logger->warn("Upload to unknown url {}", session->path);
+            session->status = 404;
+        }
+
+        uint64_t serial = session->serial;
+        schedule_timed_cb(
+            [this, wsi, serial]() {
+                auto live = http_live_.find(wsi);
+                if (live == http_live_.end() || live->second != serial)
+                    return;
+
+                auto s = static_cast<http_session*>(lws_wsi_user(wsi));
+                s->ready = true;
+                lws_callback_on_writable(wsi);
+            },
+            delay_ms);
+    }
+
+    void __account_upload(http_session* session) {
+        auto now = vxg::cloud::utils::time::now();
+        std::lock_guard<std::mutex> lock(stats_lock_);
+
+        auto it = pending_uploads_.find(session->path);
+        if (it == pending_uploads_.end())
+            return;
+
+        if (session->status != 200) {
+            stats_.uploads_failed++;
+            // Failed part may be retried
+            if (!session->range_total)
+                pending_uploads_.erase(it);
+            return;
+        }
+
+        stats_.bytes += session->received;
+        it->second.received += session->received;
+
+        // Upload is finished when all parts landed
+        if (session->range_total && it->second.received < session->range_total)
+            return;
+
+        stats_.uploads_ok++;
+        stats_.latencies.push_back(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                now - it->second.origin)
+                .count() /
+            1000.0);
+
+        if (stats_.first_upload == vxg::cloud::utils::time::null())
+            stats_.first_upload = now;
+        stats_.last_upload = now;
+
+        pending_uploads_.erase(it);
+    }
+
+    int __http_writeable(struct lws* wsi, http_session* session) {
+        unsigned char buf[LWS_PRE + 512];
+        unsigned char* start = &buf[LWS_PRE];
+        unsigned char* p = start;
+        unsigned char* end = &buf[sizeof(buf) - 1];
+        size_t body_len = session->is_list ? strlen(EMPTY_STORAGE_LIST) : 0;
+
+        if (!session->ready)
+            return 0;
+
+        if (!session->headers_sent) {
+            if (lws_add_http_common_headers(wsi, session->status,
+                                            "application/json", body_len, &p,
+                                            end) ||
+                lws_finalize_write_http_header(wsi, start, &p, end))
+                return 1;
+
+            session->headers_sent = true;
+
+            if (!session->is_list)
+                __account_upload(session);
+
+            if (body_len) {
+                lws_callback_on_writable(wsi);
+                return 0;
+            }
+        } else if (body_len) {
+            memcpy(start, EMPTY_STORAGE_LIST, body_len);
+            if (lws_write(wsi, start, body_len, LWS_WRITE_HTTP_FINAL) !=
+                (int)body_len)
+                return 1;
+        }
+
+        if (lws_http_transaction_completed(wsi))
+            return -1;
+
+        return 0;
+    }
+
+    int __callback(struct lws* wsi,
+                   enum lws_callback_reasons reason,
+                   void* user,
+                   void* in,
+                   size_t len) {
+        auto session = static_cast<http_session*>(user);
+
+        switch (reason) {
+            case LWS_CALLBACK_ESTABLISHED:
+                logger->info("Camera connected");
+                ws_wsi_ = wsi;
+                ws_fd_ = lws_get_socket_fd(wsi);
+                ws_rx_.clear();
+                break;
+            case LWS_CALLBACK_RECEIVE:
+                ws_rx_.append(static_cast<char*>(in), len);
+                if (lws_is_final_fragment(wsi) &&
+                    !lws_remaining_packet_payload(wsi)) {
+                    {
+                        std::lock_guard<std::mutex> lock(stats_lock_);
+                        stats_.ws_messages++;
+                        stats_.ws_bytes += ws_rx_.size();
+                    }
+                    try {
+                        __handle_command(json::parse(ws_rx_));
+                    } catch (const std::exception& e) {
+                        logger->error("Bad command {}: {}", ws_rx_, e.what());
+                    }
+                    ws_rx_.clear();
+                }
+                break;
+            case LWS_CALLBACK_SERVER_WRITEABLE: {
+                std::string msg;
+                bool more = false;
+
+                if (drop_ws_.exchange(false)) {
+                    logger->info("Dropping camera connection");
+                    return -1;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(ws_tx_lock_);
+                    if (ws_tx_.empty())
+                        break;
+                    msg = std::move(ws_tx_.front());
+                    ws_tx_.pop_front();
+                    more = !ws_tx_.empty();
+                }
+
+                std::vector<unsigned char> buf(LWS_PRE + msg.size());
+                memcpy(buf.data() + LWS_PRE, msg.data(), msg.size());
+                if (lws_write(wsi, buf.data() + LWS_PRE, msg.size(),
+                              LWS_WRITE_TEXT) < (int)msg.size())
+                    return -1;
+
+                if (more)
+                    lws_callback_on_writable(wsi);
+            } break;
+            case LWS_CALLBACK_CLOSED:
+                logger->info("Camera disconnected");
+                if (ws_wsi_ == wsi) {
+                    ws_wsi_ = nullptr;
+                    ws_fd_ = -1;
+                }
+                break;
+            case LWS_CALLBACK_EVENT_WAIT_CANCELLED: {
+                std::lock_guard<std::mutex> lock(ws_tx_lock_);
+                if (ws_wsi_ && (drop_ws_ || !ws_tx_.empty()))
+                    lws_callback_on_writable(ws_wsi_);
+            } break;
+            case LWS_CALLBACK_HTTP:
+                memset(session, 0, sizeof(*session));
+                strncpy(session->path, static_cast<char*>(in),
+                        sizeof(session->path) - 1);
+                session->serial = ++http_serial_;
+                http_live_[wsi] = session->serial;
+
+                // Part of the multi-part upload, bytes first-last/total
+                if (lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_CONTENT_RANGE)) {
+                    char range[64] = {0};
+                    lws_hdr_copy(wsi, range, sizeof(range),
+                                 WSI_TOKEN_HTTP_CONTENT_RANGE);
+                    if (strchr(range, '/'))
+                        session->range_total =
+                            strtoul(strchr(range, '/') + 1, nullptr, 10);
+                }
+
+                // Storage listing requested by the timeline, reply with the
+                // empty list, uploads are replied after the body received
+                if (lws_hdr_total_length(wsi, WSI_TOKEN_GET_URI)) {
+                    session->is_list =
+                        !strncmp(session->path, STORAGE_LIST_PATH,
+                                 strlen(STORAGE_LIST_PATH));
+                    session->status = session->is_list ? 200 : 404;
+                    session->ready = true;
+                    lws_callback_on_writable(wsi);
+                }
+                return 0;
+            case LWS_CALLBACK_HTTP_BODY:
+                session->received += len;
+                return 0;
+            case LWS_CALLBACK_HTTP_BODY_COMPLETION:
+                __finish_upload(wsi, session);
+                return 0;
+            case LWS_CALLBACK_HTTP_WRITEABLE:
+                return __http_writeable(wsi, session);
+            case LWS_CALLBACK_CLOSED_HTTP:
+                http_live_.erase(wsi);
+                break;
+            default:
+                break;
+        }
+
+        return lws_callback_http_dummy(wsi, reason, user, in, len);
+    }
+
+    static int __lws_callback(struct lws* wsi,
+                              enum lws_callback_reasons reason,
+                              void* user,
+                              void* in,
+                              size_t len) {
+        auto self =
+            static_cast<mock_cloud*>(lws_context_user(lws_get_context(wsi)));
+
+        if (!self)
+            return lws_callback_http_dummy(wsi, reason, user, in, len);
+
+        return self->__callback(wsi, reason, user, in, len);
+    }
+
+protected:
+    virtual void* poll_() override {
+        int n = 0;
+
+        vxg::cloud::utils::set_thread_name("mock-cloud");
+        while (n >= 0 && lws_context_ && running_)
+            n = lws_service(lws_context_, 100);
+
+        return nullptr;
+    }
+
+public:
+    mock_cloud() : mock_cloud(config()) {}
+
+    mock_cloud(config c) : config_ {c} {
+        memset(protocols_, 0, sizeof(protocols_));
+        protocols_[0].name = "http";
+        protocols_[0].callback = __lws_callback;
+        protocols_[0].per_session_data_size = sizeof(http_session);
+        protocols_[1].name = "vxg-message-protocol";
+        protocols_[1].callback = __lws_callback;
+        protocols_[1].rx_buffer_size = 64 * 1024;
+    }
+
+    virtual ~mock_cloud() { stop(); }
+
+    virtual bool start() override {
+        struct lws_context_creation_info info;
+
+        lws_set_log_level(LLL_ERR | LLL_WARN, NULL);
+
+        memset(&info, 0, sizeof info);
+        info.port = config_.port;
+        info.iface = "127.0.0.1";
+        info.protocols = protocols_;
+        info.user = this;
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+        static const struct lws_extension extensions[] = {
+            {"permessage-deflate", lws_extension_callback_pm_deflate,
+             "permessage-deflate"},
+            {NULL, NULL, NULL}};
+
+        if (config_.permessage_deflate)
+            info.extensions = extensions;
+#endif
+
+        lws_context_ = lws_create_context(&info);
+        if (!lws_context_) {
+            logger->error("Unable to start mock cloud on port {}",
+                          config_.port);
+            return false;
+        }
+
+        logger->info("Mock cloud started on port {}", config_.port);
+
+        return run();
+    }
+
+    virtual bool stop() override {
+        auto ctx = lws_context_;
+
+        if (ctx) {
+            term();
+            lws_common::stop();
+            lws_context_ = nullptr;
+            lws_context_destroy(ctx);
+        }
+
+        return true;
+    }
+
+    //! @brief Send command to the connected camera, thread-safe.
+    void send_command(json cmd) {
+        if (!lws_context_)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(ws_tx_lock_);
+            ws_tx_.push_back(cmd.dump());
+        }
+        lws_cancel_service(lws_context_);
+    }
+
+    //! @brief Close the camera WebSocket connection without the bye as the
+    //! network failure does, thread-safe.
+    void drop_connection() {
+        if (!lws_context_)
+            return;
+
+        drop_ws_ = true;
+        lws_cancel_service(lws_context_);
+    }
+
+    //! @brief Access token to use with agent::manager, the manager should be
+    //! used with profile::global::insecure_cloud_channel set.
+    vxg::cloud::agent::proto::access_token access_token() {
+        vxg::cloud::agent::proto::access_token token;
+
+        token.token = "mock";
+        token.camid = config_.cam_id;
+        token.cmngrid = config_.cam_id;
+        token.access = "all";
+        token.api = "127.0.0.1";
+        token.api_p = config_.port;
+        token.cam = "127.0.0.1";
+        token.cam_p = config_.port;
+
+        return token;
+    }
+
+    stats get_stats() {
+        std::lock_guard<std::mutex> lock(stats_lock_);
+        return stats_;
+    }
+
+    //! @brief Bytes received on the camera WebSocket connection's socket,
+    //! including the framing and compressed payloads, 0 if not connected.
+    size_t ws_wire_bytes() {
+        // Linux 4.1+ tcp_info tail which is missing in the libc's struct
+        struct {
+            struct tcp_info base;
+            uint64_t pacing_rate;
+            uint64_t max_pacing_rate;
+            uint64_t bytes_acked;
+            uint64_t bytes_received;
+        } info;
+        socklen_t len = sizeof(info);
+        int fd = ws_fd_;
+
+        memset(&info, 0, sizeof(info));
+        if (fd < 0 || getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) ||
+            len < sizeof(info))
+            return 0;
+
+        return info.bytes_received;
+    }
+
+    size_t commands_received(const std::string& cmd) {
+        std::lock_guard<std::mutex> lock(stats_lock_);
+        return stats_.commands.count(cmd) ? stats_.commands[cmd] : 0;
+    }
+};
@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include <utils/base64-simd.h>
+#include <utils/base64.h>
+#include <utils/packbits.h>
+#include <utils/utils.h>
+
+using namespace vxg::cloud::utils;
+
+namespace {
+const std::string alphabet =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+//! Bit by bit reference encoder
+std::string ref_encode(const std::vector<uint8_t>& in) {
+    std::string out;
+    size_t bits = 0;
+    uint32_t acc = 0;
+
+    for (auto b : in) {
+        acc = acc << 8 | b;
+        bits += 8;
+        while (bits >= 6) {
+            bits -= 6;
+            out += alphabet[acc >> bits & 0x3f];
+        }
+    }
+    if (bits)
+        out += alphabet[acc << (6 - bits) & 0x3f];
+    while (out.size() % 4)
+        out += '=';
+
+    return out;
+}
+
+std::vector<base64::impl> supported_impls() {
+    std::vector<base64::impl> impls;
+    auto current = base64::current();
+
+    for (auto i :
+         {base64::impl::scalar, base64::impl::ssse3, base64::impl::neon})
+        if (base64::select(i))
+            impls.push_back(i);
+    base64::select(current);
+
+    return impls;
+}
+
+std::vector<uint8_t> random_bytes(std::mt19937& rng, size_t len) {
+    std::vector<uint8_t> v(len);
+
+    for (auto& b : v)
+        b = rng();
+    return v;
+}
+
+//! Grid with the runs and noise like the real motion maps have
+std::string random_grid(std::mt19937& rng, size_t len) {
+    std::string grid;
+
+    while (grid.size() < len) {
+        size_t run = 1 + rng() % (rng() % 2 ? 300 : 4);
+        grid.append(std::min(run, len - grid.size()), '0' + rng() % 2);
+    }
+
+    return grid;
+}
+
+std::string legacy_pack(const std::string& grid) {
+    std::string packed(grid.size() * 2 + 2, 0);
+
+    packed.resize(packbits((int8_t*)grid.data(), (int8_t*)&packed[0],
+                           grid.size()));
+    return base64_encode(packed);
+}
+}  // namespace
+
+TEST(base64, RoundTrip) {
+    std::mt19937 rng(1);
+
+    for (auto impl : supported_impls()) {
+        ASSERT_TRUE(base64::select(impl));
+
+        for (size_t len = 0; len < 512; len++) {
+            auto data = random_bytes(rng, len);
+            std::string encoded(base64::encoded_size(len), 0);
+            std::vector<uint8_t> decoded(base64::decoded_size(encoded.size()));
+            size_t decoded_len = 0;
+
+            ASSERT_EQ(base64::encode(data.data(), len, &encoded[0]),
+                      encoded.size());
+            ASSERT_EQ(encoded, ref_encode(data)) << base64::name(impl);
+            ASSERT_TRUE(base64::decode(encoded.data(), encoded.size(),
+                                       decoded.data(), decoded_len));
+            decoded.resize(decoded_len);
+            ASSERT_EQ(decoded, data) << base64::name(impl) << " " << len;
+        }
+    }
+}
+
+TEST(base64, AllPairs) {
+    std::vector<uint8_t> data;
+
+    // Every 2 bytes value at every position of the 3 bytes group
+    for (int offset = 0; offset < 3; offset++) {
+        data.assign(offset, 0);
+        for (uint32_t v = 0; v < 0x10000; v++) {
+            data.push_back(v >> 8);
+            data.push_back(v);
+        }
+
+        std::string ref = ref_encode(data);
+        for (auto impl : supported_impls()) {
+            std::string encoded(base64::encoded_size(data.size()), 0);
+            std::vector<uint8_t> decoded(data.size());
+            size_t decoded_len = 0;
+
+            base64::select(impl);
+            base64::encode(data.data(), data.size(), &encoded[0]);
+            ASSERT_EQ(encoded, ref) << base64::name(impl);
+            ASSERT_TRUE(base64::decode(encoded.data(), encoded.size(),
+                                       decoded.data(), decoded_len));
+            ASSERT_EQ(decoded_len, data.size());
+            ASSERT_TRUE(std::equal(data.begin(), data.end(), decoded.begin()))
+                << base64::name(impl);
+        }
+    }
+}
+
+TEST(base64, InvalidChars) {
+    // Long enough for the vector loops and the scalar tail
+    const std::string valid(alphabet + alphabet.substr(0, 76));
+    std::vector<uint8_t> out(base64::decoded_size(valid.size()));
+    size_t len;
+
+    for (auto impl : supported_impls()) {
+        base64::select(impl);
+        ASSERT_TRUE(
+            base64::decode(valid.data(), valid.size(), out.data(), len));
+
+        for (size_t pos = 0; pos < valid.size(); pos++) {
+            for (int c = 0; c < 256; c++) {
+                std::string s = valid;
+                bool padding = c == '=' && pos >= valid.size() - 2;
+
+                s[pos] = c;
+                // "xx=y" is invalid
+                if (padding && pos == valid.size() - 2)
+                    padding = false;
+                ASSERT_EQ(base64::decode(s.data(), s.size(), out.data(), len),
+                          alphabet.find(c) != std::string::npos || padding)
+                    << base64::name(impl) << " " << pos << " " << c;
+            }
+        }
+    }
+
+    EXPECT_FALSE(base64::decode("QUJD=", 5, out.data(), len));
+    EXPECT_FALSE(base64::decode("Q===", 4, out.data(), len));
+    EXPECT_TRUE(base64::decode("QQ==", 4, out.data(), len));
+    EXPECT_EQ(len, 1);
+}
+
+TEST(base64, Compat) {
+    std::string data = "user:password with \xff\x00 bytes";
+
+    EXPECT_EQ(base64_decode(base64_encode(data)), data);
+    // Url alphabet falls back to the original decoder
+    EXPECT_EQ(base64_decode(base64_encode(data, true)), data);
+    EXPECT_EQ(base64_decode(base64_encode_mime(std::string(200, 'x')), true),
+              std::string(200, 'x'));
+}
+
+TEST(motion_map, FusedPack) {
+    std::mt19937 rng(1);
+
+    for (size_t len = 1; len < 3000; len += 1 + len / 16) {
+        for (int i = 0; i < 20; i++) {
+            std::string grid = random_grid(rng, len);
+            std::string packed = motion::map::pack(grid);
+
+            ASSERT_EQ(packed, legacy_pack(grid)) << grid;
+            ASSERT_EQ(motion::map::unpack(packed, len).substr(0, len), grid);
+        }
+    }
+
+    // Incompressible and single run grids
+    std::string noise;
+    for (int i = 0; i < 1000; i++)
+        noise += static_cast<char>(rng());
+    EXPECT_EQ(motion::map::pack(noise), legacy_pack(noise));
+    EXPECT_EQ(motion::map::pack(std::string(1000, '1')),
+              legacy_pack(std::string(1000, '1')));
+
+    char out[16];
+    EXPECT_EQ(motion::map::pack(noise.data(), noise.size(), out, sizeof(out)),
+              0);
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include <net/event-loop.h>
+
+using namespace vxg::cloud::transport;
+
+TEST(event_loop, FdEvents) {
+    event_loop loop;
+    int fds[2];
+    std::promise<std::string> received;
+
+    ASSERT_EQ(pipe(fds), 0);
+    ASSERT_TRUE(loop.start());
+    ASSERT_TRUE(loop.add(fds[0], EPOLLIN | EPOLLET, [&](uint32_t events) {
+        char buf[16];
+        ssize_t n = read(fds[0], buf, sizeof(buf));
+
+        EXPECT_TRUE(loop.in_loop_thread());
+        EXPECT_TRUE(events & EPOLLIN);
+        received.set_value(std::string(buf, n > 0 ? n : 0));
+    }));
+    EXPECT_FALSE(loop.add(fds[0], EPOLLIN, [](uint32_t) {}));
+
+    ASSERT_EQ(write(fds[1], "ping", 4), 4);
+    auto f = received.get_future();
+    ASSERT_EQ(f.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(f.get(), "ping");
+
+    loop.remove(fds[0]);
+    loop.stop();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(event_loop, RemoveInCallback) {
+    event_loop loop;
+    int a[2], b[2];
+    std::atomic<int> calls {0};
+
+    ASSERT_EQ(pipe(a), 0);
+    ASSERT_EQ(pipe(b), 0);
+    ASSERT_EQ(write(a[1], "x", 1), 1);
+    ASSERT_EQ(write(b[1], "x", 1), 1);
+    ASSERT_TRUE(loop.start());
+
+    // Both fds are ready in the same batch, the first callback removes the
+    // other fd and its fetched event is not delivered
+    loop.invoke([&]() {
+        auto cb = [&](uint32_t) {
+            calls++;
+            loop.remove(a[0]);
+            loop.remove(b[0]);
+        };
+        loop.add(a[0], EPOLLIN, cb);
+        loop.add(b[0], EPOLLIN, cb);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(calls, 1);
+
+    loop.stop();
+    for (int fd : {a[0], a[1], b[0], b[1]})
+        close(fd);
+}
+
+TEST(event_loop, Timers) {
+    event_loop loop;
+    std::mutex lock;
+    std::vector<int> order;
+    std::promise<void> done;
+
+    ASSERT_TRUE(loop.start());
+
+    auto start = std::chrono::steady_clock::now();
+    auto record = [&](int id) {
+        return [&, id]() {
+            std::lock_guard<std::mutex> _lock(lock);
+            order.push_back(id);
+        };
+    };
+    loop.schedule_timed_cb(record(3), 150);
+    loop.schedule_timed_cb(record(1), 10);
+    auto canceled = loop.schedule_timed_cb(record(0), 50);
+    loop.schedule_timed_cb(record(2), 100);
+    loop.schedule_timed_cb([&]() { done.set_value(); }, 200);
+    loop.cancel_timed_cb(canceled);
+    EXPECT_EQ(canceled->state, timed_cb::CANCELED);
+
+    auto f = done.get_future();
+    ASSERT_EQ(f.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_GE(std::chrono::steady_clock::now() - start,
+              std::chrono::milliseconds(190));
+    EXPECT_EQ(order, std::vector<int>({1, 2, 3}));
+
+    // Pending timers are canceled on stop
+    auto pending = loop.schedule_timed_cb([]() {}, 100000);
+    loop.stop();
+    EXPECT_EQ(pending->state, timed_cb::CANCELED);
+    EXPECT_EQ(loop.schedule_timed_cb([]() {}, 0), nullptr);
+}
+
+TEST(event_loop, PostAndInvoke) {
+    event_loop loop;
+    std::atomic<int> posted {0};
+    std::vector<std::thread> threads;
+    const int count = 1000;
+
+    ASSERT_TRUE(loop.start());
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < count; i++)
+                loop.post([&]() { posted++; });
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    bool in_loop = false;
+    loop.invoke([&]() { in_loop = loop.in_loop_thread(); });
+    EXPECT_TRUE(in_loop);
+    // Tasks are run in the order they were posted
+    EXPECT_EQ(posted, 4 * count);
+
+    // Not running loop runs the tasks in place
+    loop.stop();
+    loop.post([&]() { posted++; });
+    EXPECT_EQ(posted, 4 * count + 1);
+}
+
+TEST(event_loop, StopInCallback) {
+    event_loop loop;
+    std::atomic<int> calls {0};
+
+    ASSERT_TRUE(loop.start());
+    // Teardown is deferred until the callback returns
+    loop.post([&]() {
+        loop.stop();
+        calls++;
+        EXPECT_TRUE(loop.in_loop_thread());
+    });
+    for (int i = 0; i < 100 && loop.running(); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    EXPECT_EQ(calls, 1);
+    EXPECT_FALSE(loop.running());
+
+    // Restarted after the loop thread stopped itself
+    ASSERT_TRUE(loop.start());
+    loop.invoke([&]() { calls++; });
+    EXPECT_EQ(calls, 2);
+    loop.stop();
+}
+
+TEST(event_loop, DestroyInCallback) {
+    auto loop = std::make_shared<event_loop>();
+    std::promise<void> done;
+    std::atomic<int> calls {0};
+
+    ASSERT_TRUE(loop->start());
+    // The loop's last owner is dropped by its own task, the loop thread is
+    // detached and leaves without touching the destroyed loop
+    auto timer = loop->schedule_timed_cb([&]() { calls++; }, 100000);
+    loop->post([&]() {
+        loop.reset();
+        EXPECT_EQ(timer->state, timed_cb::CANCELED);
+        calls++;
+        done.set_value();
+    });
+
+    auto f = done.get_future();
+    ASSERT_EQ(f.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(calls, 1);
+}
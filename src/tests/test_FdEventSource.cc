@@ -0,0 +1,278 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include <platform/fd-event-source.h>
+
+using namespace vxg::cloud;
+using namespace vxg::cloud::transport;
+
+TEST(fd_event_source, BulkRead) {
+    auto loop = std::make_shared<event_loop>();
+    fd_event_source source(loop);
+    std::string received;
+    std::atomic<int> calls {0};
+    std::promise<void> closed;
+    std::string data(1024 * 1024, 0);
+    int fds[2];
+
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = 'a' + i % 26;
+
+    ASSERT_EQ(pipe(fds), 0);
+    ASSERT_TRUE(loop->start());
+    ASSERT_TRUE(source.start(
+        fds[0],
+        [&](const char* d, size_t size) {
+            EXPECT_TRUE(loop->in_loop_thread());
+            received.append(d, size);
+            calls++;
+        },
+        fd_event_source::FD_STREAM, [&]() { closed.set_value(); }));
+    EXPECT_FALSE(source.start(fds[0], [](const char*, size_t) {}));
+    EXPECT_TRUE(fcntl(fds[0], F_GETFL) & O_NONBLOCK);
+
+    std::thread writer([&]() {
+        size_t pos = 0;
+
+        while (pos < data.size()) {
+            ssize_t n = write(fds[1], data.data() + pos,
+                              std::min<size_t>(100000, data.size() - pos));
+            ASSERT_GT(n, 0);
+            pos += n;
+        }
+        close(fds[1]);
+    });
+
+    // End of the stream unwatches the fd
+    auto f = closed.get_future();
+    ASSERT_EQ(f.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    writer.join();
+    EXPECT_FALSE(source.running());
+    EXPECT_EQ(received, data);
+    EXPECT_EQ(source.bytes(), data.size());
+    // Read in bulk, not byte by byte
+    EXPECT_LT(calls, 1000);
+
+    // Original flags are restored
+    EXPECT_FALSE(fcntl(fds[0], F_GETFL) & O_NONBLOCK);
+    close(fds[0]);
+    loop->stop();
+}
+
+TEST(fd_event_source, EachLine) {
+    auto loop = std::make_shared<event_loop>();
+    fd_event_source source(loop);
+    line_splitter lines;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<std::string> received;
+    int fds[2];
+
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    ASSERT_TRUE(loop->start());
+    ASSERT_TRUE(source.start(fds[0], [&](const char* d, size_t size) {
+        lines.feed(d, size, [&](const std::string& line) {
+            std::lock_guard<std::mutex> _lock(lock);
+            received.push_back(line);
+            cond.notify_all();
+        });
+    }));
+
+    // Every line is delivered on its own, without waiting for the next one
+    for (size_t i = 0; i < 20; i++) {
+        std::unique_lock<std::mutex> _lock(lock);
+
+        ASSERT_EQ(write(fds[1], "m\n", 2), 2);
+        ASSERT_TRUE(cond.wait_for(_lock, std::chrono::seconds(5),
+                                  [&]() { return received.size() > i; }));
+        EXPECT_EQ(received.back(), "m");
+    }
+
+    source.stop();
+    EXPECT_FALSE(source.running());
+    ASSERT_EQ(write(fds[1], "m\n", 2), 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(received.size(), 20u);
+
+    loop->stop();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(fd_event_source, NamedPipe) {
+    char dir[] = "/tmp/test-fd-event-source-XXXXXX";
+    std::mutex lock;
+    std::string received;
+    bool closed = false;
+
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    std::string path = std::string(dir) + "/fifo";
+    ASSERT_EQ(mkfifo(path.c_str(), 0600), 0);
+
+    {
+        // Shared loop by default
+        fd_event_source source;
+
+        ASSERT_TRUE(source.open(
+            path,
+            [&](const char* d, size_t size) {
+                std::lock_guard<std::mutex> _lock(lock);
+                received.append(d, size);
+            },
+            fd_event_source::FD_STREAM, [&]() { closed = true; }));
+
+        // Writers come and go, the source keeps reading
+        for (auto msg : {"gpio=1\n", "gpio=0\n"}) {
+            int fd = open(path.c_str(), O_WRONLY);
+
+            ASSERT_GE(fd, 0);
+            ASSERT_EQ(write(fd, msg, strlen(msg)), strlen(msg));
+            close(fd);
+        }
+
+        for (int i = 0; i < 100; i++) {
+            {
+                std::lock_guard<std::mutex> _lock(lock);
+                if (received.size() == 14)
+                    break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_TRUE(source.running());
+    }
+
+    EXPECT_EQ(received, "gpio=1\ngpio=0\n");
+    EXPECT_FALSE(closed);
+    unlink(path.c_str());
+    rmdir(dir);
+}
+
+TEST(fd_event_source, CanonicalTty) {
+    auto loop = std::make_shared<event_loop>();
+    fd_event_source source(loop);
+    line_splitter splitter;
+    std::mutex lock;
+    std::vector<std::string> lines;
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+    ASSERT_GE(master, 0);
+    ASSERT_EQ(grantpt(master), 0);
+    ASSERT_EQ(unlockpt(master), 0);
+    int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    ASSERT_GE(slave, 0);
+
+    struct termios tio;
+    ASSERT_EQ(tcgetattr(slave, &tio), 0);
+    tio.c_lflag |= ICANON;
+    tio.c_lflag &= ~ECHO;
+    ASSERT_EQ(tcsetattr(slave, TCSANOW, &tio), 0);
+
+    // Both lines are queued before the single edge, canonical tty returns
+    // one line per read
+    ASSERT_EQ(write(master, "m\nm\n", 4), 4);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    ASSERT_TRUE(loop->start());
+    ASSERT_TRUE(source.start(slave, [&](const char* d, size_t size) {
+        splitter.feed(d, size, [&](const std::string& line) {
+            std::lock_guard<std::mutex> _lock(lock);
+            lines.push_back(line);
+        });
+    }));
+
+    for (int i = 0; i < 100; i++) {
+        {
+            std::lock_guard<std::mutex> _lock(lock);
+            if (lines.size() == 2)
+                break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    source.stop();
+    loop->stop();
+    EXPECT_EQ(lines, std::vector<std::string>({"m", "m"}));
+    close(slave);
+    close(master);
+}
+
+TEST(fd_event_source, Errors) {
+    auto loop = std::make_shared<event_loop>();
+    fd_event_source source(loop);
+    char path[] = "/tmp/test-fd-event-source-XXXXXX";
+    int fd = mkstemp(path);
+
+    ASSERT_GE(fd, 0);
+    ASSERT_TRUE(loop->start());
+
+    // Regular files are not supported by epoll
+    EXPECT_FALSE(source.start(fd, [](const char*, size_t) {}));
+    EXPECT_FALSE(source.running());
+    EXPECT_FALSE(fcntl(fd, F_GETFL) & O_NONBLOCK);
+    EXPECT_FALSE(source.open("/nonexistent", [](const char*, size_t) {}));
+    EXPECT_FALSE(source.start(-1, [](const char*, size_t) {}));
+
+    close(fd);
+    unlink(path);
+    loop->stop();
+}
+
+TEST(fd_event_source, StopInCallback) {
+    auto loop = std::make_shared<event_loop>();
+    fd_event_source source(loop);
+    std::atomic<int> calls {0};
+    int fds[2];
+
+    ASSERT_EQ(pipe(fds), 0);
+    ASSERT_TRUE(loop->start());
+    ASSERT_TRUE(source.start(fds[0], [&](const char*, size_t) {
+        calls++;
+        source.stop();
+    }));
+
+    ASSERT_EQ(write(fds[1], "x", 1), 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_EQ(write(fds[1], "y", 1), 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(calls, 1);
+    EXPECT_FALSE(source.running());
+
+    loop->stop();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(line_splitter, Split) {
+    line_splitter lines('\n', 8);
+    std::vector<std::string> result;
+    auto cb = [&](const std::string& line) { result.push_back(line); };
+
+    lines.feed("ab", 2, cb);
+    EXPECT_TRUE(result.empty());
+    lines.feed("c\n\nd\nef", 7, cb);
+    ASSERT_EQ(result.size(), 3);
+    EXPECT_EQ(result[0], "abc");
+    EXPECT_EQ(result[1], "");
+    EXPECT_EQ(result[2], "d");
+
+    // Long line is split
+    lines.feed("0123456789\n", 11, cb);
+    ASSERT_EQ(result.size(), 5);
+    EXPECT_EQ(result[3], "ef012345");
+    EXPECT_EQ(result[4], "6789");
+
+    lines.feed("x", 1, cb);
+    lines.reset();
+    lines.feed("y\n", 2, cb);
+    EXPECT_EQ(result.back(), "y");
+}
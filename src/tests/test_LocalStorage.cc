@@ -0,0 +1,272 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <platform/local-storage.h>
+
+using namespace ::testing;
+using namespace vxg::cloud;
+
+class local_storage_test : public Test {
+protected:
+    std::string dir_;
+
+    virtual void SetUp() {
+        char tmpl[] = "/tmp/test-local-storage-XXXXXX";
+
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir_ = tmpl;
+    }
+
+    virtual void TearDown() {
+        DIR* dir = opendir(dir_.c_str());
+        struct dirent* de;
+
+        while (dir && (de = readdir(dir)))
+            if (strcmp(de->d_name, ".") && strcmp(de->d_name, ".."))
+                unlink((dir_ + "/" + de->d_name).c_str());
+        if (dir)
+            closedir(dir);
+        rmdir(dir_.c_str());
+    }
+
+    static vxg::cloud::time at(int64_t sec) {
+        return vxg::cloud::time(std::chrono::seconds(1600000000 + sec));
+    }
+
+    static local_storage::object make_object(int64_t start,
+                                             int64_t duration,
+                                             size_t size,
+                                             object_storage::trigger_type t =
+                                                 object_storage::TT_MOTION,
+                                             object_storage::media_type m =
+                                                 object_storage::OT_MP4) {
+        local_storage::object o;
+
+        o.trigger = t;
+        o.type = m;
+        o.start = at(start);
+        o.stop = at(start + duration);
+        o.size = size;
+        return o;
+    }
+
+    //! Objects overlapping [start, stop] found by the full scan
+    static std::vector<local_storage::object> brute_find(
+        const std::vector<local_storage::object>& objects,
+        vxg::cloud::time start,
+        vxg::cloud::time stop) {
+        std::vector<local_storage::object> result;
+
+        for (auto& o : objects)
+            if (o.start <= stop && o.stop >= start)
+                result.push_back(o);
+        std::stable_sort(result.begin(), result.end(),
+                         [](const local_storage::object& a,
+                            const local_storage::object& b) {
+                             return a.start < b.start;
+                         });
+        return result;
+    }
+};
+
+TEST_F(local_storage_test, WriteReadRemove) {
+    local_storage storage(dir_);
+    agent::proto::video_clip_info clip;
+    std::vector<uint8_t> data;
+
+    ASSERT_TRUE(storage.open());
+    EXPECT_EQ(storage.path(), dir_);
+    EXPECT_EQ(storage.used(), 0);
+    EXPECT_GT(storage.size(), 0);
+
+    clip.tp_start = at(10);
+    clip.tp_stop = at(20);
+    clip.video_width = 640;
+    clip.video_height = 480;
+    clip.data = {1, 2, 3, 4, 5};
+    ASSERT_TRUE(storage.write(object_storage::TT_MOTION, object_storage::OT_MP4,
+                              clip));
+    clip.tp_start = clip.tp_stop = at(15);
+    clip.data = {6, 7};
+    ASSERT_TRUE(storage.write(object_storage::TT_ANY, object_storage::OT_JPEG,
+                              clip));
+    EXPECT_EQ(storage.used(), 7);
+    EXPECT_EQ(storage.count(), 2);
+
+    // Trigger and type filters
+    EXPECT_EQ(storage.find(object_storage::TT_ANY, object_storage::OT_INVALID,
+                           at(0), at(100))
+                  .size(),
+              2);
+    auto found = storage.find(object_storage::TT_MOTION,
+                              object_storage::OT_INVALID, at(0), at(100));
+    ASSERT_EQ(found.size(), 1);
+    EXPECT_EQ(found[0].start, at(10));
+    EXPECT_EQ(found[0].stop, at(20));
+    EXPECT_EQ(found[0].width, 640);
+    ASSERT_TRUE(storage.read(found[0], data));
+    EXPECT_EQ(data, std::vector<uint8_t>({1, 2, 3, 4, 5}));
+
+    auto clips = storage.search(object_storage::TT_ANY, object_storage::OT_JPEG,
+                                std::chrono::system_clock::to_time_t(at(15)),
+                                std::chrono::system_clock::to_time_t(at(15)));
+    ASSERT_EQ(clips.size(), 1);
+    EXPECT_EQ(clips[0].tp_start, at(15));
+    EXPECT_EQ(clips[0].video_height, 480);
+
+    // Overlapping ranges only
+    EXPECT_TRUE(storage
+                    .find(object_storage::TT_MOTION, object_storage::OT_MP4,
+                          at(21), at(30))
+                    .empty());
+    EXPECT_EQ(storage
+                  .find(object_storage::TT_MOTION, object_storage::OT_MP4,
+                        at(0), at(10))
+                  .size(),
+              1);
+
+    ASSERT_TRUE(storage.remove(found[0]));
+    EXPECT_FALSE(storage.remove(found[0]));
+    EXPECT_FALSE(storage.read(found[0], data));
+    EXPECT_EQ(storage.used(), 2);
+    EXPECT_EQ(storage.count(), 1);
+}
+
+TEST_F(local_storage_test, HundredThousandObjects) {
+    const int N = 100000;
+    std::mt19937 rng(42);
+    std::vector<local_storage::object> objects;
+    local_storage storage(dir_);
+    size_t used = 0;
+
+    ASSERT_TRUE(storage.open());
+
+    // Mostly sequential motion clips and snapshots, some are late
+    for (int i = 0; i < N; i++) {
+        int64_t start = i * 10 - (rng() % 8 == 0 ? rng() % 1000 : 0);
+        auto o = make_object(start, rng() % 60, rng() % 100000 + 1,
+                             static_cast<object_storage::trigger_type>(i % 2),
+                             i % 5 ? object_storage::OT_MP4
+                                   : object_storage::OT_JPEG);
+
+        // Same time span is replaced, keep the model unique
+        bool duplicate = false;
+        for (size_t j = objects.size() > 200 ? objects.size() - 200 : 0;
+             j < objects.size(); j++)
+            duplicate |= (objects[j].start == o.start &&
+                          objects[j].stop == o.stop &&
+                          objects[j].trigger == o.trigger &&
+                          objects[j].type == o.type);
+        if (duplicate)
+            continue;
+
+        ASSERT_TRUE(storage.add(o));
+        objects.push_back(o);
+        used += o.size;
+    }
+    EXPECT_EQ(storage.count(), objects.size());
+    EXPECT_EQ(storage.used(), used);
+
+    auto check_ranges = [&](local_storage& s) {
+        for (int q = 0; q < 200; q++) {
+            int64_t start = rng() % (N * 10);
+            auto from = at(start), to = at(start + rng() % 2000);
+            auto expected = brute_find(objects, from, to);
+            auto found = s.find(object_storage::TT_ANY,
+                                object_storage::OT_INVALID, from, to);
+
+            ASSERT_EQ(found.size(), expected.size()) << "query " << q;
+            for (size_t i = 0; i < found.size(); i++)
+                ASSERT_EQ(found[i].start, expected[i].start);
+        }
+    };
+    check_ranges(storage);
+
+    // Rotation, the oldest objects are removed
+    std::sort(objects.begin(), objects.end(),
+              [](const local_storage::object& a,
+                 const local_storage::object& b) { return a.start < b.start; });
+    size_t removed = objects.size() / 3;
+    for (size_t i = 0; i < removed; i++) {
+        ASSERT_TRUE(storage.remove(objects[i]));
+        used -= objects[i].size;
+    }
+    objects.erase(objects.begin(), objects.begin() + removed);
+    EXPECT_EQ(storage.count(), objects.size());
+    EXPECT_EQ(storage.used(), used);
+    check_ranges(storage);
+
+    // The index is persistent
+    storage.close();
+    local_storage reopened(dir_);
+    ASSERT_TRUE(reopened.open());
+    EXPECT_EQ(reopened.count(), objects.size());
+    EXPECT_EQ(reopened.used(), used);
+    check_ranges(reopened);
+}
+
+TEST_F(local_storage_test, RebuildIndex) {
+    agent::proto::video_clip_info clip;
+
+    {
+        local_storage storage(dir_);
+
+        ASSERT_TRUE(storage.open());
+        for (int i = 0; i < 10; i++) {
+            clip.tp_start = at(i * 10);
+            clip.tp_stop = at(i * 10 + 5);
+            clip.data.assign(i + 1, 0);
+            ASSERT_TRUE(storage.write(object_storage::TT_MOTION,
+                                      object_storage::OT_MP4, clip));
+        }
+    }
+
+    // Broken index and a foreign file
+    FILE* f = fopen((dir_ + "/.index-0-1").c_str(), "r+");
+    ASSERT_NE(f, nullptr);
+    fputs("garbage", f);
+    fclose(f);
+    f = fopen((dir_ + "/notes.txt").c_str(), "w");
+    ASSERT_NE(f, nullptr);
+    fclose(f);
+
+    local_storage storage(dir_);
+    ASSERT_TRUE(storage.open());
+    EXPECT_EQ(storage.count(), 10);
+    EXPECT_EQ(storage.used(), 55);
+    auto found = storage.find(object_storage::TT_MOTION, object_storage::OT_MP4,
+                              at(42), at(52));
+    ASSERT_EQ(found.size(), 2);
+    EXPECT_EQ(found[0].start, at(40));
+    EXPECT_EQ(found[0].size, 5);
+    EXPECT_EQ(found[1].start, at(50));
+}
+
+TEST_F(local_storage_test, Capacity) {
+    local_storage storage(dir_, 1000);
+
+    ASSERT_TRUE(storage.open());
+    EXPECT_EQ(storage.size(), 1000);
+    EXPECT_EQ(storage.free(), 1000);
+
+    ASSERT_TRUE(storage.add(make_object(0, 10, 400)));
+    ASSERT_TRUE(storage.add(make_object(10, 10, 500)));
+    EXPECT_EQ(storage.used(), 900);
+    EXPECT_EQ(storage.free(), 100);
+
+    // Same object written again replaces the old one
+    ASSERT_TRUE(storage.add(make_object(10, 10, 700)));
+    EXPECT_EQ(storage.count(), 2);
+    EXPECT_EQ(storage.free(), 0);
+
+    ASSERT_TRUE(storage.remove(make_object(0, 10, 400)));
+    EXPECT_EQ(storage.free(), 300);
+
+    // Invalid objects are rejected
+    EXPECT_FALSE(storage.add(make_object(10, -1, 1)));
+    EXPECT_FALSE(storage.add(make_object(0, 1, 1, object_storage::TT_INVALID)));
+}
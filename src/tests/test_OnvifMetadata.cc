@@ -0,0 +1,254 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <streamer/onvif_metadata_parser.h>
+#include <streamer/onvif_topic_trie.h>
+
+using namespace vxg::media::onvif;
+using namespace vxg::cloud;
+
+// Axis camera style metadata stream packet
+static const std::string NOTIFICATION =
+    "<tt:MetadataStream xmlns:tt=\"http://www.onvif.org/ver10/schema\">"
+    "<tt:Event>"
+    "<wsnt:NotificationMessage "
+    "xmlns:tns1=\"http://www.onvif.org/ver10/topics\" "
+    "xmlns:tnsaxis=\"http://www.axis.com/2009/event/topics\" "
+    "xmlns:wsnt=\"http://docs.oasis-open.org/wsn/b-2\" "
+    "xmlns:wsa5=\"http://www.w3.org/2005/08/addressing\">"
+    "<wsnt:Topic Dialect=\"http://docs.oasis-open.org/wsn/t-1/"
+    "TopicExpression/Simple\">tns1:VideoSource/tnsaxis:DayNightVision"
+    "</wsnt:Topic>"
+    "<wsnt:ProducerReference>"
+    "<wsa5:Address>uri://5ff5e7ee-6b4d-4f25-ae5a-f2b1e0e5d5d1/"
+    "ProducerReference</wsa5:Address>"
+    "</wsnt:ProducerReference>"
+    "<wsnt:Message>"
+    "<tt:Message UtcTime=\"2021-05-11T09:24:47.426536Z\" "
+    "PropertyOperation=\"Changed\">"
+    "<tt:Source><tt:SimpleItem Name=\"VideoSourceConfigurationToken\" "
+    "Value=\"1\"/></tt:Source>"
+    "<tt:Key></tt:Key>"
+    "<tt:Data><tt:SimpleItem Name=\"day\" Value=\"1\"/></tt:Data>"
+    "</tt:Message>"
+    "</wsnt:Message>"
+    "</wsnt:NotificationMessage>"
+    "</tt:Event>"
+    "</tt:MetadataStream>";
+
+static const std::string DOCUMENT =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" + NOTIFICATION;
+
+static std::string motion_notification(int i, bool active) {
+    return "<wsnt:NotificationMessage>"
+           "<wsnt:Topic>tns1:RuleEngine/CellMotionDetector/Motion"
+           "</wsnt:Topic>"
+           "<wsnt:Message><tt:Message UtcTime=\"2021-05-11T09:24:4" +
+           std::to_string(i) +
+           "Z\" PropertyOperation=\"Changed\">"
+           "<tt:Source><tt:SimpleItem Name=\"Rule\" Value=\"r" +
+           std::to_string(i) +
+           "\"/></tt:Source>"
+           "<tt:Data><tt:SimpleItem Name=\"IsMotion\" Value=\"" +
+           (active ? "true" : "false") +
+           "\"/></tt:Data>"
+           "</tt:Message></wsnt:Message>"
+           "</wsnt:NotificationMessage>";
+}
+
+static void expect_day_night(const event& e) {
+    EXPECT_EQ(e.topic, "tns1:VideoSource/tnsaxis:DayNightVision");
+    EXPECT_EQ(e.time, utils::time::from_iso("2021-05-11T09:24:47.426536Z"));
+    EXPECT_EQ(e.prop_op, "Changed");
+    ASSERT_EQ(e.source_items.size(), 1);
+    EXPECT_EQ(e.source_items[0].name, "VideoSourceConfigurationToken");
+    EXPECT_EQ(e.source_items[0].value, "1");
+    ASSERT_EQ(e.data_items.size(), 1);
+    EXPECT_EQ(e.data_items[0].name, "day");
+    EXPECT_EQ(e.data_items[0].value, "1");
+    // The document is a single notification, the body is the same document
+    EXPECT_EQ(e.raw_body, NOTIFICATION);
+}
+
+TEST(onvif_metadata, SplitAtEveryByte) {
+    std::vector<event> events;
+    metadata_parser parser([&events](event e) { events.push_back(e); });
+
+    for (size_t split = 0; split <= DOCUMENT.size(); split++) {
+        events.clear();
+        parser.feed(DOCUMENT.data(), split);
+        parser.feed(DOCUMENT.data() + split, DOCUMENT.size() - split);
+
+        ASSERT_EQ(events.size(), 1) << "split at " << split;
+        expect_day_night(events[0]);
+    }
+    EXPECT_EQ(parser.errors(), 0);
+}
+
+TEST(onvif_metadata, RandomChunks) {
+    std::mt19937 rng(7);
+    std::vector<event> events;
+    metadata_parser parser([&events](event e) { events.push_back(e); });
+    std::string stream;
+    const int documents = 200;
+
+    for (int i = 0; i < documents; i++)
+        stream += DOCUMENT;
+
+    for (size_t pos = 0; pos < stream.size();) {
+        size_t len = std::min<size_t>(rng() % 64 + 1, stream.size() - pos);
+
+        parser.feed(stream.data() + pos, len);
+        pos += len;
+    }
+
+    ASSERT_EQ(events.size(), documents);
+    for (auto& e : events)
+        expect_day_night(e);
+
+    // Single byte packets
+    events.clear();
+    for (char c : DOCUMENT)
+        parser.feed(&c, 1);
+    ASSERT_EQ(events.size(), 1);
+    expect_day_night(events[0]);
+}
+
+TEST(onvif_metadata, EmitsOnNotificationClose) {
+    std::vector<event> events;
+    metadata_parser parser([&events](event e) { events.push_back(e); });
+    std::string first = "<tt:MetadataStream xmlns:tt=\"ns\"><tt:Event>" +
+                        motion_notification(1, true);
+
+    // The document is not closed yet, the first notification is emitted
+    parser.feed(first.data(), first.size());
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events[0].topic, "tns1:RuleEngine/CellMotionDetector/Motion");
+    EXPECT_EQ(events[0].data_items[0].value, "true");
+    EXPECT_EQ(events[0].raw_body,
+              "<tt:MetadataStream xmlns:tt=\"ns\"><tt:Event>" +
+                  motion_notification(1, true) +
+                  "</tt:Event></tt:MetadataStream>");
+
+    std::string rest = motion_notification(2, false) +
+                       "</tt:Event></tt:MetadataStream>";
+    parser.feed(rest.data(), rest.size());
+    ASSERT_EQ(events.size(), 2);
+    EXPECT_EQ(events[1].source_items[0].value, "r2");
+    EXPECT_EQ(events[1].data_items[0].value, "false");
+    // Only its own notification is in the body
+    EXPECT_EQ(events[1].raw_body.find("r1"), std::string::npos);
+}
+
+TEST(onvif_metadata, MarkupAndEntities) {
+    std::vector<event> events;
+    metadata_parser parser([&events](event e) { events.push_back(e); });
+    std::string doc =
+        "<?xml version='1.0'?><!-- <wsnt:NotificationMessage> -->"
+        "<MetadataStream><NotificationMessage>"
+        "<Topic>\n  tns1:A/<![CDATA[B&C]]>/D&amp;E  \n</Topic>"
+        "<Message><Message UtcTime = '2021-05-11T09:24:47Z' "
+        "Note=\"a>b\" PropertyOperation='Initialized'>"
+        "<Data><SimpleItem Value=\"&lt;&#x41;&#66;&quot;&gt;\" "
+        "Name='x'></SimpleItem></Data>"
+        "</Message></Message></NotificationMessage></MetadataStream>";
+
+    for (size_t split = 0; split <= doc.size(); split++) {
+        events.clear();
+        parser.feed(doc.data(), split);
+        parser.feed(doc.data() + split, doc.size() - split);
+
+        ASSERT_EQ(events.size(), 1) << "split at " << split;
+        EXPECT_EQ(events[0].topic, "tns1:A/B&C/D&E");
+        EXPECT_EQ(events[0].prop_op, "Initialized");
+        EXPECT_EQ(events[0].time,
+                  utils::time::from_iso("2021-05-11T09:24:47Z"));
+        ASSERT_EQ(events[0].data_items.size(), 1);
+        EXPECT_EQ(events[0].data_items[0].name, "x");
+        EXPECT_EQ(events[0].data_items[0].value, "<AB\">");
+    }
+    EXPECT_EQ(parser.errors(), 0);
+}
+
+TEST(onvif_metadata, Resynchronizes) {
+    std::vector<event> events;
+    metadata_parser parser([&events](event e) { events.push_back(e); });
+    // Truncated document, the packet with its end was lost
+    std::string truncated = DOCUMENT.substr(0, DOCUMENT.size() / 2);
+    std::string garbage = "</tt:Data></x></tt:MetadataStream>";
+
+    parser.feed(truncated.data(), truncated.size());
+    parser.feed(DOCUMENT.data(), DOCUMENT.size());
+    ASSERT_EQ(events.size(), 1);
+    expect_day_night(events[0]);
+    EXPECT_EQ(parser.errors(), 1);
+
+    // Stray end tags are skipped
+    parser.feed(garbage.data(), garbage.size());
+    parser.feed(DOCUMENT.data(), DOCUMENT.size());
+    ASSERT_EQ(events.size(), 2);
+
+    // Mismatched end tag drops the document
+    std::string broken = "<a><b></a>";
+    parser.feed(broken.data(), broken.size());
+    parser.feed(DOCUMENT.data(), DOCUMENT.size());
+    ASSERT_EQ(events.size(), 3);
+    EXPECT_EQ(parser.errors(), 2);
+
+    // Unterminated markup is dropped once too long
+    std::string endless(metadata_parser::MAX_TOKEN_SIZE + 1, 'a');
+    endless[0] = '<';
+    parser.feed(endless.data(), endless.size());
+    EXPECT_EQ(parser.errors(), 3);
+    parser.feed(DOCUMENT.data(), DOCUMENT.size());
+    ASSERT_EQ(events.size(), 4);
+    expect_day_night(events[3]);
+}
+
+TEST(topic_trie, Match) {
+    topic_trie<std::string> topics;
+
+    EXPECT_TRUE(topics.empty());
+    EXPECT_EQ(topics.match("tns1:A"), nullptr);
+
+    EXPECT_TRUE(topics.insert("tns1:RuleEngine/CellMotionDetector/Motion",
+                              "motion"));
+    EXPECT_TRUE(topics.insert("tns1:Device/tnsaxis:IO/*", "io"));
+    EXPECT_TRUE(topics.insert("tns1:Device/tnsaxis:IO/Port", "port"));
+    EXPECT_TRUE(topics.insert("tns1:VideoSource//.", "video"));
+    EXPECT_TRUE(topics.insert("tns1:VideoSource/tnsaxis:Tampering//.",
+                              "tampering"));
+    EXPECT_FALSE(topics.insert("tns1:Device/tnsaxis:IO/Port", "ignored"));
+    EXPECT_FALSE(topics.empty());
+
+    auto match = [&topics](const std::string& topic) {
+        const std::string* v = topics.match(topic);
+        return v ? *v : std::string("none");
+    };
+
+    EXPECT_EQ(match("tns1:RuleEngine/CellMotionDetector/Motion"), "motion");
+    EXPECT_EQ(match("tns1:RuleEngine/CellMotionDetector"), "none");
+    EXPECT_EQ(match("tns1:RuleEngine/CellMotionDetector/Motion/X"), "none");
+    // Exact segment over '*'
+    EXPECT_EQ(match("tns1:Device/tnsaxis:IO/Port"), "port");
+    EXPECT_EQ(match("tns1:Device/tnsaxis:IO/VirtualInput"), "io");
+    EXPECT_EQ(match("tns1:Device/tnsaxis:IO"), "none");
+    // Deepest descendants match
+    EXPECT_EQ(match("tns1:VideoSource"), "video");
+    EXPECT_EQ(match("tns1:VideoSource/tnsaxis:DayNightVision"), "video");
+    EXPECT_EQ(match("tns1:VideoSource/tnsaxis:Tampering"), "tampering");
+    EXPECT_EQ(match("tns1:VideoSource/tnsaxis:Tampering/Ch1"), "tampering");
+    EXPECT_EQ(match(""), "none");
+
+    // "*" is the last resort
+    EXPECT_TRUE(topics.insert("*", "all"));
+    EXPECT_EQ(match("tns1:RuleEngine/CellMotionDetector"), "all");
+    EXPECT_EQ(match("tns1:RuleEngine/CellMotionDetector/Motion"), "motion");
+
+    topics.clear();
+    EXPECT_TRUE(topics.empty());
+    EXPECT_EQ(match("tns1:RuleEngine/CellMotionDetector/Motion"), "none");
+}
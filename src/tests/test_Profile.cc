@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <utils/profile.h>
+
+using namespace vxg::cloud::agent;
+
+TEST(profile, Counters) {
+    const int threads = 8;
+    const int iterations = 100000;
+    profile::counter<int> events;
+    profile::counter<size_t> uploading;
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            for (int i = 0; i < iterations; i++) {
+                events++;
+                uploading++;
+                uploading--;
+                if (i % 2)
+                    events += 2;
+            }
+        });
+    }
+    for (auto& w : workers)
+        w.join();
+
+    EXPECT_EQ(events, threads * iterations * 2);
+    EXPECT_EQ(uploading, 0);
+
+    // Assignment from another thread keeps the other shards increments
+    std::thread([&]() { events = 5; }).join();
+    EXPECT_EQ(events, 5);
+    events++;
+    EXPECT_EQ(events, 6);
+}
+
+TEST(profile, StatsJson) {
+    auto& stats = profile::global::instance().stats;
+    int motion_events = stats.motion_events;
+
+    stats.motion_events++;
+    stats.snapshot_last_upload_speed_KBps = 12.5;
+
+    nlohmann::json j = stats;
+    EXPECT_EQ(j["motion_events"], motion_events + 1);
+    EXPECT_EQ(j["snapshot_last_upload_speed_KBps"], 12.5);
+    EXPECT_EQ(stats.uptime(), stats.load().uptime);
+
+    stats.motion_events--;
+    stats.snapshot_last_upload_speed_KBps = 0;
+}
+
+TEST(profile, SnapshotStress) {
+    const int readers = 6;
+    const int updates = 2000;
+    auto& stats = profile::global::instance().stats;
+    int reconnects = stats.cloud_reconnects;
+    std::atomic<bool> done {false};
+    std::atomic<int> torn {0};
+    std::vector<std::thread> workers;
+
+    profile::global::update([](profile::description& settings) {
+        settings.default_snapshot_width = 0;
+        settings.default_snapshot_height = 0;
+    });
+
+    for (int r = 0; r < readers; r++) {
+        workers.emplace_back([&]() {
+            int last = 0;
+
+            while (!done.load()) {
+                auto settings = profile::global::snapshot();
+
+                // Both fields are changed by the same update, a snapshot
+                // never has one without the other
+                if (settings->default_snapshot_width !=
+                        settings->default_snapshot_height ||
+                    settings->default_snapshot_width < last)
+                    torn++;
+                last = settings->default_snapshot_width;
+                stats.cloud_reconnects++;
+            }
+        });
+    }
+
+    for (int i = 1; i <= updates; i++) {
+        profile::global::update([i](profile::description& settings) {
+            settings.default_snapshot_width = i;
+            settings.default_snapshot_height = i;
+        });
+    }
+    done = true;
+    for (auto& w : workers)
+        w.join();
+
+    EXPECT_EQ(torn, 0);
+    EXPECT_EQ(profile::global::snapshot()->default_snapshot_width, updates);
+    EXPECT_GT(stats.cloud_reconnects, reconnects);
+
+    stats.cloud_reconnects = reconnects;
+    profile::global::update([](profile::description& settings) {
+        settings.default_snapshot_width = 800;
+        settings.default_snapshot_height = 600;
+    });
+}
+
+TEST(profile, PublishInstanceChanges) {
+    auto& settings = profile::global::instance();
+    size_t max_queued_events = settings.max_queued_events;
+
+    profile::global::publish();
+    settings.max_queued_events = max_queued_events + 1;
+    EXPECT_EQ(profile::global::snapshot()->max_queued_events,
+              max_queued_events);
+    profile::global::publish();
+    EXPECT_EQ(profile::global::snapshot()->max_queued_events,
+              max_queued_events + 1);
+
+    settings.max_queued_events = max_queued_events;
+    profile::global::publish();
+}
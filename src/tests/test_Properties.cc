@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
+#include <sys/stat.h>
 #include <utils/properties.h>
 
+#include <thread>
+
 using namespace ::testing;
 using namespace std;
 using namespace vxg;
@@ -14,7 +17,19 @@ protected:
         properties::reset(random_file_);
     }
 
-    virtual void TearDown() { unlink(random_file_.c_str()); }
+    virtual void TearDown() {
+        properties::flush();
+        unlink(random_file_.c_str());
+        unlink((random_file_ + ".default").c_str());
+    }
+
+    nlohmann::json file_json() {
+        nlohmann::json j;
+        std::ifstream f(random_file_);
+
+        f >> j;
+        return j;
+    }
 
 public:
     std::string random_file_;
@@ -49,4 +64,84 @@ TEST_F(TestProperties, SetEmpty) {
     EXPECT_TRUE(testEmpty.empty());
     EXPECT_FALSE(testNonEmpty.empty());
     EXPECT_STREQ(testNonEmpty.c_str(), "TEST");
-}
\ No newline at end of file
+}
+
+TEST_F(TestProperties, WriteBehind) {
+    properties::set("TEST_FIELD", "TEST1");
+    properties::set("TEST_FIELD", "TEST2");
+    EXPECT_EQ(properties::get("TEST_FIELD"), "TEST2");
+
+    // Coalesced sets are stored by the background thread
+    for (int i = 0; i < 100 && !file_json().contains("TEST_FIELD"); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(file_json()["TEST_FIELD"], "TEST2");
+
+    properties::set("TEST_FIELD", "TEST3");
+    properties::flush();
+    EXPECT_EQ(file_json()["TEST_FIELD"], "TEST3");
+}
+
+TEST_F(TestProperties, ExternalReload) {
+    properties::set("LOCAL_FIELD", "LOCAL");
+    properties::flush();
+
+    nlohmann::json j = file_json();
+    j["EXTERNAL_FIELD"] = "EXTERNAL";
+    {
+        std::ofstream f(random_file_ + ".edit");
+        f << j;
+    }
+    rename((random_file_ + ".edit").c_str(), random_file_.c_str());
+
+    for (int i = 0; i < 100 && properties::get("EXTERNAL_FIELD").empty();
+         i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(properties::get("EXTERNAL_FIELD"), "EXTERNAL");
+    EXPECT_EQ(properties::get("LOCAL_FIELD"), "LOCAL");
+}
+
+TEST_F(TestProperties, StoreRetry) {
+    std::string tmp = random_file_ + ".tmp";
+    auto retry_delay = properties::store_retry_delay_;
+
+    properties::store_retry_delay_ = std::chrono::milliseconds(50);
+    // The temporary file can't be created in place of the directory
+    ASSERT_EQ(mkdir(tmp.c_str(), 0755), 0);
+    properties::set("TEST_FIELD", "TEST");
+    properties::flush();
+    EXPECT_FALSE(file_json().contains("TEST_FIELD"));
+
+    // Stored by the retry without the next set()
+    rmdir(tmp.c_str());
+    for (int i = 0; i < 100 && !file_json().contains("TEST_FIELD"); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(file_json()["TEST_FIELD"], "TEST");
+
+    properties::store_retry_delay_ = retry_delay;
+}
+
+TEST_F(TestProperties, ConcurrentSet) {
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < 100; i++) {
+                std::string key = "T" + std::to_string(t) + "_" +
+                                  std::to_string(i);
+                properties::set(key, key);
+                EXPECT_EQ(properties::get(key), key);
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+    properties::flush();
+
+    nlohmann::json j = file_json();
+    for (int t = 0; t < 4; t++)
+        for (int i = 0; i < 100; i++) {
+            std::string key = "T" + std::to_string(t) + "_" +
+                              std::to_string(i);
+            EXPECT_EQ(j[key], key);
+        }
+}
@@ -0,0 +1,311 @@
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+
+#include <platform/rest-api.h>
+
+using namespace ::testing;
+using namespace vxg::cloud;
+using namespace vxg::cloud::rest_api;
+
+//! Loopback HTTP/1.0 server emulating the camera's param.cgi, answers
+//! action=list with the k='v' lines of the requested keys and
+//! action=update by updating the params.
+class stub_cgi_server {
+    int fd_ {-1};
+    std::thread thread_;
+    std::atomic<bool> running_ {false};
+    std::vector<std::thread> clients_;
+    std::mutex lock_;
+    kv_list params_;
+
+    static std::string __decode_query(const std::string& req_line) {
+        auto start = req_line.find('?');
+        auto end = req_line.find(' ', req_line.find(' ') + 1);
+
+        if (start == std::string::npos || end == std::string::npos ||
+            start > end)
+            return "";
+        return req_line.substr(start + 1, end - start - 1);
+    }
+
+    std::string __handle(const std::string& query) {
+        std::string body;
+        std::istringstream args(query);
+        std::string arg, action;
+        kv_list update;
+
+        while (std::getline(args, arg, '&')) {
+            if (arg.empty())
+                continue;
+
+            auto eq = arg.find('=');
+            std::string k = arg.substr(0, eq);
+            std::string v = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+            if (k == "action") {
+                action = v;
+            } else if (action == "list") {
+                std::lock_guard<std::mutex> lock(lock_);
+                if (params_.count(k))
+                    body += k + "='" + params_[k] + "'\r\n";
+            } else if (action == "update") {
+                update[k] = v;
+            }
+        }
+
+        if (action == "update") {
+            std::lock_guard<std::mutex> lock(lock_);
+            for (auto& kv : update)
+                params_[kv.first] = kv.second;
+            updates++;
+            body = "OK\r\n";
+        }
+
+        return body;
+    }
+
+    void __serve(int client) {
+        std::string req;
+        char buf[4096];
+        ssize_t n;
+
+        while (req.find("\r\n\r\n") == std::string::npos &&
+               (n = recv(client, buf, sizeof(buf), 0)) > 0)
+            req.append(buf, n);
+
+        int now = ++in_flight;
+        int max = max_in_flight.load();
+        while (now > max && !max_in_flight.compare_exchange_weak(max, now)) {
+        }
+        requests++;
+
+        // Slow camera
+        std::this_thread::sleep_for(delay);
+
+        std::string line = req.substr(0, req.find('\r'));
+        std::string body = __handle(__decode_query(line));
+        std::string resp =
+            "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " +
+            std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" +
+            body;
+
+        in_flight--;
+        send(client, resp.data(), resp.size(), MSG_NOSIGNAL);
+        close(client);
+    }
+
+public:
+    std::atomic<int> requests {0};
+    std::atomic<int> updates {0};
+    std::atomic<int> in_flight {0};
+    std::atomic<int> max_in_flight {0};
+    std::chrono::milliseconds delay {50};
+    int port {0};
+
+    bool start() {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        int one = 1;
+
+        fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd_ < 0)
+            return false;
+        setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd_, (struct sockaddr*)&addr, sizeof(addr)) ||
+            listen(fd_, 64) ||
+            getsockname(fd_, (struct sockaddr*)&addr, &len))
+            return false;
+        port = ntohs(addr.sin_port);
+
+        running_ = true;
+        thread_ = std::thread([this]() {
+            int client;
+
+            while (running_ && (client = accept(fd_, nullptr, nullptr)) >= 0)
+                clients_.emplace_back(&stub_cgi_server::__serve, this,
+                                      client);
+        });
+
+        return true;
+    }
+
+    void stop() {
+        running_ = false;
+        shutdown(fd_, SHUT_RDWR);
+        close(fd_);
+        if (thread_.joinable())
+            thread_.join();
+        for (auto& t : clients_)
+            t.join();
+    }
+
+    void set(const std::string& k, const std::string& v) {
+        std::lock_guard<std::mutex> lock(lock_);
+        params_[k] = v;
+    }
+
+    std::string param(const std::string& k) {
+        std::lock_guard<std::mutex> lock(lock_);
+        return params_[k];
+    }
+};
+
+class rest_api_test : public Test {
+protected:
+    stub_cgi_server server_;
+    std::unique_ptr<rest_api::http> api_;
+    k_list keys_;
+
+    virtual void SetUp() {
+        ASSERT_TRUE(server_.start());
+        for (int i = 0; i < 40; i++) {
+            keys_.push_back("root.Image.I0.Param" + std::to_string(i));
+            server_.set(keys_.back(), "value " + std::to_string(i));
+        }
+
+        api_.reset(new rest_api::http("http://127.0.0.1:" +
+                                      std::to_string(server_.port)));
+    }
+
+    virtual void TearDown() {
+        api_.reset();
+        server_.stop();
+    }
+};
+
+TEST(rest_api, KvTokenizer) {
+    std::string data =
+        "a='1'\r\nno separator\r\nb=x='y'\r\n\r\nc=\nd='it''s'\r\n=e\nf=last";
+    kv_tokenizer tokenizer(data.data(), data.size());
+    kv_token token;
+    std::string v;
+    std::vector<std::pair<std::string, std::string>> tokens;
+
+    while (tokenizer.next(token)) {
+        kv_tokenizer::value(token, v);
+        tokens.emplace_back(std::string(token.key, token.key_len), v);
+    }
+
+    ASSERT_EQ(tokens.size(), 6);
+    EXPECT_EQ(tokens[0], std::make_pair(std::string("a"), std::string("1")));
+    EXPECT_EQ(tokens[1], std::make_pair(std::string("b"), std::string("x=y")));
+    EXPECT_EQ(tokens[2], std::make_pair(std::string("c"), std::string("")));
+    EXPECT_EQ(tokens[3], std::make_pair(std::string("d"), std::string("its")));
+    EXPECT_EQ(tokens[4], std::make_pair(std::string(""), std::string("e")));
+    EXPECT_EQ(tokens[5], std::make_pair(std::string("f"), std::string("last")));
+
+    // Tokens point to the data
+    tokenizer = kv_tokenizer(data.data(), data.size());
+    ASSERT_TRUE(tokenizer.next(token));
+    EXPECT_EQ(token.key, data.data());
+    EXPECT_EQ(std::string(token.value, token.value_len), "1");
+
+    // Parser keeps the last value of the repeated key
+    kv_parser parser;
+    auto kv = parser.process("k='1'\nk='2'\n");
+    ASSERT_EQ(kv.size(), 1);
+    EXPECT_EQ(kv["k"], "2");
+}
+
+TEST_F(rest_api_test, BatchGet) {
+    const std::string path = "/axis-cgi/param.cgi?action=list&";
+
+    // All keys in one request by default
+    auto kv = api_->get(path, "GET", keys_);
+    ASSERT_EQ(kv.size(), keys_.size());
+    EXPECT_EQ(kv["root.Image.I0.Param7"], "value 7");
+    EXPECT_EQ(server_.requests.load(), 1);
+
+    // Split into concurrent requests
+    api_->set_max_keys_per_request(5);
+    api_->set_max_concurrent_requests(4);
+    kv = api_->get(path, "GET", keys_);
+    ASSERT_EQ(kv.size(), keys_.size());
+    for (size_t i = 0; i < keys_.size(); i++)
+        EXPECT_EQ(kv[keys_[i]], "value " + std::to_string(i));
+    EXPECT_EQ(server_.requests.load(), 9);
+    EXPECT_GT(server_.max_in_flight.load(), 1);
+    EXPECT_LE(server_.max_in_flight.load(), 4);
+
+    // Unknown keys are missing
+    kv = api_->get(path, "GET", k_list {"root.Unknown", keys_[0]});
+    EXPECT_EQ(kv.size(), 1);
+    EXPECT_EQ(api_->get(path, "GET", keys_[1]), "value 1");
+}
+
+TEST_F(rest_api_test, Cache) {
+    const std::string path = "/axis-cgi/param.cgi?action=list&";
+    const std::string update = "/axis-cgi/param.cgi?action=update&";
+
+    api_->set_cache_ttl(std::chrono::seconds(60));
+    EXPECT_EQ(api_->get(path, "GET", keys_).size(), keys_.size());
+    EXPECT_EQ(server_.requests.load(), 1);
+
+    // Cached
+    EXPECT_EQ(api_->get(path, "GET", keys_).size(), keys_.size());
+    EXPECT_EQ(api_->get(path, "GET", keys_[3]), "value 3");
+    EXPECT_EQ(server_.requests.load(), 1);
+
+    // Set invalidates the key, only it is requested
+    api_->set(update, "GET", keys_[3], "new");
+    EXPECT_EQ(server_.param(keys_[3]), "new");
+    EXPECT_EQ(server_.requests.load(), 2);
+    auto kv = api_->get(path, "GET", keys_);
+    EXPECT_EQ(kv[keys_[3]], "new");
+    EXPECT_EQ(kv[keys_[4]], "value 4");
+    EXPECT_EQ(server_.requests.load(), 3);
+
+    kv_list changes {{keys_[4], "a"}, {keys_[5], "b"}};
+    api_->set(update, "GET", changes);
+    kv = api_->get(path, "GET", keys_);
+    EXPECT_EQ(kv[keys_[4]], "a");
+    EXPECT_EQ(kv[keys_[5]], "b");
+    EXPECT_EQ(server_.requests.load(), 5);
+
+    // Changed by someone else, stale until the TTL expiration
+    server_.set(keys_[0], "external");
+    EXPECT_EQ(api_->get(path, "GET", keys_[0]), "value 0");
+    api_->invalidate_cache();
+    EXPECT_EQ(api_->get(path, "GET", keys_[0]), "external");
+    EXPECT_EQ(server_.requests.load(), 6);
+
+    // Short TTL applies to the cached values too
+    api_->set_cache_ttl(std::chrono::milliseconds(300));
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    EXPECT_EQ(api_->get(path, "GET", keys_[0]), "external");
+    EXPECT_EQ(server_.requests.load(), 7);
+    server_.set(keys_[0], "expired");
+    EXPECT_EQ(api_->get(path, "GET", keys_[0]), "external");
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    EXPECT_EQ(api_->get(path, "GET", keys_[0]), "expired");
+    EXPECT_EQ(server_.requests.load(), 8);
+}
+
+TEST_F(rest_api_test, BatchSet) {
+    const std::string update = "/axis-cgi/param.cgi?action=update&";
+    kv_list changes;
+
+    for (int i = 0; i < 20; i++)
+        changes[keys_[i]] = "set" + std::to_string(i);
+
+    api_->set_max_keys_per_request(3);
+    api_->set_max_concurrent_requests(2);
+    api_->set(update, "GET", changes);
+    EXPECT_EQ(server_.requests.load(), 7);
+    EXPECT_EQ(server_.updates.load(), 7);
+    EXPECT_LE(server_.max_in_flight.load(), 2);
+    for (int i = 0; i < 20; i++)
+        EXPECT_EQ(server_.param(keys_[i]), "set" + std::to_string(i));
+    EXPECT_EQ(server_.param(keys_[20]), "value 20");
+}
@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+#include <time.h>
+
+#include <random>
+#include <regex>
+
+#include <utils/utils.h>
+
+namespace iso = vxg::cloud::utils::time;
+using cloud_time = vxg::cloud::time;
+
+namespace {
+//! strftime() based reference formatting with microseconds
+std::string ref_format(cloud_time t, const char* fmt, bool zulu) {
+    using namespace std::chrono;
+    auto us = time_point_cast<microseconds>(t);
+    if (us > t)
+        us -= microseconds(1);
+    auto secs = time_point_cast<seconds>(us);
+    if (secs > us)
+        secs -= seconds(1);
+    time_t tt = secs.time_since_epoch().count();
+    struct tm tm;
+    char buf[64];
+
+    gmtime_r(&tt, &tm);
+    size_t len = strftime(buf, sizeof(buf), fmt, &tm);
+    snprintf(buf + len, sizeof(buf) - len, ".%06lld%s",
+             static_cast<long long>((us - secs).count()), zulu ? "Z" : "");
+
+    return buf;
+}
+
+bool ref_is_iso(const std::string& s) {
+    static const std::regex r(
+        "[0-9]{4}-[0-9]{2}-[0-9]{2}T[0-9]{2}:[0-9]{2}:[0-9]{2}(.[0-9]+)*Z*");
+    return std::regex_match(s, r);
+}
+
+bool ref_is_iso_packed(const std::string& s) {
+    static const std::regex r("([0-9]{8}T[0-9]{6})(.[0-9]+)*");
+    return std::regex_match(s, r);
+}
+
+std::string mutate(std::string s, std::mt19937& rng) {
+    static const char chars[] = "0123456789-:T.Z x\n";
+    int mutations = rng() % 4;
+
+    for (int i = 0; i < mutations; i++) {
+        char c = chars[rng() % (sizeof(chars) - 1)];
+        size_t pos = s.empty() ? 0 : rng() % (s.size() + 1);
+
+        switch (rng() % 3) {
+            case 0:
+                s.insert(pos, 1, c);
+                break;
+            case 1:
+                if (pos < s.size())
+                    s.erase(pos, 1);
+                break;
+            default:
+                if (pos < s.size())
+                    s[pos] = c;
+        }
+    }
+
+    return s;
+}
+}  // namespace
+
+TEST(iso_time, RoundTrip) {
+    std::mt19937_64 rng(1);
+    // 1900 - 2200
+    std::uniform_int_distribution<int64_t> dist(-2208988800LL * 1000000000,
+                                                7258118400LL * 1000000000);
+
+    for (int i = 0; i < 100000; i++) {
+        cloud_time t {std::chrono::nanoseconds(dist(rng))};
+        char buf[iso::ISO_LEN + 1];
+        cloud_time parsed;
+
+        size_t len = iso::format_iso(t, buf, sizeof(buf));
+        ASSERT_EQ(std::string(buf, len), ref_format(t, "%FT%T", true));
+        ASSERT_TRUE(iso::parse_iso(buf, len, parsed));
+        // Microseconds precision, truncated
+        ASSERT_LE(parsed, t);
+        ASSERT_GT(parsed + std::chrono::microseconds(1), t);
+        ASSERT_EQ(iso::to_iso(parsed), buf);
+        ASSERT_EQ(iso::from_iso(buf), parsed);
+
+        len = iso::format_iso_packed(t, buf, sizeof(buf));
+        ASSERT_EQ(std::string(buf, len),
+                  ref_format(t, "%Y%m%dT%H%M%S", false));
+        ASSERT_TRUE(iso::parse_iso_packed(buf, len, parsed));
+        ASSERT_EQ(iso::to_iso_packed(parsed), buf);
+        ASSERT_EQ(iso::from_iso_packed(buf), parsed);
+
+        ASSERT_EQ(iso::to_iso2(t), ref_format(t, "%FT%T", false));
+        ASSERT_EQ(iso::from_iso2(iso::to_iso2(t)), parsed);
+    }
+}
+
+TEST(iso_time, Parse) {
+    cloud_time t;
+
+    EXPECT_EQ(iso::from_iso("2021-11-17T10:44:00.409714Z"),
+              std::chrono::system_clock::from_time_t(1637145840) +
+                  std::chrono::microseconds(409714));
+    EXPECT_EQ(iso::from_iso("2021-11-17T10:44:00Z"),
+              std::chrono::system_clock::from_time_t(1637145840));
+    EXPECT_EQ(iso::from_iso_packed("20211117T104400"),
+              std::chrono::system_clock::from_time_t(1637145840));
+    // Nanoseconds precision, the rest is ignored
+    EXPECT_EQ(iso::from_iso("2021-11-17T10:44:00.1234567891234Z"),
+              std::chrono::system_clock::from_time_t(1637145840) +
+                  std::chrono::nanoseconds(123456789));
+    // Leap day
+    EXPECT_TRUE(iso::iso_time_valid("2020-02-29T00:00:00Z"));
+
+    for (auto invalid : {"", "2021-11-17T10:44:00", "2021-11-17T10:44:00.5",
+                         "2021-02-29T00:00:00Z", "2021-13-01T00:00:00Z",
+                         "2021-00-01T00:00:00Z", "2021-04-31T00:00:00Z",
+                         "2021-11-17T24:00:00Z", "2021-11-17T10:60:00Z",
+                         "2021-11-17T10:44:60Z", "2021-11-17 10:44:00Z",
+                         "2021/11/17T10:44:00Z", "20211117T104400Z"}) {
+        EXPECT_FALSE(iso::iso_time_valid(invalid)) << invalid;
+        EXPECT_FALSE(iso::parse_iso(invalid, strlen(invalid), t)) << invalid;
+    }
+
+    EXPECT_TRUE(iso::parse_iso("2021-11-17T10:44:00", 19, t, false));
+    EXPECT_FALSE(iso::parse_iso_packed("20211117T1044", 13, t));
+    EXPECT_FALSE(iso::parse_iso_packed("20211117T104461", 15, t));
+    EXPECT_EQ(iso::from_iso("garbage"),
+              std::chrono::system_clock::from_time_t(0));
+}
+
+TEST(iso_time, FormatBufferSize) {
+    char buf[iso::ISO_LEN + 1];
+    cloud_time t = std::chrono::system_clock::from_time_t(1637145840);
+
+    EXPECT_EQ(iso::format_iso(t, buf, iso::ISO_LEN), 0);
+    EXPECT_EQ(iso::format_iso(t, buf, sizeof(buf)), iso::ISO_LEN);
+    EXPECT_STREQ(buf, "2021-11-17T10:44:00.000000Z");
+    EXPECT_EQ(iso::format_iso(t, buf, iso::ISO_LEN, false),
+              iso::ISO_LEN - 1);
+    EXPECT_EQ(iso::format_iso_packed(t, buf, iso::ISO_PACKED_LEN), 0);
+    EXPECT_EQ(iso::format_iso_packed(t, buf, sizeof(buf)),
+              iso::ISO_PACKED_LEN);
+    EXPECT_STREQ(buf, "20211117T104400.000000");
+}
+
+TEST(iso_time, ValidateLikeRegex) {
+    std::mt19937 rng(1);
+    const std::string iso[] = {"2021-09-15T09:51:20.000000Z",
+                               "2021-09-15T09:51:20Z",
+                               "2021-09-15T09:51:20",
+                               "2021-09-15T09:51:20.1.2ZZ"};
+    const std::string packed[] = {"20210915T095120.000000", "20210915T095120",
+                                  "20210915T095120.1x2"};
+
+    for (int i = 0; i < 20000; i++) {
+        std::string s = mutate(iso[i % 4], rng);
+        ASSERT_EQ(iso::is_iso(s), ref_is_iso(s)) << s;
+
+        s = mutate(packed[i % 3], rng);
+        ASSERT_EQ(iso::is_iso_packed(s), ref_is_iso_packed(s)) << s;
+    }
+}
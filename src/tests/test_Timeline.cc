@@ -2,6 +2,8 @@
 
 #include <agent/timeline.h>
 
+#include <thread>
+
 using namespace ::testing;
 using namespace std;
 using namespace vxg::cloud;
@@ -132,4 +134,161 @@ TEST_F(TestTimeline, Timeline_LoadVFSStoreCloud) {
 
     EXPECT_TRUE(ret_load1);
     EXPECT_TRUE(ret_store1);
-}
\ No newline at end of file
+}
+
+//! Fake Cloud storage, counts list requests
+class fake_cloud_storage : public timed_storage {
+public:
+    std::vector<period> objects;
+    size_t list_calls {0};
+
+    fake_cloud_storage() {}
+    fake_cloud_storage(proto::access_token::ptr,
+                       transport::libwebsockets::http::ptr) {}
+
+    virtual std::vector<item_ptr> list(vxg::cloud::time start,
+                                       vxg::cloud::time stop) override {
+        std::vector<item_ptr> result;
+
+        list_calls++;
+        for (auto& o : objects) {
+            if (o.intersects({start, stop}))
+                result.push_back(std::make_shared<item>(o));
+        }
+
+        return result;
+    }
+    virtual bool load(item_ptr) override { return false; }
+    virtual bool store(item_ptr i) override {
+        objects.push_back({i->begin, i->end});
+        return true;
+    }
+    virtual void erase(item_ptr) override {}
+};
+
+class TimelineCache : public Test {
+protected:
+    virtual void SetUp() {
+        now = utils::time::now();
+        storage = std::make_shared<fake_cloud_storage>();
+        cached = std::make_shared<timeline<fake_cloud_storage>>(storage);
+        cached->set_cache_ttl(std::chrono::hours(1));
+    }
+
+public:
+    vxg::cloud::time now;
+    std::shared_ptr<fake_cloud_storage> storage;
+    std::shared_ptr<timeline<fake_cloud_storage>> cached;
+
+    period at(int begin_sec, int end_sec) {
+        return {now + std::chrono::seconds(begin_sec),
+                now + std::chrono::seconds(end_sec)};
+    }
+};
+
+TEST_F(TimelineCache, RepeatedRequestsServedFromCache) {
+    storage->objects = {at(0, 10), at(10, 20), at(30, 40)};
+
+    auto s1 = cached->slices(at(0, 60).begin, at(0, 60).end);
+    auto s2 = cached->slices(at(0, 60).begin, at(0, 60).end);
+    auto s3 = cached->slices(at(5, 35).begin, at(5, 35).end);
+
+    EXPECT_EQ(storage->list_calls, 1);
+    EXPECT_EQ(cached->cache_hits(), 2);
+    ASSERT_EQ(s1.size(), 2);
+    EXPECT_EQ(s1[0].begin, at(0, 20).begin);
+    EXPECT_EQ(s1[0].end, at(0, 20).end);
+    EXPECT_EQ(s1[1].begin, at(30, 40).begin);
+    ASSERT_EQ(s2.size(), 2);
+    ASSERT_EQ(s3.size(), 2);
+    EXPECT_EQ(s3[0].end, at(0, 20).end);
+}
+
+TEST_F(TimelineCache, SlidingWindowMergesKnownPeriods) {
+    storage->objects = {at(0, 100)};
+
+    // Slice extends beyond the requested window, next windows inside the
+    // slice are known
+    for (int i = 0; i < 10; i++)
+        cached->slices(at(i * 10, i * 10 + 10).begin,
+                       at(i * 10, i * 10 + 10).end);
+    EXPECT_EQ(storage->list_calls, 1);
+
+    // Empty windows are known too after the first request
+    cached->slices(at(100, 110).begin, at(100, 110).end);
+    cached->slices(at(100, 110).begin, at(100, 110).end);
+    cached->slices(at(105, 110).begin, at(105, 110).end);
+    EXPECT_EQ(storage->list_calls, 2);
+    EXPECT_TRUE(cached->slices(at(100, 110).begin, at(100, 110).end).empty());
+}
+
+TEST_F(TimelineCache, OptimisticUpdate) {
+    auto s1 = cached->slices(at(0, 15).begin, at(0, 15).end);
+    EXPECT_TRUE(s1.empty());
+
+    // Uploaded chunks are reported to the timeline, storage is not requested
+    // anymore for the uploaded periods
+    for (int i = 0; i < 5; i++) {
+        auto p = at(i * 15, i * 15 + 15);
+        storage->store(std::make_shared<timed_storage::item>(p));
+        cached->add(p);
+    }
+
+    auto s2 = cached->slices(at(0, 75).begin, at(0, 75).end);
+    EXPECT_EQ(storage->list_calls, 1);
+    ASSERT_EQ(s2.size(), 1);
+    EXPECT_EQ(s2[0].begin, at(0, 75).begin);
+    EXPECT_EQ(s2[0].end, at(0, 75).end);
+}
+
+TEST_F(TimelineCache, TTLInvalidation) {
+    cached->set_cache_ttl(std::chrono::milliseconds(50));
+    storage->objects = {at(0, 10)};
+
+    cached->slices(at(0, 20).begin, at(0, 20).end);
+    cached->slices(at(0, 20).begin, at(0, 20).end);
+    EXPECT_EQ(storage->list_calls, 1);
+
+    // Data appeared in the storage without the timeline
+    storage->objects.push_back(at(10, 20));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto s = cached->slices(at(0, 20).begin, at(0, 20).end);
+    EXPECT_EQ(storage->list_calls, 2);
+    ASSERT_EQ(s.size(), 1);
+    EXPECT_EQ(s[0].end, at(0, 20).end);
+}
+
+TEST_F(TimelineCache, DisabledCache) {
+    cached->set_cache_ttl(std::chrono::seconds(0));
+
+    for (int i = 0; i < 3; i++)
+        cached->slices(at(0, 20).begin, at(0, 20).end);
+
+    EXPECT_EQ(storage->list_calls, 3);
+}
+
+TEST(period_set, MergeAndRemove) {
+    auto now = utils::time::now();
+    auto at = [&](int b, int e) -> period {
+        return {now + std::chrono::seconds(b), now + std::chrono::seconds(e)};
+    };
+    period_set set;
+
+    set.add(at(10, 20));
+    set.add(at(30, 40));
+    set.add(at(0, 5));
+    EXPECT_EQ(set.size(), 3);
+
+    // Adjacent and intersecting periods merge
+    set.add(at(20, 30));
+    ASSERT_EQ(set.size(), 2);
+    EXPECT_TRUE(set.covers(at(12, 38)));
+    EXPECT_FALSE(set.covers(at(3, 12)));
+
+    set.remove(at(15, 25));
+    ASSERT_EQ(set.size(), 3);
+    EXPECT_EQ(set.periods()[1].end, at(10, 15).end);
+    EXPECT_EQ(set.periods()[2].begin, at(25, 40).begin);
+    EXPECT_EQ(set.intersecting(at(14, 26)).size(), 2);
+}
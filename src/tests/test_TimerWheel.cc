@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+#include <net/timer-wheel.h>
+
+using namespace vxg::cloud::transport;
+
+namespace {
+struct test_timer : public timer_wheel::node {
+    size_t id {0};
+    uint64_t fired {0};
+};
+}  // namespace
+
+TEST(timer_wheel, ExpireInOrder) {
+    timer_wheel wheel(1000);
+    std::vector<test_timer> timers(5);
+    std::vector<size_t> order;
+    uint64_t delays[] = {50, 1, 5000, 64, 300000};
+
+    for (size_t i = 0; i < timers.size(); i++) {
+        timers[i].id = i;
+        wheel.add(&timers[i], 1000 + delays[i]);
+    }
+    EXPECT_EQ(wheel.size(), 5);
+
+    uint64_t tick = 0;
+    while (wheel.next_tick(tick)) {
+        wheel.advance(tick, [&](timer_wheel::node* n) {
+            auto t = static_cast<test_timer*>(n);
+            t->fired = wheel.now();
+            order.push_back(t->id);
+        });
+    }
+
+    EXPECT_EQ(order, std::vector<size_t>({1, 0, 3, 2, 4}));
+    for (size_t i = 0; i < timers.size(); i++)
+        EXPECT_EQ(timers[i].fired, 1000 + delays[i]);
+    EXPECT_TRUE(wheel.empty());
+}
+
+TEST(timer_wheel, Cancel) {
+    timer_wheel wheel(0);
+    test_timer a, b, c;
+    size_t fired = 0;
+
+    wheel.add(&a, 10);
+    wheel.add(&b, 10);
+    wheel.add(&c, 100000);
+    wheel.remove(&b);
+    wheel.remove(&c);
+    // Double removal is noop
+    wheel.remove(&c);
+
+    EXPECT_FALSE(b.linked());
+    EXPECT_EQ(wheel.size(), 1);
+
+    wheel.advance(200000, [&](timer_wheel::node* n) {
+        EXPECT_EQ(n, &a);
+        fired++;
+    });
+
+    EXPECT_EQ(fired, 1);
+    EXPECT_TRUE(wheel.empty());
+}
+
+TEST(timer_wheel, PastAndFarTimers) {
+    timer_wheel wheel(100);
+    test_timer past, far;
+    // Beyond the wheel's span of 64^4 ticks
+    uint64_t far_expires = 100 + 3 * (1ull << 24) + 7;
+    std::map<timer_wheel::node*, uint64_t> fired;
+
+    wheel.add(&past, 10);
+    wheel.add(&far, far_expires);
+
+    uint64_t tick = 0;
+    while (wheel.next_tick(tick))
+        wheel.advance(
+            tick, [&](timer_wheel::node* n) { fired[n] = wheel.now(); });
+
+    // Timer in the past expires at the next tick
+    EXPECT_EQ(fired[&past], 101);
+    EXPECT_EQ(fired[&far], far_expires);
+}
+
+TEST(timer_wheel, WakeupsOfUpperLevels) {
+    timer_wheel wheel(12345);
+    test_timer t;
+    size_t wakeups = 0;
+    uint64_t fired = 0;
+
+    wheel.add(&t, 12345 + 30000);
+
+    // Woken up only to cascade the timer down, not at every level 1 slot
+    uint64_t tick = 0;
+    while (wheel.next_tick(tick)) {
+        wakeups++;
+        wheel.advance(tick, [&](timer_wheel::node*) { fired = wheel.now(); });
+    }
+
+    EXPECT_EQ(fired, 12345 + 30000);
+    EXPECT_LE(wakeups, size_t(timer_wheel::LEVELS));
+}
+
+TEST(timer_wheel, Random) {
+    std::mt19937 rng(42);
+    timer_wheel wheel(rng());
+    uint64_t start = wheel.now();
+    std::vector<test_timer> timers(10000);
+    size_t fired = 0;
+
+    for (auto& t : timers)
+        wheel.add(&t, start + rng() % 1000000);
+    for (size_t i = 0; i < timers.size(); i += 3)
+        wheel.remove(&timers[i]);
+
+    uint64_t now = start;
+    while (!wheel.empty()) {
+        // Irregular ticks, late advancing must not skip timers
+        now += rng() % 5000;
+        wheel.advance(now, [&](timer_wheel::node* n) {
+            auto t = static_cast<test_timer*>(n);
+            EXPECT_LE(t->expires, now);
+            EXPECT_EQ(t->expires, wheel.now());
+            fired++;
+        });
+    }
+
+    EXPECT_EQ(fired, timers.size() - (timers.size() + 2) / 3);
+}
@@ -1,7 +1,10 @@
 #include <agent-proto/proto.h>
 #include <gtest/gtest.h>
+#include <utils/ring-buffer.h>
 #include <utils/utils.h>
 
+#include <thread>
+
 using namespace ::testing;
 using namespace std;
 using namespace vxg::cloud;
@@ -223,4 +226,87 @@ TEST(utils, time_to_from_iso) {
     EXPECT_STREQ(end_iso.c_str(), str_iso_end.c_str());
     EXPECT_EQ(begin, from_iso_begin);
     EXPECT_EQ(end, from_iso_end);
-}
\ No newline at end of file
+}
+
+TEST(utils, LoggingLazy) {
+    vxg::logger::logger_ptr logger = vxg::logger::instance("lazylogger");
+    int evaluated = 0;
+    auto arg = [&]() { return ++evaluated; };
+
+    vxg::logger::set_level(logger, vxg::logger::lvl_warn);
+    VXG_LOG(logger, debug, "skipped {}", arg());
+    EXPECT_EQ(evaluated, 0);
+    VXG_LOG(logger, warn, "logged {}", arg());
+    EXPECT_EQ(evaluated, 1);
+
+    vxg::logger::set_level(logger, vxg::logger::lvl_off);
+    VXG_LOG_RATE_LIMITED(logger, err, 1, 1000, "skipped {}", arg());
+    EXPECT_EQ(evaluated, 1);
+}
+
+TEST(utils, LoggingRateLimit) {
+    vxg::logger::logger_ptr logger = vxg::logger::instance("ratelogger");
+    int evaluated = 0;
+    auto arg = [&]() { return ++evaluated; };
+
+    vxg::logger::set_level(logger, vxg::logger::lvl_info);
+    for (int i = 0; i < 10; i++)
+        VXG_LOG_RATE_LIMITED(logger, info, 2, 60000, "logged {}", arg());
+    EXPECT_EQ(evaluated, 2);
+
+    vxg::log_rate_limiter limiter(3, std::chrono::milliseconds(100));
+    size_t suppressed = 0;
+    size_t allowed = 0;
+
+    for (int i = 0; i < 10; i++)
+        allowed += limiter.allow(suppressed);
+    EXPECT_EQ(allowed, 3);
+    EXPECT_EQ(suppressed, 0);
+
+    // Suppressed messages are reported with the first one of the new period
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    EXPECT_TRUE(limiter.allow(suppressed));
+    EXPECT_EQ(suppressed, 7);
+    EXPECT_TRUE(limiter.allow(suppressed));
+    EXPECT_EQ(suppressed, 0);
+}
+
+TEST(utils, RingBuffer) {
+    vxg::cloud::utils::ring_buffer ring(100);
+    std::string in;
+    std::string out;
+    size_t len;
+
+    EXPECT_EQ(ring.capacity(), 128);
+    for (int i = 0; i < 1000; i++)
+        in += static_cast<char>(i * 7);
+
+    // Uneven writes and reads wrap around the storage end many times
+    size_t written = 0;
+    while (out.size() < in.size()) {
+        written += ring.write(in.data() + written,
+                              std::min<size_t>(in.size() - written, 37));
+
+        const uint8_t* p = ring.read_ptr(len);
+        len = std::min<size_t>(len, 23);
+        out.append(reinterpret_cast<const char*>(p), len);
+        ring.consume(len);
+    }
+    EXPECT_EQ(out, in);
+    EXPECT_TRUE(ring.empty());
+
+    // Free space span ends at the storage end
+    ring.clear();
+    ring.write(in.data(), 100);
+    ring.consume(100);
+    ring.write_ptr(len);
+    EXPECT_EQ(len, 28);
+    EXPECT_EQ(ring.write(in.data(), 200), 128);
+    EXPECT_TRUE(ring.full());
+    ring.write_ptr(len);
+    EXPECT_EQ(len, 0);
+
+    char buf[200];
+    EXPECT_EQ(ring.read(buf, sizeof(buf)), 128);
+    EXPECT_EQ(std::string(buf, 128), in.substr(0, 128));
+}
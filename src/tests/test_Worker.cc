@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <net/transport.h>
+
+using namespace vxg::cloud;
+using namespace vxg::cloud::transport;
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+//! Worker without the service loop, only the rx thread is tested
+class test_worker : public worker {
+public:
+    test_worker(std::function<void(Data&)> handler) : worker(handler) {}
+    virtual ~test_worker() { term(); }
+
+    virtual bool start() override { return run(); }
+    virtual bool stop() override {
+        term();
+        return true;
+    }
+
+    virtual timed_cb_ptr schedule_timed_cb(std::function<void()> cb,
+                                           size_t ms) override {
+        return nullptr;
+    }
+    virtual void cancel_timed_cb(timed_cb_ptr t) override {}
+
+    void inject(Data d) { rx_q_.push(std::move(d)); }
+
+protected:
+    virtual void* poll_() override { return nullptr; }
+};
+}  // namespace
+
+TEST(transport_worker, Wakeup) {
+    const size_t COUNT = 100;
+    std::mutex lock;
+    std::condition_variable cond;
+    size_t handled = 0;
+
+    auto record = [&]() {
+        std::lock_guard<std::mutex> l(lock);
+        handled++;
+        cond.notify_one();
+    };
+
+    test_worker w([&](Data&) { record(); });
+    ASSERT_TRUE(w.start());
+
+    // Messages and tasks alternately, each one is enqueued to the idle worker
+    // and must wake it up, the dispatch latency is measured by bench-worker
+    for (size_t i = 0; i < COUNT; i++) {
+        std::unique_lock<std::mutex> l(lock);
+        size_t expected = handled + 1;
+
+        if (i % 2)
+            w.inject(Data(std::string("{}")));
+        else
+            w.run_on_rx_thread(record);
+
+        ASSERT_TRUE(cond.wait_for(l, std::chrono::seconds(10),
+                                  [&]() { return handled == expected; }));
+    }
+
+    w.stop();
+}
+
+TEST(transport_worker, OrderAndTerm) {
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<std::string> handled;
+    test_worker w([&](Data& d) {
+        std::lock_guard<std::mutex> l(lock);
+        handled.push_back(d);
+        cond.notify_one();
+    });
+
+    ASSERT_TRUE(w.start());
+    for (size_t i = 0; i < 100; i++)
+        w.inject(Data(std::to_string(i)));
+
+    {
+        std::unique_lock<std::mutex> l(lock);
+        ASSERT_TRUE(cond.wait_for(l, std::chrono::seconds(1),
+                                  [&]() { return handled.size() == 100; }));
+        for (size_t i = 0; i < handled.size(); i++)
+            EXPECT_EQ(handled[i], std::to_string(i));
+    }
+
+    // Idle worker is terminated promptly, not after a polling timeout
+    auto start = clock_type::now();
+    w.stop();
+    EXPECT_LT(clock_type::now() - start, std::chrono::milliseconds(100));
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+
+namespace vxg {
+namespace cloud {
+namespace utils {
+
+//! @brief Decorrelated jitter backoff.
+//!
+//! Every next delay is random in [base, previous delay * 3] capped with the
+//! cap. Delays grow exponentially on average but the clients which lost the
+//! connection at the same time don't retry in lockstep.
+class decorrelated_backoff {
+public:
+    decorrelated_backoff(std::chrono::milliseconds base,
+                         std::chrono::milliseconds cap,
+                         uint32_t seed = std::random_device {}())
+        : base_ {base}, cap_ {cap}, prev_ {base}, rng_ {seed} {}
+
+    std::chrono::milliseconds next() {
+        int64_t lo = base_.count();
+        int64_t hi = std::max(lo, static_cast<int64_t>(prev_.count() * 3));
+        std::uniform_int_distribution<int64_t> dist(lo, hi);
+
+        prev_ = std::min(cap_, std::chrono::milliseconds(dist(rng_)));
+
+        return prev_;
+    }
+
+    //! Start from the base delay, should be called on successful connection
+    void reset() { prev_ = base_; }
+
+    void set_limits(std::chrono::milliseconds base,
+                    std::chrono::milliseconds cap) {
+        base_ = base;
+        cap_ = cap;
+        prev_ = std::min(std::max(prev_, base_), cap_);
+    }
+
+private:
+    std::chrono::milliseconds base_;
+    std::chrono::milliseconds cap_;
+    std::chrono::milliseconds prev_;
+    std::mt19937 rng_;
+};
+
+}  // namespace utils
+}  // namespace cloud
+}  // namespace vxg
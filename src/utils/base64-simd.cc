@@ -0,0 +1,385 @@
+#include "base64-simd.h"
+
+#include <string.h>
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BASE64_SSSE3
+#include <tmmintrin.h>
+#elif defined(__aarch64__)
+#define BASE64_NEON
+#include <arm_neon.h>
+#endif
+
+namespace vxg {
+namespace cloud {
+namespace utils {
+namespace base64 {
+
+namespace {
+const char alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+//! Char to 6-bit value, 0xff for the chars out of the alphabet
+const uint8_t dtable[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12,
+    0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24,
+    0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+    0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff,
+};
+
+//! Scalar encoding, also encodes the tails of the vector loops
+size_t encode_scalar(const uint8_t* in, size_t len, char* out) {
+    char* o = out;
+    size_t i = 0;
+
+    for (; i + 3 <= len; i += 3) {
+        uint32_t v = in[i] << 16 | in[i + 1] << 8 | in[i + 2];
+
+        o[0] = alphabet[v >> 18];
+        o[1] = alphabet[v >> 12 & 0x3f];
+        o[2] = alphabet[v >> 6 & 0x3f];
+        o[3] = alphabet[v & 0x3f];
+        o += 4;
+    }
+
+    if (i < len) {
+        uint32_t v = in[i] << 16 | (i + 1 < len ? in[i + 1] << 8 : 0);
+
+        o[0] = alphabet[v >> 18];
+        o[1] = alphabet[v >> 12 & 0x3f];
+        o[2] = i + 1 < len ? alphabet[v >> 6 & 0x3f] : '=';
+        o[3] = '=';
+        o += 4;
+    }
+
+    return o - out;
+}
+
+//! Scalar decoding, also decodes the tails of the vector loops.
+//! @p len is a multiple of 4.
+bool decode_scalar(const char* in, size_t len, uint8_t* out, size_t& out_len) {
+    const uint8_t* s = reinterpret_cast<const uint8_t*>(in);
+    uint8_t* o = out;
+
+    for (size_t i = 0; i < len; i += 4) {
+        uint32_t a = dtable[s[i]];
+        uint32_t b = dtable[s[i + 1]];
+        uint32_t c = dtable[s[i + 2]];
+        uint32_t d = dtable[s[i + 3]];
+        size_t n = 3;
+
+        // Padding is allowed in the last quad only
+        if (i + 4 == len && s[i + 3] == '=') {
+            d = 0;
+            n = 2;
+            if (s[i + 2] == '=') {
+                c = 0;
+                n = 1;
+            }
+        }
+
+        if ((a | b | c | d) > 0x3f)
+            return false;
+
+        uint32_t v = a << 18 | b << 12 | c << 6 | d;
+        o[0] = v >> 16;
+        if (n > 1)
+            o[1] = v >> 8;
+        if (n > 2)
+            o[2] = v;
+        o += n;
+    }
+
+    out_len = o - out;
+    return true;
+}
+
+#ifdef BASE64_SSSE3
+// W. Muła, D. Lemire, "Faster Base64 Encoding and Decoding using AVX2
+// Instructions", SSE variant: 12 bytes to 16 chars per iteration
+__attribute__((target("ssse3"))) size_t encode_ssse3(const uint8_t* in,
+                                                     size_t len,
+                                                     char* out) {
+    const __m128i shuffle =
+        _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m128i shift_lut =
+        _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    char* o = out;
+    size_t i = 0;
+
+    // 16 bytes are loaded, 12 are used
+    for (; i + 16 <= len; i += 12) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+        // Split every 3 bytes into 4 6-bit indices
+        v = _mm_shuffle_epi8(v, shuffle);
+        __m128i t0 = _mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00));
+        __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+        __m128i t2 = _mm_and_si128(v, _mm_set1_epi32(0x003f03f0));
+        __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+        __m128i indices = _mm_or_si128(t1, t3);
+
+        // Map 0..25, 26..51, 52..61, 62, 63 ranges to the offsets
+        __m128i r = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        r = _mm_or_si128(r, _mm_and_si128(less, _mm_set1_epi8(13)));
+        r = _mm_add_epi8(_mm_shuffle_epi8(shift_lut, r), indices);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o), r);
+        o += 16;
+    }
+
+    return (o - out) + encode_scalar(in + i, len - i, o);
+}
+
+// 16 chars to 12 bytes per iteration, invalid chars detected by the
+// nibbles lookup
+__attribute__((target("ssse3"))) bool decode_ssse3(const char* in,
+                                                   size_t len,
+                                                   uint8_t* out,
+                                                   size_t& out_len) {
+    const __m128i shift_lut =
+        _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_lut = _mm_setr_epi8(
+        (char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+        (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+        (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+    const __m128i bitpos_lut = _mm_setr_epi8(
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0,
+        0, 0, 0);
+    const __m128i pack =
+        _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    uint8_t* o = out;
+    size_t i = 0;
+    size_t tail;
+
+    // The last quad may be padded, leave it to the scalar code
+    for (; i + 16 + 4 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi32(v, 4), _mm_set1_epi8(0x0f));
+        __m128i lo = _mm_and_si128(v, _mm_set1_epi8(0x0f));
+
+        __m128i m = _mm_shuffle_epi8(mask_lut, lo);
+        __m128i bit = _mm_shuffle_epi8(bitpos_lut, hi);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(m, bit),
+                                             _mm_setzero_si128())))
+            return false;
+
+        // '/' shares the high nibble with '+'
+        __m128i is_slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+        __m128i shift = _mm_or_si128(
+            _mm_andnot_si128(is_slash, _mm_shuffle_epi8(shift_lut, hi)),
+            _mm_and_si128(is_slash, _mm_set1_epi8(16)));
+        v = _mm_add_epi8(v, shift);
+
+        // Merge 4 6-bit values into 3 bytes
+        v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+        v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+        v = _mm_shuffle_epi8(v, pack);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(o), v);
+        uint32_t last = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+        memcpy(o + 8, &last, sizeof(last));
+        o += 12;
+    }
+
+    if (!decode_scalar(in + i, len - i, o, tail))
+        return false;
+
+    out_len = (o - out) + tail;
+    return true;
+}
+
+bool ssse3_supported() {
+    return __builtin_cpu_supports("ssse3");
+}
+#endif
+
+#ifdef BASE64_NEON
+// 48 bytes to 64 chars per iteration, the alphabet is a 64 bytes table
+size_t encode_neon(const uint8_t* in, size_t len, char* out) {
+    const uint8x16x4_t table = vld1q_u8_x4(
+        reinterpret_cast<const uint8_t*>(alphabet));
+    const uint8x16_t mask = vdupq_n_u8(0x3f);
+    char* o = out;
+    size_t i = 0;
+
+    for (; i + 48 <= len; i += 48) {
+        uint8x16x3_t v = vld3q_u8(in + i);
+        uint8x16x4_t r;
+
+        r.val[0] = vshrq_n_u8(v.val[0], 2);
+        r.val[1] = vandq_u8(
+            vorrq_u8(vshlq_n_u8(v.val[0], 4), vshrq_n_u8(v.val[1], 4)), mask);
+        r.val[2] = vandq_u8(
+            vorrq_u8(vshlq_n_u8(v.val[1], 2), vshrq_n_u8(v.val[2], 6)), mask);
+        r.val[3] = vandq_u8(v.val[2], mask);
+
+        for (int k = 0; k < 4; k++)
+            r.val[k] = vqtbl4q_u8(table, r.val[k]);
+        vst4q_u8(reinterpret_cast<uint8_t*>(o), r);
+        o += 64;
+    }
+
+    return (o - out) + encode_scalar(in + i, len - i, o);
+}
+
+// 64 chars to 48 bytes per iteration, the decode table is looked up in two
+// 64 bytes halves, chars above 127 are rejected separately
+bool decode_neon(const char* in, size_t len, uint8_t* out, size_t& out_len) {
+    const uint8x16x4_t lo_table = vld1q_u8_x4(dtable);
+    const uint8x16x4_t hi_table = vld1q_u8_x4(dtable + 64);
+    const uint8x16_t offset = vdupq_n_u8(64);
+    uint8_t* o = out;
+    size_t i = 0;
+    size_t tail;
+
+    for (; i + 64 + 4 <= len; i += 64) {
+        uint8x16x4_t v = vld4q_u8(reinterpret_cast<const uint8_t*>(in + i));
+        uint8x16_t invalid = vdupq_n_u8(0);
+        uint8x16x3_t r;
+
+        for (int k = 0; k < 4; k++) {
+            uint8x16_t c = v.val[k];
+
+            v.val[k] = vqtbx4q_u8(vqtbl4q_u8(lo_table, c), hi_table,
+                                  vsubq_u8(c, offset));
+            invalid = vorrq_u8(invalid, vorrq_u8(v.val[k], c));
+        }
+        // 0xff for the chars out of the alphabet, high bit for above 127
+        if (vmaxvq_u8(invalid) & 0x80)
+            return false;
+
+        r.val[0] = vorrq_u8(vshlq_n_u8(v.val[0], 2), vshrq_n_u8(v.val[1], 4));
+        r.val[1] = vorrq_u8(vshlq_n_u8(v.val[1], 4), vshrq_n_u8(v.val[2], 2));
+        r.val[2] = vorrq_u8(vshlq_n_u8(v.val[2], 6), v.val[3]);
+        vst3q_u8(o, r);
+        o += 48;
+    }
+
+    if (!decode_scalar(in + i, len - i, o, tail))
+        return false;
+
+    out_len = (o - out) + tail;
+    return true;
+}
+#endif
+
+struct dispatch {
+    impl type;
+    size_t (*encode)(const uint8_t*, size_t, char*);
+    bool (*decode)(const char*, size_t, uint8_t*, size_t&);
+};
+
+const dispatch implementations[] = {
+    {impl::scalar, encode_scalar, decode_scalar},
+#ifdef BASE64_SSSE3
+    {impl::ssse3, encode_ssse3, decode_ssse3},
+#endif
+#ifdef BASE64_NEON
+    {impl::neon, encode_neon, decode_neon},
+#endif
+};
+
+bool supported(impl i) {
+    switch (i) {
+        case impl::scalar:
+            return true;
+#ifdef BASE64_SSSE3
+        case impl::ssse3:
+            return ssse3_supported();
+#endif
+#ifdef BASE64_NEON
+        case impl::neon:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+//! Best supported implementation, the last one in the list
+const dispatch* best() {
+    const dispatch* d = &implementations[0];
+
+    for (auto& i : implementations)
+        if (supported(i.type))
+            d = &i;
+
+    return d;
+}
+
+std::atomic<const dispatch*>& active() {
+    static std::atomic<const dispatch*> d {best()};
+
+    return d;
+}
+}  // namespace
+
+size_t encode(const uint8_t* in, size_t len, char* out) {
+    return active().load(std::memory_order_relaxed)->encode(in, len, out);
+}
+
+bool decode(const char* in, size_t len, uint8_t* out, size_t& out_len) {
+    out_len = 0;
+    if (len % 4)
+        return false;
+
+    return active().load(std::memory_order_relaxed)->decode(in, len, out,
+                                                            out_len);
+}
+
+impl current() {
+    return active().load(std::memory_order_relaxed)->type;
+}
+
+bool select(impl i) {
+    if (!supported(i))
+        return false;
+
+    for (auto& d : implementations) {
+        if (d.type == i) {
+            active().store(&d, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char* name(impl i) {
+    switch (i) {
+        case impl::ssse3:
+            return "ssse3";
+        case impl::neon:
+            return "neon";
+        default:
+            return "scalar";
+    }
+}
+}  // namespace base64
+}  // namespace utils
+}  // namespace cloud
+}  // namespace vxg
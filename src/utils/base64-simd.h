@@ -0,0 +1,57 @@
+#ifndef __BASE64_SIMD_H
+#define __BASE64_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace vxg {
+namespace cloud {
+namespace utils {
+//! @brief Allocation-free base64 codec writing into the caller buffers.
+//!
+//! Standard alphabet with '=' padding, the same output as base64_encode().
+//! Vectorized with SSSE3 on x86 (selected at runtime) and NEON on aarch64,
+//! other platforms use the scalar implementation.
+namespace base64 {
+
+enum class impl { scalar, ssse3, neon };
+
+//! Encoded length of @p len bytes
+inline size_t encoded_size(size_t len) {
+    return (len + 2) / 3 * 4;
+}
+
+//! Max decoded length of @p len chars
+inline size_t decoded_size(size_t len) {
+    return len / 4 * 3;
+}
+
+//! @brief Encode @p len bytes of @p in.
+//!
+//! @param out Output buffer of at least encoded_size(len) chars, not zero
+//!            terminated.
+//! @return Number of chars written.
+size_t encode(const uint8_t* in, size_t len, char* out);
+
+//! @brief Decode @p len chars of @p in.
+//!
+//! @param out Output buffer of at least decoded_size(len) bytes.
+//! @param[out] out_len Number of bytes written.
+//! @return false if @p in is not a padded standard alphabet base64 string.
+bool decode(const char* in, size_t len, uint8_t* out, size_t& out_len);
+
+//! Implementation in use
+impl current();
+
+//! @brief Switch the implementation, used by the tests and benchmarks.
+//!
+//! @return false if @p i is not supported by the CPU.
+bool select(impl i);
+
+const char* name(impl i);
+}  // namespace base64
+}  // namespace utils
+}  // namespace cloud
+}  // namespace vxg
+
+#endif
@@ -30,9 +30,14 @@
 
    René Nyffenegger rene.nyffenegger@adp-gmbh.ch
 
+   Altered: standard alphabet encoding and decoding go through the
+   vectorized codec from base64-simd.h, the code below is the fallback for
+   the url alphabet and malformed input.
+
 */
 
 #include "base64.h"
+#include "base64-simd.h"
 
  //
  // Depending on the url parameter in base64_chars, one of
@@ -106,6 +111,12 @@ std::string base64_encode(unsigned char const* bytes_to_encode, size_t in_len, b
 
     size_t len_encoded = (in_len +2) / 3 * 4;
 
+    if (!url) {
+        std::string ret(len_encoded, '\0');
+        vxg::cloud::utils::base64::encode(bytes_to_encode, in_len, &ret[0]);
+        return ret;
+    }
+
     unsigned char trailing_char = url ? '.' : '=';
 
  //
@@ -180,6 +191,17 @@ static std::string decode(String encoded_string, bool remove_linebreaks) {
     size_t length_of_string = encoded_string.length();
     if (!length_of_string) return std::string("");
 
+    {
+        std::string ret(vxg::cloud::utils::base64::decoded_size(length_of_string), '\0');
+        size_t len = 0;
+
+        if (vxg::cloud::utils::base64::decode(encoded_string.data(), length_of_string,
+                                              reinterpret_cast<uint8_t*>(&ret[0]), len)) {
+            ret.resize(len);
+            return ret;
+        }
+    }
+
     size_t in_len = length_of_string;
     size_t pos = 0;
 
@@ -14,6 +14,8 @@ logger::loglevel logger::default_loglevel_ = logger::lvl_info;
 bool logger::tcp_logsink_enabled_ {false};
 std::string logger::tcp_logsink_host_;
 uint16_t logger::tcp_logsink_port_;
+size_t logger::async_queue_size_ {8192};
+bool logger::async_nonblocking_ {false};
 
 std::shared_ptr<spdlog::sinks::dist_sink_mt> logger::dist_sink_;
 std::shared_ptr<spdlog::sinks::syslog_sink_mt> logger::syslog_sink_;
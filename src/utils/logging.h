@@ -15,6 +15,8 @@
 
 #include <utils/loguru.h>
 
+#include <atomic>
+#include <chrono>
 #include <fstream>
 
 namespace vxg {
@@ -44,6 +46,11 @@ public:
         bool tcp_logsink_enabled {false};
         std::string tcp_logsink_host;
         uint16_t tcp_logsink_port;
+        //! Async logging queue size in messages
+        size_t async_queue_size {8192};
+        //! Don't block the logging threads if the async queue is full, the
+        //! oldest queued messages are dropped instead, see dropped()
+        bool async_nonblocking {false};
     };
 
 private:
@@ -61,6 +68,9 @@ private:
     static std::string tcp_logsink_host_;
     static uint16_t tcp_logsink_port_;
 
+    static size_t async_queue_size_;
+    static bool async_nonblocking_;
+
     static std::shared_ptr<spdlog::sinks::dist_sink_mt> dist_sink_;
     static std::shared_ptr<spdlog::sinks::syslog_sink_mt> syslog_sink_;
     static std::shared_ptr<spdlog::sinks::stdout_color_sink_mt> console_sink_;
@@ -160,14 +170,18 @@ private:
         auto default_logger = spdlog::get("default");
 
         if (default_logger == nullptr) {
-            spdlog::init_thread_pool(8192, 1);
+            spdlog::init_thread_pool(async_queue_size_, 1);
             spdlog_thread_pool_ = spdlog::thread_pool();
 
             // Init master dist_sink_ and real sinks depending on settings
             _reset_sinks();
 
+            // Clones inherit the overflow policy
             default_logger = std::make_shared<spdlog::async_logger>(
-                "default", dist_sink_, spdlog_thread_pool_);
+                "default", dist_sink_, spdlog_thread_pool_,
+                async_nonblocking_
+                    ? spdlog::async_overflow_policy::overrun_oldest
+                    : spdlog::async_overflow_policy::block);
             default_logger->set_pattern(log_pattern_);
             default_logger->set_level(
                 (spdlog::level::level_enum)default_loglevel_);
@@ -246,11 +260,21 @@ public:
         tcp_logsink_enabled_ = opts.tcp_logsink_enabled;
         tcp_logsink_host_ = opts.tcp_logsink_host;
         tcp_logsink_port_ = opts.tcp_logsink_port;
+        async_queue_size_ = opts.async_queue_size;
+        async_nonblocking_ = opts.async_nonblocking;
 
         // _init_loguru_backtrace(argc, argv);
         _reset_sinks();
     }
 
+    //! @brief Number of messages dropped because the async queue was full,
+    //!        non-zero only with options::async_nonblocking.
+    static size_t dropped() {
+        auto pool = spdlog::thread_pool();
+
+        return pool ? pool->overrun_counter() : 0;
+    }
+
     //! @brief Change the logger object loglevel
     //!
     //! @param log_ptr Logger object pointer.
@@ -312,5 +336,82 @@ public:
     }
 };
 
+//! @brief Per call site log rate limiter, lets @p burst messages per
+//!        @p period pass, counts the rest as suppressed.
+//!        Lock-free, the window switching is approximate under contention.
+//!        Used by the VXG_LOG_RATE_LIMITED() macro.
+class log_rate_limiter {
+    const size_t burst_;
+    const int64_t period_;
+    std::atomic<int64_t> window_start_ {0};
+    std::atomic<size_t> passed_ {0};
+    std::atomic<size_t> suppressed_ {0};
+
+public:
+    log_rate_limiter(size_t burst, std::chrono::milliseconds period)
+        : burst_ {burst},
+          period_ {std::chrono::duration_cast<std::chrono::nanoseconds>(period)
+                       .count()} {}
+
+    //! @brief Check if the message is allowed.
+    //!
+    //! @param[out] suppressed Number of messages suppressed since the last
+    //!             allowed one, reported once with the first message of the
+    //!             new period.
+    //! @return true if the message should be logged.
+    bool allow(size_t& suppressed) {
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now().time_since_epoch())
+                          .count();
+        int64_t start = window_start_.load(std::memory_order_relaxed);
+
+        suppressed = 0;
+        if (now - start >= period_ &&
+            window_start_.compare_exchange_strong(start, now)) {
+            passed_.store(0, std::memory_order_relaxed);
+            suppressed = suppressed_.exchange(0);
+        }
+
+        if (passed_.fetch_add(1, std::memory_order_relaxed) < burst_)
+            return true;
+
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+};
+
 }  // namespace vxg
+
+//! @brief Log with the arguments evaluation skipped if @p lvl is disabled.
+//!
+//! @param log_ptr logger_ptr
+//! @param lvl spdlog level name: trace, debug, info, warn, err, critical
+//!
+//! VXG_LOG(logger, debug, "C <= S: {}", message.dump());
+#define VXG_LOG(log_ptr, lvl, ...)                                           \
+    do {                                                                     \
+        auto&& __vxg_log = (log_ptr);                                        \
+        if (__vxg_log->should_log(spdlog::level::lvl))                       \
+            __vxg_log->log(spdlog::level::lvl, __VA_ARGS__);                 \
+    } while (0)
+
+//! @brief Lazy VXG_LOG() which lets only @p burst messages of the call site
+//!        per @p period_ms pass, the number of suppressed messages is logged
+//!        with the next allowed one.
+#define VXG_LOG_RATE_LIMITED(log_ptr, lvl, burst, period_ms, ...)            \
+    do {                                                                     \
+        static ::vxg::log_rate_limiter __vxg_limiter(                        \
+            burst, std::chrono::milliseconds(period_ms));                    \
+        auto&& __vxg_log = (log_ptr);                                        \
+        size_t __vxg_suppressed;                                             \
+        if (__vxg_log->should_log(spdlog::level::lvl) &&                     \
+            __vxg_limiter.allow(__vxg_suppressed)) {                         \
+            if (__vxg_suppressed)                                            \
+                __vxg_log->log(spdlog::level::lvl,                           \
+                               "{} similar messages suppressed",             \
+                               __vxg_suppressed);                            \
+            __vxg_log->log(spdlog::level::lvl, __VA_ARGS__);                 \
+        }                                                                    \
+    } while (0)
+
 #endif  // __LOGGING_H
\ No newline at end of file
@@ -1,6 +1,13 @@
 #ifndef __PROFILE_H
 #define __PROFILE_H
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
 #include <agent-proto/command/utils.h>
 #include <agent-proto/objects/config.h>
 
@@ -16,10 +23,8 @@ namespace agent {
 //! Ex. vxg::cloud::agent::profile::instance().raw_messaging = false;
 namespace profile {
 
-struct debug_stats {
-    std::chrono::time_point<std::chrono::steady_clock> __spawn_time_;
-
-    debug_stats() { __spawn_time_ = std::chrono::steady_clock::now(); }
+//! @brief Plain copy of the debug stats, sent to the Cloud as the event meta.
+struct debug_stats_values {
     int motion_events {0};
 
     int records_uploaded {0};
@@ -41,13 +46,13 @@ struct debug_stats {
     double file_meta_last_upload_speed_KBps {0.0};
 
     int cloud_reconnects {0};
-    size_t uptime;
+    size_t uptime {0};
     size_t ram_usage_overall_percents {0};
     size_t ram_usage_agent_percents {0};
     size_t cpu_usage_overall_percents {0};
     size_t cpu_usage_agent_percents {0};
 
-    JSON_DEFINE_TYPE_INTRUSIVE(debug_stats,
+    JSON_DEFINE_TYPE_INTRUSIVE(debug_stats_values,
                                motion_events,
                                snapshots_uploaded,
                                snapshots_capture_failed,
@@ -72,6 +77,164 @@ struct debug_stats {
                                cpu_usage_agent_percents);
 };
 
+//! @brief Counter updated from many threads without contention.
+//!
+//! Every thread increments its own cache line sized shard, the value is the
+//! sum of the shards. Assignment is meant for the gauges updated by a single
+//! thread, concurrent increments are not lost.
+template <typename T>
+class counter {
+    static constexpr size_t SHARDS = 8;
+    struct alignas(64) shard {
+        std::atomic<T> value {0};
+    };
+    shard shards_[SHARDS];
+
+    static size_t __shard() {
+        static std::atomic<size_t> next {0};
+        thread_local size_t index =
+            next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+        return index;
+    }
+
+public:
+    counter() = default;
+    counter(const counter&) = delete;
+    counter& operator=(const counter&) = delete;
+
+    counter& operator+=(T delta) {
+        shards_[__shard()].value.fetch_add(delta, std::memory_order_relaxed);
+        return *this;
+    }
+
+    counter& operator-=(T delta) {
+        shards_[__shard()].value.fetch_sub(delta, std::memory_order_relaxed);
+        return *this;
+    }
+
+    counter& operator++() { return *this += 1; }
+    counter& operator--() { return *this -= 1; }
+    void operator++(int) { *this += 1; }
+    void operator--(int) { *this -= 1; }
+
+    counter& operator=(T value) {
+        size_t mine = __shard();
+        T others = 0;
+
+        for (size_t i = 0; i < SHARDS; i++)
+            if (i != mine)
+                others += shards_[i].value.load(std::memory_order_relaxed);
+        shards_[mine].value.store(value - others, std::memory_order_relaxed);
+        return *this;
+    }
+
+    T load() const {
+        T sum = 0;
+
+        // Unsigned shards may wrap, the sum is still correct
+        for (auto& s : shards_)
+            sum += s.value.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    operator T() const { return load(); }
+};
+
+//! @brief Last written value readable from any thread.
+template <typename T>
+class gauge {
+    std::atomic<T> value_ {T()};
+
+public:
+    gauge() = default;
+    gauge(const gauge&) = delete;
+
+    gauge& operator=(T value) {
+        value_.store(value, std::memory_order_relaxed);
+        return *this;
+    }
+
+    T load() const { return value_.load(std::memory_order_relaxed); }
+    operator T() const { return load(); }
+};
+
+//! @brief Debugging stats updated by the agent threads.
+struct debug_stats {
+    //! Agent start time, uptime is counted from it
+    const std::chrono::steady_clock::time_point __spawn_time_ {
+        std::chrono::steady_clock::now()};
+
+    counter<int> motion_events;
+
+    counter<int> records_uploaded;
+    counter<int> records_upload_failed;
+    counter<size_t> records_uploading;
+    counter<int> records_upload_queued;
+    gauge<double> records_last_upload_speed_KBps;
+
+    counter<size_t> snapshots_uploading;
+    counter<int> snapshots_upload_failed;
+    counter<int> snapshots_uploaded;
+    counter<int> snapshots_capture_failed;
+    gauge<double> snapshot_last_upload_speed_KBps;
+
+    counter<size_t> file_meta_uploading;
+    counter<int> file_meta_upload_failed;
+    counter<int> file_meta_uploaded;
+    counter<int> file_meta_capture_failed;
+    gauge<double> file_meta_last_upload_speed_KBps;
+
+    counter<int> cloud_reconnects;
+    gauge<size_t> ram_usage_overall_percents;
+    gauge<size_t> ram_usage_agent_percents;
+    gauge<size_t> cpu_usage_overall_percents;
+    gauge<size_t> cpu_usage_agent_percents;
+
+    //! Seconds since the agent start
+    size_t uptime() const {
+        using namespace std::chrono;
+        return duration_cast<seconds>(steady_clock::now() - __spawn_time_)
+            .count();
+    }
+
+    //! @brief Sum up the counters.
+    //!
+    //! Counters are read one by one, the values are not a consistent
+    //! snapshot of all the stats.
+    debug_stats_values load() const {
+        debug_stats_values v;
+
+        v.motion_events = motion_events;
+        v.records_uploaded = records_uploaded;
+        v.records_upload_failed = records_upload_failed;
+        v.records_uploading = records_uploading;
+        v.records_upload_queued = records_upload_queued;
+        v.records_last_upload_speed_KBps = records_last_upload_speed_KBps;
+        v.snapshots_uploading = snapshots_uploading;
+        v.snapshots_upload_failed = snapshots_upload_failed;
+        v.snapshots_uploaded = snapshots_uploaded;
+        v.snapshots_capture_failed = snapshots_capture_failed;
+        v.snapshot_last_upload_speed_KBps = snapshot_last_upload_speed_KBps;
+        v.file_meta_uploading = file_meta_uploading;
+        v.file_meta_upload_failed = file_meta_upload_failed;
+        v.file_meta_uploaded = file_meta_uploaded;
+        v.file_meta_capture_failed = file_meta_capture_failed;
+        v.file_meta_last_upload_speed_KBps = file_meta_last_upload_speed_KBps;
+        v.cloud_reconnects = cloud_reconnects;
+        v.uptime = uptime();
+        v.ram_usage_overall_percents = ram_usage_overall_percents;
+        v.ram_usage_agent_percents = ram_usage_agent_percents;
+        v.cpu_usage_overall_percents = cpu_usage_overall_percents;
+        v.cpu_usage_agent_percents = cpu_usage_agent_percents;
+
+        return v;
+    }
+
+    friend void to_json(nlohmann::json& j, const debug_stats& s) {
+        j = s.load();
+    }
+};
+
 class description {
 public:
     //! Device vendor.
@@ -97,6 +260,58 @@ public:
     //! library.
     bool allow_invalid_ssl_certs {false};
 
+    //! Offer the permessage-deflate compression for the Cloud WebSocket
+    //! connection, it's used only if the server accepts it. Reduces the
+    //! traffic of the chatty events and configuration messages for the CPU
+    //! cost of the compression.
+    bool websocket_permessage_deflate {false};
+
+    //! @brief Max commands waiting for the Cloud's ack, e.g. events with
+    //! snapshots waiting for the upload url. When exceeded the oldest pending
+    //! command is considered as timed out. Rounded up to the power of 2.
+    size_t command_acks_max_pending {1024};
+
+    //! @brief Cloud reconnection delays limits, milliseconds. Delays after
+    //! the accidental disconnection grow with the decorrelated jitter from
+    //! the base up to the cap and are reset when the camera is registered.
+    size_t reconnect_backoff_base_ms {100};
+    size_t reconnect_backoff_cap_ms {30000};
+    //! @brief Time after the accidental disconnection the session may be
+    //! resumed, seconds. Event streams are kept running during this time and
+    //! their events are queued and sent when the camera with the same id is
+    //! registered again. 0 disables the session resuming.
+    size_t session_resume_window_sec {60};
+    //! Max events queued while the session is being resumed, the oldest
+    //! events are dropped when exceeded.
+    size_t max_queued_events {128};
+
+    //! @brief Coalescing of the events notified by the event streams.
+    //!
+    //! Bounds the snapshots, cam_events and uploads triggered by the bursty
+    //! event sources like a flapping motion detector.
+    struct event_coalescing {
+        //! Stateless events notified within this time after the previous one
+        //! are merged into one event with the extended time span, stateful
+        //! event deactivation followed by the activation within this time is
+        //! ignored. Zero disables debouncing.
+        std::chrono::milliseconds debounce {0};
+        //! Max delay of the merged stateless event.
+        std::chrono::milliseconds max_delay {std::chrono::seconds(10)};
+        //! Max events per second, exceeding stateless events are merged and
+        //! stateful event activations are delayed. Zero disables the limit.
+        double max_rate {2};
+        //! Number of the events passed at once regardless of the max_rate.
+        size_t burst {10};
+        //! Merge the stateless events, if false they are dropped.
+        bool merge {true};
+    };
+    //! @brief Coalescing of the event types not listed in
+    //! event_coalescing_by_event.
+    event_coalescing default_event_coalescing;
+    //! @brief Coalescing per event name, the key is "motion", "sound", etc. or
+    //! the custom event name.
+    std::map<std::string, event_coalescing> event_coalescing_by_event;
+
     //! @brief Default image width for preview and events snapshots.
     //!
     //! Used as suggestion for the [stream::get_snapshot()](@ref
@@ -135,6 +350,48 @@ public:
     size_t max_concurent_snapshot_uploads {4};
     //! @brief Max concurent file_meta upload
     size_t max_concurent_file_meta_uploads {6};
+    //! @brief Max concurent uploads of periodic timeline records(continuous
+    //! direct upload recording and memorycard synchronization), can't be
+    //! greater than max_concurent_video_uploads which limits event records.
+    size_t max_concurent_timeline_uploads {1};
+    //! @brief Max concurent uploads of all kinds, when exceeded the upload
+    //! scheduler starts the planned uploads in the order of their priority:
+    //! snapshots, event records, file meta, timeline records.
+    size_t max_concurent_uploads {8};
+    //! @brief Waiting time in the upload queue that raises the planned
+    //! upload's priority by one level, prevents starvation of the low
+    //! priority uploads.
+    std::chrono::seconds upload_priority_aging_step {std::chrono::seconds(30)};
+    //! @brief Snapshot upload TTL in the upload queue, late snapshots are
+    //! dropped.
+    std::chrono::seconds max_snapshot_uploads_queue_lateness {
+        std::chrono::seconds(60)};
+    //! @brief File meta upload TTL in the upload queue, late file metas are
+    //! dropped.
+    std::chrono::seconds max_file_meta_uploads_queue_lateness {
+        std::chrono::seconds(120)};
+    //! @brief Lifetime of the locally cached Cloud timeline slices, the
+    //! uploader requests Cloud storage only if cached data for the upload
+    //! window is missing or outdated, zero disables caching.
+    std::chrono::seconds cloud_timeline_cache_ttl {std::chrono::seconds(60)};
+    //! @brief Max number of the record upload url requests gathered into
+    //! single get_direct_upload_url command, Cloud must support the
+    //! get_direct_upload_url.extra list, 1 disables batching.
+    size_t direct_upload_url_batch_size {1};
+    //! @brief Time of gathering the record upload url requests into the
+    //! batch before sending it.
+    std::chrono::milliseconds direct_upload_url_batch_window {
+        std::chrono::milliseconds(200)};
+    //! @brief Part size of the multi-part record upload in bytes, records
+    //! larger than this are uploaded by parts with the Content-Range header
+    //! over several connections, Cloud storage must support ranged PUT,
+    //! 0 disables multi-part upload.
+    size_t direct_upload_part_size {0};
+    //! @brief Max number of the parts of the single record uploaded at the
+    //! same time.
+    size_t direct_upload_parts_window {4};
+    //! @brief Number of retries of the failed part upload.
+    size_t direct_upload_part_retries {2};
     //! @brief Default event pre recording time
     std::chrono::seconds default_pre_record_time {std::chrono::seconds(10)};
     //! @brief Default event post recording time
@@ -158,11 +415,6 @@ public:
     //!
     std::string cm_registration_sid;
 
-    //! @internal
-    //! Debugging stats
-    //! @endinternal
-    debug_stats stats;
-
     //! @private
     //! @deprecated
     int motion_win_level {5};
@@ -216,20 +468,88 @@ public:
 };
 
 //! @brief Cloud agent global profile settings access interface class.
+//!
+//! Settings are written via instance() before the agent start. Threads of
+//! the running agent read them via snapshot(), an immutable copy published
+//! by publish() or update() and read without locks.
 class global : public description {
     global() {}
 
+    struct published {
+        std::mutex lock;
+        std::shared_ptr<const description> settings;
+        std::atomic<uint64_t> generation {0};
+    };
+
+    static published& __published() {
+        static published p;
+        return p;
+    }
+
+    //! Must be called with the published::lock held
+    static void __publish(published& p) {
+        std::atomic_store(&p.settings,
+                          std::shared_ptr<const description>(
+                              std::make_shared<description>(instance())));
+        p.generation.fetch_add(1, std::memory_order_release);
+    }
+
 public:
+    //! @internal
+    //! Debugging stats
+    //! @endinternal
+    debug_stats stats;
+
     static global& instance() {
         static global g;
+        return g;
+    }
 
-        // Update uptime on each access
-        using namespace std::chrono;
-        g.stats.uptime =
-            duration_cast<seconds>(steady_clock::now() - g.stats.__spawn_time_)
-                .count();
+    //! @brief Publish the current instance() settings as the snapshot().
+    //!
+    //! Called by the agent manager on start, must be called if settings are
+    //! changed via instance() while the agent is running.
+    static void publish() {
+        auto& p = __published();
+        std::lock_guard<std::mutex> lock(p.lock);
 
-        return g;
+        __publish(p);
+    }
+
+    //! @brief Change the settings and publish them.
+    //!
+    //! @param f Function changing the settings, called under the writers
+    //!          lock.
+    static void update(const std::function<void(description&)>& f) {
+        auto& p = __published();
+        std::lock_guard<std::mutex> lock(p.lock);
+
+        f(instance());
+        __publish(p);
+    }
+
+    //! @brief Immutable copy of the last published settings.
+    //!
+    //! Every thread keeps the last seen copy, the shared copy is taken only
+    //! if a newer one was published. Settings are published on the first
+    //! call if publish() was not called yet.
+    static std::shared_ptr<const description> snapshot() {
+        auto& p = __published();
+        thread_local std::shared_ptr<const description> local;
+        thread_local uint64_t local_generation = 0;
+        uint64_t generation = p.generation.load(std::memory_order_acquire);
+
+        if (!generation) {
+            publish();
+            generation = p.generation.load(std::memory_order_acquire);
+        }
+
+        if (generation != local_generation) {
+            local = std::atomic_load(&p.settings);
+            local_generation = generation;
+        }
+
+        return local;
     }
 };
 
@@ -1,8 +1,266 @@
 #include "properties.h"
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+#include <algorithm>
+#include <thread>
+
 namespace vxg {
 std::string properties::props_filename_;
 std::string properties::default_props_filename_;
 std::mutex properties::lock_;
 nlohmann::json properties::default_json_;
+std::chrono::milliseconds properties::write_delay_ {200};
+std::chrono::milliseconds properties::store_retry_delay_ {1000};
+std::shared_ptr<const nlohmann::json> properties::cache_;
+std::atomic<uint64_t> properties::generation_ {0};
+nlohmann::json properties::pending_ = nlohmann::json::object();
+
+namespace {
+//! Write-behind thread state, guarded by properties::lock_.
+//! Defined after the properties static members to be destroyed before them.
+struct props_worker {
+    std::thread thread;
+    int wake_fd {-1};
+    int inotify_fd {-1};
+    int watch {-1};
+    std::string file_name;
+    bool stop {false};
+    //! Cache differs from the file
+    bool dirty {false};
+    std::chrono::steady_clock::time_point store_at;
+    //! File written by the last store, its inotify events are ignored
+    struct stat stored {};
+    //! Serializes the file writes
+    std::mutex store_lock;
+
+    void wake() {
+        uint64_t one = 1;
+
+        if (wake_fd >= 0 && ::write(wake_fd, &one, sizeof(one)) < 0)
+            return;
+    }
+
+    ~props_worker() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(properties::lock_);
+                stop = true;
+            }
+            wake();
+            thread.join();
+        }
+
+        properties::flush();
+
+        if (wake_fd >= 0)
+            ::close(wake_fd);
+        if (inotify_fd >= 0)
+            ::close(inotify_fd);
+    }
+} worker_;
+
+bool same_file(const struct stat& a, const struct stat& b) {
+    return a.st_ino == b.st_ino && a.st_size == b.st_size &&
+           a.st_mtim.tv_sec == b.st_mtim.tv_sec &&
+           a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+//! Read all pending inotify events
+//! @return true if any of them is about @p name
+bool read_file_events(int fd, const std::string& name) {
+    alignas(struct inotify_event) char buf[4096];
+    bool changed = false;
+    ssize_t len;
+
+    while ((len = ::read(fd, buf, sizeof(buf))) > 0) {
+        for (char* p = buf; p < buf + len;) {
+            auto event = reinterpret_cast<struct inotify_event*>(p);
+
+            if ((event->mask & IN_Q_OVERFLOW) ||
+                (event->len && name == event->name))
+                changed = true;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
+}  // namespace
+
+std::shared_ptr<const nlohmann::json> properties::__cache() {
+    auto cache = std::atomic_load(&cache_);
+
+    if (cache)
+        return cache;
+
+    auto j = std::make_shared<nlohmann::json>();
+    __load(props_filename_, *j);
+    if (!j->is_object())
+        *j = nlohmann::json::object();
+
+    if (!worker_.thread.joinable()) {
+        worker_.wake_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        worker_.inotify_fd = ::inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        if (worker_.wake_fd < 0 || worker_.inotify_fd < 0)
+            vxg::logger::error("Unable to create props watcher: {}",
+                               strerror(errno));
+        else
+            worker_.thread = std::thread(&properties::__worker);
+    }
+
+    // Watch the directory, stores replace the file with a new one
+    size_t slash = props_filename_.rfind('/');
+    std::string dir = ".";
+    worker_.file_name = props_filename_;
+    if (slash != std::string::npos) {
+        dir = slash ? props_filename_.substr(0, slash) : "/";
+        worker_.file_name = props_filename_.substr(slash + 1);
+    }
+    if (worker_.inotify_fd >= 0) {
+        worker_.watch = ::inotify_add_watch(worker_.inotify_fd, dir.c_str(),
+                                            IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (worker_.watch < 0)
+            vxg::logger::warn("Unable to watch props file {}: {}",
+                              props_filename_, strerror(errno));
+    }
+
+    __publish(j);
+    return j;
+}
+
+void properties::__publish(std::shared_ptr<const nlohmann::json> j) {
+    std::atomic_store(&cache_, j);
+    generation_.fetch_add(1, std::memory_order_release);
+}
+
+void properties::__schedule_store() {
+    if (worker_.dirty)
+        return;
+
+    worker_.dirty = true;
+    worker_.store_at = std::chrono::steady_clock::now() + write_delay_;
+    worker_.wake();
+}
+
+std::mutex& properties::__store_lock() {
+    return worker_.store_lock;
+}
+
+void properties::__cache_drop() {
+    flush();
+
+    std::lock_guard<std::mutex> guard(lock_);
+    if (worker_.watch >= 0) {
+        ::inotify_rm_watch(worker_.inotify_fd, worker_.watch);
+        worker_.watch = -1;
+    }
+    worker_.file_name.clear();
+    pending_ = nlohmann::json::object();
+    __publish(nullptr);
+}
+
+void properties::__reload() {
+    auto j = std::make_shared<nlohmann::json>();
+
+    __load(props_filename_, *j);
+    if (!j->is_object())
+        *j = nlohmann::json::object();
+    for (auto& p : pending_.items())
+        (*j)[p.key()] = p.value();
+
+    auto cache = std::atomic_load(&cache_);
+    if (cache && *cache != *j) {
+        vxg::logger::info("Props file {} was modified, reloading",
+                          props_filename_);
+        __publish(j);
+    }
+}
+
+void properties::flush() {
+    std::lock_guard<std::mutex> store_guard(__store_lock());
+    std::shared_ptr<const nlohmann::json> j;
+    nlohmann::json stored_keys;
+    std::string file;
+
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        j = std::atomic_load(&cache_);
+        if (!worker_.dirty || !j)
+            return;
+        worker_.dirty = false;
+        stored_keys = pending_;
+        file = props_filename_;
+    }
+
+    bool ok = __store(file, *j);
+
+    std::lock_guard<std::mutex> guard(lock_);
+    if (!ok) {
+        // The cache is still not stored, retry after the delay even if no
+        // set() follows
+        worker_.dirty = true;
+        worker_.store_at =
+            std::chrono::steady_clock::now() + store_retry_delay_;
+        worker_.wake();
+        return;
+    }
+
+    // Keys set again during the store are still pending
+    for (auto& p : stored_keys.items()) {
+        auto it = pending_.find(p.key());
+        if (it != pending_.end() && *it == p.value())
+            pending_.erase(it);
+    }
+    ::stat(file.c_str(), &worker_.stored);
+}
+
+void properties::__worker() {
+    std::unique_lock<std::mutex> lock(lock_);
+
+    while (!worker_.stop) {
+        int timeout = -1;
+        std::string file_name = worker_.file_name;
+
+        if (worker_.dirty) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                worker_.store_at - std::chrono::steady_clock::now());
+            timeout = std::max<int>(0, left.count());
+        }
+        lock.unlock();
+
+        struct pollfd fds[2] = {{worker_.wake_fd, POLLIN, 0},
+                                {worker_.inotify_fd, POLLIN, 0}};
+        bool changed = false;
+        uint64_t wakes;
+
+        if (::poll(fds, 2, timeout) > 0) {
+            if (fds[0].revents & POLLIN &&
+                ::read(worker_.wake_fd, &wakes, sizeof(wakes)) < 0)
+                wakes = 0;
+            if (fds[1].revents & POLLIN)
+                changed = read_file_events(worker_.inotify_fd, file_name);
+        }
+
+        lock.lock();
+        // Reload first, the store must not overwrite the external changes
+        if (changed && !file_name.empty() &&
+            file_name == worker_.file_name) {
+            struct stat st;
+
+            if (::stat(props_filename_.c_str(), &st) == 0 &&
+                !same_file(st, worker_.stored))
+                __reload();
+        }
+
+        if (worker_.dirty &&
+            std::chrono::steady_clock::now() >= worker_.store_at) {
+            lock.unlock();
+            flush();
+            lock.lock();
+        }
+    }
+}
 }  // namespace vxg
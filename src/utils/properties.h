@@ -1,6 +1,14 @@
 #pragma once
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <memory>
+#include <mutex>
 
 #include <utils/logging.h>
 #include <nlohmann/json.hpp>
@@ -11,14 +19,70 @@ namespace vxg {
 //!        dictionary storred in the file.
 //!        File with defaults used to initialize property during the get()
 //!        if its value wasn't set() yet.
+//!
+//!        Properties are cached in memory, get() doesn't lock and doesn't
+//!        touch the file. set() updates the cache, the file is rewritten
+//!        atomically by the background thread after the write_delay_, all
+//!        the set() calls within the delay are coalesced into one write.
+//!        External file modifications are picked up via inotify.
 class properties {
 public:
     static std::string props_filename_;
     static std::string default_props_filename_;
     static std::mutex lock_;
     static nlohmann::json default_json_;
+    //! Write-behind delay
+    static std::chrono::milliseconds write_delay_;
+    //! Delay before the failed store is retried
+    static std::chrono::milliseconds store_retry_delay_;
 
 private:
+    //! Cached file content, replaced as a whole on every modification
+    static std::shared_ptr<const nlohmann::json> cache_;
+    //! Incremented on every cache_ replacement
+    static std::atomic<uint64_t> generation_;
+    //! Keys set but not stored yet, guarded by lock_
+    static nlohmann::json pending_;
+
+    //! Load the cache if needed, start the write-behind thread.
+    //! Should be called with lock_ held.
+    static std::shared_ptr<const nlohmann::json> __cache();
+    //! Replace the cache, should be called with lock_ held
+    static void __publish(std::shared_ptr<const nlohmann::json> j);
+    //! Wake the write-behind thread, should be called with lock_ held
+    static void __schedule_store();
+    //! Serializes the file writes with the write-behind thread, must be
+    //! taken before lock_ if both are needed
+    static std::mutex& __store_lock();
+    //! Store pending changes and drop the cache before the file switch
+    static void __cache_drop();
+    //! Reload the cache after the external file modification, pending keys
+    //! are kept. Should be called with lock_ held.
+    static void __reload();
+    //! Write-behind and file watching thread
+    static void __worker();
+
+    //! @brief Cache snapshot of the calling thread.
+    //!        Only an atomic generation check unless the cache was modified.
+    //!
+    //! @return Reference valid until the next call in the same thread.
+    static const nlohmann::json& __snapshot() {
+        thread_local std::shared_ptr<const nlohmann::json> local;
+        thread_local uint64_t local_generation = 0;
+        uint64_t generation = generation_.load(std::memory_order_acquire);
+
+        if (generation != local_generation || !local) {
+            local = std::atomic_load(&cache_);
+            if (!local) {
+                std::lock_guard<std::mutex> guard(lock_);
+                local = __cache();
+            }
+            local_generation = generation;
+        }
+
+        return *local;
+    }
+
     /**
      * @brief Create props file with default settings
      *
@@ -30,6 +94,7 @@ private:
 
         vxg::logger::info("Reseting props file {}", props_filename_);
 
+        std::lock_guard<std::mutex> store_guard(__store_lock());
         __load(default_props_filename_, j);
         __store(props_filename_, j);
     }
@@ -58,23 +123,62 @@ private:
         return true;
     }
 
-    static bool __store(std::string filepath, nlohmann::json j) {
+    //! Write to the temporary file, sync and rename over @p filepath so
+    //! the readers never see the partially written file
+    static bool __store(std::string filepath, const nlohmann::json& j) {
+        std::string tmp = filepath + ".tmp";
+        std::string data;
+
         try {
-            std::ofstream f(filepath);
-            if (!f.fail()) {
-                f << j;
-                f.close();
-                return true;
-            }
+            data = j.dump();
         } catch (std::exception& e) {
             vxg::logger::error("Unable to save {} : {}", filepath, e.what());
+            return false;
         }
-        return false;
+
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                        0644);
+        if (fd < 0) {
+            vxg::logger::error("Unable to save {} : {}", filepath,
+                               strerror(errno));
+            return false;
+        }
+
+        const char* p = data.data();
+        size_t left = data.size();
+        while (left) {
+            ssize_t written = ::write(fd, p, left);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                break;
+            p += written;
+            left -= written;
+        }
+
+        if (left || ::fsync(fd) != 0) {
+            vxg::logger::error("Unable to save {} : {}", filepath,
+                               strerror(errno));
+            ::close(fd);
+            ::unlink(tmp.c_str());
+            return false;
+        }
+        ::close(fd);
+
+        if (::rename(tmp.c_str(), filepath.c_str()) != 0) {
+            vxg::logger::error("Unable to save {} : {}", filepath,
+                               strerror(errno));
+            ::unlink(tmp.c_str());
+            return false;
+        }
+
+        return true;
     }
 
     static bool __set(std::string key,
                       std::string val,
                       std::string props_file = props_filename_) {
+        std::lock_guard<std::mutex> store_guard(__store_lock());
         nlohmann::json j;
         if (__load(props_file, j)) {
             j[key] = val;
@@ -103,6 +207,7 @@ private:
         return false;
     }
 
+    //! Every key is written by __set() under the store lock
     static void _apply_defaults_if_needed(bool force) {
         using namespace nlohmann;
         nlohmann::json j;
@@ -132,9 +237,20 @@ private:
     }
 
 public:
-    static void set_props_filepath(std::string file) { props_filename_ = file; }
+    static void set_props_filepath(std::string file) {
+        __cache_drop();
+
+        // Cache loaded from the previous file meanwhile is dropped too
+        std::lock_guard<std::mutex> guard(lock_);
+        props_filename_ = file;
+        __publish(nullptr);
+    }
     static void set_default_props_filepath(std::string file) {
-        default_props_filename_ = file;
+        __cache_drop();
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            default_props_filename_ = file;
+        }
         bool force = false;
         std::string ver, default_ver;
         __get("version", ver, props_filename_);
@@ -159,30 +275,32 @@ public:
 
     static void set(std::string key, std::string val) {
         std::lock_guard<std::mutex> guard(lock_);
+        auto j = std::make_shared<nlohmann::json>(*__cache());
 
-        if (!__set(key, val)) {
-            _apply_defaults_if_needed(false);
-            if (!__set(key, val)) {
-                vxg::logger::error("Not possible to set property, failing");
-            }
-        }
+        (*j)[key] = val;
+        __publish(j);
+        pending_[key] = val;
+        __schedule_store();
     }
 
     static std::string get(std::string key) {
-        std::lock_guard<std::mutex> guard(lock_);
-        std::string value = "";
+        const nlohmann::json& j = __snapshot();
+        auto it = j.find(key);
 
-        if (!__get(key, value)) {
-            vxg::logger::error("Not possible to get property, failing");
-        }
+        if (it == j.end() || !it->is_string())
+            return "";
 
-        return value;
+        return it->get<std::string>();
     }
 
+    //! @brief Store pending set() calls to the file immediately.
+    static void flush();
+
     static bool reset(std::string props_filepath,
                       std::string default_props_filepath = "") {
         nlohmann::json j;
 
+        // Defaults are applied to the file, the cache is reloaded after
         set_props_filepath(props_filepath);
 
         if (!default_props_filepath.empty())
@@ -190,11 +308,14 @@ public:
         else
             set_default_props_filepath(props_filepath + ".default");
 
-        __load(props_filepath, j);
-        if (!__store(props_filepath, j)) {
-            vxg::logger::error("Unable to open props file {} for write",
-                               props_filepath);
-            return false;
+        {
+            std::lock_guard<std::mutex> store_guard(__store_lock());
+            __load(props_filepath, j);
+            if (!__store(props_filepath, j)) {
+                vxg::logger::error("Unable to open props file {} for write",
+                                   props_filepath);
+                return false;
+            }
         }
 
         if (!__load(default_props_filepath, j)) {
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace vxg {
+namespace cloud {
+namespace utils {
+
+//! @brief Fixed capacity bytes FIFO.
+//!
+//! The data and the free space are exposed as contiguous spans for the zero
+//! copy recv()/send(), a span ends at the end of the storage, the rest is
+//! available after the span is consumed or committed. Not thread safe.
+class ring_buffer {
+public:
+    //! @param capacity Rounded up to the power of 2.
+    explicit ring_buffer(size_t capacity) {
+        capacity_ = 1;
+        while (capacity_ < capacity)
+            capacity_ <<= 1;
+        data_.reset(new uint8_t[capacity_]);
+    }
+
+    ring_buffer(const ring_buffer&) = delete;
+    ring_buffer& operator=(const ring_buffer&) = delete;
+
+    size_t size() const { return tail_ - head_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return head_ == tail_; }
+    bool full() const { return size() == capacity_; }
+
+    //! @brief Contiguous free space.
+    //!
+    //! @param[out] len Span length, 0 if the buffer is full.
+    //! @return Span start, the written data becomes readable after commit().
+    uint8_t* write_ptr(size_t& len) {
+        size_t pos = tail_ & (capacity_ - 1);
+
+        len = std::min(capacity_ - size(), capacity_ - pos);
+        return data_.get() + pos;
+    }
+
+    void commit(size_t len) { tail_ += len; }
+
+    //! @brief Contiguous data.
+    //!
+    //! @param[out] len Span length, 0 if the buffer is empty.
+    //! @return Span start, the data stays in the buffer until consume().
+    const uint8_t* read_ptr(size_t& len) const {
+        size_t pos = head_ & (capacity_ - 1);
+
+        len = std::min(size(), capacity_ - pos);
+        return data_.get() + pos;
+    }
+
+    void consume(size_t len) { head_ += len; }
+
+    //! @return Number of bytes copied, less than @p len if the buffer is full.
+    size_t write(const void* data, size_t len) {
+        auto p = static_cast<const uint8_t*>(data);
+        size_t written = 0;
+
+        while (written < len && !full()) {
+            size_t span;
+            uint8_t* dst = write_ptr(span);
+
+            span = std::min(span, len - written);
+            memcpy(dst, p + written, span);
+            commit(span);
+            written += span;
+        }
+
+        return written;
+    }
+
+    //! @return Number of bytes copied, less than @p len if the buffer is
+    //!         drained.
+    size_t read(void* data, size_t len) {
+        auto p = static_cast<uint8_t*>(data);
+        size_t done = 0;
+
+        while (done < len && !empty()) {
+            size_t span;
+            const uint8_t* src = read_ptr(span);
+
+            span = std::min(span, len - done);
+            memcpy(p + done, src, span);
+            consume(span);
+            done += span;
+        }
+
+        return done;
+    }
+
+    void clear() { head_ = tail_ = 0; }
+
+private:
+    std::unique_ptr<uint8_t[]> data_;
+    size_t capacity_;
+    //! Positions grow monotonically and are wrapped on access
+    size_t head_ {0};
+    size_t tail_ {0};
+};
+
+}  // namespace utils
+}  // namespace cloud
+}  // namespace vxg
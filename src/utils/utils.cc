@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <iomanip>
@@ -8,6 +9,7 @@
 
 #include <date/tz.h>
 
+#include <utils/base64-simd.h>
 #include <utils/base64.h>
 #include <utils/logging.h>
 #include <utils/packbits.h>
@@ -31,85 +33,220 @@ void set_thread_name(std::string name) {
 
 namespace time {
 
-inline std::string put_time(const tm* t, const char* fmt) {
-#ifdef __GNUC__
-#include <features.h>
-#if __GNUC_PREREQ(5, 0)
-    std::stringstream stream;
-    stream << std::put_time(t, fmt);
-    return stream.str();
-#else
-    char buf[128];
-    if (0 < strftime(buf, sizeof(buf), fmt, t))
-        return buf;
-    else
-        return "";
-#endif
-#endif
+namespace {
+// Proleptic Gregorian calendar conversions, see
+// http://howardhinnant.github.io/date_algorithms.html
+int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
 }
 
-inline std::string to_iso_8601(cloud::time t) {
-    // convert to time_t which will represent the number of
-    // seconds since the UNIX epoch, UTC 00:00:00 Thursday, 1st. January 1970
-    auto epoch_seconds = std::chrono::system_clock::to_time_t(t);
+void civil_from_days(int64_t z, int64_t& y, unsigned& m, unsigned& d) {
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe =
+        (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
 
-    // Format this as date time to seconds resolution
-    // e.g. 2016-08-30T08:18:51
-    std::stringstream stream;
-    stream << time::put_time(gmtime(&epoch_seconds), "%FT%T");
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+}
 
-    // If we now convert back to a time_point we will get the time truncated
-    // to whole seconds
-    auto truncated = std::chrono::system_clock::from_time_t(epoch_seconds);
+unsigned days_in_month(int64_t y, unsigned m) {
+    static const unsigned char days[] = {31, 28, 31, 30, 31, 30,
+                                         31, 31, 30, 31, 30, 31};
 
-    // Now we subtract this seconds count from the original time to
-    // get the number of extra microseconds..
-    auto delta_us =
-        std::chrono::duration_cast<std::chrono::microseconds>(t - truncated)
-            .count();
+    if (m == 2 && y % 4 == 0 && (y % 100 != 0 || y % 400 == 0))
+        return 29;
+    return days[m - 1];
+}
 
-    // And append this to the output stream as fractional seconds
-    // e.g. 2016-08-30T08:18:51.867479
-    stream << "." << std::fixed << std::setw(6) << std::setfill('0')
-           << delta_us;
+inline int64_t floor_div(int64_t a, int64_t b) {
+    return a / b - (a % b < 0);
+}
+
+inline char* put_digits(char* p, unsigned v, int n) {
+    for (int i = n - 1; i >= 0; i--, v /= 10)
+        p[i] = '0' + v % 10;
+    return p + n;
+}
 
-    return stream.str();
+inline bool get_digits(const char* p, int n, unsigned& v) {
+    v = 0;
+    for (int i = 0; i < n; i++) {
+        if (p[i] < '0' || p[i] > '9')
+            return false;
+        v = v * 10 + (p[i] - '0');
+    }
+    return true;
 }
 
-inline std::string to_iso_8601_packed(cloud::time t) {
-    // convert to time_t which will represent the number of
-    // seconds since the UNIX epoch, UTC 00:00:00 Thursday, 1st. January 1970
-    auto epoch_seconds = std::chrono::system_clock::to_time_t(t);
+//! Format with microseconds precision, truncated as date::floor() does
+size_t format_time(cloud::time t,
+                   char* buf,
+                   size_t size,
+                   bool packed,
+                   bool zulu) {
+    size_t len = packed ? ISO_PACKED_LEN + zulu : ISO_LEN - !zulu;
+
+    if (size <= len)
+        return 0;
+
+    int64_t us = floor_div(t.time_since_epoch().count(), 1000);
+    int64_t secs = floor_div(us, 1000000);
+    int64_t days = floor_div(secs, 86400);
+    unsigned sod = static_cast<unsigned>(secs - days * 86400);
+    int64_t y;
+    unsigned m, d;
+    char* p = buf;
+
+    civil_from_days(days, y, m, d);
+
+    p = put_digits(p, static_cast<unsigned>(y), 4);
+    if (!packed)
+        *p++ = '-';
+    p = put_digits(p, m, 2);
+    if (!packed)
+        *p++ = '-';
+    p = put_digits(p, d, 2);
+    *p++ = 'T';
+    p = put_digits(p, sod / 3600, 2);
+    if (!packed)
+        *p++ = ':';
+    p = put_digits(p, sod / 60 % 60, 2);
+    if (!packed)
+        *p++ = ':';
+    p = put_digits(p, sod % 60, 2);
+    *p++ = '.';
+    p = put_digits(p, static_cast<unsigned>(us - secs * 1000000), 6);
+    if (zulu)
+        *p++ = 'Z';
+    *p = 0;
+
+    return p - buf;
+}
+
+//! Parse the time with separators @p date_sep and @p time_sep, 0 for none
+bool parse_time(const char* s,
+                size_t len,
+                cloud::time& t,
+                char date_sep,
+                char time_sep,
+                bool zulu) {
+    const char* end = s + len;
+    const char* p = s;
+    unsigned y, m, d, hh, mm, ss;
+    int64_t ns = 0;
+
+    if (len < (date_sep ? 19u : 15u))
+        return false;
+
+    if (!get_digits(p, 4, y))
+        return false;
+    p += 4;
+    if (date_sep && *p++ != date_sep)
+        return false;
+    if (!get_digits(p, 2, m))
+        return false;
+    p += 2;
+    if (date_sep && *p++ != date_sep)
+        return false;
+    if (!get_digits(p, 2, d) || p[2] != 'T')
+        return false;
+    p += 3;
+    if (!get_digits(p, 2, hh))
+        return false;
+    p += 2;
+    if (time_sep && *p++ != time_sep)
+        return false;
+    if (!get_digits(p, 2, mm))
+        return false;
+    p += 2;
+    if (time_sep && *p++ != time_sep)
+        return false;
+    if (!get_digits(p, 2, ss))
+        return false;
+    p += 2;
+
+    if (m < 1 || m > 12 || d < 1 || d > days_in_month(y, m) || hh > 23 ||
+        mm > 59 || ss > 59)
+        return false;
+
+    // Fraction digits beyond the nanoseconds are ignored
+    if (p < end && *p == '.' && p + 1 < end && p[1] >= '0' && p[1] <= '9') {
+        int64_t scale = 100000000;
+
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, scale /= 10)
+            ns += (*p - '0') * scale;
+    }
+
+    if (zulu && (p == end || *p != 'Z'))
+        return false;
+
+    int64_t secs = days_from_civil(y, m, d) * 86400 + hh * 3600 + mm * 60 + ss;
+    t = cloud::time(std::chrono::nanoseconds(secs * 1000000000 + ns));
 
-    // Format this as date time to seconds resolution
-    // e.g. 2016-08-30T08:18:51
-    std::stringstream stream;
-    stream << time::put_time(gmtime(&epoch_seconds), "%Y%m%dT%H%M%S");
+    return true;
+}
 
-    // If we now convert back to a time_point we will get the time truncated
-    // to whole seconds
-    auto truncated = std::chrono::system_clock::from_time_t(epoch_seconds);
+//! Matches the "(.[0-9]+)*" regex, any char followed by digits, repeated
+bool fraction_groups(const char* p, const char* end) {
+    if (p == end)
+        return true;
+    if (end - p < 2 || *p == '\n' || *p == '\r' || p[1] < '0' || p[1] > '9')
+        return false;
 
-    // Now we subtract this seconds count from the original time to
-    // get the number of extra microseconds..
-    auto delta_us =
-        std::chrono::duration_cast<std::chrono::microseconds>(t - truncated)
-            .count();
+    for (p++; p < end; p++) {
+        if (*p >= '0' && *p <= '9')
+            continue;
+        // Next group start, should be followed by a digit
+        if (*p == '\n' || *p == '\r' || p + 1 == end || p[1] < '0' ||
+            p[1] > '9')
+            return false;
+    }
 
-    // And append this to the output stream as fractional seconds
-    // e.g. 2016-08-30T08:18:51.867479
-    stream << "." << std::fixed << std::setw(6) << std::setfill('0')
-           << delta_us;
+    return true;
+}
+}  // namespace
+
+size_t format_iso(cloud::time t, char* buf, size_t size, bool zulu) {
+    return format_time(t, buf, size, false, zulu);
+}
 
-    return stream.str();
+size_t format_iso_packed(cloud::time t, char* buf, size_t size) {
+    return format_time(t, buf, size, true, false);
+}
+
+bool parse_iso(const char* s, size_t len, cloud::time& t, bool zulu) {
+    return parse_time(s, len, t, '-', ':', zulu);
+}
+
+bool parse_iso_packed(const char* s, size_t len, cloud::time& t) {
+    return parse_time(s, len, t, 0, 0, false);
+}
+
+std::string to_iso_8601(cloud::time t) {
+    char buf[ISO_LEN + 1];
+
+    return std::string(buf, format_iso(t, buf, sizeof(buf), false));
 }
 
 std::string to_iso_packed(cloud::time t) {
-    return to_iso_8601_packed(t);
+    char buf[ISO_PACKED_LEN + 1];
+
+    return std::string(buf, format_iso_packed(t, buf, sizeof(buf)));
 }
 
 std::string now_ISO8601_UTC_packed() {
-    return to_iso_8601_packed(std::chrono::system_clock::now());
+    return to_iso_packed(std::chrono::system_clock::now());
 }
 
 std::string now_ISO8601_UTC() {
@@ -126,7 +263,7 @@ std::string time_to_ISO8601(std::time_t t) {
 }
 
 std::string time_to_ISO8601_packed(std::time_t t) {
-    return to_iso_8601_packed(std::chrono::system_clock::from_time_t(t));
+    return to_iso_packed(std::chrono::system_clock::from_time_t(t));
 }
 
 inline int parse_int(const char* value) {
@@ -155,13 +292,15 @@ std::time_t ISO8601_to_time(const std::string& input) {
 }
 
 std::string to_iso(cloud::time t) {
-    using namespace std::chrono;
-    return date::format("%FT%TZ", date::floor<microseconds>(t));
+    char buf[ISO_LEN + 1];
+
+    return std::string(buf, format_iso(t, buf, sizeof(buf)));
 }
 
 std::string to_iso2(cloud::time t) {
-    using namespace std::chrono;
-    return date::format("%FT%T", date::floor<microseconds>(t));
+    char buf[ISO_LEN + 1];
+
+    return std::string(buf, format_iso(t, buf, sizeof(buf), false));
 }
 
 std::string to_iso_local(cloud::time t) {
@@ -183,85 +322,207 @@ double to_double(cloud::time t) {
 }
 
 cloud::time from_iso(std::string st) {
-    using namespace std::chrono;
-    std::istringstream is;
     cloud::time t;
-    is.str(st);
-    is >> date::parse("%FT%TZ", t);
 
-    if (is.fail())
-        return system_clock::from_time_t(0);
+    if (!parse_iso(st.data(), st.size(), t))
+        return std::chrono::system_clock::from_time_t(0);
 
     return t;
 }
 
 cloud::time from_iso2(std::string st) {
-    using namespace std::chrono;
-    std::istringstream is;
     cloud::time t;
-    is.str(st);
-    is >> date::parse("%FT%T", t);
 
-    if (is.fail())
-        return system_clock::from_time_t(0);
+    if (!parse_iso(st.data(), st.size(), t, false))
+        return std::chrono::system_clock::from_time_t(0);
 
     return t;
 }
 
 cloud::time from_iso_packed(std::string st) {
-    using namespace std::chrono;
-    std::istringstream is;
     cloud::time t;
-    is.str(st);
-    is >> date::parse("%Y%m%dT%H%M%S", t);
 
-    if (is.fail())
-        return system_clock::from_time_t(0);
+    if (!parse_iso_packed(st.data(), st.size(), t))
+        return std::chrono::system_clock::from_time_t(0);
 
     return t;
 }
 
 bool iso_time_valid(const std::string& s) {
-    using namespace std;
-    using namespace date;
-    istringstream in {s};
-    cloud::time tp;
-    in >> date::parse("%FT%TZ", tp);
-    return !in.fail();
+    cloud::time t;
+
+    return parse_iso(s.data(), s.size(), t);
 }
 
 bool is_iso_packed(const std::string& s) {
     // YYYYMMDDThhmmss.mmm
     // YYYYMMDDThhmmss
-    std::regex r("([0-9]{8}T[0-9]{6})(.[0-9]+)*");
-    return std::regex_match(s, r);
+    // Same as the "([0-9]{8}T[0-9]{6})(.[0-9]+)*" regex match
+    const char* p = s.data();
+    unsigned v;
+
+    if (s.size() < 15 || !get_digits(p, 8, v) || p[8] != 'T' ||
+        !get_digits(p + 9, 6, v))
+        return false;
+
+    return fraction_groups(p + 15, p + s.size());
 }
 
 bool is_iso(const std::string& s) {
     // 2021-09-15T09:51:20.000000Z
-    std::regex r(
-        "[0-9]{4}-[0-9]{2}-[0-9]{2}T[0-9]{2}:[0-9]{2}:[0-9]{2}(.[0-9]+)*Z*");
-    return std::regex_match(s, r);
+    // Same as the
+    // "[0-9]{4}-[0-9]{2}-[0-9]{2}T[0-9]{2}:[0-9]{2}:[0-9]{2}(.[0-9]+)*Z*"
+    // regex match
+    const char* p = s.data();
+    const char* end = p + s.size();
+    unsigned v;
+
+    if (s.size() < 19 || !get_digits(p, 4, v) || p[4] != '-' ||
+        !get_digits(p + 5, 2, v) || p[7] != '-' || !get_digits(p + 8, 2, v) ||
+        p[10] != 'T' || !get_digits(p + 11, 2, v) || p[13] != ':' ||
+        !get_digits(p + 14, 2, v) || p[16] != ':' || !get_digits(p + 17, 2, v))
+        return false;
+
+    // Fraction groups end with a digit, trailing 'Z's are the suffix
+    while (end > p + 19 && end[-1] == 'Z')
+        end--;
+
+    return fraction_groups(p + 19, end);
 }
 
 }  // namespace time
 
 namespace motion {
-std::string map::pack(const std::string& unpackedGrid) {
-    std::string packedBits;
-    ssize_t packedLen;
-    map motionMap;
+namespace {
+//! Base64 encodes the bytes as they are produced, staged in the small
+//! buffer to encode them with the vectorized codec
+class base64_sink {
+    char* out_;
+    // Multiple of 3, no padding until finish()
+    uint8_t buf_[192];
+    size_t n_ {0};
+
+public:
+    explicit base64_sink(char* out) : out_ {out} {}
+
+    void put(uint8_t b) {
+        buf_[n_++] = b;
+        if (n_ == sizeof(buf_))
+            __flush();
+    }
 
-    // +1 for packbits header
-    packedBits.resize(unpackedGrid.size() + 1);
-    packedLen = packbits((signed char*)unpackedGrid.c_str(),
-                         (signed char*)packedBits.data(), unpackedGrid.size());
+    void put(const uint8_t* p, size_t len) {
+        while (len) {
+            size_t n = std::min(len, sizeof(buf_) - n_);
 
-    if (packedLen > 0) {
-        packedBits.resize(packedLen);
-        motionMap = base64_encode(packedBits);
+            memcpy(buf_ + n_, p, n);
+            n_ += n;
+            p += n;
+            len -= n;
+            if (n_ == sizeof(buf_))
+                __flush();
+        }
     }
 
+    //! Encode and pad the rest, return the output end
+    char* finish() {
+        __flush();
+        return out_;
+    }
+
+private:
+    void __flush() {
+        out_ += base64::encode(buf_, n_, out_);
+        n_ = 0;
+    }
+};
+}  // namespace
+
+size_t map::packed_size(size_t len) {
+    // Packbits adds a header byte per 128 bytes of the literal data
+    return base64::encoded_size(len + len / 128 + 2);
+}
+
+// Same encoding as packbits() from packbits.c, the output bytes are written
+// to the base64 sink instead of the intermediate buffer
+size_t map::pack(const char* grid, size_t len, char* out, size_t size) {
+    enum { DUMP, RUN } mode = DUMP;
+    const size_t MINRUN = 3, MAXRUN = 128, MAXDAT = 128;
+    const uint8_t* source = reinterpret_cast<const uint8_t*>(grid);
+    uint8_t buf[MAXDAT * 2];
+    size_t nbuf = 1;
+    size_t rstart = 0;
+    uint8_t c, lastc;
+    base64_sink sink(out);
+
+    if (!len || size < packed_size(len))
+        return 0;
+
+    buf[0] = lastc = *source++;
+    for (size_t left = len - 1; left; --left) {
+        buf[nbuf++] = c = *source++;
+
+        switch (mode) {
+            case DUMP:
+                // Buffer is full, write the length byte, then the data
+                if (nbuf > MAXDAT) {
+                    sink.put(nbuf - 2);
+                    sink.put(buf, nbuf - 1);
+                    buf[0] = c;
+                    nbuf = 1;
+                    rstart = 0;
+                    break;
+                }
+
+                if (c == lastc) {
+                    if (nbuf - rstart >= MINRUN) {
+                        if (rstart > 0) {
+                            sink.put(rstart - 1);
+                            sink.put(buf, rstart);
+                        }
+                        mode = RUN;
+                    } else if (rstart == 0) {
+                        // No dump in progress, so can't lose by making these
+                        // 2 a run
+                        mode = RUN;
+                    }
+                } else {
+                    rstart = nbuf - 1;
+                }
+                break;
+
+            case RUN:
+                if (c != lastc || nbuf - rstart > MAXRUN) {
+                    sink.put(-(nbuf - rstart - 2));
+                    sink.put(lastc);
+                    buf[0] = c;
+                    nbuf = 1;
+                    rstart = 0;
+                    mode = DUMP;
+                }
+                break;
+        }
+        lastc = c;
+    }
+
+    if (mode == DUMP) {
+        sink.put(nbuf - 1);
+        sink.put(buf, nbuf);
+    } else {
+        sink.put(-(nbuf - rstart - 1));
+        sink.put(lastc);
+    }
+
+    return sink.finish() - out;
+}
+
+std::string map::pack(const std::string& unpackedGrid) {
+    std::string motionMap;
+
+    motionMap.resize(packed_size(unpackedGrid.size()));
+    motionMap.resize(pack(unpackedGrid.data(), unpackedGrid.size(),
+                          &motionMap[0], motionMap.size()));
+
     return motionMap;
 }
 
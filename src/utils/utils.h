@@ -61,6 +61,36 @@ inline cloud::time max() {
 bool is_iso_packed(const std::string& s);
 bool is_iso(const std::string& s);
 
+//! Length of the YYYY-MM-DDThh:mm:ss.uuuuuuZ string
+constexpr size_t ISO_LEN = 27;
+//! Length of the YYYYMMDDThhmmss.uuuuuu string
+constexpr size_t ISO_PACKED_LEN = 22;
+
+//! @brief Format @p t as YYYY-MM-DDThh:mm:ss.uuuuuu[Z] without allocations.
+//!
+//! @param buf Output buffer, zero terminated.
+//! @param size Buffer size, at least ISO_LEN + 1.
+//! @param zulu Append 'Z'.
+//! @return Formatted string length, 0 if the buffer is too small.
+size_t format_iso(cloud::time t, char* buf, size_t size, bool zulu = true);
+//! @brief Format @p t as YYYYMMDDThhmmss.uuuuuu without allocations.
+//!
+//! @param buf Output buffer, zero terminated.
+//! @param size Buffer size, at least ISO_PACKED_LEN + 1.
+//! @return Formatted string length, 0 if the buffer is too small.
+size_t format_iso_packed(cloud::time t, char* buf, size_t size);
+//! @brief Parse YYYY-MM-DDThh:mm:ss[.f...][Z] without allocations.
+//!        Up to 9 fraction digits are used, characters after the parsed
+//!        time are ignored as date::parse() does.
+//!
+//! @param zulu Require the 'Z' suffix.
+//! @return false if @p s is not a valid time.
+bool parse_iso(const char* s, size_t len, cloud::time& t, bool zulu = true);
+//! @brief Parse YYYYMMDDThhmmss[.f...] without allocations.
+//!
+//! @return false if @p s is not a valid time.
+bool parse_iso_packed(const char* s, size_t len, cloud::time& t);
+
 };  // namespace time
 
 struct uri {
@@ -136,6 +166,16 @@ struct map : public std::string {
 
     static std::string pack(const std::string& unpackedGrid);
     static std::string unpack(const std::string& packedMap, size_t outputLen);
+
+    //! Max packed length of the @p len cells grid
+    static size_t packed_size(size_t len);
+    //! @brief Packbits and base64 encode the grid in one pass without
+    //!        allocations, the same result as pack().
+    //!
+    //! @param out Output buffer, not zero terminated.
+    //! @param size Output buffer size, at least packed_size(len).
+    //! @return Packed length, 0 if the buffer is too small or grid is empty.
+    static size_t pack(const char* grid, size_t len, char* out, size_t size);
 };  // struct map
 
 };  // namespace motion